@@ -458,6 +458,18 @@ public:
 		return m_SubtreeHeaders;
 	}
 
+	///STK: read access to the nodes of a bvh without quantization, used
+	///to traverse the tree with several rays at once
+	SIMD_FORCE_INLINE const NodeArray&	getContiguousNodeArray() const
+	{
+		return m_contiguousNodes;
+	}
+
+	SIMD_FORCE_INLINE int	getNumNodes() const
+	{
+		return m_curNodeIndex;
+	}
+
 ////////////////////////////////////////////////////////////////////
 
 	/////Calculate space needed to store BVH for serialization
@@ -485,7 +497,7 @@ public:
 
 ////////////////////////////////////////////////////////////////////
 
-	SIMD_FORCE_INLINE bool isQuantized()
+	SIMD_FORCE_INLINE bool isQuantized() const
 	{
 		return m_useQuantization;
 	}
@@ -68,7 +68,8 @@ protected:
 	
 	void	updateActivationState(btScalar timeStep);
 
-	void	updateActions(btScalar timeStep);
+	///STK: virtual so that the raycasts of all vehicles can be prepared
+	virtual void	updateActions(btScalar timeStep);
 
 	void	startProfiling(btScalar timeStep);
 
@@ -183,6 +183,9 @@ void STKConfig::load(const std::string &filename)
     CHECK_NEG(m_no_explosive_items_timeout,"powerup no-explosive-items-timeout"    );
     CHECK_NEG(m_max_moveable_objects,      "network max-moveable-objects");
     CHECK_NEG(m_network_steering_reduction,"network steering-reduction" );
+    CHECK_NEG(m_network_rewind_distance,   "network rewind-distance"    );
+    CHECK_NEG(m_network_rewind_angle,      "network rewind-angle"       );
+    CHECK_NEG(m_network_rewind_speed,      "network rewind-speed"       );
     CHECK_NEG(m_default_moveable_friction, "physics default-moveable-friction");
     CHECK_NEG(m_solver_iterations,         "physics: solver-iterations"       );
     CHECK_NEG(m_solver_split_impulse_thresh,"physics: solver-split-impulse-threshold");
@@ -238,6 +241,9 @@ void STKConfig::init_defaults()
     m_solver_set_flags           = 0;
     m_solver_reset_flags         = 0;
     m_network_steering_reduction = -100;
+    m_network_rewind_distance    = -100;
+    m_network_rewind_angle       = -100;
+    m_network_rewind_speed       = -100;
     m_title_music                = NULL;
     m_default_music              = NULL;
     m_race_win_music             = NULL;
@@ -525,6 +531,9 @@ void STKConfig::getAllData(const XMLNode * root)
     {
         networking_node->get("max-moveable-objects", &m_max_moveable_objects);
         networking_node->get("steering-reduction", &m_network_steering_reduction);
+        networking_node->get("rewind-distance", &m_network_rewind_distance);
+        networking_node->get("rewind-angle", &m_network_rewind_angle);
+        networking_node->get("rewind-speed", &m_network_rewind_speed);
     }
 
     if(const XMLNode *replay_node = root->getNode("replay"))
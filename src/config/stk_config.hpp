@@ -98,6 +98,12 @@ public:
      *  steering adjustments. */
     float m_network_steering_reduction;
 
+    /** A client does not rewind if the confirmed state of each rewinder
+     *  differs less than these values from the predicted state (in m, radian
+     *  and m/s). */
+    float m_network_rewind_distance, m_network_rewind_angle,
+        m_network_rewind_speed;
+
     /** If the angle between a normal on a vertex and the normal of the
      *  triangle are more than this value, the physics will use the normal
      *  of the triangle in smoothing normal. */
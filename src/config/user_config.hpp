@@ -761,6 +761,10 @@ namespace UserConfigParams
     /** True if arena (battle/soccer) ai profiling. */
     PARAM_PREFIX bool m_arena_ai_stats PARAM_DEFAULT(false);
 
+    /** True if the positions of ghost karts should be used to benchmark
+     *  Graph::findRoadSector. */
+    PARAM_PREFIX bool m_sector_benchmark PARAM_DEFAULT(false);
+
     /** True if slipstream debugging is activated. */
     PARAM_PREFIX bool m_slipstream_debug  PARAM_DEFAULT( false );
 
@@ -71,6 +71,7 @@
 #include "main_loop.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
+#include "network/rewind_manager.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "physics/physics.hpp"
@@ -1816,6 +1817,14 @@ void IrrDriver::displayFPS()
                     min, fps, max, SP::sp_solid_poly_count,
                     SP::sp_shadow_poly_count, m_last_light_bucket_distance, irr_driver->getSceneComplexity(),
                     m_skinning_joint, ping);
+        if (NetworkConfig::get()->isNetworking() &&
+            NetworkConfig::get()->isClient() && RewindManager::exists())
+        {
+            RewindManager* rwm = RewindManager::get();
+            fps_string += StringUtils::insertValues(L", Rewinds: %d, "
+                "skipped: %d", rwm->getRewindCount(),
+                rwm->getSkippedRewindCount());
+        }
     }
     else
     {
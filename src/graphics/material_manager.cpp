@@ -411,6 +411,19 @@ void MaterialManager::makeMaterialsPermanent()
     m_shared_material_index = (int) m_materials.size();
 }   // makeMaterialsPermanent
 
+// ----------------------------------------------------------------------------
+/** Removes all temporary materials without deleting them, the caller owns
+ *  them afterwards. Used by multi-lobby servers, so that the materials of a
+ *  track are not found when another lobby loads a different track.
+ *  \param materials The materials are appended to this vector.
+ */
+void MaterialManager::takeTempMaterials(std::vector<Material*>* materials)
+{
+    materials->insert(materials->end(),
+        m_materials.begin() + m_shared_material_index, m_materials.end());
+    m_materials.resize(m_shared_material_index);
+}   // takeTempMaterials
+
 // ----------------------------------------------------------------------------
 void MaterialManager::unloadAllTextures()
 {
@@ -79,6 +79,7 @@ public:
     bool      pushTempMaterial (const XMLNode *root, const std::string& filename, bool deprecated = false);
     void      popTempMaterial  ();
     void      makeMaterialsPermanent();
+    void      takeTempMaterials(std::vector<Material*>* materials);
     bool      hasMaterial(const std::string& fname);
 
     void      unloadAllTextures();
@@ -25,6 +25,7 @@
 #include "graphics/material_manager.hpp"
 #include "guiengine/engine.hpp"
 #include "guiengine/skin.hpp"
+#include "io/metadata_cache.hpp"
 #include "karts/kart_properties_manager.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/command_line.hpp"
@@ -32,6 +33,7 @@
 #include "utils/file_utils.hpp"
 #include "utils/log.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
 
 #ifdef ANDROID
 #include "io/assets_android.hpp"
@@ -39,6 +41,7 @@
 
 #include <irrlicht.h>
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdexcept>
 #include <sstream>
@@ -59,11 +62,13 @@ namespace irr {
 #  include <sys/types.h>
 #  include <dirent.h>
 #  include <unistd.h>
+#  include <utime.h>
 #else
 #  define WIN32_LEAN_AND_MEAN
 #  include <direct.h>
 #  include <windows.h>
 #  include <stdio.h>
+#  include <sys/utime.h>
 #  if !defined(__MINGW32__)
      /*Needed by the remove directory function */
 #    define S_ISDIR(mode)  (((mode) & S_IFMT) == S_IFDIR)
@@ -254,9 +259,11 @@ FileManager::FileManager()
     checkAndCreateScreenshotDir();
     checkAndCreateReplayDir();
     checkAndCreateCachedTexturesDir();
+    checkAndCreateCachedDataDir();
     checkAndCreateGPDir();
 
     redirectOutput();
+    pruneCachedData();
 }   // FileManager
 
 // ----------------------------------------------------------------------------
@@ -518,7 +525,7 @@ FileManager::~FileManager()
  */
 bool FileManager::fileExists(const std::string& path) const
 {
-    std::lock_guard<std::mutex> lock(m_file_system_lock);
+    SharedLockGuard lock(m_file_system_lock);
 #ifdef DEBUG
     bool exists = m_file_system->existFile(path.c_str());
     if(exists) return true;
@@ -551,6 +558,7 @@ void FileManager::addRootDirs(const std::string &roots)
 //-----------------------------------------------------------------------------
 io::IXMLReader *FileManager::createXMLReader(const std::string &filename)
 {
+    SharedLockGuard lock(m_file_system_lock);
     return m_file_system->createXMLReader(filename.c_str());
 }   // getXMLReader
 //-----------------------------------------------------------------------------
@@ -574,6 +582,33 @@ XMLNode *FileManager::createXMLTree(const std::string &filename)
     }
 }   // createXMLTree
 
+//-----------------------------------------------------------------------------
+/** Reads in many XML files in parallel, using all cores. This is used to
+ *  read the configuration files of all karts and tracks at startup. The
+ *  parsed trees are cached in a file in the user config directory, so only
+ *  the files that changed since the last time are parsed again.
+ *  \param filenames Names of the XML files to read.
+ *  \param cache_name Name of the cache file (see MetadataCache).
+ *  \return The XMLNode trees in the order of the file names, NULL for files
+ *          that don't exist or can't be read.
+ */
+std::vector<XMLNode*>
+         FileManager::createXMLTrees(const std::vector<std::string>& filenames,
+                                     const std::string& cache_name)
+{
+    MetadataCache cache(getUserConfigFile(cache_name),
+                        (unsigned int)filenames.size());
+    std::vector<XMLNode*> trees(filenames.size(), NULL);
+    ThreadPool pool(ThreadPool::getDefaultThreadCount(8), "XMLTree");
+    pool.parallelFor((unsigned)filenames.size(),
+        [&cache, &filenames, &trees](unsigned i)
+        {
+            trees[i] = cache.createXMLTree(i, filenames[i]);
+        });
+    cache.save();
+    return trees;
+}   // createXMLTrees
+
 //-----------------------------------------------------------------------------
 /** Reads in XML from a string and converts it into a XMLNode tree.
  *  \param content the string containing the XML content.
@@ -621,7 +656,7 @@ io::path FileManager::createAbsoluteFilename(const std::string &f)
  */
 void FileManager::pushModelSearchPath(const std::string& path)
 {
-    std::lock_guard<std::mutex> lock(m_file_system_lock);
+    std::lock_guard<SharedMutex> lock(m_file_system_lock);
 
     m_model_search_path.push_back(path);
     const int n=m_file_system->getFileArchiveCount();
@@ -650,7 +685,7 @@ void FileManager::pushModelSearchPath(const std::string& path)
  */
 void FileManager::pushTextureSearchPath(const std::string& path, const std::string& container_id)
 {
-    std::lock_guard<std::mutex> lock(m_file_system_lock);
+    std::lock_guard<SharedMutex> lock(m_file_system_lock);
 
     m_texture_search_path.push_back(TextureSearchPath(path, container_id));
     const int n=m_file_system->getFileArchiveCount();
@@ -681,7 +716,7 @@ void FileManager::popTextureSearchPath()
 {
     if (!m_texture_search_path.empty())
     {
-        std::lock_guard<std::mutex> lock(m_file_system_lock);
+        std::lock_guard<SharedMutex> lock(m_file_system_lock);
         TextureSearchPath dir = m_texture_search_path.back();
         m_texture_search_path.pop_back();
         m_file_system->removeFileArchive(createAbsoluteFilename(dir.m_texture_search_path));
@@ -695,7 +730,7 @@ void FileManager::popModelSearchPath()
 {
     if (!m_model_search_path.empty())
     {
-        std::lock_guard<std::mutex> lock(m_file_system_lock);
+        std::lock_guard<SharedMutex> lock(m_file_system_lock);
         std::string dir = m_model_search_path.back();
         m_model_search_path.pop_back();
         m_file_system->removeFileArchive(createAbsoluteFilename(dir));
@@ -839,6 +874,15 @@ std::string FileManager::getCachedTexturesDir() const
     return m_cached_textures_dir;
 }   // getCachedTexturesDir
 
+//-----------------------------------------------------------------------------
+/** Returns the directory in which data computed from the assets (which is
+ *  not a texture) should be cached.
+*/
+std::string FileManager::getCachedDataDir() const
+{
+    return m_cached_data_dir;
+}   // getCachedDataDir
+
 //-----------------------------------------------------------------------------
 /** Returns the directory in which user-defined grand prix should be stored.
  */
@@ -1181,6 +1225,96 @@ void FileManager::checkAndCreateCachedTexturesDir()
 
 }   // checkAndCreateCachedTexturesDir
 
+// ----------------------------------------------------------------------------
+/** Creates the directory for other cached data. This will set
+*  m_cached_data_dir with the appropriate path.
+*/
+void FileManager::checkAndCreateCachedDataDir()
+{
+#if defined(WIN32)
+    m_cached_data_dir = m_user_config_dir + "cached-data/";
+#elif defined(__APPLE__)
+    m_cached_data_dir = getenv("HOME");
+    m_cached_data_dir += "/Library/Application Support/SuperTuxKart/CachedData/";
+#else
+    m_cached_data_dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart", ".cache/", ".");
+    m_cached_data_dir += "cached-data/";
+#endif
+
+    if (!checkAndCreateDirectory(m_cached_data_dir))
+    {
+        Log::error("FileManager", "Can not create cached data directory '%s', "
+            "falling back to '.'.", m_cached_data_dir.c_str());
+        m_cached_data_dir = "./";
+    }
+
+}   // checkAndCreateCachedDataDir
+
+// ----------------------------------------------------------------------------
+/** Removes the least recently used files from the cached data directory
+ *  until it's smaller than MAX_CACHED_DATA_SIZE. A file is used when it's
+ *  written or read (see touchCachedData), so the cache of tracks which are
+ *  not played anymore (or changed) is removed first.
+ */
+void FileManager::pruneCachedData()
+{
+    // Enough for the bvh and physics of the largest tracks
+    const uint64_t MAX_CACHED_DATA_SIZE = 256 * 1024 * 1024;
+
+    // Never remove files from the fallback directory
+    if (m_cached_data_dir == "./")
+        return;
+
+    std::set<std::string> files;
+    listFiles(files, m_cached_data_dir);
+    std::vector<std::pair<time_t, std::string> > all_files;
+    uint64_t total_size = 0;
+    for (const std::string& file : files)
+    {
+        const std::string path = m_cached_data_dir + file;
+        struct stat st;
+        if (FileUtils::statU8Path(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        total_size += (uint64_t)st.st_size;
+        all_files.emplace_back(st.st_mtime, file);
+    }
+    if (total_size <= MAX_CACHED_DATA_SIZE)
+        return;
+
+    std::sort(all_files.begin(), all_files.end());
+    unsigned removed = 0;
+    for (auto& file : all_files)
+    {
+        const std::string path = m_cached_data_dir + file.second;
+        struct stat st;
+        if (FileUtils::statU8Path(path, &st) != 0 || !removeFile(path))
+            continue;
+        removed++;
+        total_size -= std::min(total_size, (uint64_t)st.st_size);
+        if (total_size <= MAX_CACHED_DATA_SIZE)
+            break;
+    }
+    Log::info("FileManager", "Removed %d old files from '%s'.", removed,
+              m_cached_data_dir.c_str());
+}   // pruneCachedData
+
+// ----------------------------------------------------------------------------
+/** Marks a file in the cached data directory as used now by setting its
+ *  modification time, so it's kept by pruneCachedData. Files outside of
+ *  the directory (like the caches next to a track) are not changed.
+ *  \param filename Full path of the file.
+ */
+void FileManager::touchCachedData(const std::string& filename) const
+{
+    if (filename.compare(0, m_cached_data_dir.size(), m_cached_data_dir) != 0)
+        return;
+#if defined(WIN32)
+    _wutime(StringUtils::utf8ToWide(filename).c_str(), NULL);
+#else
+    utime(filename.c_str(), NULL);
+#endif
+}   // touchCachedData
+
 // ----------------------------------------------------------------------------
 /** Creates the directories for user-defined grand prix. This will set m_gp_dir
  *  with the appropriate path.
@@ -25,7 +25,6 @@
  * Contains generic utility classes for file I/O (especially XML handling).
  */
 
-#include <mutex>
 #include <string>
 #include <vector>
 #include <set>
@@ -37,6 +36,7 @@ using namespace irr;
 
 #include "io/xml_node.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/shared_mutex.hpp"
 
 struct TextureSearchPath
 {
@@ -66,7 +66,10 @@ public:
                     ASSET_COUNT};
 
 private:
-    mutable std::mutex m_file_system_lock;
+    /** Protects the file archives of the file system: lookups only read
+     *  them and can run in parallel (e.g. when loading all karts and tracks),
+     *  while adding or removing a search path needs exclusive access. */
+    mutable SharedMutex m_file_system_lock;
 
     /** The names of the various subdirectories of the asset types. */
     std::vector< std::string > m_subdir_name;
@@ -98,6 +101,9 @@ private:
     /** Directory where resized textures are cached. */
     std::string       m_cached_textures_dir;
 
+    /** Directory where other data computed from the assets is cached. */
+    std::string       m_cached_data_dir;
+
     /** Directory where user-defined grand prix are stored. */
     std::string       m_gp_dir;
 
@@ -128,6 +134,8 @@ private:
     void              checkAndCreateScreenshotDir();
     void              checkAndCreateReplayDir();
     void              checkAndCreateCachedTexturesDir();
+    void              checkAndCreateCachedDataDir();
+    void              pruneCachedData();
     void              checkAndCreateGPDir();
     void              discoverPaths();
     void              addAssetsSearchPath();
@@ -149,11 +157,16 @@ public:
     static void       setStdoutDir(const std::string &dir);
     io::IXMLReader   *createXMLReader(const std::string &filename);
     XMLNode          *createXMLTree(const std::string &filename);
+    std::vector<XMLNode*>
+                      createXMLTrees(const std::vector<std::string>& filenames,
+                                     const std::string& cache_name);
     XMLNode          *createXMLTreeFromString(const std::string & content);
 
     std::string       getScreenshotDir() const;
     std::string       getReplayDir() const;
     std::string       getCachedTexturesDir() const;
+    std::string       getCachedDataDir() const;
+    void              touchCachedData(const std::string& filename) const;
     std::string       getGPDir() const;
     bool              checkAndCreateDirectory(const std::string &path);
     bool              checkAndCreateDirectoryP(const std::string &path);
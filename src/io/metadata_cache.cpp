@@ -0,0 +1,355 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "io/metadata_cache.hpp"
+
+#include "io/file_manager.hpp"
+#include "io/xml_node.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+/** Identifies a metadata cache ('STKM'). */
+static const uint32_t METADATA_CACHE_MAGIC = 0x4d4b5453;
+/** Increase when the layout of the file or of the serialized XMLNode trees
+ *  changes. */
+static const uint32_t METADATA_CACHE_VERSION = 2;
+/** Number of uint32 values in the header. */
+static const unsigned int METADATA_CACHE_HEADER_SIZE = 4;
+
+namespace
+{
+    void append(std::string* data, const void* value, size_t size)
+    {
+        data->append((const char*)value, size);
+    }   // append
+
+    // ------------------------------------------------------------------------
+    void appendString(std::string* data, const std::string& s)
+    {
+        const uint32_t size = (uint32_t)s.size();
+        append(data, &size, sizeof(size));
+        data->append(s);
+    }   // appendString
+
+    // ------------------------------------------------------------------------
+    /** Reads a value, returns false (and leaves the position unchanged) if
+     *  the data is too short. */
+    bool read(const std::string& data, size_t* pos, void* value, size_t size)
+    {
+        if (data.size() - *pos < size)
+            return false;
+        memcpy(value, data.data() + *pos, size);
+        *pos += size;
+        return true;
+    }   // read
+
+    // ------------------------------------------------------------------------
+    bool readString(const std::string& data, size_t* pos, std::string* s)
+    {
+        uint32_t size;
+        if (!read(data, pos, &size, sizeof(size)) ||
+            data.size() - *pos < size)
+            return false;
+        s->assign(data, *pos, size);
+        *pos += size;
+        return true;
+    }   // readString
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Reads the cache file (if it exists).
+ *  \param filename Name of the cache file.
+ *  \param num_files Number of files that will be read using this cache.
+ */
+MetadataCache::MetadataCache(const std::string& filename,
+                             unsigned int num_files)
+             : m_filename(filename), m_new_entries(num_files)
+{
+    load();
+}   // MetadataCache
+
+// ----------------------------------------------------------------------------
+/** Reads the entries of the cache file. A file which is truncated, was
+ *  written by a different version or on a different platform is ignored.
+ */
+void MetadataCache::load()
+{
+    FILE* fd = FileUtils::fopenU8Path(m_filename, "rb");
+    if (!fd)
+        return;
+    std::string data;
+    char buffer[64 * 1024];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), fd)) > 0)
+        data.append(buffer, size);
+    fclose(fd);
+
+    size_t pos = 0;
+    uint32_t header[METADATA_CACHE_HEADER_SIZE];
+    uint64_t hash;
+    if (!read(data, &pos, header, sizeof(header)) ||
+        !read(data, &pos, &hash, sizeof(hash)) ||
+        header[0] != METADATA_CACHE_MAGIC ||
+        header[1] != METADATA_CACHE_VERSION ||
+        header[2] != sizeof(wchar_t))
+        return;
+
+    uint64_t data_hash = FileUtils::FNV_HASH_BASIS;
+    FileUtils::addToHash(&data_hash, data.data() + pos, data.size() - pos);
+    if (data_hash != hash)
+    {
+        Log::warn("MetadataCache", "Ignoring corrupt cache '%s'.",
+                  m_filename.c_str());
+        return;
+    }
+
+    for (uint32_t i = 0; i < header[3]; i++)
+    {
+        std::string name;
+        Entry entry;
+        if (!readString(data, &pos, &name) ||
+            !read(data, &pos, &entry.m_hash, sizeof(entry.m_hash)) ||
+            !read(data, &pos, &entry.m_size, sizeof(entry.m_size)) ||
+            !readString(data, &pos, &entry.m_tree))
+        {
+            m_old_entries.clear();
+            return;
+        }
+        m_old_entries[name] = entry;
+    }
+}   // load
+
+// ----------------------------------------------------------------------------
+/** Gets the hash of the content and the size of a file. The modification
+ *  time is not used: it has only a resolution of seconds on some systems,
+ *  and a file edited in the same second with the same size (e.g. a changed
+ *  number in a kart.xml) would be taken from the cache. Hashing the small
+ *  files is still much faster than parsing them.
+ *  \return False if the file doesn't exist.
+ */
+bool MetadataCache::getFileStamp(const std::string& filename, Entry* entry)
+{
+    FILE* fd = FileUtils::fopenU8Path(filename, "rb");
+    if (!fd)
+        return false;
+    entry->m_hash = FileUtils::FNV_HASH_BASIS;
+    entry->m_size = 0;
+    char buffer[16 * 1024];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), fd)) > 0)
+    {
+        FileUtils::addToHash(&entry->m_hash, buffer, size);
+        entry->m_size += size;
+    }
+    const bool ok = ferror(fd) == 0;
+    fclose(fd);
+    return ok;
+}   // getFileStamp
+
+// ----------------------------------------------------------------------------
+/** Returns the XMLNode tree of a file, from the cache if the file didn't
+ *  change since the cache was written, otherwise the file is parsed.
+ *  \param index Index of the file, each index must only be used once.
+ *  \param filename Name of the XML file.
+ *  \return The tree, or NULL if the file doesn't exist or can't be read.
+ */
+XMLNode* MetadataCache::createXMLTree(unsigned int index,
+                                      const std::string& filename)
+{
+    assert(index < m_new_entries.size());
+    std::pair<std::string, Entry>& new_entry = m_new_entries[index];
+    new_entry.first = filename;
+    if (!getFileStamp(filename, &new_entry.second))
+        return NULL;
+
+    auto it = m_old_entries.find(filename);
+    if (it != m_old_entries.end() &&
+        it->second.m_hash == new_entry.second.m_hash &&
+        it->second.m_size == new_entry.second.m_size &&
+        !it->second.m_tree.empty())
+    {
+        XMLNode* node = XMLNode::deserialize(filename, it->second.m_tree);
+        if (node)
+        {
+            new_entry.second.m_tree = it->second.m_tree;
+            return node;
+        }
+    }
+
+    XMLNode* node = file_manager->createXMLTree(filename);
+    if (node)
+        node->serialize(&new_entry.second.m_tree);
+    return node;
+}   // createXMLTree
+
+// ----------------------------------------------------------------------------
+/** Replaces the cache file with the files read now (so entries of removed
+ *  karts and tracks are dropped). The file is only written if it changed
+ *  (see FileUtils::writeFileAtomic).
+ *  \return True if the cache is up to date.
+ */
+bool MetadataCache::save() const
+{
+    // Nothing to do if all trees were taken from the cache and no file was
+    // removed
+    bool changed = false;
+    unsigned int num_trees = 0;
+    for (const std::pair<std::string, Entry>& entry : m_new_entries)
+    {
+        if (entry.second.m_tree.empty())
+            continue;
+        num_trees++;
+        auto it = m_old_entries.find(entry.first);
+        changed = changed || it == m_old_entries.end() ||
+                  it->second.m_hash != entry.second.m_hash ||
+                  it->second.m_size != entry.second.m_size ||
+                  it->second.m_tree.size() != entry.second.m_tree.size();
+    }
+    if (!changed && num_trees == m_old_entries.size())
+        return true;
+
+    std::string entries;
+    uint32_t count = 0;
+    for (const std::pair<std::string, Entry>& entry : m_new_entries)
+    {
+        if (entry.second.m_tree.empty())
+            continue;
+        appendString(&entries, entry.first);
+        append(&entries, &entry.second.m_hash, sizeof(entry.second.m_hash));
+        append(&entries, &entry.second.m_size, sizeof(entry.second.m_size));
+        appendString(&entries, entry.second.m_tree);
+        count++;
+    }
+
+    const uint32_t header[METADATA_CACHE_HEADER_SIZE] =
+    {
+        METADATA_CACHE_MAGIC, METADATA_CACHE_VERSION,
+        (uint32_t)sizeof(wchar_t), count
+    };
+    uint64_t hash = FileUtils::FNV_HASH_BASIS;
+    FileUtils::addToHash(&hash, entries.data(), entries.size());
+    std::string data;
+    append(&data, header, sizeof(header));
+    append(&data, &hash, sizeof(hash));
+    data.append(entries);
+
+    // The user config directory can be shared by a client and a server
+    if (!FileUtils::writeFileAtomic(m_filename, [&data](FILE* fd)
+        {
+            return fwrite(data.data(), data.size(), 1, fd) == 1;
+        }))
+        return false;
+    Log::info("MetadataCache", "Saved the metadata of %d files to '%s'.", count,
+              m_filename.c_str());
+    return true;
+}   // save
+
+// ----------------------------------------------------------------------------
+/** Checks that a cached tree is the same as the parsed one, and that a
+ *  changed or removed file is not taken from the cache.
+ */
+void MetadataCache::unitTesting()
+{
+    const std::string dir = file_manager->getCachedDataDir();
+    const std::string cache_file = dir + "metadata-unit-test.dat";
+    const std::string xml_file = dir + "metadata-unit-test.xml";
+    auto write_file = [](const std::string& name, const std::string& content)
+        {
+            FILE* fd = FileUtils::fopenU8Path(name, "wb");
+            assert(fd);
+            fwrite(content.data(), content.size(), 1, fd);
+            fclose(fd);
+        };
+    remove(FileUtils::getPortableWritingPath(cache_file).c_str());
+    write_file(xml_file, "<kart name=\"Tux\" groups=\"standard\">\n"
+                         "  <mode name=\"race\" scene=\"scene.xml\"/>\n"
+                         "  <sounds engine=\"large\"/>\n"
+                         "</kart>\n");
+
+    // The first read fills the cache
+    MetadataCache first(cache_file, 2);
+    XMLNode* parsed = first.createXMLTree(0, xml_file);
+    assert(parsed);
+    assert(first.createXMLTree(1, dir + "metadata-unit-test.missing")
+           == NULL);
+    bool saved = first.save();
+    assert(saved);
+    std::string serialized;
+    parsed->serialize(&serialized);
+
+    // The second read takes the tree from the cache
+    MetadataCache second(cache_file, 1);
+    assert(second.m_old_entries.size() == 1);
+    assert(second.m_old_entries[xml_file].m_tree == serialized);
+    XMLNode* cached = second.createXMLTree(0, xml_file);
+    assert(cached);
+    std::string cached_serialized;
+    cached->serialize(&cached_serialized);
+    assert(cached_serialized == serialized);
+    std::string name;
+    cached->getNode("mode")->get("scene", &name);
+    assert(name == "scene.xml");
+    assert(cached->getNode(1)->getName() == "sounds");
+
+    // A file with a different size is parsed again
+    write_file(xml_file, "<kart name=\"Beastie\"/>\n");
+    MetadataCache third(cache_file, 1);
+    XMLNode* changed = third.createXMLTree(0, xml_file);
+    assert(changed);
+    changed->get("name", &name);
+    assert(name == "Beastie");
+    saved = third.save();
+    assert(saved);
+
+    // A file changed in the same second with the same size is parsed again
+    write_file(xml_file, "<kart name=\"Beastie\" mass=\"120\"/>\n");
+    MetadataCache fourth(cache_file, 1);
+    delete fourth.createXMLTree(0, xml_file);
+    saved = fourth.save();
+    assert(saved);
+    write_file(xml_file, "<kart name=\"Beastie\" mass=\"150\"/>\n");
+    MetadataCache fifth(cache_file, 1);
+    XMLNode* same_size = fifth.createXMLTree(0, xml_file);
+    assert(same_size);
+    float mass = 0;
+    same_size->get("mass", &mass);
+    assert(mass == 150.0f);
+    delete same_size;
+
+    // A corrupt cache is ignored
+    FILE* fd = FileUtils::fopenU8Path(cache_file, "r+b");
+    assert(fd);
+    fseek(fd, -1, SEEK_END);
+    const int c = fgetc(fd);
+    fseek(fd, -1, SEEK_END);
+    fputc(c ^ 1, fd);
+    fclose(fd);
+    MetadataCache corrupt(cache_file, 0);
+    assert(corrupt.m_old_entries.empty());
+
+    delete parsed;
+    delete cached;
+    delete changed;
+    remove(FileUtils::getPortableWritingPath(cache_file).c_str());
+    remove(FileUtils::getPortableWritingPath(xml_file).c_str());
+    (void)saved;
+}   // unitTesting
@@ -0,0 +1,88 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_METADATA_CACHE_HPP
+#define HEADER_METADATA_CACHE_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class XMLNode;
+
+/** \brief A cache of the parsed kart.xml and track.xml files.
+ *  All information about the installed karts and tracks (names, groups,
+ *  modes, kart properties, ...) comes from these files, so with many addons
+ *  reading and parsing them takes a large part of the startup time, even
+ *  though they almost never change. The cache stores the XMLNode trees of
+ *  all files in one binary file in the user config directory, together with
+ *  the size and a hash of the content of each file. Only the files that
+ *  changed since the cache was written are parsed again.
+ *  Only the XML is cached: each kart still loads its materials.xml and its
+ *  kart and wheel models at startup (see KartModel::loadModels), since the
+ *  size of the model defines the physical size of the kart and the master
+ *  model is needed to display the kart. With many addon karts this is by
+ *  far the largest part of the startup time.
+ *  The cache is filled while the files are read (see
+ *  FileManager::createXMLTrees), createXMLTree can be called from different
+ *  threads as long as each index is only used once.
+ * \ingroup io
+ */
+class MetadataCache : public NoCopy
+{
+private:
+    struct Entry
+    {
+        /** Hash of the content and size of the file. */
+        uint64_t m_hash, m_size;
+        /** The serialized XMLNode tree, empty if the file can't be read. */
+        std::string m_tree;
+        Entry() : m_hash(0), m_size(0) {}
+    };
+
+    /** Name of the cache file. */
+    std::string m_filename;
+
+    /** The entries read from the cache file, indexed by file name. */
+    std::map<std::string, Entry> m_old_entries;
+
+    /** The entries of all files read now, which replace the old entries
+     *  when the cache is saved. */
+    std::vector<std::pair<std::string, Entry> > m_new_entries;
+
+    // ------------------------------------------------------------------------
+    void load();
+    // ------------------------------------------------------------------------
+    static bool getFileStamp(const std::string& filename, Entry* entry);
+
+public:
+    // ------------------------------------------------------------------------
+    MetadataCache(const std::string& filename, unsigned int num_files);
+    // ------------------------------------------------------------------------
+    XMLNode* createXMLTree(unsigned int index, const std::string& filename);
+    // ------------------------------------------------------------------------
+    bool save() const;
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // MetadataCache
+
+#endif
@@ -23,6 +23,7 @@
 #include "utils/string_utils.hpp"
 #include "utils/vec3.hpp"
 
+#include <cstring>
 #include <stdexcept>
 
 XMLNode::XMLNode(io::IXMLReader *xml)
@@ -86,6 +87,111 @@ XMLNode::~XMLNode()
     m_nodes.clear();
 }   // ~XMLNode
 
+// ----------------------------------------------------------------------------
+/** Appends a compact binary form of this node and all its children to a
+ *  string, from which the tree can be recreated without parsing the XML
+ *  file again (see MetadataCache).
+ *  \param data The string to append the node to.
+ */
+void XMLNode::serialize(std::string *data) const
+{
+    auto write_size = [data](size_t size)
+        {
+            const uint32_t n = (uint32_t)size;
+            data->append((const char*)&n, sizeof(n));
+        };
+    write_size(m_name.size());
+    data->append(m_name);
+    write_size(m_attributes.size());
+    for (auto& attribute : m_attributes)
+    {
+        write_size(attribute.first.size());
+        data->append(attribute.first);
+        write_size(attribute.second.size());
+        data->append((const char*)attribute.second.c_str(),
+                     attribute.second.size() * sizeof(wchar_t));
+    }
+    write_size(m_nodes.size());
+    for (const XMLNode* node : m_nodes)
+        node->serialize(data);
+}   // serialize
+
+// ----------------------------------------------------------------------------
+/** Recreates a tree from the data written by serialize().
+ *  \param filename Name of the XML file the tree was read from.
+ *  \param data The serialized tree.
+ *  \return The tree, or NULL if the data is invalid.
+ */
+XMLNode *XMLNode::deserialize(const std::string &filename,
+                              const std::string &data)
+{
+    XMLNode *node = new XMLNode();
+    node->m_file_name = filename;
+    size_t pos = 0;
+    if (!node->readSerialized(data, &pos, 0) || pos != data.size())
+    {
+        delete node;
+        return NULL;
+    }
+    return node;
+}   // deserialize
+
+// ----------------------------------------------------------------------------
+/** Reads this node and its children from the data written by serialize().
+ *  \param data The serialized tree.
+ *  \param pos Position of this node in data, on return the position after
+ *         this node.
+ *  \param depth Depth of this node, to reject invalid data.
+ *  \return False if the data is invalid.
+ */
+bool XMLNode::readSerialized(const std::string &data, size_t *pos,
+                             unsigned int depth)
+{
+    auto read_size = [&data, pos](size_t element_size, uint32_t *n)
+        {
+            if (data.size() - *pos < sizeof(*n))
+                return false;
+            memcpy(n, data.data() + *pos, sizeof(*n));
+            *pos += sizeof(*n);
+            return (data.size() - *pos) / element_size >= *n;
+        };
+    uint32_t n;
+    if (depth > 256 || !read_size(1, &n))
+        return false;
+    m_name.assign(data, *pos, n);
+    *pos += n;
+
+    uint32_t num_attributes;
+    if (!read_size(1, &num_attributes))
+        return false;
+    for (uint32_t i = 0; i < num_attributes; i++)
+    {
+        if (!read_size(1, &n))
+            return false;
+        std::string name(data, *pos, n);
+        *pos += n;
+        if (!read_size(sizeof(wchar_t), &n))
+            return false;
+        std::vector<wchar_t> value(n + 1, 0);
+        memcpy(value.data(), data.data() + *pos, n * sizeof(wchar_t));
+        *pos += n * sizeof(wchar_t);
+        m_attributes[name] = core::stringw(value.data(), n);
+    }
+
+    uint32_t num_nodes;
+    if (!read_size(1, &num_nodes))
+        return false;
+    for (uint32_t i = 0; i < num_nodes; i++)
+    {
+        XMLNode *node = new XMLNode();
+        node->m_file_name = m_file_name;
+        m_nodes.push_back(node);
+        if (!node->readSerialized(data, pos, depth + 1))
+            return false;
+    }
+    return true;
+}   // readSerialized
+
 // ----------------------------------------------------------------------------
 /** Stores all attributes, and reads in all children.
  *  \param xml The XML reader.
@@ -55,9 +55,13 @@ private:
     std::vector<XMLNode *>               m_nodes;
 
     void readXML(io::IXMLReader *xml);
+    bool readSerialized(const std::string &data, size_t *pos,
+                        unsigned int depth);
 
     std::string                          m_file_name;
 
+         XMLNode() {}
+
 public:
          LEAK_CHECK();
          XMLNode(io::IXMLReader *xml);
@@ -67,6 +71,10 @@ public:
 
         ~XMLNode();
 
+    void               serialize(std::string *data) const;
+    static XMLNode    *deserialize(const std::string &filename,
+                                   const std::string &data);
+
     const std::string &getName() const {return m_name; }
     const XMLNode     *getNode(const std::string &name) const;
     const void         getNodes(const std::string &s, std::vector<XMLNode*>& out) const;
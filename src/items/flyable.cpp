@@ -22,6 +22,7 @@
 #include "items/flyable.hpp"
 
 #include <cmath>
+#include <cstring>
 
 #include <IMeshManipulator.h>
 #include <IMeshSceneNode.h>
@@ -658,12 +659,11 @@ void Flyable::moveToInfinity(bool set_moveable_trans)
 }   // moveToInfinity
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Flyable::saveState(std::vector<std::string>* ru)
+BareNetworkString* Flyable::saveState()
 {
     if (m_has_hit_something)
         return NULL;
 
-    ru->push_back(getUniqueIdentity());
 
     BareNetworkString* buffer = new BareNetworkString();
     uint16_t ticks_since_thrown_animation = (m_ticks_since_thrown & 32767) |
@@ -682,6 +682,34 @@ BareNetworkString* Flyable::saveState(std::vector<std::string>* ru)
     return buffer;
 }   // saveState
 
+// ----------------------------------------------------------------------------
+/** Compares the predicted state with a confirmed state, the physical body
+ *  may differ up to the thresholds in stk_config.
+ */
+bool Flyable::isStateDiverged(BareNetworkString* predicted,
+                              BareNetworkString* confirmed, int count)
+{
+    // Ticks since thrown (with the animation flag in the highest bit) and
+    // gravity vector
+    const int body_offset = m_do_terrain_info ? 6 : 2;
+    const int body_end = body_offset + CompressNetworkBody::COMPRESSED_SIZE;
+    if (count < body_end || (int)predicted->size() < body_end ||
+        (confirmed->getCurrentData()[0] & 0x80) != 0)
+        return isDataDiverged(predicted, confirmed, count);
+
+    if (memcmp(predicted->getCurrentData(), confirmed->getCurrentData(),
+        body_offset) != 0)
+        return true;
+    predicted->skip(body_offset);
+    confirmed->skip(body_offset);
+    if (CompressNetworkBody::isDiverged(predicted, confirmed,
+        stk_config->m_network_rewind_distance,
+        stk_config->m_network_rewind_angle,
+        stk_config->m_network_rewind_speed))
+        return true;
+    return isDataDiverged(predicted, confirmed, count - body_end);
+}   // isStateDiverged
+
 // ----------------------------------------------------------------------------
 void Flyable::restoreState(BareNetworkString *buffer, int count)
 {
@@ -257,8 +257,16 @@ public:
     // ------------------------------------------------------------------------
     virtual void computeError() OVERRIDE;
     // ------------------------------------------------------------------------
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
-        OVERRIDE;
+    virtual BareNetworkString* saveState() OVERRIDE;
+    // ------------------------------------------------------------------------
+    /** A flyable deleted in this client is not predicted, so it doesn't
+     *  cause a rewind if it's deleted in server too. */
+    virtual BareNetworkString* savePredictedState() OVERRIDE
+                             { return m_has_server_state ? saveState() : NULL; }
+    // ------------------------------------------------------------------------
+    virtual bool isStateDiverged(BareNetworkString* predicted,
+                                 BareNetworkString* confirmed,
+                                 int count) OVERRIDE;
     // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
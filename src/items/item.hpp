@@ -400,6 +400,10 @@ public:
         return lc.length2() < m_distance_2;
     }   // hitKart
     // ------------------------------------------------------------------------
+    /** Returns the largest distance from the item at which hitKart can be
+     *  true (the vertical distance is halved in hitKart). */
+    float getMaxHitDistance() const         { return 2.0f * sqrtf(m_distance_2); }
+    // ------------------------------------------------------------------------
     bool rotating() const               { return getType() != ITEM_BUBBLEGUM; }
 
 public:
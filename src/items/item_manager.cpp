@@ -48,8 +48,9 @@ std::vector<scene::IMesh *>  ItemManager::m_item_mesh;
 std::vector<scene::IMesh *>  ItemManager::m_item_lowres_mesh;
 std::vector<video::SColorf>  ItemManager::m_glow_color;
 bool                         ItemManager::m_disable_item_collection = false;
-std::mt19937                 ItemManager::m_random_engine;
-uint32_t                     ItemManager::m_random_seed = 0;
+std::mt19937                 ItemManager::m_random_engine[PT_COUNT];
+uint32_t                     ItemManager::m_random_seed[PT_COUNT] = {};
+const float                  ItemManager::ITEM_GRID_CELL_SIZE = 4.0f;
 
 //-----------------------------------------------------------------------------
 /** Loads the default item meshes (high- and low-resolution).
@@ -148,6 +149,7 @@ void ItemManager::removeTextures()
 ItemManager::ItemManager()
 {
     m_switch_ticks = -1;
+    m_max_hit_distance = 0.0f;
     // The actual loading is done in loadDefaultItems
 
     // Prepare the switch to array, which stores which item should be
@@ -223,6 +225,7 @@ unsigned int ItemManager::insertItem(Item *item)
     }
     item->setItemId(index);
     insertItemInQuad(item);
+    insertItemInGrid(item);
     // Now insert into the appropriate quad list, if there is a quad list
     // (i.e. race mode has a quad graph).
     return index;
@@ -247,6 +250,20 @@ void ItemManager::insertItemInQuad(Item *item)
     }   // if m_items_in_quads
 }   // insertItemInQuad
 
+//-----------------------------------------------------------------------------
+/** Inserts an item into the cell of the item grid containing it.
+ *  \param item The item to insert.
+ */
+void ItemManager::insertItemInGrid(Item *item)
+{
+    const Vec3& xyz = item->getXYZ();
+    m_items_in_cells[getGridCell(getGridCoordinate(xyz.getX()),
+                                 getGridCoordinate(xyz.getZ()))]
+        .push_back(item);
+    m_max_hit_distance = std::max(m_max_hit_distance,
+                                  item->getMaxHitDistance());
+}   // insertItemInGrid
+
 //-----------------------------------------------------------------------------
 /** Creates a new item at the location of the kart (e.g. kart drops a
  *  bubblegum).
@@ -363,14 +380,9 @@ void ItemManager::collectedItem(ItemState *item, AbstractKart *kart)
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
+    // Only the items in the cells of the item grid close to the kart are
+    // tested, m_items_in_quads is not used since an item on the border of
+    // a quad can be hit from adjacent quads, or from outside of the track.
 
     /** Disable item collection detection for debug purposes. */
     if(m_disable_item_collection) return;
@@ -378,8 +390,9 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
     // Spare tire karts don't collect items
     if ( dynamic_cast<SpareTireAI*>(kart->getController()) ) return;
 
-    for(AllItemTypes::iterator i =m_all_items.begin();
-                               i!=m_all_items.end();  i++)
+    getItemsInRange(kart->getXYZ(), m_max_hit_distance, &m_items_in_range);
+    for(AllItemTypes::iterator i =m_items_in_range.begin();
+                               i!=m_items_in_range.end();  i++)
     {
         // Ignore items that have been collected or are not available atm
         if ((!*i) || !(*i)->isAvailable() || (*i)->isUsedUp()) continue;
@@ -399,7 +412,7 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
         {
             collectedItem(*i, kart);
         }   // if hit
-    }   // for m_all_items
+    }   // for m_items_in_range
 }   // checkItemHit
 
 //-----------------------------------------------------------------------------
@@ -504,6 +517,7 @@ void ItemManager::deleteItem(ItemState *item)
 {
     // First check if the item needs to be removed from the items-in-quad list
     deleteItemInQuad(item);
+    deleteItemInGrid(item);
     int index = item->getItemId();
     m_all_items[index] = NULL;
     delete item;
@@ -528,6 +542,66 @@ void ItemManager::deleteItemInQuad(ItemState* item)
     }   // if m_items_in_quads
 }   // deleteItemInQuad
 
+//-----------------------------------------------------------------------------
+/** Removes an item from the item grid. The position of the item must be the
+ *  same as when it was inserted.
+ *  \param The item to delete.
+ */
+void ItemManager::deleteItemInGrid(ItemState* item)
+{
+    const Vec3& xyz = item->getXYZ();
+    auto cell = m_items_in_cells.find(
+        getGridCell(getGridCoordinate(xyz.getX()),
+                    getGridCoordinate(xyz.getZ())));
+    assert(cell != m_items_in_cells.end());
+    AllItemTypes &items = cell->second;
+    AllItemTypes::iterator it = std::find(items.begin(), items.end(), item);
+    assert(it != items.end());
+    items.erase(it);
+    if (items.empty())
+        m_items_in_cells.erase(cell);
+}   // deleteItemInGrid
+
+//-----------------------------------------------------------------------------
+/** Returns all items with a horizontal distance of at most radius from
+ *  xyz (and some more of the grid cells overlapping this range), in the
+ *  order of their index in the list of all items. Collected or otherwise
+ *  unavailable items are included too.
+ *  \param xyz The center of the range.
+ *  \param radius The radius of the range.
+ *  \param items On return the items in the range.
+ */
+void ItemManager::getItemsInRange(const Vec3& xyz, float radius,
+                                  std::vector<ItemState*>* items) const
+{
+    items->clear();
+    if (m_items_in_cells.empty())
+        return;
+    const int x0 = getGridCoordinate(xyz.getX() - radius);
+    const int x1 = getGridCoordinate(xyz.getX() + radius);
+    const int z0 = getGridCoordinate(xyz.getZ() - radius);
+    const int z1 = getGridCoordinate(xyz.getZ() + radius);
+    for (int x = x0; x <= x1; x++)
+    {
+        for (int z = z0; z <= z1; z++)
+        {
+            auto cell = m_items_in_cells.find(getGridCell(x, z));
+            if (cell != m_items_in_cells.end())
+            {
+                items->insert(items->end(), cell->second.begin(),
+                              cell->second.end());
+            }
+        }
+    }
+    // Keep the order of m_all_items, so that items are collected in the
+    // same order on server and clients
+    std::sort(items->begin(), items->end(),
+        [](const ItemState* a, const ItemState* b)
+        {
+            return a->getItemId() < b->getItemId();
+        });
+}   // getItemsInRange
+
 //-----------------------------------------------------------------------------
 /** Switches all items: boxes become bananas and vice versa for a certain
  *  amount of time (as defined in stk_config.xml).
@@ -602,7 +676,7 @@ bool ItemManager::randomItemsForArena(const AlignedArray<btTransform>& pos)
                     "Use default item location.");
                 return false;
             }
-            uint32_t number = m_random_engine();
+            uint32_t number = m_random_engine[STKProcess::getType()]();
             Log::debug("[ItemManager]", "%u from random engine.", number);
             const int node = number % ALL_NODES;
 
@@ -24,17 +24,20 @@
 #include "items/item.hpp"
 #include "utils/aligned_array.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/stk_process.hpp"
 #include "utils/vec3.hpp"
 
 #include <SColor.h>
 
 #include <assert.h>
 #include <algorithm>
+#include <cmath>
 
 #include <map>
 #include <memory>
 #include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class Kart;
@@ -53,21 +56,22 @@ private:
     /** Disable item collection (for debugging purposes). */
     static bool m_disable_item_collection;
 
-    static std::mt19937 m_random_engine;
+    /** Random engine and seed for random item location of each process. */
+    static std::mt19937 m_random_engine[PT_COUNT];
 
-    static uint32_t m_random_seed;
+    static uint32_t m_random_seed[PT_COUNT];
 public:
     static void loadDefaultItemMeshes();
     static void removeTextures();
     static void updateRandomSeed(uint32_t seed_number)
     {
-        m_random_engine.seed(seed_number);
-        m_random_seed = seed_number;
+        m_random_engine[STKProcess::getType()].seed(seed_number);
+        m_random_seed[STKProcess::getType()] = seed_number;
     }   // updateRandomSeed
     // ------------------------------------------------------------------------
     static uint32_t getRandomSeed()
     {
-        return m_random_seed;
+        return m_random_seed[STKProcess::getType()];
     }   // getRandomSeed
 
     // ------------------------------------------------------------------------
@@ -107,6 +111,22 @@ private:
      *  field is undefined if no Graph exist, e.g. arena without navmesh. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** A 2d (x/z) hash grid of all items, so that hit detection only needs
+     *  to test the items close to a kart. Items don't move, so an item only
+     *  changes its cell when it is inserted or deleted, or when its state
+     *  is restored in a rewind. Collected and switched items stay in the
+     *  grid. */
+    std::unordered_map<uint64_t, AllItemTypes> m_items_in_cells;
+
+    /** The largest distance from an item at which it can be hit. */
+    float m_max_hit_distance;
+
+    /** Avoids allocating memory for each call of checkItemHit. */
+    AllItemTypes m_items_in_range;
+
+    /** Size of the cells of the item grid. */
+    static const float ITEM_GRID_CELL_SIZE;
+
     /** Stores all item models. */
     static std::vector<scene::IMesh *> m_item_mesh;
 
@@ -123,6 +143,17 @@ protected:
     void setSwitchItems(const std::vector<int> &switch_items);
     void insertItemInQuad(Item *item);
     void deleteItemInQuad(ItemState *item);
+    void insertItemInGrid(Item *item);
+    void deleteItemInGrid(ItemState *item);
+    // ------------------------------------------------------------------------
+    /** Returns the key of the grid cell containing a position. */
+    static uint64_t getGridCell(int x, int z)
+    {
+        return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+    }   // getGridCell
+    // ------------------------------------------------------------------------
+    static int getGridCoordinate(float f)
+                           { return (int)std::floor(f / ITEM_GRID_CELL_SIZE); }
 public:
              ItemManager();
     virtual ~ItemManager();
@@ -140,6 +171,8 @@ public:
     virtual void   collectedItem   (ItemState *item, AbstractKart *kart);
     virtual void   switchItems     ();
     bool           randomItemsForArena(const AlignedArray<btTransform>& pos);
+    void           getItemsInRange (const Vec3& xyz, float radius,
+                                    std::vector<ItemState*>* items) const;
 
     // ------------------------------------------------------------------------
     /** Returns true if the items are switched atm. */
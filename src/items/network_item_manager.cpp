@@ -219,9 +219,8 @@ void NetworkItemManager::setItemConfirmationTime(std::weak_ptr<STKPeer> peer,
  *  to save the initial state, which is the first confirmed state by all
  *  clients.
  */
-BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
+BareNetworkString* NetworkItemManager::saveState()
 {
-    ru->push_back(getUniqueIdentity());
     // On the server:
     // ==============
     m_item_events.lock();
@@ -244,6 +243,15 @@ BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
     return s;
 }   // saveState
 
+// ----------------------------------------------------------------------------
+/** Item events from the server can't be predicted, so only a confirmed
+ *  state without events is the same as the (empty) predicted state.
+ */
+BareNetworkString* NetworkItemManager::savePredictedState()
+{
+    return new BareNetworkString();
+}   // savePredictedState
+
 //-----------------------------------------------------------------------------
 /** Progresses the time for all item by the given number of ticks. Used
  *  when computing a new state from a confirmed state.
@@ -484,7 +492,13 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
         // ... will be copied from item state to item
         if (is && item)
         {
+            // A reused index can be a different item at another position
+            const bool moved = item->getXYZ() != is->getXYZ();
+            if (moved)
+                deleteItemInGrid(item);
             *(ItemState*)item = *is;
+            if (moved)
+                insertItemInGrid(dynamic_cast<Item*>(item));
         }
         else if (is && !item)
         {
@@ -497,10 +511,12 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
             *((ItemState*)item_new) = *is;
             m_all_items[i] = item_new;
             insertItemInQuad(item_new);
+            insertItemInGrid(item_new);
         }
         else if (!is && item)
         {
             deleteItemInQuad(item);
+            deleteItemInGrid(item);
             delete item;
             m_all_items[i] = NULL;
         }
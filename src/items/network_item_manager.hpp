@@ -81,10 +81,11 @@ public:
                               const AbstractKart *kart,
                               const Vec3 *server_xyz = NULL,
                               const Vec3 *server_normal = NULL) OVERRIDE;
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
-        OVERRIDE;
+    virtual BareNetworkString* saveState() OVERRIDE;
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePredictedState() OVERRIDE;
+    // ------------------------------------------------------------------------
     virtual void rewindToEvent(BareNetworkString *bns) OVERRIDE {};
     // ------------------------------------------------------------------------
     virtual void saveTransform() OVERRIDE {};
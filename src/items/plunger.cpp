@@ -252,9 +252,9 @@ void Plunger::hitTrack()
 }   // hitTrack
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Plunger::saveState(std::vector<std::string>* ru)
+BareNetworkString* Plunger::saveState()
 {
-    BareNetworkString* buffer = Flyable::saveState(ru);
+    BareNetworkString* buffer = Flyable::saveState();
     if (!buffer)
         return NULL;
 
@@ -875,9 +875,9 @@ bool RubberBall::hit(AbstractKart* kart, PhysicalObject* object)
 }   // hit
 
 // ----------------------------------------------------------------------------
-BareNetworkString* RubberBall::saveState(std::vector<std::string>* ru)
+BareNetworkString* RubberBall::saveState()
 {
-    BareNetworkString* buffer = Flyable::saveState(ru);
+    BareNetworkString* buffer = Flyable::saveState();
     if (!buffer)
         return NULL;
 
@@ -68,6 +68,10 @@ public:
     const float   getSuspensionLength(int index, int wheel) const
                { return m_all_physic_info[index].m_suspension_length[wheel]; }
     // ------------------------------------------------------------------------
+    /** Returns all transforms of this ghost kart. */
+    const std::vector<btTransform>& getAllTransforms() const
+                                                   { return m_all_transform; }
+    // ------------------------------------------------------------------------
     void          addReplayEvent(float time,
                                  const btTransform &trans,
                                  const ReplayBase::PhysicInfo &pi,
@@ -72,6 +72,7 @@
 #include "network/race_event_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/tick_profiler.hpp"
 #include "physics/btKart.hpp"
 #include "physics/btKartRaycast.hpp"
 #include "physics/physics.hpp"
@@ -1433,7 +1434,11 @@ void Kart::update(int ticks)
     // based on the collision speed.
     m_body->setRestitution(m_kart_properties->getRestitution(fabsf(m_speed)));
 
-    m_controller->update(ticks);
+    {
+        TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_AI,
+            !m_controller->isPlayerController());
+        m_controller->update(ticks);
+    }
 
 #ifndef SERVER_ONLY
 #undef DEBUG_CAMERA_SHAKE
@@ -1538,19 +1543,8 @@ void Kart::update(int ticks)
 
     if (!has_animation_before)
     {
-        Vec3 from(0.0f, 0.0f, 0.0f);
-        for (unsigned int i = 0; i < 4; i++)
-            from += m_vehicle->getWheelInfo(i).m_raycastInfo.m_hardPointWS;
-
-        // Add a certain epsilon (0.3) to the height of the kart. This avoids
-        // problems of the ray being cast from under the track (which happened
-        // e.g. on tux tollway when jumping down from the ramp, when the chassis
-        // partly tunnels through the track). While tunneling should not be
-        // happening (since Z velocity is clamped), the epsilon is left in place
-        // just to be on the safe side (it will not hit the chassis itself).
-        from = from/4 + (getTrans().getBasis() * Vec3(0.0f, 0.3f, 0.0f));
-
-        m_terrain_info->update(getTrans().getBasis(), from);
+        m_terrain_info->update(getTrans().getBasis(),
+                               getTerrainRayStart(getTrans()));
     }
     else
     {
@@ -1782,6 +1776,57 @@ void Kart::update(int ticks)
 
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Returns the start of the raycast that detects the terrain under the kart.
+ *  It is cast from the center of the 4 wheel positions and not from the
+ *  chassis, since after a physics step the chassis can be ahead of the
+ *  wheels (see update()).
+ *  \param trans The transform of the kart.
+ */
+Vec3 Kart::getTerrainRayStart(const btTransform& trans) const
+{
+    Vec3 from(0.0f, 0.0f, 0.0f);
+    for (unsigned int i = 0; i < 4; i++)
+        from += m_vehicle->getWheelInfo(i).m_raycastInfo.m_hardPointWS;
+
+    // Add a certain epsilon (0.3) to the height of the kart. This avoids
+    // problems of the ray being cast from under the track (which happened
+    // e.g. on tux tollway when jumping down from the ramp, when the chassis
+    // partly tunnels through the track). While tunneling should not be
+    // happening (since Z velocity is clamped), the epsilon is left in place
+    // just to be on the safe side (it will not hit the chassis itself).
+    from = from/4 + (trans.getBasis() * Vec3(0.0f, 0.3f, 0.0f));
+    return from;
+}   // getTerrainRayStart
+
+//-----------------------------------------------------------------------------
+/** Returns the ray that update() will cast to detect the terrain, based on
+ *  the current physical position. This allows World to cast the rays of all
+ *  karts at once before the karts are updated.
+ *  \param from, to On return the start and end of the ray.
+ *  \return False if the kart has an animation, which can move it in update().
+ */
+bool Kart::getTerrainRay(btVector3 *from, btVector3 *to) const
+{
+    if (m_kart_animation)
+        return false;
+    // Moveable::update() will set the transform from the motion state
+    btTransform trans = getTrans();
+    if (m_body->getInvMass() != 0)
+        m_motion_state->getWorldTransform(trans);
+    const Vec3 start = getTerrainRayStart(trans);
+    *from = start;
+    *to   = TerrainInfo::getRayEnd(trans.getBasis(), start);
+    return true;
+}   // getTerrainRay
+
+//-----------------------------------------------------------------------------
+/** Sets the result of the terrain ray, see getTerrainRay(). */
+void Kart::setPrefetchedTerrainRay(const TriangleMesh::Ray &ray)
+{
+    m_terrain_info->setPrefetchedRay(ray);
+}   // setPrefetchedTerrainRay
+
 //-----------------------------------------------------------------------------
 /** Updates the local speed based on the current physical velocity. The value
  *  is smoothed exponentially to avoid camera stuttering (camera distance
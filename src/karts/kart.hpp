@@ -30,6 +30,7 @@
 
 #include "items/powerup_manager.hpp"    // For PowerupType
 #include "karts/abstract_kart.hpp"
+#include "physics/triangle_mesh.hpp"
 #include "utils/cpp2011.hpp"
 #include "utils/no_copy.hpp"
 
@@ -38,6 +39,7 @@
 class AbstractKartAnimation;
 class Attachment;
 class btKart;
+class btKartRaycaster;
 class btUprightConstraint;
 class Controller;
 class HitEffect;
@@ -115,7 +117,7 @@ protected:
     /** Handles the powerup of a kart. */
     Powerup *m_powerup;
 
-    std::unique_ptr<btVehicleRaycaster> m_vehicle_raycaster;
+    std::unique_ptr<btKartRaycaster> m_vehicle_raycaster;
 
     std::unique_ptr<btKart> m_vehicle;
 
@@ -289,6 +291,7 @@ protected:
     void          playCrashSFX(const Material* m, AbstractKart *k);
     void          loadData(RaceManager::KartType type, bool animatedModel);
     void          updateWeight();
+    Vec3          getTerrainRayStart(const btTransform& trans) const;
 public:
                    Kart(const std::string& ident, unsigned int world_kart_id,
                         int position, const btTransform& init_transform,
@@ -326,6 +329,8 @@ public:
     virtual void   crashed          (const Material *m, const Vec3 &normal) OVERRIDE;
     virtual float  getHoT           () const OVERRIDE;
     virtual void   update           (int ticks) OVERRIDE;
+    bool           getTerrainRay    (btVector3 *from, btVector3 *to) const;
+    void           setPrefetchedTerrainRay(const TriangleMesh::Ray &ray);
     virtual void   finishedRace     (float time, bool from_server=false) OVERRIDE;
     virtual void   setPosition      (int p) OVERRIDE;
     virtual void   beep             () OVERRIDE;
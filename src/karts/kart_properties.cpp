@@ -66,11 +66,13 @@ std::string KartProperties::getHandicapAsString(HandicapLevel h)
  *  Otherwise the defaults are taken from STKConfig (and since they are all
  *  defined, it is guaranteed that each kart has well defined physics values).
  */
-KartProperties::KartProperties(const std::string &filename)
+KartProperties::KartProperties(const std::string &filename,
+                               const XMLNode* kart_xml)
 {
     m_is_addon = false;
     m_icon_material = NULL;
     m_minimap_icon  = NULL;
+    m_minimap_icon_loaded = false;
     m_name          = "NONAME";
     m_ident         = "NONAME";
     m_icon_file     = "";
@@ -99,7 +101,7 @@ KartProperties::KartProperties(const std::string &filename)
     // The default constructor for stk_config uses filename=""
     if (filename != "")
     {
-        load(filename, "kart");
+        load(filename, "kart", kart_xml);
     }
     else
     {
@@ -180,13 +182,15 @@ void KartProperties::copyFrom(const KartProperties *source)
 /** Loads the kart properties from a file.
  *  \param filename Filename to load.
  *  \param node Name of the xml node to load the data from
+ *  \param kart_xml The already read file, or NULL if it must be read here.
  */
-void KartProperties::load(const std::string &filename, const std::string &node)
+void KartProperties::load(const std::string &filename, const std::string &node,
+                          const XMLNode* kart_xml)
 {
     // Get the default values from STKConfig. This will also allocate any
     // pointers used in KartProperties
 
-    const XMLNode* root = new XMLNode(filename);
+    const XMLNode* root = kart_xml ? kart_xml : new XMLNode(filename);
     std::string kart_type;
 
     if (root->get("type", &kart_type))
@@ -240,7 +244,7 @@ void KartProperties::load(const std::string &filename, const std::string &node)
                    filename.c_str());
         Log::error("[KartProperties]", "%s", err.what());
     }
-    if(root) delete root;
+    if(root != kart_xml) delete root;
 
     // Set a default group (that has to happen after init_default and load)
     if(m_groups.size()==0)
@@ -284,6 +288,8 @@ void KartProperties::load(const std::string &filename, const std::string &node)
                                                     /*make_permanent*/true,
                                                     /*complain_if_not_found*/true,
                                                     /*strip_path*/false);
+    // The minimap icon is only loaded when it is displayed (see
+    // getMinimapIcon)
     if (m_minimap_icon_file!="")
     {
         // check if there is an icon in the skin folder first
@@ -296,10 +302,9 @@ void KartProperties::load(const std::string &filename, const std::string &node)
             m_minimap_icon_file = GUIEngine::getSkin()->getThemedIcon(std::string("karts/")
                                                                       +m_ident+"/"+m_minimap_icon_file);
         }
-        m_minimap_icon = STKTexManager::getInstance()->getTexture(m_minimap_icon_file);
     }
-    else
-        m_minimap_icon = NULL;
+    m_minimap_icon = NULL;
+    m_minimap_icon_loaded = false;
 
     // Only load the model if the .kart file has the appropriate version,
     // otherwise warnings are printed.
@@ -344,6 +349,25 @@ void KartProperties::load(const std::string &filename, const std::string &node)
 
 }   // load
 
+// ----------------------------------------------------------------------------
+/** Returns the texture to use in the minimap, or NULL if not defined. The
+ *  texture is loaded the first time it is needed, so that loading all karts
+ *  at startup doesn't need to load all minimap icons.
+ */
+video::ITexture* KartProperties::getMinimapIcon() const
+{
+    if (!m_minimap_icon_loaded)
+    {
+        m_minimap_icon_loaded = true;
+        if (m_minimap_icon_file != "")
+        {
+            m_minimap_icon = STKTexManager::getInstance()
+                                         ->getTexture(m_minimap_icon_file);
+        }
+    }
+    return m_minimap_icon;
+}   // getMinimapIcon
+
 // ----------------------------------------------------------------------------
 /** Returns a pointer to the KartModel object.
  *  \param krt The KartRenderType, like default, red, blue or transparent.
@@ -374,7 +398,9 @@ void KartProperties::adjustForOnlineAddonKart(const KartProperties* source)
     m_ident = source->m_ident;
     m_shadow_material = source->m_shadow_material;
     m_icon_material = source->m_icon_material;
+    m_minimap_icon_file = source->m_minimap_icon_file;
     m_minimap_icon = source->m_minimap_icon;
+    m_minimap_icon_loaded = source->m_minimap_icon_loaded;
     m_engine_sfx_type = source->m_engine_sfx_type;
     m_color = source->m_color;
 }  // adjustForOnlineAddonKart
@@ -75,8 +75,12 @@ private:
     std::string              m_minimap_icon_file;
 
     /** The texture to use in the minimap. If not defined, a simple
-     *  color dot is used. */
-    video::ITexture         *m_minimap_icon;
+     *  color dot is used. It is only loaded when it is first used, so
+     *  it is mutable. */
+    mutable video::ITexture *m_minimap_icon;
+
+    /** If loading the minimap icon was already tried. */
+    mutable bool             m_minimap_icon_loaded;
 
     /** The kart model and wheels. It is mutable since the wheels of the
      *  KartModel can rotate and turn, and animations are played, but otherwise
@@ -203,14 +207,16 @@ private:
     InterpolationArray m_restitution;
 
     void  load              (const std::string &filename,
-                             const std::string &node);
+                             const std::string &node,
+                             const XMLNode* kart_xml);
     void combineCharacteristics(HandicapLevel h);
 
 public:
     /** Returns the string representation of a handicap level. */
     static std::string      getHandicapAsString(HandicapLevel h);
 
-          KartProperties    (const std::string &filename="");
+          KartProperties    (const std::string &filename="",
+                             const XMLNode* kart_xml=NULL);
          ~KartProperties    ();
     void  copyForPlayer     (const KartProperties *source,
                              HandicapLevel h = HANDICAP_NONE);
@@ -236,8 +242,7 @@ public:
     Material*     getIconMaterial    () const {return m_icon_material;        }
 
     // ------------------------------------------------------------------------
-    /** Returns the texture to use in the minimap, or NULL if not defined. */
-    video::ITexture *getMinimapIcon  () const {return m_minimap_icon;         }
+    video::ITexture *getMinimapIcon  () const;
 
     // ------------------------------------------------------------------------
     KartModel* getKartModelCopy(std::shared_ptr<RenderInfo> ri=nullptr) const;
@@ -149,26 +149,44 @@ void KartPropertiesManager::removeKart(const std::string &ident)
 }   // removeKart
 
 //-----------------------------------------------------------------------------
-/** Loads all kart properties and models.
+/** Loads all kart properties and models. The kart.xml files of all karts
+ *  are read in parallel first, the karts are then loaded one after another
+ *  (since e.g. loading the models is not thread-safe).
  */
 void KartPropertiesManager::loadAllKarts(bool loading_icon)
 {
     m_all_kart_dirs.clear();
-    std::vector<std::string>::const_iterator dir;
-    for(dir = m_kart_search_path.begin(); dir!=m_kart_search_path.end(); dir++)
+
+    std::vector<std::set<std::string> > all_subdirs(m_kart_search_path.size());
+    std::vector<std::string> config_files;
+    for(unsigned int i=0; i<m_kart_search_path.size(); i++)
+    {
+        const std::string &dir = m_kart_search_path[i];
+        config_files.push_back(dir+"/kart.xml");
+        file_manager->listFiles(all_subdirs[i], dir);
+        for(const std::string& subdir : all_subdirs[i])
+            config_files.push_back(dir+subdir+"/kart.xml");
+    }
+    std::vector<XMLNode*> all_xmls =
+        file_manager->createXMLTrees(config_files, "kart_metadata.dat");
+    std::map<std::string, const XMLNode*> kart_xmls;
+    for(unsigned int i=0; i<config_files.size(); i++)
+        kart_xmls[config_files[i]] = all_xmls[i];
+
+    for(unsigned int i=0; i<m_kart_search_path.size(); i++)
     {
+        const std::string &dir = m_kart_search_path[i];
+
         // First check if there is a kart in the current directory
         // -------------------------------------------------------
-        if(loadKart(*dir)) continue;
+        if(loadKart(dir, kart_xmls[dir+"/kart.xml"])) continue;
 
         // If not, check each subdir of this directory.
         // --------------------------------------------
-        std::set<std::string> result;
-        file_manager->listFiles(result, *dir);
-        for(std::set<std::string>::const_iterator subdir=result.begin();
-            subdir!=result.end(); subdir++)
+        for(const std::string& subdir : all_subdirs[i])
         {
-            const bool loaded = loadKart(*dir+*subdir);
+            const bool loaded = loadKart(dir+subdir,
+                                         kart_xmls[dir+subdir+"/kart.xml"]);
 
             if (loaded && loading_icon)
             {
@@ -179,6 +197,9 @@ void KartPropertiesManager::loadAllKarts(bool loading_icon)
             }
         }   // for all files in the currently handled directory
     }   // for i
+
+    for(XMLNode* xml : all_xmls)
+        delete xml;
 }   // loadAllKarts
 
 //-----------------------------------------------------------------------------
@@ -240,18 +261,21 @@ void KartPropertiesManager::loadCharacteristics(const XMLNode *root)
 
 //-----------------------------------------------------------------------------
 /** Loads a single kart and (if not disabled) the corresponding 3d model.
- *  \param filename Full path to the kart config file.
+ *  \param dir The directory of the kart.
+ *  \param kart_xml The already read kart.xml file of the directory, or NULL
+ *         if it must be read here (which also handles a missing file).
  */
-bool KartPropertiesManager::loadKart(const std::string &dir)
+bool KartPropertiesManager::loadKart(const std::string &dir,
+                                     const XMLNode* kart_xml)
 {
     std::string config_filename = dir + "/kart.xml";
-    if(!file_manager->fileExists(config_filename))
+    if(!kart_xml && !file_manager->fileExists(config_filename))
         return false;
 
     KartProperties* kart_properties;
     try
     {
-        kart_properties = new KartProperties(config_filename);
+        kart_properties = new KartProperties(config_filename, kart_xml);
     }
     catch (std::runtime_error& err)
     {
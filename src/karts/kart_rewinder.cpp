@@ -19,6 +19,7 @@
 #include "karts/kart_rewinder.hpp"
 
 #include "audio/sfx_manager.hpp"
+#include "config/stk_config.hpp"
 #include "items/attachment.hpp"
 #include "items/powerup.hpp"
 #include "guiengine/message_queue.hpp"
@@ -159,15 +160,13 @@ void KartRewinder::computeError()
 /** Saves all state information for a kart in a memory buffer. The memory
  *  is allocated here and the address returned. It will then be managed
  *  by the RewindManager.
- *  \param[out] ru The unique identity of rewinder writing to.
  *  \return The address of the memory buffer with the state.
  */
-BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
+BareNetworkString* KartRewinder::saveState()
 {
     if (m_eliminated)
         return nullptr;
 
-    ru->push_back(getUniqueIdentity());
     const int MEMSIZE = 17*sizeof(float) + 9+3;
 
     BareNetworkString *buffer = new BareNetworkString(MEMSIZE);
@@ -266,6 +265,52 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
     return buffer;
 }   // saveState
 
+// ----------------------------------------------------------------------------
+/** Compares the predicted state with a confirmed state. The physical body
+ *  may differ up to the thresholds in stk_config, all other values must be
+ *  the same.
+ *  \param predicted The state saved in this client.
+ *  \param confirmed The state from the server.
+ *  \param count Number of bytes of the confirmed state.
+ */
+bool KartRewinder::isStateDiverged(BareNetworkString* predicted,
+                                   BareNetworkString* confirmed, int count)
+{
+    // Size of controls, controller and the two booleans bytes (see saveState)
+    const int bool_offset = 10;
+    int body_offset = bool_offset + 2;
+    if (count < body_offset || (int)predicted->size() < body_offset)
+        return true;
+    const uint8_t bool_for_each_data =
+        (uint8_t)confirmed->getCurrentData()[bool_offset];
+    if (bool_for_each_data & (1 << 1))
+        body_offset += 2;
+    if (bool_for_each_data & (1 << 2))
+        body_offset += 2;
+    if (bool_for_each_data & (1 << 3))
+        body_offset += 2;
+    if (bool_for_each_data & (1 << 4))
+        body_offset += 4;
+    const bool has_animation = (bool_for_each_data & (1 << 5)) != 0;
+
+    const int body_end = body_offset + CompressNetworkBody::COMPRESSED_SIZE;
+    if (has_animation || count < body_end ||
+        (int)predicted->size() < body_end)
+        return isDataDiverged(predicted, confirmed, count);
+
+    if (memcmp(predicted->getCurrentData(), confirmed->getCurrentData(),
+        body_offset) != 0)
+        return true;
+    predicted->skip(body_offset);
+    confirmed->skip(body_offset);
+    if (CompressNetworkBody::isDiverged(predicted, confirmed,
+        stk_config->m_network_rewind_distance,
+        stk_config->m_network_rewind_angle,
+        stk_config->m_network_rewind_speed))
+        return true;
+    return isDataDiverged(predicted, confirmed, count - body_end);
+}   // isStateDiverged
+
 // ----------------------------------------------------------------------------
 /** Actually rewind to the specified state. 
  *  \param buffer The buffer with the state info.
@@ -40,8 +40,12 @@ public:
     ~KartRewinder() {}
     virtual void saveTransform() OVERRIDE;
     virtual void computeError() OVERRIDE;
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
-        OVERRIDE;
+    virtual BareNetworkString* saveState() OVERRIDE;
+    virtual BareNetworkString* savePredictedState() OVERRIDE
+                                                        { return saveState(); }
+    virtual bool isStateDiverged(BareNetworkString* predicted,
+                                 BareNetworkString* confirmed,
+                                 int count) OVERRIDE;
     void reset() OVERRIDE;
     virtual void restoreState(BareNetworkString *p, int count) OVERRIDE;
     virtual void rewindToEvent(BareNetworkString *p) OVERRIDE {}
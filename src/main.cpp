@@ -209,6 +209,7 @@
 #include "input/keyboard_device.hpp"
 #include "input/wiimote_manager.hpp"
 #include "io/file_manager.hpp"
+#include "io/metadata_cache.hpp"
 #include "items/attachment_manager.hpp"
 #include "items/item_manager.hpp"
 #include "items/network_item_manager.hpp"
@@ -225,6 +226,8 @@
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "network/database_connector.hpp"
+#include "network/ip_range_index.hpp"
 #include "network/network.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
@@ -238,10 +241,14 @@
 #include "network/server_config.hpp"
 #include "network/servers_manager.hpp"
 #include "network/socket_address.hpp"
+#include "network/state_delta.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
+#include "network/tick_profiler.hpp"
 #include "online/profile_manager.hpp"
 #include "online/request_manager.hpp"
+#include "physics/physics.hpp"
+#include "physics/triangle_mesh.hpp"
 #include "race/grand_prix_manager.hpp"
 #include "race/highscore_manager.hpp"
 #include "race/history.hpp"
@@ -257,6 +264,8 @@
 #include "states_screens/dialogs/message_dialog.hpp"
 #include "tips/tips_manager.hpp"
 #include "tracks/arena_graph.hpp"
+#include "tracks/physics_pack.hpp"
+#include "tracks/quad_soa.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/command_line.hpp"
@@ -268,6 +277,7 @@
 #include "utils/profiler.hpp"
 #include "utils/stk_process.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/time.hpp"
 #include "utils/translation.hpp"
 
 static void cleanSuperTuxKart();
@@ -570,6 +580,7 @@ void cmdLineHelp()
     "       --unlock-all       Permanently unlock all karts and tracks for testing.\n"
     "       --no-unlock-all    Disable unlock-all (i.e. base unlocking on player achievement).\n"
     "       --no-graphics      Do not display the actual race.\n"
+    "       --startup-benchmark Print how long the phases of the startup take.\n"
     "       --sp-shader-debug  Enables debug in sp shader, it will print all unavailable uniforms.\n"
     "       --demo-mode=t      Enables demo mode after t seconds of idle time in "
                                "main menu.\n"
@@ -578,6 +589,11 @@ void cmdLineHelp()
     "       --demo-laps=n      Number of laps to use in a demo.\n"
     "       --demo-karts=n     Number of karts to use in a demo.\n"
     // "       --history          Replay history file 'history.dat'.\n"
+    // "       --history-stream   Write history.dat while racing, with keyframes\n"
+    // "                          of all rewinders in network.\n"
+    // "       --history-compress Compress the chunks of history.dat.\n"
+    // "       --history-keyframe=n Seconds between keyframes (default 10).\n"
+    // "       --history-seek=n   Start replaying history.dat after n seconds.\n"
     // "       --test-ai=n        Use the test-ai for every n-th AI kart.\n"
     // "                          (so n=1 means all Ais will be the test ai)\n"
     // "
@@ -604,6 +620,7 @@ void cmdLineHelp()
     "       --port=n           Port number to use.\n"
     "       --auto-connect     Automatically connect to first server and start race\n"
     "       --max-players=n    Maximum number of clients (server only).\n"
+    "       --lobbies=n        Number of lobbies run by this server process (server only).\n"
     "       --min-players=n    Minimum number of clients for ownerless server(server only).\n"
     "       --motd             Message showing in all lobby of clients, can specify a .txt file.\n"
     "       --auto-end         Automatically end network game after 1st player finished\n"
@@ -965,6 +982,8 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         AIBaseController::setTestAI(n);
     if (CommandLine::has("--fps-debug"))
         UserConfigParams::m_fps_debug = true;
+    if (CommandLine::has("--sector-benchmark"))
+        UserConfigParams::m_sector_benchmark = true;
     if (CommandLine::has("--rewind") )
         RewindManager::setEnable(true);
     if(CommandLine::has("--soccer-ai-stats"))
@@ -1284,6 +1303,14 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
     {
         ServerConfig::m_server_max_players = 1;
     }
+    if (CommandLine::has("--lobbies", &n))
+    {
+        ServerConfig::m_lobbies = n;
+    }
+    if (ServerConfig::m_lobbies < 1)
+    {
+        ServerConfig::m_lobbies = 1;
+    }
 
     if (CommandLine::has("--min-players", &n))
     {
@@ -1400,6 +1427,9 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
 
     if (NetworkConfig::get()->isServer())
     {
+        // Additional lobbies load their own tracks, so this must be set
+        // before any world is created
+        STKProcess::setIndependentChildren(ServerConfig::m_lobbies > 1);
         const std::string& server_name = ServerConfig::m_server_name;
         if (ServerConfig::m_wan_server)
         {
@@ -1431,6 +1461,8 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
             Log::info("main", "Creating a LAN server '%s'.",
                 server_name.c_str());
         }
+        if (STKProcess::hasIndependentChildren() && STKHost::existHost())
+            STKHost::get()->startChildLobbies(ServerConfig::m_lobbies - 1);
     }
 
     if (CommandLine::has("--auto-connect"))
@@ -1656,6 +1688,14 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         if (!History::m_online_history_replay)
             UserConfigParams::m_no_start_screen = true;
     }   // --history
+    if (CommandLine::has("--history-stream"))
+        history->setStreaming(true);
+    if (CommandLine::has("--history-compress"))
+        history->setCompress(true);
+    if (CommandLine::has("--history-keyframe", &n) && n > 0)
+        history->setKeyframeInterval((float)n);
+    if (CommandLine::has("--history-seek", &n) && n > 0)
+        history->setSeekTicks(stk_config->time2Ticks((float)n));
 
     // Demo mode
     if(CommandLine::has("--demo-mode", &s))
@@ -1737,6 +1777,26 @@ void initUserConfig()
                                                     // command line parameters
 }   // initUserConfig
 
+//=============================================================================
+/** Time (see StkTime::getMonoTimeMs) at which the current startup phase
+ *  started, or -1 if --startup-benchmark is not used. */
+static int64_t g_startup_phase_start = -1;
+
+// ----------------------------------------------------------------------------
+/** Prints how long the startup phase that just finished took, if
+ *  --startup-benchmark is used.
+ *  \param phase Name of the finished phase.
+ */
+void logStartupPhase(const char* phase)
+{
+    if (g_startup_phase_start < 0)
+        return;
+    const int64_t now = (int64_t)StkTime::getMonoTimeMs();
+    Log::info("StartupBenchmark", "%-10s %6d ms", phase,
+              (int)(now - g_startup_phase_start));
+    g_startup_phase_start = now;
+}   // logStartupPhase
+
 //=============================================================================
 void clearGlobalVariables()
 {
@@ -1873,9 +1933,11 @@ void initRest()
         XMLNode characteristicsNode(file_manager->getAsset("kart_characteristics.xml"));
         kart_properties_manager->loadCharacteristics(&characteristicsNode);
     }
+    logStartupPhase("init");
 
     track_manager->loadTrackList();
     music_manager->addMusicToTracks();
+    logStartupPhase("tracks");
 
     GUIEngine::addLoadingIcon(irr_driver->getTexture(FileManager::GUI_ICON,
                                                      "notes.png"      ) );
@@ -1996,6 +2058,8 @@ int main(int argc, char *argv[])
 {
     clearGlobalVariables();
     CommandLine::init(argc, argv);
+    if (CommandLine::has("--startup-benchmark"))
+        g_startup_phase_start = (int64_t)StkTime::getMonoTimeMs();
 
     CrashReporting::installHandlers();
 #ifndef WIN32
@@ -2104,6 +2168,7 @@ int main(int argc, char *argv[])
         // Create the story mode timer with empty setting first, it will
         // be reset later after story mode status and player manager is loaded
         story_mode_timer = new StoryModeTimer();
+        logStartupPhase("config");
         initRest();
 
 #ifdef ENABLE_WIIUSE
@@ -2126,10 +2191,12 @@ int main(int argc, char *argv[])
         ParticleKindManager::get()->getParticles("explosion_bomb.xml");
         ParticleKindManager::get()->getParticles("explosion_cake.xml");
         ParticleKindManager::get()->getParticles("jump_explosion.xml");
+        logStartupPhase("materials");
 
         GUIEngine::addLoadingIcon( irr_driver->getTexture(FileManager::GUI_ICON,
                                                           "options_video.png"));
         kart_properties_manager -> loadAllKarts    ();
+        logStartupPhase("karts");
         handleXmasMode();
         handleEasterEarMode();
 
@@ -2172,6 +2239,7 @@ int main(int argc, char *argv[])
 
         attachment_manager->loadModels();
         file_manager->popTextureSearchPath();
+        logStartupPhase("models");
 
         GUIEngine::addLoadingIcon( irr_driver->getTexture(FileManager::GUI_ICON,
                                                           "banana.png")    );
@@ -2206,6 +2274,12 @@ int main(int argc, char *argv[])
             }
         }
 #endif
+        logStartupPhase("addons");
+        if (g_startup_phase_start >= 0)
+        {
+            Log::info("StartupBenchmark", "%-10s %6d ms", "total",
+                      (int)StkTime::getMonoTimeMs());
+        }
 
         if(UserConfigParams::m_unit_testing)
         {
@@ -2613,8 +2687,18 @@ void runUnitTests()
     GraphicsRestrictions::unitTesting();
     Log::info("UnitTest", "NetworkString");
     NetworkString::unitTesting();
+    Log::info("UnitTest", "StateDelta");
+    StateDelta::unitTesting();
     Log::info("UnitTest", "SocketAddress");
     SocketAddress::unitTesting();
+#ifdef ENABLE_SQLITE3
+    Log::info("UnitTest", "DatabaseConnector");
+    DatabaseConnector::unitTesting();
+#endif
+    Log::info("UnitTest", "IPRangeIndex");
+    IPRangeIndexUtils::unitTesting();
+    Log::info("UnitTest", "TickProfiler");
+    TickProfiler::unitTesting();
     Log::info("UnitTest", "StringUtils::versionToInt");
     StringUtils::unitTesting();
 
@@ -2658,6 +2742,21 @@ void runUnitTests()
     Log::info("UnitTest", "Arena Graph");
     ArenaGraph::unitTesting();
 
+    Log::info("UnitTest", "QuadSoA");
+    QuadSoA::unitTesting();
+
+    Log::info("UnitTest", "TriangleMesh");
+    TriangleMesh::unitTesting();
+
+    Log::info("UnitTest", "PhysicsPack");
+    PhysicsPack::unitTesting();
+
+    Log::info("UnitTest", "MetadataCache");
+    MetadataCache::unitTesting();
+
+    Log::info("UnitTest", "Physics collision list");
+    Physics::unitTesting();
+
     Log::info("UnitTest", "Fonts for translation");
     font_manager->unitTesting();
 
@@ -46,6 +46,7 @@
 #include "network/rewind_manager.hpp"
 #include "network/server.hpp"
 #include "network/stk_host.hpp"
+#include "network/tick_profiler.hpp"
 #include "online/request_manager.hpp"
 #include "race/history.hpp"
 #include "race/race_manager.hpp"
@@ -615,11 +616,18 @@ void MainLoop::run()
                 num_steps > stk_config->time2Ticks(1.0f);
             for (int i = 0; i < num_steps; i++)
             {
+                // Only measured for servers
+                TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_TICK);
                 if (World::getWorld() && history->replayHistory())
                 {
                     history->updateReplay(
                                        World::getWorld()->getTicksSinceStart());
                 }
+                else if (World::getWorld())
+                {
+                    history->updateRecording(
+                                       World::getWorld()->getTicksSinceStart());
+                }
 
                 PROFILER_PUSH_CPU_MARKER("Protocol manager update",
                                          0x7F, 0x00, 0x7F);
@@ -30,9 +30,8 @@
 // Position offset to attach in kart model
 const Vec3 g_kart_flag_offset(0.0, 0.2f, -0.5f);
 // ============================================================================
-BareNetworkString* CTFFlag::saveState(std::vector<std::string>* ru)
+BareNetworkString* CTFFlag::saveState()
 {
-    ru->push_back(getUniqueIdentity());
     BareNetworkString* buffer = new BareNetworkString();
     int flag_status_unsigned = m_flag_status + 2;
     flag_status_unsigned &= 31;
@@ -89,7 +89,7 @@ public:
     // ------------------------------------------------------------------------
     virtual void computeError() {}
     // ------------------------------------------------------------------------
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual BareNetworkString* saveState();
     // ------------------------------------------------------------------------
     virtual void undoEvent(BareNetworkString* buffer) {}
     // ------------------------------------------------------------------------
@@ -269,9 +269,11 @@ void LinearWorld::update(int ticks)
 void LinearWorld::updateTrackSectors()
 {
     const unsigned int kart_amount = getNumKarts();
+    m_sector_karts.clear();
+    m_sector_xyz.clear();
+    m_sector_nodes.clear();
     for(unsigned int n=0; n<kart_amount; n++)
     {
-        KartInfo& kart_info = m_kart_info[n];
         AbstractKart* kart = m_karts[n].get();
 
         // Nothing to do for karts that are currently being
@@ -289,11 +291,25 @@ void LinearWorld::updateTrackSectors()
               kart->getMaterial()->isDriveReset()))  &&
              !kart->isGhostKart())
             continue;
-        getTrackSector(n)->update(kart->getFrontXYZ());
+        m_sector_karts.push_back(n);
+        m_sector_xyz.push_back(kart->getFrontXYZ());
+        m_sector_nodes.push_back(getTrackSector(n)->getCurrentGraphNode());
+    }   // for n
+
+    // Most karts are still on the same graph node, test this for all karts
+    // at once, so only the others have to search for their new node
+    Graph::get()->pointInsideQuads(m_sector_xyz, &m_sector_nodes);
+    for (unsigned int i = 0; i < m_sector_karts.size(); i++)
+    {
+        const unsigned int n = m_sector_karts[i];
+        KartInfo& kart_info = m_kart_info[n];
+        AbstractKart* kart = m_karts[n].get();
+        getTrackSector(n)->update(m_sector_xyz[i], /*ignore_vertical*/false,
+            m_sector_nodes[i] != Graph::UNKNOWN_SECTOR);
         kart_info.m_overall_distance = kart_info.m_finished_laps
                                      * Track::getCurrentTrack()->getTrackLength()
                         + getDistanceDownTrackForKart(kart->getWorldKartId(), true);
-    }   // for n
+    }   // for i
 }   // updateTrackSectors
 
 //-----------------------------------------------------------------------------
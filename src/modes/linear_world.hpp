@@ -71,6 +71,12 @@ private:
     /* if set then the game will auto end after this time for networking */
     float       m_finish_timeout;
 
+    /** The karts whose track sector is updated in this time step, with
+     *  their positions and graph nodes (used to test all karts at once). */
+    std::vector<unsigned int> m_sector_karts;
+    std::vector<Vec3>         m_sector_xyz;
+    std::vector<int>          m_sector_nodes;
+
     /** This calculate the time difference between the second kart in the race
      *  (there must be at least two) and the first kart in the race
      *  (who must be a ghost).
@@ -73,6 +73,7 @@
 #include "states_screens/race_result_gui.hpp"
 #include "states_screens/state_manager.hpp"
 #include "tracks/check_manager.hpp"
+#include "tracks/graph.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "tracks/track_object.hpp"
@@ -90,6 +91,7 @@
 
 
 World* World::m_world[PT_COUNT];
+std::recursive_mutex World::m_loading_mutex;
 
 /** The main world class is used to handle the track and the karts.
  *  The end of the race is detected in two phases: first the (abstract)
@@ -157,6 +159,7 @@ World::World() : WorldStatus()
  */
 void World::init()
 {
+    std::unique_lock<std::recursive_mutex> loading = lockLoading();
     m_ended_early         = false;
     m_faster_music_active = false;
     m_fastest_kart        = 0;
@@ -206,6 +209,20 @@ void World::init()
     // This also defines the static Track::getCurrentTrack function.
     if (m_process_type == PT_MAIN)
         track->loadTrackModel(RaceManager::get()->getReverseTrack());
+    else if (STKProcess::hasIndependentChildren())
+    {
+        // The track in track manager is used by the main lobby, so load
+        // a separate copy
+        if (!track)
+        {
+            std::ostringstream msg;
+            msg << "Track '" << RaceManager::get()->getTrackName()
+                << "' not found.\n";
+            throw std::runtime_error(msg.str());
+        }
+        track = new Track(track->getFilename());
+        track->loadTrackModel(RaceManager::get()->getReverseTrack());
+    }
     else
     {
         Track* child_track = Track::getCurrentTrack();
@@ -233,6 +250,18 @@ void World::init()
         ReplayPlay::get()->load();
         for (unsigned int k = 0; k < gk; k++)
             m_karts.push_back(ReplayPlay::get()->getGhostKart(k));
+        if (UserConfigParams::m_sector_benchmark && Graph::get())
+        {
+            std::vector<std::vector<Vec3> > paths;
+            for (unsigned int k = 0; k < gk; k++)
+            {
+                paths.emplace_back();
+                for (const btTransform& t :
+                     ReplayPlay::get()->getGhostKart(k)->getAllTransforms())
+                    paths.back().push_back(t.getOrigin());
+            }
+            Graph::get()->benchmarkFindRoadSector(paths);
+        }
     }
     main_loop->renderGUI(6999);
 
@@ -274,8 +303,7 @@ void World::init()
     if (m_race_gui)
         m_race_gui->init();
 
-    if (m_process_type == PT_MAIN)
-        powerup_manager->computeWeightsForRace(RaceManager::get()->getNumberOfKarts());
+    powerup_manager->computeWeightsForRace(RaceManager::get()->getNumberOfKarts());
     main_loop->renderGUI(7200);
     if (m_process_type == PT_MAIN && UserConfigParams::m_particles_effects > 1)
     {
@@ -605,6 +633,7 @@ Controller* World::loadAIController(AbstractKart* kart)
 //-----------------------------------------------------------------------------
 World::~World()
 {
+    std::unique_lock<std::recursive_mutex> loading = lockLoading();
     if (m_process_type == PT_MAIN)
     {
         GUIEngine::getDevice()->setResizable(false);
@@ -677,7 +706,8 @@ World::~World()
 
     m_world[m_process_type] = NULL;
 
-    if (m_process_type == PT_MAIN)
+    // The scene of a multi-lobby server still has the tracks of other lobbies
+    if (m_process_type == PT_MAIN && !STKProcess::hasIndependentChildren())
         irr_driver->getSceneManager()->clear();
 
 #ifdef DEBUG
@@ -1176,6 +1206,8 @@ void World::update(int ticks)
 
     PROFILER_PUSH_CPU_MARKER("World::update (Kart::upate)", 0x40, 0x7F, 0x00);
 
+    castTerrainRays();
+
     // Update all the karts. This in turn will also update the controller,
     // which causes all AI steering commands set. So in the following
     // physics update the new steering is taken into account.
@@ -1208,6 +1240,40 @@ void World::update(int ticks)
 #endif
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Casts the rays that detect the terrain under the karts against the track
+ *  at once, before the karts are updated (see Physics::castTrackRays()).
+ *  Each kart uses the result in its update if its ray didn't change.
+ */
+void World::castTerrainRays()
+{
+    std::vector<TriangleMesh::Ray> rays;
+    std::vector<Kart*> karts;
+    rays.reserve(m_karts.size());
+    karts.reserve(m_karts.size());
+    for (unsigned int i = 0; i < m_karts.size(); i++)
+    {
+        // Only the karts which are updated in update()
+        SpareTireAI* sta =
+            dynamic_cast<SpareTireAI*>(m_karts[i]->getController());
+        if (m_karts[i]->isEliminated() && !(sta && sta->isMoving()))
+            continue;
+        Kart* kart = dynamic_cast<Kart*>(m_karts[i].get());
+        TriangleMesh::Ray ray;
+        if (!kart || kart->isGhostKart() ||
+            !kart->getTerrainRay(&ray.m_from, &ray.m_to))
+            continue;
+        rays.push_back(ray);
+        karts.push_back(kart);
+    }
+    if (rays.empty())
+        return;
+
+    Physics::get()->castTrackRays(&rays, (unsigned int)karts.size());
+    for (unsigned int i = 0; i < karts.size(); i++)
+        karts[i]->setPrefetchedTerrainRay(rays[i]);
+}   // castTerrainRays
+
 // ----------------------------------------------------------------------------
 /** Only updates the track. The order in which the various parts of STK are
  *  updated is quite important (i.e. the track can't be updated as part of
@@ -29,6 +29,7 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <stdexcept>
 
@@ -91,6 +92,9 @@ public:
 private:
     /** A pointer to the global world object for a race. */
     static World *m_world[PT_COUNT];
+
+    /** Serialises loading and unloading of worlds of multi-lobby servers. */
+    static std::recursive_mutex m_loading_mutex;
     // ------------------------------------------------------------------------
     void setAITeam();
     // ------------------------------------------------------------------------
@@ -190,6 +194,7 @@ protected:
     virtual void  update(int ticks) OVERRIDE;
     virtual void  createRaceGUI();
             void  updateTrack(int ticks);
+            void  castTerrainRays();
     // ------------------------------------------------------------------------
     /** Used for AI karts that are still racing when all player kart finished.
      *  Generally it should estimate the arrival time for those karts, but as
@@ -236,6 +241,18 @@ public:
     // ------------------------------------------------------------------------
     static void     clear() { memset(m_world, 0, sizeof(m_world)); }
     // ------------------------------------------------------------------------
+    /** The lobbies of a multi-lobby server share the scene, material and
+     *  file manager, so only one of them can load or unload a world at a
+     *  time. Returns an unlocked lock for other processes. */
+    static std::unique_lock<std::recursive_mutex> lockLoading()
+    {
+        std::unique_lock<std::recursive_mutex> ul(m_loading_mutex,
+            std::defer_lock);
+        if (STKProcess::hasIndependentChildren())
+            ul.lock();
+        return ul;
+    }
+    // ------------------------------------------------------------------------
 
     // Pure virtual functions
     // ======================
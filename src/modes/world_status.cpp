@@ -450,7 +450,7 @@ void WorldStatus::updateTime(int ticks)
     switch (m_clock_mode)
     {
         case CLOCK_CHRONO:
-            if (m_process_type == PT_CHILD || !device->getTimer()->isStopped())
+            if (m_process_type != PT_MAIN || !device->getTimer()->isStopped())
             {
                 m_time_ticks++;
                 m_time  = stk_config->ticks2Time(m_time_ticks);
@@ -464,12 +464,12 @@ void WorldStatus::updateTime(int ticks)
                 m_time_ticks = 0;
                 m_time = 0.0f;
                 // For rescue animation playing (if any) in result screen
-                if (m_process_type == PT_CHILD || !device->getTimer()->isStopped())
+                if (m_process_type != PT_MAIN || !device->getTimer()->isStopped())
                     m_count_up_ticks++;
                 break;
             }
 
-            if (m_process_type == PT_CHILD || !device->getTimer()->isStopped())
+            if (m_process_type != PT_MAIN || !device->getTimer()->isStopped())
             {
                 m_time_ticks--;
                 m_time = stk_config->ticks2Time(m_time_ticks);
@@ -26,6 +26,7 @@
 #include "network/race_event_manager.hpp"
 #include "network/server_config.hpp"
 #include "network/stk_host.hpp"
+#include "network/tick_profiler.hpp"
 #include "race/race_manager.hpp"
 #include "states_screens/state_manager.hpp"
 #include "utils/log.hpp"
@@ -77,7 +78,7 @@ float ChildLoop::getLimitedDt()
 void ChildLoop::run()
 {
     VS::setThreadName("ChildLoop");
-    STKProcess::init(PT_CHILD);
+    STKProcess::init(m_cl_config->m_process_type);
 
     GUIEngine::disableGraphics();
     RaceManager::create();
@@ -85,6 +86,14 @@ void ChildLoop::run()
     NetworkConfig::get()->setIsServer(true);
     if (m_cl_config->m_lan_server)
         NetworkConfig::get()->setIsLAN();
+    else if (STKProcess::hasIndependentChildren())
+    {
+        // The main lobby has detected the ip type already
+        NetworkConfig::get()->copyIPDetectionResult(
+            NetworkConfig::getByType(PT_MAIN));
+        NetworkConfig::get()->setIsWAN();
+        NetworkConfig::get()->setIsPublicServer();
+    }
     else
     {
         if (UserConfigParams::m_default_ip_type == NetworkConfig::IP_NONE)
@@ -135,6 +144,7 @@ void ChildLoop::run()
 
         for (int i = 0; i < num_steps; i++)
         {
+            TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_TICK);
             if (auto pm = ProtocolManager::lock())
                 pm->update(1);
 
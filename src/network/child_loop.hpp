@@ -18,6 +18,7 @@
 #ifndef HEADER_SERVER_LOOP_HPP
 #define HEADER_SERVER_LOOP_HPP
 
+#include "utils/stk_process.hpp"
 #include "utils/types.hpp"
 #include <atomic>
 #include <string>
@@ -28,6 +29,9 @@ struct ChildLoopConfig
     uint32_t m_login_id;
     std::string m_token;
     unsigned m_server_ai;
+    /** PT_CHILD for the server created from the gui, or one of the
+     *  additional lobbies of a multi-lobby server. */
+    ProcessType m_process_type = PT_CHILD;
 };
 
 class ChildLoop
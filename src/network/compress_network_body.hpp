@@ -25,9 +25,14 @@
 #include "LinearMath/btMotionState.h"
 #include "btBulletDynamicsCommon.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace CompressNetworkBody
 {
     using namespace MiniGLM;
+    /** Number of bytes written by compress into a string. */
+    const int COMPRESSED_SIZE = 3 * 4 + 4 + 6 * 2;
     // ------------------------------------------------------------------------
     /** Set body and motion state of bullet object with compressed values. */
     inline void setCompressedValues(float x, float y, float z,
@@ -101,6 +106,39 @@ namespace CompressNetworkBody
         setCompressedValues(x, y, z, compressed_q, lvx, lvy, lvz, avx, avy,
             avz, body, ms);
     }   // decompress
+    // ------------------------------------------------------------------------
+    /** Reads a compressed body from each string and compares them, used in
+     *  client to check if a confirmed state differs from the predicted one.
+     *  \param max_distance Maximum difference of the positions.
+     *  \param max_angle Maximum angle between the rotations in radian.
+     *  \param max_speed Maximum difference of each linear and angular
+     *         velocity component.
+     *  \return True if any difference is larger than the maximum.
+     */
+    inline bool isDiverged(const BareNetworkString* a,
+                           const BareNetworkString* b, float max_distance,
+                           float max_angle, float max_speed)
+    {
+        btVector3 pos_a, pos_b;
+        for (int i = 0; i < 3; i++)
+        {
+            pos_a[i] = a->getFloat();
+            pos_b[i] = b->getFloat();
+        }
+        btQuaternion q_a = decompressbtQuaternion(a->getUInt32());
+        btQuaternion q_b = decompressbtQuaternion(b->getUInt32());
+        bool diverged = (pos_a - pos_b).length2() > max_distance * max_distance
+            || 2.0f * acosf(std::min(fabsf(q_a.dot(q_b)), 1.0f)) > max_angle;
+        // Read all velocities so that both strings are after the body
+        for (int i = 0; i < 6; i++)
+        {
+            float v_a = toFloat32(a->getUInt16());
+            float v_b = toFloat32(b->getUInt16());
+            if (fabsf(v_a - v_b) > max_speed)
+                diverged = true;
+        }
+        return diverged;
+    }   // isDiverged
 };
 
 #endif // HEADER_COMPRESS_NETWORK_BODY_HPP
@@ -141,10 +141,12 @@ ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
 }   // encryptSend
 
 // ----------------------------------------------------------------------------
-NetworkString* Crypto::decryptRecieve(ENetPacket* p)
+/** Decrypts a received packet into ns, which keeps its allocated buffer. */
+void Crypto::decryptRecieve(ENetPacket* p, NetworkString* ns)
 {
     int clen = (int)(p->dataLength - 8);
-    auto ns = std::unique_ptr<NetworkString>(new NetworkString(p->data, clen));
+    ns->m_buffer.resize(clen);
+    ns->m_current_offset = 1;
 
     std::array<uint8_t, 12> iv = {};
     if (NetworkConfig::get()->isClient())
@@ -159,10 +161,6 @@ NetworkString* Crypto::decryptRecieve(ENetPacket* p)
     {
         throw std::runtime_error("Failed authentication.");
     }
-
-    NetworkString* result = ns.get();
-    ns.release();
-    return result;
 }   // decryptRecieve
 
 #endif
@@ -207,10 +207,12 @@ ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
 }   // encryptSend
 
 // ----------------------------------------------------------------------------
-NetworkString* Crypto::decryptRecieve(ENetPacket* p)
+/** Decrypts a received packet into ns, which keeps its allocated buffer. */
+void Crypto::decryptRecieve(ENetPacket* p, NetworkString* ns)
 {
     int clen = (int)(p->dataLength - 8);
-    auto ns = std::unique_ptr<NetworkString>(new NetworkString(p->data, clen));
+    ns->m_buffer.resize(clen);
+    ns->m_current_offset = 1;
 
     std::array<uint8_t, 12> iv = {};
     if (NetworkConfig::get()->isClient())
@@ -238,9 +240,7 @@ NetworkString* Crypto::decryptRecieve(ENetPacket* p)
     if (EVP_DecryptFinal_ex(m_decrypt, unused_16_blocks.data(), &dlen) > 0)
     {
         assert(dlen == 0);
-        NetworkString* result = ns.get();
-        ns.release();
-        return result;
+        return;
     }
     throw std::runtime_error("Failed to finalize decryption.");
 }   // decryptRecieve
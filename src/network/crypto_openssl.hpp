@@ -153,7 +153,7 @@ public:
     // ------------------------------------------------------------------------
     ENetPacket* encryptSend(BareNetworkString& ns, bool reliable);
     // ------------------------------------------------------------------------
-    NetworkString* decryptRecieve(ENetPacket* p);
+    void decryptRecieve(ENetPacket* p, NetworkString* ns);
 
 };
 
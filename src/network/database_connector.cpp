@@ -0,0 +1,410 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifdef ENABLE_SQLITE3
+
+#include "network/database_connector.hpp"
+
+#include "utils/log.hpp"
+#include "utils/stk_process.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+/** Maximum number of cached prepared statements, the least recently used
+ *  one is finalized when a new statement is added. */
+static const unsigned MAX_STATEMENTS = 64;
+
+/** Maximum number of jobs taken from the queue at once. */
+static const unsigned MAX_BATCH = 64;
+
+// ----------------------------------------------------------------------------
+/** Starts the database thread.
+ *  \param db The opened database, it is closed when the connector is
+ *  destroyed.
+ */
+DatabaseConnector::DatabaseConnector(sqlite3* db)
+{
+    m_db = db;
+    m_stop = false;
+    for (Histogram& h : m_histograms)
+    {
+        for (std::atomic<uint64_t>& b : h.m_buckets)
+            b.store(0);
+        h.m_count.store(0);
+        h.m_total_us.store(0);
+        h.m_run_us.store(0);
+        h.m_max_us.store(0);
+    }
+    ProcessType pt = STKProcess::getType();
+    m_thread = std::thread([this, pt]()
+        {
+            std::string thread_name = "DatabaseConn";
+            if (pt != PT_MAIN)
+                thread_name += StringUtils::toString(pt);
+            VS::setThreadName(thread_name.c_str());
+            STKProcess::init(pt);
+            while (true)
+            {
+                std::unique_lock<std::mutex> ul(m_jobs_mutex);
+                m_jobs_cv.wait(ul, [this]
+                    {
+                        return m_stop || !m_jobs.empty();
+                    });
+                if (m_jobs.empty())
+                    return;
+                std::list<Job> batch;
+                auto it = m_jobs.begin();
+                std::advance(it, std::min((size_t)MAX_BATCH, m_jobs.size()));
+                batch.splice(batch.end(), m_jobs, m_jobs.begin(), it);
+                ul.unlock();
+                runBatch(batch);
+            }
+        });
+}   // DatabaseConnector
+
+// ----------------------------------------------------------------------------
+/** Runs all remaining jobs (their callbacks are discarded) and closes the
+ *  database. */
+DatabaseConnector::~DatabaseConnector()
+{
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_stop = true;
+    m_jobs_cv.notify_one();
+    ul.unlock();
+    m_thread.join();
+    for (auto& p : m_statements)
+        sqlite3_finalize(p.second.first);
+    sqlite3_close(m_db);
+}   // ~DatabaseConnector
+
+// ----------------------------------------------------------------------------
+void DatabaseConnector::addJob(QueryType type, bool write,
+                               std::function<void()> run,
+                               std::function<void()> callback)
+{
+    Job job;
+    job.m_type = type;
+    job.m_write = write;
+    job.m_added_time = std::chrono::steady_clock::now();
+    job.m_run = run;
+    job.m_callback = callback;
+    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+    m_jobs.push_back(job);
+    m_jobs_cv.notify_one();
+}   // addJob
+
+// ----------------------------------------------------------------------------
+/** Adds a query which does not return any row, consecutive writes are run in
+ *  one transaction.
+ *  \param bind_function Optional function binding the values of the query,
+ *  only values which stay the same for each call should be written into
+ *  the query string so the prepared statement can be reused.
+ *  \param callback Optional function run by \ref handleCallbacks, it is told
+ *  if the query succeeded.
+ */
+void DatabaseConnector::addWrite(QueryType type, const std::string& query,
+                       std::function<void(sqlite3_stmt* stmt)> bind_function,
+                       std::function<void(bool)> callback)
+{
+    std::shared_ptr<bool> written = std::make_shared<bool>(false);
+    std::function<void()> done;
+    if (callback)
+        done = [callback, written]() { callback(*written); };
+    addJob(type, true/*write*/, [this, query, bind_function, written]()
+        {
+            *written = execute(query, bind_function);
+        }, done);
+}   // addWrite
+
+// ----------------------------------------------------------------------------
+/** Returns the cached prepared statement of a query, or prepares and caches
+ *  a new one. The cache keeps the most recently used statements, so queries
+ *  with values written into the string (like console commands) don't keep
+ *  out the frequent ones. */
+sqlite3_stmt* DatabaseConnector::getStatement(const std::string& query)
+{
+    auto it = m_statements.find(query);
+    if (it != m_statements.end())
+    {
+        m_statement_lru.splice(m_statement_lru.begin(), m_statement_lru,
+            it->second.second);
+        return it->second.first;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseConnector",
+            "Error preparing database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+    if (m_statements.size() >= MAX_STATEMENTS)
+    {
+        // A statement used by an outer query (in a row function) was used
+        // more recently, so it's never removed here
+        auto last = m_statements.find(*m_statement_lru.back());
+        sqlite3_finalize(last->second.first);
+        m_statement_lru.pop_back();
+        m_statements.erase(last);
+    }
+    auto ret = m_statements.emplace(query,
+        std::make_pair(stmt, m_statement_lru.end()));
+    m_statement_lru.push_front(&ret.first->first);
+    ret.first->second.second = m_statement_lru.begin();
+    return stmt;
+}   // getStatement
+
+// ----------------------------------------------------------------------------
+/** Runs a query with an optional function binding values and an optional
+ *  function called for each result row. It must be called in a job or with
+ *  the \ref lock held.
+ *  \return True if no error occurs.
+ */
+bool DatabaseConnector::execute(const std::string& query,
+                         std::function<void(sqlite3_stmt* stmt)> bind_function,
+                         std::function<void(sqlite3_stmt* stmt)> row_function)
+{
+    sqlite3_stmt* stmt = getStatement(query);
+    if (!stmt)
+        return false;
+    if (bind_function)
+        bind_function(stmt);
+    int ret = sqlite3_step(stmt);
+    while (ret == SQLITE_ROW)
+    {
+        if (row_function)
+            row_function(stmt);
+        ret = sqlite3_step(stmt);
+    }
+    bool result = ret == SQLITE_DONE;
+    if (!result)
+    {
+        Log::error("DatabaseConnector", "Error running query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return result;
+}   // execute
+
+// ----------------------------------------------------------------------------
+void DatabaseConnector::runJob(const Job& job)
+{
+    auto start = std::chrono::steady_clock::now();
+    job.m_run();
+    auto end = std::chrono::steady_clock::now();
+    uint64_t run_us = std::chrono::duration_cast<std::chrono::microseconds>
+        (end - start).count();
+    uint64_t total_us = std::chrono::duration_cast<std::chrono::microseconds>
+        (end - job.m_added_time).count();
+
+    Histogram& h = m_histograms[job.m_type];
+    unsigned bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS - 1 && total_us >= (1ull << bucket))
+        bucket++;
+    h.m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    h.m_count.fetch_add(1, std::memory_order_relaxed);
+    h.m_total_us.fetch_add(total_us, std::memory_order_relaxed);
+    h.m_run_us.fetch_add(run_us, std::memory_order_relaxed);
+    // Only written by the database thread
+    if (total_us > h.m_max_us.load(std::memory_order_relaxed))
+        h.m_max_us.store(total_us, std::memory_order_relaxed);
+}   // runJob
+
+// ----------------------------------------------------------------------------
+/** Runs jobs taken from the queue, consecutive writes are wrapped in a
+ *  transaction so they only need one disk sync. */
+void DatabaseConnector::runBatch(std::list<Job>& batch)
+{
+    std::unique_lock<std::mutex> ul(m_db_mutex);
+    auto it = batch.begin();
+    while (it != batch.end())
+    {
+        auto last = it;
+        while (last != batch.end() && last->m_write)
+            last++;
+        if (last == it)
+        {
+            runJob(*it++);
+            continue;
+        }
+        const bool transaction = std::distance(it, last) > 1 &&
+            sqlite3_exec(m_db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+        for (auto job = it; job != last; job++)
+            runJob(*job);
+        if (transaction &&
+            sqlite3_exec(m_db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK)
+        {
+            Log::error("DatabaseConnector", "Error committing writes: %s",
+                sqlite3_errmsg(m_db));
+            sqlite3_exec(m_db, "ROLLBACK;", NULL, NULL, NULL);
+        }
+        it = last;
+    }
+    ul.unlock();
+
+    std::lock_guard<std::mutex> lock(m_callbacks_mutex);
+    for (Job& job : batch)
+    {
+        if (job.m_callback)
+            m_callbacks.push_back(job.m_callback);
+    }
+}   // runBatch
+
+// ----------------------------------------------------------------------------
+/** Runs the callbacks of finished jobs, called by the asynchronous thread of
+ *  the lobby. */
+void DatabaseConnector::handleCallbacks()
+{
+    std::vector<std::function<void()> > callbacks;
+    std::unique_lock<std::mutex> ul(m_callbacks_mutex);
+    if (m_callbacks.empty())
+        return;
+    std::swap(callbacks, m_callbacks);
+    ul.unlock();
+    for (auto& callback : callbacks)
+        callback();
+}   // handleCallbacks
+
+// ----------------------------------------------------------------------------
+const char* DatabaseConnector::getQueryTypeName(QueryType type)
+{
+    switch (type)
+    {
+    case QT_BAN_CHECK:     return "ban check";
+    case QT_GEOLOCATION:   return "geolocation";
+    case QT_SERVER_STATS:  return "server stats";
+    case QT_PLAYER_REPORT: return "player report";
+    case QT_POLL:          return "poll";
+    case QT_CONSOLE:       return "console";
+    default:               return "unknown";
+    }
+}   // getQueryTypeName
+
+// ----------------------------------------------------------------------------
+/** Returns the latency (from adding a job until it is finished) histogram
+ *  and the average running time of each query type. */
+std::string DatabaseConnector::getStats() const
+{
+    std::ostringstream oss;
+    for (unsigned i = 0; i < QT_COUNT; i++)
+    {
+        const Histogram& h = m_histograms[i];
+        uint64_t count = h.m_count.load();
+        if (count == 0)
+            continue;
+        oss << getQueryTypeName((QueryType)i) << ": " << count <<
+            " jobs, average latency (ms): " <<
+            (float)h.m_total_us.load() / 1000.0f / (float)count <<
+            ", average running time (ms): " <<
+            (float)h.m_run_us.load() / 1000.0f / (float)count <<
+            ", max latency (ms): " << (float)h.m_max_us.load() / 1000.0f <<
+            "\n";
+        for (unsigned j = 0; j < HISTOGRAM_BUCKETS; j++)
+        {
+            uint64_t n = h.m_buckets[j].load();
+            if (n == 0)
+                continue;
+            if (j == HISTOGRAM_BUCKETS - 1)
+            {
+                oss << "    >= " << (float)(1ull << (j - 1)) / 1000.0f <<
+                    " ms: " << n << "\n";
+            }
+            else
+            {
+                oss << "    < " << (float)(1ull << j) / 1000.0f <<
+                    " ms: " << n << "\n";
+            }
+        }
+    }
+    if (oss.str().empty())
+        oss << "No database jobs\n";
+    return oss.str();
+}   // getStats
+
+// ----------------------------------------------------------------------------
+/** Checks with an in-memory database that queued writes and queries are run
+ *  in order, that the callbacks are run by handleCallbacks and that one-off
+ *  queries don't remove a frequently used statement from the cache. */
+void DatabaseConnector::unitTesting()
+{
+    sqlite3* db = NULL;
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK)
+        Log::fatal("DatabaseConnector", "Cannot open in-memory database.");
+    DatabaseConnector* dc = new DatabaseConnector(db);
+    dc->addWrite(QT_CONSOLE, "CREATE TABLE test (value INTEGER);");
+    int written = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        dc->addWrite(QT_SERVER_STATS, "INSERT INTO test (value) VALUES (?);",
+            [i](sqlite3_stmt* stmt) { sqlite3_bind_int(stmt, 1, i); },
+            [&written](bool success)
+            {
+                if (success)
+                    written++;
+            });
+    }
+    std::shared_ptr<int> sum = std::make_shared<int>(-1);
+    bool finished = false;
+    dc->addQuery(QT_CONSOLE, [dc, sum]()
+        {
+            dc->execute("SELECT SUM(value) FROM test;", nullptr,
+                [sum](sqlite3_stmt* stmt)
+                {
+                    *sum = sqlite3_column_int(stmt, 0);
+                });
+        }, [&finished]() { finished = true; });
+
+    uint64_t timeout = StkTime::getMonoTimeMs() + 10000;
+    while (!finished && StkTime::getMonoTimeMs() < timeout)
+    {
+        dc->handleCallbacks();
+        StkTime::sleep(1);
+    }
+    if (!finished || written != 100 || *sum != 4950)
+    {
+        Log::fatal("DatabaseConnector", "Jobs failed: finished %d, written "
+            "%d, sum %d.", finished, written, *sum);
+    }
+    if (dc->m_histograms[QT_SERVER_STATS].m_count.load() != 100)
+        Log::fatal("DatabaseConnector", "Wrong number of timed jobs.");
+
+    const std::string insert = "INSERT INTO test (value) VALUES (?);";
+    {
+        std::unique_lock<std::mutex> ul = dc->lock();
+        for (unsigned i = 0; i < MAX_STATEMENTS * 2; i++)
+        {
+            dc->execute(insert, [](sqlite3_stmt* stmt)
+                { sqlite3_bind_int(stmt, 1, 0); });
+            dc->execute("SELECT value FROM test WHERE value = " +
+                StringUtils::toString(i) + ";");
+        }
+    }
+    if (dc->m_statements.size() != MAX_STATEMENTS ||
+        dc->m_statement_lru.size() != MAX_STATEMENTS ||
+        dc->m_statements.find(insert) == dc->m_statements.end())
+        Log::fatal("DatabaseConnector", "Wrong cached statements.");
+    delete dc;
+}   // unitTesting
+
+#endif
@@ -0,0 +1,167 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_DATABASE_CONNECTOR_HPP
+#define HEADER_DATABASE_CONNECTOR_HPP
+
+#ifdef ENABLE_SQLITE3
+
+#include "utils/no_copy.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+/** Runs the sqlite queries of the server lobby in a separate thread, so a
+ *  slow disk or a large table never stalls the protocol threads. Jobs are
+ *  run in the order they are added, consecutive writes are batched into one
+ *  transaction. A job can have a callback which is run later in the thread
+ *  calling \ref handleCallbacks (the asynchronous thread of the lobby), so it
+ *  can safely use the lobby and its peers.
+ */
+class DatabaseConnector : public NoCopy
+{
+public:
+    /** Type of query, used for the latency statistics. */
+    enum QueryType : unsigned int
+    {
+        QT_BAN_CHECK = 0,
+        QT_GEOLOCATION,
+        QT_SERVER_STATS,
+        QT_PLAYER_REPORT,
+        QT_POLL,
+        QT_CONSOLE,
+        QT_COUNT
+    };
+
+    /** Latency buckets, bucket i counts the jobs which took less than
+     *  2^i microseconds, the last one counts all slower jobs. */
+    static const unsigned HISTOGRAM_BUCKETS = 24;
+
+private:
+    struct Job
+    {
+        QueryType m_type;
+
+        /** Writes are grouped into transactions. */
+        bool m_write;
+
+        std::chrono::steady_clock::time_point m_added_time;
+
+        std::function<void()> m_run;
+
+        std::function<void()> m_callback;
+    };
+
+    struct Histogram
+    {
+        std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> m_buckets;
+        std::atomic<uint64_t> m_count, m_total_us, m_run_us, m_max_us;
+    };
+
+    sqlite3* m_db;
+
+    std::thread m_thread;
+
+    /** Held by the worker thread while running jobs, see \ref lock. */
+    std::mutex m_db_mutex;
+
+    std::mutex m_jobs_mutex;
+
+    std::condition_variable m_jobs_cv;
+
+    std::list<Job> m_jobs;
+
+    /** Set when the connector is destroyed, protected by m_jobs_mutex. */
+    bool m_stop;
+
+    std::mutex m_callbacks_mutex;
+
+    std::vector<std::function<void()> > m_callbacks;
+
+    /** Queries of the cached statements, the most recently used first. */
+    std::list<const std::string*> m_statement_lru;
+
+    /** Prepared statements for each query with their position in
+     *  m_statement_lru, only used with m_db_mutex. */
+    std::map<std::string, std::pair<sqlite3_stmt*,
+        std::list<const std::string*>::iterator> > m_statements;
+
+    Histogram m_histograms[QT_COUNT];
+
+    // ------------------------------------------------------------------------
+    void addJob(QueryType type, bool write, std::function<void()> run,
+                std::function<void()> callback);
+    // ------------------------------------------------------------------------
+    void runJob(const Job& job);
+    // ------------------------------------------------------------------------
+    void runBatch(std::list<Job>& batch);
+    // ------------------------------------------------------------------------
+    sqlite3_stmt* getStatement(const std::string& query);
+
+public:
+    DatabaseConnector(sqlite3* db);
+    // ------------------------------------------------------------------------
+    ~DatabaseConnector();
+    // ------------------------------------------------------------------------
+    /** Adds a job run by the database thread, the callback (if any) is run
+     *  by \ref handleCallbacks after it. */
+    void addQuery(QueryType type, std::function<void()> run,
+                  std::function<void()> callback = nullptr)
+                            { addJob(type, false/*write*/, run, callback); }
+    // ------------------------------------------------------------------------
+    void addWrite(QueryType type, const std::string& query,
+                  std::function<void(sqlite3_stmt* stmt)> bind_function =
+                  nullptr, std::function<void(bool)> callback = nullptr);
+    // ------------------------------------------------------------------------
+    bool execute(const std::string& query,
+                 std::function<void(sqlite3_stmt* stmt)> bind_function =
+                 nullptr,
+                 std::function<void(sqlite3_stmt* stmt)> row_function =
+                 nullptr);
+    // ------------------------------------------------------------------------
+    void handleCallbacks();
+    // ------------------------------------------------------------------------
+    /** Locks the database for a synchronous query in the calling thread, no
+     *  job is run until the lock is released. */
+    std::unique_lock<std::mutex> lock()
+    {
+        return std::unique_lock<std::mutex>(m_db_mutex);
+    }   // lock
+    // ------------------------------------------------------------------------
+    std::string getStats() const;
+    // ------------------------------------------------------------------------
+    static const char* getQueryTypeName(QueryType type);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // DatabaseConnector
+
+#endif
+
+#endif
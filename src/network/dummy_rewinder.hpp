@@ -29,7 +29,7 @@ class DummyRewinder : public Rewinder, public EventRewinder
 {
 public:
     // -------------------------------------------------------------------------
-    BareNetworkString* saveState(std::vector<std::string>* ru)  { return NULL; }
+    BareNetworkString* saveState()                            { return NULL; }
     // -------------------------------------------------------------------------
     virtual void undoEvent(BareNetworkString* s)                              {}
     // -------------------------------------------------------------------------
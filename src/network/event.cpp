@@ -24,7 +24,25 @@
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 
+#include <mutex>
 #include <string.h>
+#include <vector>
+
+// ============================================================================
+/** Events and the strings of received messages are created in the listening
+ *  thread and deleted in other threads many times per second, so they are
+ *  kept for reuse instead of being freed. */
+static std::mutex g_pool_mutex;
+static std::vector<void*> g_pooled_events;
+static std::vector<NetworkString*> g_pooled_strings;
+/** Limits of the pool, larger strings are freed. */
+static const unsigned MAX_POOLED = 256;
+static const size_t MAX_POOLED_CAPACITY = 2048;
+
+std::atomic<uint64_t> Event::m_events_allocated(0);
+std::atomic<uint64_t> Event::m_events_reused(0);
+std::atomic<uint64_t> Event::m_strings_allocated(0);
+std::atomic<uint64_t> Event::m_strings_reused(0);
 
 /** \brief Constructor
  *  \param event : The event that needs to be translated.
@@ -44,6 +62,7 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
     m_arrival_time = StkTime::getMonoTimeMs();
     m_pdi = PDI_TIMEOUT;
     m_peer = peer;
+    m_data = NULL;
 
     switch (event->type)
     {
@@ -75,19 +94,28 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
         {
             throw std::runtime_error("Unencrypted content at wrong state.");
         }
-        if (m_peer->getCrypto() && (event->channelID == EVENT_CHANNEL_NORMAL ||
-            event->channelID == EVENT_CHANNEL_DATA_TRANSFER))
+        NetworkString* ns = getPooledString();
+        try
         {
-            m_data = m_peer->getCrypto()->decryptRecieve(event->packet);
+            if (m_peer->getCrypto() &&
+                (event->channelID == EVENT_CHANNEL_NORMAL ||
+                event->channelID == EVENT_CHANNEL_DATA_TRANSFER))
+            {
+                m_peer->getCrypto()->decryptRecieve(event->packet, ns);
+            }
+            else
+            {
+                ns->setReceived(event->packet->data,
+                    (int)event->packet->dataLength);
+            }
         }
-        else
+        catch (...)
         {
-            m_data = new NetworkString(event->packet->data, 
-                (int)event->packet->dataLength);
+            releasePooledString(ns);
+            throw;
         }
+        m_data = ns;
     }
-    else
-        m_data = NULL;
 
     if (event->packet)
     {
@@ -102,6 +130,92 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
  */
 Event::~Event()
 {
-    delete m_data;
+    if (m_data)
+        releasePooledString(m_data);
 }   // ~Event
 
+// ----------------------------------------------------------------------------
+/** Takes the memory of an event from the pool if possible. */
+void* Event::operator new(size_t size)
+{
+    assert(size == sizeof(Event));
+    std::unique_lock<std::mutex> ul(g_pool_mutex);
+    if (!g_pooled_events.empty())
+    {
+        void* ptr = g_pooled_events.back();
+        g_pooled_events.pop_back();
+        ul.unlock();
+        m_events_reused.fetch_add(1, std::memory_order_relaxed);
+        return ptr;
+    }
+    ul.unlock();
+    m_events_allocated.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+/** Returns the memory of an event to the pool, or frees it if the pool is
+ *  full. */
+void Event::operator delete(void* ptr)
+{
+    if (!ptr)
+        return;
+    std::unique_lock<std::mutex> ul(g_pool_mutex);
+    if (g_pooled_events.size() < MAX_POOLED)
+    {
+        g_pooled_events.push_back(ptr);
+        return;
+    }
+    ul.unlock();
+    ::operator delete(ptr);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+/** Returns a string for a received message, its content will be replaced.
+ */
+NetworkString* Event::getPooledString()
+{
+    std::unique_lock<std::mutex> ul(g_pool_mutex);
+    if (!g_pooled_strings.empty())
+    {
+        NetworkString* ns = g_pooled_strings.back();
+        g_pooled_strings.pop_back();
+        ul.unlock();
+        m_strings_reused.fetch_add(1, std::memory_order_relaxed);
+        return ns;
+    }
+    ul.unlock();
+    m_strings_allocated.fetch_add(1, std::memory_order_relaxed);
+    return new NetworkString(PROTOCOL_NONE, MAX_POOLED_CAPACITY / 8);
+}   // getPooledString
+
+// ----------------------------------------------------------------------------
+/** Keeps the string (and its buffer) for later messages if the pool is not
+ *  full and the buffer is not too big. */
+void Event::releasePooledString(NetworkString* ns)
+{
+    if (ns->getBuffer().capacity() <= MAX_POOLED_CAPACITY)
+    {
+        std::lock_guard<std::mutex> lock(g_pool_mutex);
+        if (g_pooled_strings.size() < MAX_POOLED)
+        {
+            g_pooled_strings.push_back(ns);
+            return;
+        }
+    }
+    delete ns;
+}   // releasePooledString
+
+// ----------------------------------------------------------------------------
+/** Frees all pooled events and strings, called when STKHost is destroyed. */
+void Event::clearPool()
+{
+    std::lock_guard<std::mutex> lock(g_pool_mutex);
+    for (void* ptr : g_pooled_events)
+        ::operator delete(ptr);
+    g_pooled_events.clear();
+    for (NetworkString* ns : g_pooled_strings)
+        delete ns;
+    g_pooled_strings.clear();
+}   // clearPool
+
@@ -30,6 +30,7 @@
 
 #include "enet/enet.h"
 
+#include <atomic>
 #include <memory>
 
 class STKPeer;
@@ -89,9 +90,24 @@ private:
     /** For disconnection event, a bit more info is provided. */
     PeerDisconnectInfo m_pdi;
 
+    static NetworkString* getPooledString();
+    static void releasePooledString(NetworkString* ns);
+
 public:
+    /** Number of events and received message strings which had to be
+     *  allocated and which were reused from the pool, shown in the network
+     *  console. */
+    static std::atomic<uint64_t> m_events_allocated, m_events_reused,
+        m_strings_allocated, m_strings_reused;
+
          Event(ENetEvent* event, std::shared_ptr<STKPeer> peer);
         ~Event();
+    // ------------------------------------------------------------------------
+    static void* operator new(size_t size);
+    // ------------------------------------------------------------------------
+    static void operator delete(void* ptr);
+    // ------------------------------------------------------------------------
+    static void clearPool();
 
     // ------------------------------------------------------------------------
     /** Returns the type of this event. */
@@ -20,6 +20,7 @@
 
 #include "config/player_manager.hpp"
 #include "config/user_config.hpp"
+#include "modes/world.hpp"
 #ifdef DEBUG
 #include "network/network_config.hpp"
 #endif
@@ -64,6 +65,12 @@ GameSetup::GameSetup()
     const std::string& server_name = ServerConfig::m_server_name;
     m_server_name_utf8 = StringUtils::wideToUtf8
         (StringUtils::xmlDecode(server_name));
+    // Additional lobbies of a multi-lobby server are numbered from 2
+    if (STKProcess::hasIndependentChildren() && STKProcess::isChild())
+    {
+        m_server_name_utf8 += " " + StringUtils::toString(
+            STKProcess::getType() - PT_CHILD + 2);
+    }
     m_extra_server_info = -1;
     m_is_grand_prix.store(false);
     reset();
@@ -75,6 +82,8 @@ void GameSetup::loadWorld()
     // Notice: for arena (battle / soccer) lap and reverse will be mapped to
     // goals / time limit and random item location
     assert(!m_tracks.empty());
+    // The user config below is shared by all lobbies of a multi-lobby server
+    std::unique_lock<std::recursive_mutex> loading = World::lockLoading();
     // Disable accidentally unlocking of a challenge
     if (STKProcess::getType() == PT_MAIN && PlayerManager::getCurrentPlayer())
         PlayerManager::getCurrentPlayer()->setCurrentChallenge("");
@@ -0,0 +1,101 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/ip_range_index.hpp"
+#include "network/stk_ipv6.hpp"
+
+#include <cassert>
+
+// ----------------------------------------------------------------------------
+void IPRangeIndexUtils::unitTesting()
+{
+    typedef IPRangeIndex<uint32_t> Index;
+    Index empty;
+    assert(empty.find(0) == -1);
+    assert(empty.getNumSegments() == 0);
+
+    // Overlapping ranges, the one with the largest start wins
+    std::vector<Index::Range> ranges;
+    ranges.push_back({ 100, 200, 0 });
+    ranges.push_back({ 150, 160, 1 });
+    ranges.push_back({ 155, 300, 2 });
+    ranges.push_back({ 500, 400, 3 });
+    Index i1(ranges);
+    assert(i1.find(99) == -1);
+    assert(i1.find(100) == 0);
+    assert(i1.find(149) == 0);
+    assert(i1.find(150) == 1);
+    assert(i1.find(154) == 1);
+    assert(i1.find(155) == 2);
+    assert(i1.find(200) == 2);
+    assert(i1.find(300) == 2);
+    assert(i1.find(301) == -1);
+    assert(i1.find(450) == -1);
+
+    // Inner range ending before the outer one
+    ranges.clear();
+    ranges.push_back({ 10, 100, 0 });
+    ranges.push_back({ 20, 30, 1 });
+    Index i2(ranges);
+    assert(i2.find(19) == 0);
+    assert(i2.find(25) == 1);
+    assert(i2.find(31) == 0);
+    assert(i2.find(100) == 0);
+    assert(i2.find(101) == -1);
+    assert(i2.getNumSegments() == 4);
+
+    // Same start, the later range wins, adjacent segments are merged
+    ranges.clear();
+    ranges.push_back({ 0, 9, 0 });
+    ranges.push_back({ 0, 19, 1 });
+    ranges.push_back({ 20, 29, 1 });
+    Index i3(ranges);
+    assert(i3.find(0) == 1);
+    assert(i3.find(25) == 1);
+    assert(i3.getNumSegments() == 2);
+
+    // Range ending at the largest address
+    ranges.clear();
+    ranges.push_back({ 0xffffff00, 0xffffffff, 7 });
+    Index i4(ranges);
+    assert(i4.find(0xfffffeff) == -1);
+    assert(i4.find(0xffffffff) == 7);
+
+    IPv6Key start, end, key;
+    assert(getIPv6CIDRRange("2001:db8::/32", &start, &end));
+    assert(start.first == 0x20010db800000000ULL && start.second == 0);
+    assert(end.first == 0x20010db8ffffffffULL && end.second == ~0ULL);
+    assert(getIPv6CIDRRange("2001:db8::1/128", &start, &end));
+    assert(start == end && start.second == 1);
+    assert(getIPv6CIDRRange("2001:db8:0:0:8000::/65", &start, &end));
+    assert(start.second == 0x8000000000000000ULL && end.second == ~0ULL);
+    assert(!getIPv6CIDRRange("2001:db8::", &start, &end));
+    assert(!getIPv6CIDRRange("2001:db8::/0", &start, &end));
+
+    std::vector<IPRangeIndex<IPv6Key>::Range> ranges6;
+    getIPv6CIDRRange("2001:db8::/32", &start, &end);
+    ranges6.push_back({ start, end, 0 });
+    getIPv6CIDRRange("2001:db8:1::/48", &start, &end);
+    ranges6.push_back({ start, end, 1 });
+    IPRangeIndex<IPv6Key> i5(ranges6);
+    assert(getIPv6Key("2001:db8:1::5", &key) && i5.find(key) == 1);
+    assert(getIPv6Key("2001:db8:2::5", &key) && i5.find(key) == 0);
+    assert(getIPv6Key("2001:db9::", &key) && i5.find(key) == -1);
+    assert(getIPv6Key("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", &key));
+    assert(key.first == ~0ULL && key.second == ~0ULL && i5.find(key) == -1);
+}   // unitTesting
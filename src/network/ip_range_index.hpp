@@ -0,0 +1,148 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_IP_RANGE_INDEX_HPP
+#define HEADER_IP_RANGE_INDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <utility>
+#include <vector>
+
+/** An IPv6 address as upper and lower 64 bits, so it is ordered. */
+typedef std::pair<uint64_t, uint64_t> IPv6Key;
+
+namespace IPRangeIndexUtils
+{
+    // ------------------------------------------------------------------------
+    /** Sets next to the key after v, returns false if v is the largest. */
+    inline bool next(uint32_t v, uint32_t* n)
+    {
+        *n = v + 1;
+        return v != std::numeric_limits<uint32_t>::max();
+    }   // next
+    // ------------------------------------------------------------------------
+    inline bool next(uint64_t v, uint64_t* n)
+    {
+        *n = v + 1;
+        return v != std::numeric_limits<uint64_t>::max();
+    }   // next
+    // ------------------------------------------------------------------------
+    inline bool next(const IPv6Key& v, IPv6Key* n)
+    {
+        n->second = v.second + 1;
+        n->first = n->second == 0 ? v.first + 1 : v.first;
+        return v.first != std::numeric_limits<uint64_t>::max() ||
+            v.second != std::numeric_limits<uint64_t>::max();
+    }   // next
+    // ------------------------------------------------------------------------
+    void unitTesting();
+}   // namespace IPRangeIndexUtils
+
+/** An immutable index of (possibly overlapping) address ranges, each with a
+ *  value. The ranges are flattened into sorted disjoint segments when it is
+ *  built, so a lookup is a binary search. If several ranges contain an
+ *  address the one with the largest start wins (the same as ordering by
+ *  start descending in sql), for the same start the later one wins.
+ */
+template<typename T>
+class IPRangeIndex
+{
+public:
+    struct Range
+    {
+        T m_start;
+        T m_end;
+        int m_value;
+    };
+
+private:
+    /** Start of each segment, a segment ends before the next one starts. */
+    std::vector<T> m_starts;
+
+    /** Value of each segment, -1 if no range contains it. */
+    std::vector<int> m_values;
+
+public:
+    // ------------------------------------------------------------------------
+    /** Creates an empty index. */
+    IPRangeIndex() {}
+    // ------------------------------------------------------------------------
+    /** Builds the index, ranges with start after end are ignored. */
+    IPRangeIndex(const std::vector<Range>& ranges)
+    {
+        struct Point
+        {
+            T m_key;
+            bool m_add;
+            size_t m_range;
+            bool operator<(const Point& other) const
+                                             { return m_key < other.m_key; }
+        };
+        std::vector<Point> points;
+        points.reserve(ranges.size() * 2);
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            const Range& r = ranges[i];
+            if (r.m_end < r.m_start)
+                continue;
+            points.push_back({ r.m_start, true, i });
+            T after;
+            if (IPRangeIndexUtils::next(r.m_end, &after))
+                points.push_back({ after, false, i });
+        }
+        std::stable_sort(points.begin(), points.end());
+
+        // Ranges containing the current segment, the last one wins
+        std::set<std::pair<T, size_t> > active;
+        size_t i = 0;
+        while (i < points.size())
+        {
+            const T key = points[i].m_key;
+            for (; i < points.size() && !(key < points[i].m_key); i++)
+            {
+                const Range& r = ranges[points[i].m_range];
+                if (points[i].m_add)
+                    active.insert(std::make_pair(r.m_start, points[i].m_range));
+                else
+                    active.erase(std::make_pair(r.m_start, points[i].m_range));
+            }
+            int value = active.empty() ?
+                -1 : ranges[active.rbegin()->second].m_value;
+            if (!m_values.empty() && m_values.back() == value)
+                continue;
+            m_starts.push_back(key);
+            m_values.push_back(value);
+        }
+    }   // IPRangeIndex
+    // ------------------------------------------------------------------------
+    /** Returns the value of the range containing key, or -1. */
+    int find(const T& key) const
+    {
+        auto it = std::upper_bound(m_starts.begin(), m_starts.end(), key);
+        if (it == m_starts.begin())
+            return -1;
+        return m_values[it - m_starts.begin() - 1];
+    }   // find
+    // ------------------------------------------------------------------------
+    size_t getNumSegments() const                   { return m_starts.size(); }
+};   // IPRangeIndex
+
+#endif
@@ -309,6 +309,15 @@ public:
     const std::array<uint32_t, 8>& getNAT64PrefixData() const
                                                 { return m_nat64_prefix_data; }
     // ------------------------------------------------------------------------
+    /** Uses the ip detection result of another process, so the lobbies of a
+     *  multi-lobby server don't query the stun servers again. */
+    void copyIPDetectionResult(const NetworkConfig* other)
+    {
+        m_ip_type.store(other->getIPType());
+        m_nat64_prefix = other->m_nat64_prefix;
+        m_nat64_prefix_data = other->m_nat64_prefix_data;
+    }   // copyIPDetectionResult
+    // ------------------------------------------------------------------------
     void initClientPort();
     // ------------------------------------------------------------------------
     void setNumFixedAI(unsigned num)                  { m_num_fixed_ai = num; }
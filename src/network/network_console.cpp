@@ -16,12 +16,15 @@
 //  along with this program; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include "network/event.hpp"
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
 #include "network/server_config.hpp"
 #include "network/socket_address.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
+#include "network/tick_profiler.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
@@ -53,6 +56,21 @@ void showHelp()
     std::cout << "listpeers, List all peers with host ID and IP." << std::endl;
     std::cout << "listban, List IP ban list of server." << std::endl;
     std::cout << "speedstats, Show upload and download speed." << std::endl;
+    std::cout << "deltastats, Show bytes saved by delta states for each peer."
+        << std::endl;
+    std::cout << "relevancystats, Show bytes saved and time used by filtering "
+        "states for each peer." << std::endl;
+    std::cout << "poolstats, Show allocated and reused events and received "
+        "messages." << std::endl;
+    std::cout << "dbstats, Show the latency of database queries." << std::endl;
+    std::cout << "dbbenchmark #, Compare # ban and geolocation lookups with "
+        "queries and with the in memory index." << std::endl;
+    std::cout << "tickstats, Show the time per tick used by each part of the "
+        "server." << std::endl;
+    std::cout << "ticktrace #, Trace each part of the next # ticks for "
+        "tickexport." << std::endl;
+    std::cout << "tickexport, Write the tick histograms and the trace to the "
+        "server config directory." << std::endl;
 }   // showHelp
 
 // ----------------------------------------------------------------------------
@@ -178,6 +196,76 @@ void mainLoop(STKHost* host)
                 "   Download speed (KBps): " <<
                 (float)host->getDownloadSpeed() / 1024.0f  << std::endl;
         }
+        else if (str == "deltastats")
+        {
+            auto peers = host->getPeers();
+            if (peers.empty())
+                std::cout << "No peers exist" << std::endl;
+            for (unsigned int i = 0; i < peers.size(); i++)
+            {
+                std::cout << peers[i]->getHostId() << ": " <<
+                    peers[i]->getAddress().toString() << " saved (KB): " <<
+                    (float)peers[i]->getStateBytesSaved() / 1024.0f <<
+                    std::endl;
+            }
+        }
+        else if (str == "relevancystats")
+        {
+            auto gp = GameProtocol::lock();
+            if (!gp)
+            {
+                std::cout << "No game running" << std::endl;
+                continue;
+            }
+            const StateRelevancy& sr = gp->getStateRelevancy();
+            uint64_t full = sr.getFullBytes();
+            uint64_t sent = sr.getSentBytes();
+            std::cout << "Full states (KB): " << (float)full / 1024.0f <<
+                ", filtered states (KB): " << (float)sent / 1024.0f <<
+                ", saved: " << (full == 0 ? 0.0f :
+                100.0f * (float)(full - sent) / (float)full) << "%" <<
+                ", filtering time (ms): " <<
+                (float)sr.getFilterTimeUs() / 1000.0f << std::endl;
+        }
+        else if (str == "poolstats")
+        {
+            std::cout << "Events allocated: " <<
+                Event::m_events_allocated.load() << ", reused: " <<
+                Event::m_events_reused.load() <<
+                ", received messages allocated: " <<
+                Event::m_strings_allocated.load() << ", reused: " <<
+                Event::m_strings_reused.load() << std::endl;
+        }
+        else if (str == "dbstats")
+        {
+            auto sl = LobbyProtocol::get<ServerLobby>();
+            if (sl)
+                sl->printDatabaseStats();
+        }
+        else if (str == "dbbenchmark")
+        {
+            auto sl = LobbyProtocol::get<ServerLobby>();
+            if (sl)
+                sl->benchmarkDatabaseIndex(number > 0 ? number : 10000);
+        }
+        else if (str == "tickstats")
+        {
+            std::cout << TickProfiler::getSummaryOfAll();
+        }
+        else if (str == "ticktrace")
+        {
+            TickProfiler::startTraceOfAll(number > 0 ? number : 1000);
+        }
+        else if (str == "tickexport")
+        {
+            const std::string dir = ServerConfig::getConfigDirectory();
+            if (TickProfiler::writeJSONOfAll(dir + "/tick_profile.json") &&
+                TickProfiler::writeChromeTraceOfAll(dir + "/tick_trace.json"))
+            {
+                std::cout << "Written tick_profile.json and tick_trace.json "
+                    "to " << dir << std::endl;
+            }
+        }
         else
         {
             std::cout << "Unknown command: " << str << std::endl;
@@ -442,6 +442,14 @@ public:
         m_current_offset = 1;   // ignore type
     }   // NetworkString
 
+    // ------------------------------------------------------------------------
+    /** Replaces the content with a received message like the constructor
+     *  above, but reuses the allocated buffer. */
+    void setReceived(const uint8_t *data, int len)
+    {
+        m_buffer.assign(data, data + len);
+        m_current_offset = 1;   // ignore type
+    }   // setReceived
     // ------------------------------------------------------------------------
     /** Empties the string, but does not reset the pre-allocated size. */
     void clear()
@@ -26,6 +26,7 @@
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
+#include "utils/string_utils.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 
@@ -56,6 +57,8 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
             std::string thread_name = "PtlMgr";
             if (pt == PT_CHILD)
                 thread_name += "_child";
+            else if (pt > PT_CHILD)
+                thread_name += "_child" + StringUtils::toString(pt - PT_CHILD);
             VS::setThreadName(thread_name.c_str());
             STKProcess::init(pt);
             while(!pm->m_exit.load())
@@ -31,14 +31,20 @@
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_config.hpp"
 #include "network/socket_address.hpp"
+#include "network/state_delta.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
+#include "race/history.hpp"
 #include "tracks/track.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 #include "main_loop.hpp"
 
+#include <chrono>
+#include <set>
+
 // ============================================================================
 std::weak_ptr<GameProtocol> GameProtocol::m_game_protocol[PT_COUNT];
 // ============================================================================
@@ -63,12 +69,15 @@ GameProtocol::GameProtocol()
     m_network_item_manager = static_cast<NetworkItemManager*>
         (Track::getCurrentTrack()->getItemManager());
     m_data_to_send = getNetworkString();
+    m_filtered_state = getNetworkString();
+    m_state_count_offset = 0;
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
 GameProtocol::~GameProtocol()
 {
     delete m_data_to_send;
+    delete m_filtered_state;
 }   // ~GameProtocol
 
 //-----------------------------------------------------------------------------
@@ -131,6 +140,8 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     {
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
     case GP_STATE:             handleState(event);            break;
+    case GP_STATE_DELTA:       handleStateDelta(event);       break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
     case GP_ADJUST_TIME:
     case GP_ITEM_UPDATE:
@@ -280,50 +291,75 @@ void GameProtocol::handleItemEventConfirmation(Event *event)
 
 // ----------------------------------------------------------------------------
 /** Called by the server before assembling a new message containing the full
- *  state of the race to be sent to a client.
+ *  state of the race to be sent to a client. The layout after the ticks is:
+ *  the number of rewinder names, each with its id and unique identity,
+ *  then the number of rewinder states, each with its id and size before the
+ *  data.
  */
 void GameProtocol::startNewState()
 {
     assert(NetworkConfig::get()->isServer());
     m_data_to_send->clear();
     m_data_to_send->addUInt8(GP_STATE)
-        .addUInt32(World::getWorld()->getTicksSinceStart());
+        .addUInt32(World::getWorld()->getTicksSinceStart())
+        .addUInt8(0)/*number of rewinder names*/;
+    m_state_count_offset = 0;
+    if (ServerConfig::m_state_relevancy != 0)
+        m_state_relevancy.startNewState();
 }   // startNewState
 
+// ----------------------------------------------------------------------------
+/** Called by a server to tell clients the unique identity of a rewinder id,
+ *  all names need to be added before any state.
+ *  \param id The rewinder id.
+ *  \param name The unique identity of the rewinder.
+ */
+void GameProtocol::addRewinderName(uint16_t id, const std::string& name)
+{
+    assert(NetworkConfig::get()->isServer());
+    assert(m_state_count_offset == 0);
+    const unsigned names_offset = 1/*protocol type*/ + 1 /*gp event type*/+
+        4/*time*/;
+    m_data_to_send->getBuffer()[names_offset]++;
+    m_data_to_send->addUInt16(id).encodeString(name);
+}   // addRewinderName
+
 // ----------------------------------------------------------------------------
 /** Called by a server to add data to the current state. The data in buffer
  *  is copied, so the data can be freed after this call/.
+ *  \param rewinder The rewinder which saved the state.
  *  \param buffer Adds the data in the buffer to the current state.
  */
-void GameProtocol::addState(BareNetworkString *buffer)
+void GameProtocol::addState(const Rewinder* rewinder,
+                            BareNetworkString *buffer)
 {
     assert(NetworkConfig::get()->isServer());
-    m_data_to_send->addUInt16(buffer->size());
+    if (m_state_count_offset == 0)
+    {
+        m_state_count_offset = m_data_to_send->getTotalSize();
+        m_data_to_send->addUInt8(0);
+    }
+    m_data_to_send->getBuffer()[m_state_count_offset]++;
+    const unsigned offset = m_data_to_send->getTotalSize();
+    m_data_to_send->addUInt16(rewinder->getRewinderID())
+        .addUInt16(buffer->size());
     (*m_data_to_send) += *buffer;
+    if (ServerConfig::m_state_relevancy != 0)
+    {
+        m_state_relevancy.addState(rewinder, offset,
+            m_data_to_send->getTotalSize() - offset);
+    }
 }   // addState
 
 // ----------------------------------------------------------------------------
-/** Called by a server to finalize the current state, which add updated
- *  names of rewinder using to the beginning of state buffer
- *  \param cur_rewinder List of current rewinder using.
+/** Called by a server to finalize the current state, which adds the number
+ *  of rewinder states if no state has been added.
  */
-void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
+void GameProtocol::finalizeState()
 {
     assert(NetworkConfig::get()->isServer());
-    auto& buffer = m_data_to_send->getBuffer();
-    auto pos = buffer.begin() + 1/*protocol type*/ + 1 /*gp event type*/+
-        4/*time*/;
-
-    m_data_to_send->reset();
-    std::vector<uint8_t> names;
-    names.push_back((uint8_t)cur_rewinder.size());
-    for (std::string& name : cur_rewinder)
-    {
-        names.push_back((uint8_t)name.size());
-        std::vector<uint8_t> rewinder(name.begin(), name.end());
-        names.insert(names.end(), rewinder.begin(), rewinder.end());
-    }
-    buffer.insert(pos, names.begin(), names.end());
+    if (m_state_count_offset == 0)
+        m_data_to_send->addUInt8(0);
 }   // finalizeState
 
 // ----------------------------------------------------------------------------
@@ -333,9 +369,203 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
 void GameProtocol::sendState()
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    const int relevancy = ServerConfig::m_state_relevancy;
+    if (!ServerConfig::m_delta_state && relevancy == 0)
+    {
+        sendMessageToPeers(m_data_to_send, /*reliable*/false);
+        return;
+    }
+
+    // Remember the full state so it can be used as a baseline later
+    const unsigned header_size = 1/*protocol type*/ + 1 /*gp event type*/+
+        4/*time*/;
+    const uint8_t* state = m_data_to_send->getBuffer().data() + header_size;
+    const unsigned state_size =
+        m_data_to_send->getTotalSize() - header_size;
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    if (ServerConfig::m_delta_state && relevancy != 1)
+        addStateHistory(&m_state_history, ticks, state, state_size);
+
+    std::map<uint32_t, int> acked_state;
+    if (ServerConfig::m_delta_state)
+    {
+        std::lock_guard<std::mutex> lock(m_acked_state_mutex);
+        acked_state = m_acked_state;
+    }
+
+    // Peers acknowledged the same state share the same delta
+    std::map<int, NetworkString*> all_deltas;
+    std::set<uint32_t> all_host_ids;
+    for (auto& peer : STKHost::get()->getPeers())
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        all_host_ids.insert(peer->getHostId());
+
+        NetworkString* peer_state = m_data_to_send;
+        if (relevancy != 0)
+        {
+            auto start = std::chrono::steady_clock::now();
+            bool filtered = m_state_relevancy.filterState(peer.get(),
+                *m_data_to_send, m_filtered_state);
+            auto end = std::chrono::steady_clock::now();
+            if (filtered && relevancy == 1)
+                peer_state = m_filtered_state;
+            m_state_relevancy.addStats(m_data_to_send->getTotalSize(),
+                filtered ? m_filtered_state->getTotalSize() :
+                m_data_to_send->getTotalSize(),
+                std::chrono::duration_cast<std::chrono::microseconds>
+                (end - start).count());
+        }
+
+        if (!ServerConfig::m_delta_state)
+        {
+            peer->sendPacket(peer_state, /*reliable*/false);
+            continue;
+        }
+        if (relevancy == 1)
+        {
+            // Each peer receives different states, so each has its own
+            // baseline
+            sendPeerDeltaState(peer.get(), peer_state, acked_state);
+            continue;
+        }
+
+        auto it = acked_state.find(peer->getHostId());
+        const std::vector<uint8_t>* baseline = NULL;
+        if (it != acked_state.end() && it->second != ticks)
+            baseline = findStateHistory(m_state_history, it->second);
+        if (!baseline)
+        {
+            // No state acknowledged recently (lost or live join), send
+            // the full state
+            peer->sendPacket(m_data_to_send, /*reliable*/false);
+            continue;
+        }
+
+        NetworkString*& delta = all_deltas[it->second];
+        if (!delta)
+        {
+            delta = getNetworkString(state_size);
+            delta->addUInt8(GP_STATE_DELTA).addUInt32(ticks)
+                .addUInt32(it->second);
+            StateDelta::encode(*baseline, state, state_size, delta);
+        }
+        peer->sendPacket(delta, /*reliable*/false);
+        peer->addStateBytesSaved((int)m_data_to_send->getTotalSize() -
+            (int)delta->getTotalSize());
+    }
+    for (auto& p : all_deltas)
+        delete p.second;
+
+    for (auto it = m_peer_state_history.begin();
+         it != m_peer_state_history.end();)
+    {
+        if (all_host_ids.find(it->first) == all_host_ids.end())
+            it = m_peer_state_history.erase(it);
+        else
+            it++;
+    }
 }   // sendState
 
+// ----------------------------------------------------------------------------
+/** Sends the state filtered for a peer, as a delta to the state the peer
+ *  acknowledged if it's still in the history of this peer.
+ *  \param peer The peer to send the state to.
+ *  \param state The state filtered for this peer.
+ *  \param acked_state Ticks of the latest state acknowledged by each peer.
+ */
+void GameProtocol::sendPeerDeltaState(STKPeer* peer, NetworkString* state,
+                                      const std::map<uint32_t, int>&
+                                      acked_state)
+{
+    const unsigned header_size = 1/*protocol type*/ + 1 /*gp event type*/+
+        4/*time*/;
+    const uint8_t* data = state->getBuffer().data() + header_size;
+    const unsigned size = state->getTotalSize() - header_size;
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    auto& history = m_peer_state_history[peer->getHostId()];
+
+    auto it = acked_state.find(peer->getHostId());
+    const std::vector<uint8_t>* baseline = NULL;
+    if (it != acked_state.end() && it->second != ticks)
+        baseline = findStateHistory(history, it->second);
+    if (!baseline)
+        peer->sendPacket(state, /*reliable*/false);
+    else
+    {
+        NetworkString* delta = getNetworkString(size);
+        delta->addUInt8(GP_STATE_DELTA).addUInt32(ticks)
+            .addUInt32(it->second);
+        StateDelta::encode(*baseline, data, size, delta);
+        peer->sendPacket(delta, /*reliable*/false);
+        peer->addStateBytesSaved((int)state->getTotalSize() -
+            (int)delta->getTotalSize());
+        delete delta;
+    }
+    // Added after encoding, as it can remove the baseline
+    addStateHistory(&history, ticks, data, size);
+}   // sendPeerDeltaState
+
+// ----------------------------------------------------------------------------
+/** Saves a full state (without header) to be used as a baseline for delta
+ *  states, it keeps at most DELTA_STATE_HISTORY states.
+ */
+void GameProtocol::addStateHistory(
+    std::deque<std::pair<int, std::vector<uint8_t> > >* history,
+    int ticks, const uint8_t* state, unsigned size)
+{
+    history->emplace_back(ticks, std::vector<uint8_t>(state, state + size));
+    while (history->size() > DELTA_STATE_HISTORY)
+        history->pop_front();
+}   // addStateHistory
+
+// ----------------------------------------------------------------------------
+/** Returns the full state saved at the given ticks, or NULL if it has been
+ *  removed from the history already.
+ */
+const std::vector<uint8_t>* GameProtocol::findStateHistory(
+    const std::deque<std::pair<int, std::vector<uint8_t> > >& history,
+    int ticks) const
+{
+    for (auto it = history.rbegin(); it != history.rend(); it++)
+    {
+        if (it->first == ticks)
+            return &it->second;
+    }
+    return NULL;
+}   // findStateHistory
+
+// ----------------------------------------------------------------------------
+/** Sends an acknowledgement of a received state to the server, so that it
+ *  can be used as a baseline for delta states.
+ *  \param ticks Ticks of the received state.
+ */
+void GameProtocol::sendStateAck(int ticks)
+{
+    assert(NetworkConfig::get()->isClient());
+    NetworkString *ns = getNetworkString(5);
+    ns->addUInt8(GP_STATE_ACK).addUInt32(ticks);
+    // The next acknowledgement will replace a lost one anyway
+    sendToServer(ns, /*reliable*/false);
+    delete ns;
+}   // sendStateAck
+
+// ----------------------------------------------------------------------------
+/** Called in server when a client acknowledged a state.
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    if (!NetworkConfig::get()->isServer() || !checkDataSize(event, 4))
+        return;
+    int ticks = event->data().getUInt32();
+    std::lock_guard<std::mutex> lock(m_acked_state_mutex);
+    auto ret = m_acked_state.emplace(event->getPeer()->getHostId(), ticks);
+    // Unreliable messages may arrive out of order
+    if (!ret.second && ret.first->second < ticks)
+        ret.first->second = ticks;
+}   // handleStateAck
+
 // ----------------------------------------------------------------------------
 /** Called when a new full state is received form the server.
  */
@@ -346,21 +576,66 @@ void GameProtocol::handleState(Event *event)
     NetworkString &data = event->data();
     int ticks          = data.getUInt32();
 
-    // Check for updated rewinder using
-    unsigned rewinder_size = data.getUInt8();
-    std::vector<std::string> rewinder_using;
-    for (unsigned i = 0; i < rewinder_size; i++)
+    if (NetworkConfig::get()->getServerCapabilities().find("delta_state") !=
+        NetworkConfig::get()->getServerCapabilities().end())
     {
-        std::string name;
-        data.decodeString(&name);
-        rewinder_using.push_back(name);
+        addStateHistory(&m_state_history, ticks,
+            (const uint8_t*)data.getCurrentData(), data.size());
+        sendStateAck(ticks);
     }
+    addRewindInfoState(ticks, &data);
+}   // handleState
 
-    // The memory for bns will be handled in the RewindInfoState object
-    RewindInfoState* ris = new RewindInfoState(ticks, data.getCurrentOffset(),
-        rewinder_using, data.getBuffer());
+// ----------------------------------------------------------------------------
+/** Called when a delta state is received form the server, it rebuilds the
+ *  full state from the baseline before it's added to the rewind queue.
+ */
+void GameProtocol::handleStateDelta(Event *event)
+{
+    if (!NetworkConfig::get()->isClient())
+        return;
+    NetworkString &data = event->data();
+    int ticks = data.getUInt32();
+    int baseline_ticks = data.getUInt32();
+    const std::vector<uint8_t>* baseline =
+        findStateHistory(m_state_history, baseline_ticks);
+    if (!baseline)
+    {
+        Log::warn("GameProtocol", "Missing baseline %d for delta state %d.",
+            baseline_ticks, ticks);
+        return;
+    }
+
+    BareNetworkString state;
+    try
+    {
+        StateDelta::decode(*baseline, &data, &state.getBuffer());
+    }
+    catch (std::exception& e)
+    {
+        Log::error("GameProtocol", "Invalid delta state: %s", e.what());
+        return;
+    }
+    addStateHistory(&m_state_history, ticks, state.getBuffer().data(),
+        state.size());
+    sendStateAck(ticks);
+    addRewindInfoState(ticks, &state);
+}   // handleStateDelta
+
+// ----------------------------------------------------------------------------
+/** Adds a full state received from the server to the rewind queue, the
+ *  rewinder names and ids are read later in RewindInfoState::restore in main
+ *  thread.
+ *  \param ticks Ticks of the state.
+ *  \param data The state with the current offset at the rewinder names.
+ */
+void GameProtocol::addRewindInfoState(int ticks, BareNetworkString* data)
+{
+    // The state is copied into a recycled buffer of the RewindInfoState
+    RewindInfoState* ris = new RewindInfoState(ticks,
+        data->getCurrentOffset(), data->getBuffer());
     RewindManager::get()->addNetworkRewindInfo(ris);
-}   // handleState
+}   // addRewindInfoState
 
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
@@ -391,6 +666,10 @@ void GameProtocol::rewind(BareNetworkString *buffer)
     {
         pc->actionFromNetwork(std::get<0>(a), std::get<1>(a), std::get<2>(a),
             std::get<3>(a));
+        // The server records the actions of all players in a streamed
+        // history
+        if (NetworkConfig::get()->isServer() && history->isStreaming())
+            history->addEvent(kart_id, std::get<0>(a), std::get<1>(a));
     }
 }   // rewind
 
@@ -21,12 +21,15 @@
 
 #include "network/event_rewinder.hpp"
 #include "network/protocol.hpp"
+#include "network/state_relevancy.hpp"
 
 #include "input/input.hpp"                // for PlayerAction
 #include "utils/cpp2011.hpp"
 #include "utils/stk_process.hpp"
 
 #include <cstdlib>
+#include <deque>
+#include <map>
 #include <mutex>
 #include <vector>
 #include <tuple>
@@ -34,6 +37,7 @@
 class BareNetworkString;
 class NetworkItemManager;
 class NetworkString;
+class Rewinder;
 class STKPeer;
 
 class GameProtocol : public Protocol
@@ -49,13 +53,22 @@ private:
            GP_STATE,
            GP_ITEM_UPDATE,
            GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
+           GP_ADJUST_TIME,
+           GP_STATE_DELTA,
+           GP_STATE_ACK
     };
 
+    /** Number of full states kept as possible baseline of a delta state. */
+    static const unsigned DELTA_STATE_HISTORY = 32;
+
     /** A network string that collects all information from the server to be sent
      *  next. */
     NetworkString *m_data_to_send;
 
+    /** Offset of the number of rewinder states in \ref m_data_to_send, or
+     *  0 if no state has been added to the current state yet. */
+    unsigned m_state_count_offset;
+
     /** The server might request that the world clock of a client is adjusted
      *  to reduce number of rollbacks. */
     std::vector<int8_t> m_adjust_time;
@@ -74,8 +87,43 @@ private:
     // List of all kart actions to send to the server
     std::vector<Action> m_all_actions;
 
+    /** The latest full states (without header) with their ticks, in server
+     *  the ones sent and in client the ones received. They are used as
+     *  baseline for delta states. */
+    std::deque<std::pair<int, std::vector<uint8_t> > > m_state_history;
+
+    /** The states (without header) sent to each peer (host id) if states
+     *  are filtered for each peer, used as baseline for delta states. */
+    std::map<uint32_t, std::deque<std::pair<int, std::vector<uint8_t> > > >
+        m_peer_state_history;
+
+    /** Decides which rewinder states are sent to each peer (server only). */
+    StateRelevancy m_state_relevancy;
+
+    /** The state filtered for a peer, reused for all peers. */
+    NetworkString* m_filtered_state;
+
+    /** Ticks of the latest state each peer (host id) has acknowledged, only
+     *  used in server. */
+    std::map<uint32_t, int> m_acked_state;
+
+    /** Protect \ref m_acked_state which is written by the network thread. */
+    std::mutex m_acked_state_mutex;
+
     void handleControllerAction(Event *event);
     void handleState(Event *event);
+    void handleStateDelta(Event *event);
+    void handleStateAck(Event *event);
+    void addRewindInfoState(int ticks, BareNetworkString* data);
+    void addStateHistory(
+        std::deque<std::pair<int, std::vector<uint8_t> > >* history,
+        int ticks, const uint8_t* state, unsigned size);
+    const std::vector<uint8_t>* findStateHistory(
+        const std::deque<std::pair<int, std::vector<uint8_t> > >& history,
+        int ticks) const;
+    void sendPeerDeltaState(STKPeer* peer, NetworkString* state,
+                            const std::map<uint32_t, int>& acked_state);
+    void sendStateAck(int ticks);
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
     static std::weak_ptr<GameProtocol> m_game_protocol[PT_COUNT];
@@ -112,9 +160,10 @@ public:
     void controllerAction(int kart_id, PlayerAction action,
                           int value, int val_l, int val_r);
     void startNewState();
-    void addState(BareNetworkString *buffer);
+    void addRewinderName(uint16_t id, const std::string& name);
+    void addState(const Rewinder* rewinder, BareNetworkString *buffer);
     void sendState();
-    void finalizeState(std::vector<std::string>& cur_rewinder);
+    void finalizeState();
     void sendItemEventConfirmation(int ticks);
 
     virtual void undo(BareNetworkString *buffer) OVERRIDE;
@@ -138,6 +187,10 @@ public:
         return m_game_protocol[pt].lock();
     }   // lock
     // ------------------------------------------------------------------------
+    /** Returns the statistics of filtering states for each peer. */
+    const StateRelevancy& getStateRelevancy() const
+                                                 { return m_state_relevancy; }
+    // ------------------------------------------------------------------------
     /** Returns the NetworkString in which a state was saved. */
     NetworkString* getState() const { return m_data_to_send;  }
     // ------------------------------------------------------------------------
@@ -29,8 +29,10 @@
 #include "modes/capture_the_flag.hpp"
 #include "modes/linear_world.hpp"
 #include "network/crypto.hpp"
+#include "network/database_connector.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
+#include "network/ip_range_index.hpp"
 #include "network/network.hpp"
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
@@ -45,6 +47,7 @@
 #include "network/stk_host.hpp"
 #include "network/stk_ipv6.hpp"
 #include "network/stk_peer.hpp"
+#include "network/tick_profiler.hpp"
 #include "online/online_profile.hpp"
 #include "online/request_manager.hpp"
 #include "online/xml_request.hpp"
@@ -59,6 +62,7 @@
 #include "utils/translation.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -224,6 +228,7 @@ ServerLobby::ServerLobby() : LobbyProtocol()
     m_default_vote = new PeerVote();
     m_player_reports_table_exists = false;
     initDatabase();
+    TickProfiler::get()->setEnabled(true);
 }   // ServerLobby
 
 //-----------------------------------------------------------------------------
@@ -250,6 +255,7 @@ void ServerLobby::initDatabase()
 #ifdef ENABLE_SQLITE3
     m_last_poll_db_time = StkTime::getMonoTimeMs();
     m_db = NULL;
+    m_db_connector = NULL;
     m_ip_ban_table_exists = false;
     m_ipv6_ban_table_exists = false;
     m_online_id_ban_table_exists = false;
@@ -296,6 +302,14 @@ void ServerLobby::initDatabase()
         m_ip_geolocation_table_exists);
     checkTableExists(ServerConfig::m_ipv6_geolocation_table,
         m_ipv6_geolocation_table_exists);
+    m_db_connector = new DatabaseConnector(m_db);
+    // Until the indexes are loaded connecting players are tested with
+    // queries
+    m_db_connector->addQuery(DatabaseConnector::QT_POLL, [this]()
+        {
+            loadBanIndex();
+            loadGeolocationIndex();
+        });
 #endif
 }   // initDatabase
 
@@ -305,9 +319,19 @@ void ServerLobby::initServerStatsTable()
 #ifdef ENABLE_SQLITE3
     if (!ServerConfig::m_sql_management || !m_db)
         return;
+    // The host id must be known before any peer connects
+    std::unique_lock<std::mutex> ul = m_db_connector->lock();
+    // Host ids are only unique in each lobby of a multi-lobby server, so
+    // the additional lobbies use their own tables
+    std::string server_uid = ServerConfig::m_server_uid;
+    if (STKProcess::hasIndependentChildren() && STKProcess::isChild())
+    {
+        server_uid += "_" + StringUtils::toString(
+            STKProcess::getType() - PT_CHILD + 2);
+    }
     std::string table_name = std::string("v") +
         StringUtils::toString(ServerConfig::m_server_db_version) + "_" +
-        ServerConfig::m_server_uid + "_stats";
+        server_uid + "_stats";
 
     std::ostringstream oss;
     oss << "CREATE TABLE IF NOT EXISTS " << table_name << " (\n"
@@ -369,7 +393,7 @@ void ServerLobby::initServerStatsTable()
     // players in minutes
     std::string full_stats_view_name = std::string("v") +
         StringUtils::toString(ServerConfig::m_server_db_version) + "_" +
-        ServerConfig::m_server_uid + "_full_stats";
+        server_uid + "_full_stats";
     oss.str("");
     oss << "CREATE VIEW IF NOT EXISTS " << full_stats_view_name << " AS\n"
         << "    SELECT host_id, ip,\n"
@@ -391,7 +415,7 @@ void ServerLobby::initServerStatsTable()
     // played of each players in minutes
     std::string current_players_view_name = std::string("v") +
         StringUtils::toString(ServerConfig::m_server_db_version) + "_" +
-        ServerConfig::m_server_uid + "_current_players";
+        server_uid + "_current_players";
     oss.str("");
     oss.clear();
     oss << "CREATE VIEW IF NOT EXISTS " << current_players_view_name << " AS\n"
@@ -415,7 +439,7 @@ void ServerLobby::initServerStatsTable()
     // If sqlite supports window functions (since 3.25), it will include last session player info (ip, country, ping...)
     std::string player_stats_view_name = std::string("v") +
         StringUtils::toString(ServerConfig::m_server_db_version) + "_" +
-        ServerConfig::m_server_uid + "_player_stats";
+        server_uid + "_player_stats";
     oss.str("");
     oss.clear();
     if (sqlite3_libversion_number() < 3025000)
@@ -516,8 +540,13 @@ void ServerLobby::destroyDatabase()
     auto peers = STKHost::get()->getPeers();
     for (auto& peer : peers)
         writeDisconnectInfoTable(peer.get());
-    if (m_db != NULL)
-        sqlite3_close(m_db);
+    // Finishes all queued queries and closes the database
+    delete m_db_connector;
+    m_db_connector = NULL;
+    m_db = NULL;
+    std::atomic_store(&m_ban_index, std::shared_ptr<const BanIndex>());
+    std::atomic_store(&m_geolocation_index,
+        std::shared_ptr<const GeolocationIndex>());
 #endif
 }   // destroyDatabase
 
@@ -529,11 +558,18 @@ void ServerLobby::writeDisconnectInfoTable(STKPeer* peer)
         return;
     std::string query = StringUtils::insertValues(
         "UPDATE %s SET disconnected_time = datetime('now'), "
-        "ping = %d, packet_loss = %d "
-        "WHERE host_id = %u;", m_server_stats_table.c_str(),
-        peer->getAveragePing(), peer->getPacketLoss(),
-        peer->getHostId());
-    easySQLQuery(query);
+        "ping = ?, packet_loss = ? "
+        "WHERE host_id = ?;", m_server_stats_table.c_str());
+    const int ping = peer->getAveragePing();
+    const int packet_loss = peer->getPacketLoss();
+    const uint32_t host_id = peer->getHostId();
+    m_db_connector->addWrite(DatabaseConnector::QT_SERVER_STATS, query,
+        [ping, packet_loss, host_id](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int(stmt, 1, ping);
+            sqlite3_bind_int(stmt, 2, packet_loss);
+            sqlite3_bind_int64(stmt, 3, host_id);
+        });
 #endif
 }   // writeDisconnectInfoTable
 
@@ -922,10 +958,44 @@ bool ServerLobby::notifyEventAsynchronous(Event* event)
 
 //-----------------------------------------------------------------------------
 #ifdef ENABLE_SQLITE3
+/** In memory copy of the active bans, see \ref loadBanIndex. */
+struct ServerLobby::BanIndex
+{
+    struct Ban
+    {
+        int m_row_id;
+        std::string m_reason;
+        std::string m_description;
+        /** Identify the row when the trigger count is updated. */
+        int64_t m_ip_start, m_ip_end;
+        std::string m_ipv6_cidr;
+    };
+    std::vector<Ban> m_ip_bans;
+    std::vector<Ban> m_ipv6_bans;
+    std::map<uint32_t, Ban> m_online_id_bans;
+    /** Index of the ban in m_ip_bans for each address. */
+    IPRangeIndex<uint32_t> m_ip_index;
+    /** Index of the ban in m_ipv6_bans for each address. */
+    IPRangeIndex<IPv6Key> m_ipv6_index;
+};   // BanIndex
+
+//-----------------------------------------------------------------------------
+/** In memory copy of the geolocation tables, see \ref loadGeolocationIndex.
+ */
+struct ServerLobby::GeolocationIndex
+{
+    std::vector<std::string> m_country_codes;
+    /** Index of the country code for each address. */
+    IPRangeIndex<uint32_t> m_ip_index;
+    /** Index of the country code for the upper 64 bits of each address. */
+    IPRangeIndex<uint64_t> m_ipv6_index;
+};   // GeolocationIndex
+
+//-----------------------------------------------------------------------------
 /* Every 1 minute STK will poll database:
  * 1. Set disconnected time to now for non-exists host.
  * 2. Clear expired player reports if necessary
- * 3. Kick active peer from ban list
+ * 3. Rebuild the ban index and kick active peer from ban list
  */
 void ServerLobby::pollDatabase()
 {
@@ -937,203 +1007,142 @@ void ServerLobby::pollDatabase()
 
     m_last_poll_db_time = StkTime::getMonoTimeMs();
 
-    if (m_ip_ban_table_exists)
+    // The database thread only gets a copy of the peer data it needs, and
+    // the peers are kicked after it finishes
+    struct PeerInfo
+    {
+        std::weak_ptr<STKPeer> m_peer;
+        std::string m_address;
+        uint32_t m_ip;
+        std::string m_ipv6;
+        bool m_has_profiles;
+        uint32_t m_online_id;
+    };
+    auto peers = STKHost::get()->getPeers();
+    std::vector<PeerInfo> infos;
+    std::vector<uint32_t> exist_hosts;
+    for (auto& peer : peers)
     {
-        std::string query =
-            "SELECT ip_start, ip_end, reason, description FROM ";
-        query += ServerConfig::m_ip_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
+        if (peer->isValidated())
+            exist_hosts.push_back(peer->getHostId());
+        if (peer->isAIPeer())
+            continue;
+        PeerInfo info;
+        info.m_peer = peer;
+        info.m_address = peer->getAddress().toString();
+        info.m_ip = peer->getAddress().isIPv6() ?
+            0 : peer->getAddress().getIP();
+        if (peer->getAddress().isIPv6())
+            info.m_ipv6 = peer->getAddress().toString(false);
+        info.m_has_profiles = !peer->getPlayerProfiles().empty();
+        info.m_online_id = info.m_has_profiles ?
+            peer->getPlayerProfiles()[0]->getOnlineId() : 0;
+        infos.push_back(info);
+    }
+    const bool no_peers = peers.empty() || exist_hosts.empty();
+    auto kicked = std::make_shared<std::vector<std::weak_ptr<STKPeer> > >();
+
+    m_db_connector->addQuery(DatabaseConnector::QT_POLL,
+        [this, infos, exist_hosts, no_peers, kicked]()
+        {
+            loadBanIndex();
+            std::shared_ptr<const BanIndex> index =
+                std::atomic_load(&m_ban_index);
+            for (const PeerInfo& p : infos)
             {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
+                const BanIndex::Ban* ban = NULL;
+                int i = -1;
+                if (p.m_ipv6.empty())
                 {
-                    // IPv4 ban list atm
-                    if (p->isAIPeer() || p->getAddress().isIPv6())
-                        continue;
-
-                    uint32_t ip_start = 0;
-                    uint32_t ip_end = 0;
-                    if (!StringUtils::fromString(data[0], ip_start))
-                        continue;
-                    if (!StringUtils::fromString(data[1], ip_end))
-                        continue;
-                    uint32_t peer_addr = p->getAddress().getIP();
-                    if (ip_start <= peer_addr && ip_end >= peer_addr)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            p->getAddress().toString().c_str(),
-                            data[2], data[3]);
-                        p->kick();
-                    }
+                    i = index->m_ip_index.find(p.m_ip);
+                    if (i != -1)
+                        ban = &index->m_ip_bans[i];
                 }
-                return 0;
-            }, &peers, NULL);
-    }
-
-    if (m_ipv6_ban_table_exists)
-    {
-        std::string query =
-            "SELECT ipv6_cidr, reason, description FROM ";
-        query += ServerConfig::m_ipv6_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
-            {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
+                else
                 {
-                    std::string ipv6;
-                    if (p->getAddress().isIPv6())
-                        ipv6 = p->getAddress().toString(false);
-                    // IPv6 ban list atm
-                    if (p->isAIPeer() || ipv6.empty())
-                        continue;
-
-                    char* ipv6_cidr = data[0];
-                    if (insideIPv6CIDR(ipv6_cidr, ipv6.c_str()) == 1)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            ipv6.c_str(), data[1], data[2]);
-                        p->kick();
-                    }
+                    IPv6Key key;
+                    if (getIPv6Key(p.m_ipv6.c_str(), &key))
+                        i = index->m_ipv6_index.find(key);
+                    if (i != -1)
+                        ban = &index->m_ipv6_bans[i];
                 }
-                return 0;
-            }, &peers, NULL);
-    }
-
-    if (m_online_id_ban_table_exists)
-    {
-        std::string query = "SELECT online_id, reason, description FROM ";
-        query += ServerConfig::m_online_id_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
-            {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
+                if (!ban && p.m_has_profiles)
                 {
-                    if (p->isAIPeer()
-                        || p->getPlayerProfiles().empty())
-                        continue;
-
-                    uint32_t online_id = 0;
-                    if (!StringUtils::fromString(data[0], online_id))
-                        continue;
-                    if (online_id == p->getPlayerProfiles()[0]->getOnlineId())
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            p->getAddress().toString().c_str(),
-                            data[1], data[2]);
-                        p->kick();
-                    }
+                    auto it = index->m_online_id_bans.find(p.m_online_id);
+                    if (it != index->m_online_id_bans.end())
+                        ban = &it->second;
                 }
-                return 0;
-            }, &peers, NULL);
-    }
+                if (!ban)
+                    continue;
+                Log::info("ServerLobby",
+                    "Kick %s, reason: %s, description: %s",
+                    p.m_ipv6.empty() ? p.m_address.c_str() : p.m_ipv6.c_str(),
+                    ban->m_reason.c_str(), ban->m_description.c_str());
+                kicked->push_back(p.m_peer);
+            }
 
-    if (m_player_reports_table_exists &&
-        ServerConfig::m_player_reports_expired_days != 0.0f)
-    {
-        std::string query = StringUtils::insertValues(
-            "DELETE FROM %s "
-            "WHERE datetime"
-            "(reported_time, '+%f days') < datetime('now');",
-            ServerConfig::m_player_reports_table.c_str(),
-            ServerConfig::m_player_reports_expired_days);
-        easySQLQuery(query);
-    }
-    if (m_server_stats_table.empty())
-        return;
+            if (m_player_reports_table_exists &&
+                ServerConfig::m_player_reports_expired_days != 0.0f)
+            {
+                std::string query = StringUtils::insertValues(
+                    "DELETE FROM %s "
+                    "WHERE datetime"
+                    "(reported_time, '+%f days') < datetime('now');",
+                    ServerConfig::m_player_reports_table.c_str(),
+                    ServerConfig::m_player_reports_expired_days);
+                easySQLQuery(query);
+            }
+            if (m_server_stats_table.empty())
+                return;
 
-    std::string query;
-    auto peers = STKHost::get()->getPeers();
-    std::vector<uint32_t> exist_hosts;
-    if (!peers.empty())
-    {
-        for (auto& peer : peers)
-        {
-            if (!peer->isValidated())
-                continue;
-            exist_hosts.push_back(peer->getHostId());
-        }
-    }
-    if (peers.empty() || exist_hosts.empty())
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET disconnected_time = datetime('now') "
-            "WHERE connected_time = disconnected_time;",
-            m_server_stats_table.c_str());
-    }
-    else
-    {
-        std::ostringstream oss;
-        oss << "UPDATE " << m_server_stats_table
-            << "    SET disconnected_time = datetime('now')"
-            << "    WHERE connected_time = disconnected_time AND"
-            << "    host_id NOT IN (";
-        for (unsigned i = 0; i < exist_hosts.size(); i++)
+            std::string query;
+            if (no_peers)
+            {
+                query = StringUtils::insertValues(
+                    "UPDATE %s SET disconnected_time = datetime('now') "
+                    "WHERE connected_time = disconnected_time;",
+                    m_server_stats_table.c_str());
+            }
+            else
+            {
+                std::ostringstream oss;
+                oss << "UPDATE " << m_server_stats_table
+                    << "    SET disconnected_time = datetime('now')"
+                    << "    WHERE connected_time = disconnected_time AND"
+                    << "    host_id NOT IN (";
+                for (unsigned i = 0; i < exist_hosts.size(); i++)
+                {
+                    oss << exist_hosts[i];
+                    if (i != (exist_hosts.size() - 1))
+                        oss << ",";
+                }
+                oss << ");";
+                query = oss.str();
+            }
+            easySQLQuery(query);
+        },
+        [kicked]()
         {
-            oss << exist_hosts[i];
-            if (i != (exist_hosts.size() - 1))
-                oss << ",";
-        }
-        oss << ");";
-        query = oss.str();
-    }
-    easySQLQuery(query);
+            for (std::weak_ptr<STKPeer>& p : *kicked)
+            {
+                if (auto peer = p.lock())
+                    peer->kick();
+            }
+        });
 }   // pollDatabase
 
 //-----------------------------------------------------------------------------
 /** Run simple query with write lock waiting and optional function, this
- *  function has no callback for the return (if any) by the query.
+ *  function has no callback for the return (if any) by the query. It must be
+ *  called in a database job or during initialization.
  *  Return true if no error occurs
  */
 bool ServerLobby::easySQLQuery(const std::string& query,
                    std::function<void(sqlite3_stmt* stmt)> bind_function) const
 {
-    if (!m_db)
-        return false;
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (bind_function)
-            bind_function(stmt);
-        ret = sqlite3_step(stmt);
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for easy query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-            return false;
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby",
-            "Error preparing database for easy query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+    if (!m_db_connector)
         return false;
-    }
-    return true;
+    return m_db_connector->execute(query, bind_function);
 }   // easySQLQuery
 
 //-----------------------------------------------------------------------------
@@ -1180,7 +1189,9 @@ void ServerLobby::checkTableExists(const std::string& table, bool& result)
 }   // checkTableExists
 
 //-----------------------------------------------------------------------------
-std::string ServerLobby::ip2Country(const SocketAddress& addr) const
+/** Returns the country code of an IPv4 address, called by the database
+ *  thread. */
+std::string ServerLobby::ip2Country(const SocketAddress& addr)
 {
     if (!m_db || !m_ip_geolocation_table_exists || addr.isLAN())
         return "";
@@ -1188,79 +1199,304 @@ std::string ServerLobby::ip2Country(const SocketAddress& addr) const
     std::string cc_code;
     std::string query = StringUtils::insertValues(
         "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= %d AND `ip_end` >= %d "
+        "WHERE `ip_start` <= ?1 AND `ip_end` >= ?1 "
         "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ip_geolocation_table.c_str(), addr.getIP(),
-        addr.getIP());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        ServerConfig::m_ip_geolocation_table.c_str());
+    const uint32_t ip = addr.getIP();
+    m_db_connector->execute(query, [ip](sqlite3_stmt* stmt)
         {
-            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+            sqlite3_bind_int64(stmt, 1, ip);
+        },
+        [&cc_code](sqlite3_stmt* stmt)
         {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return "";
-    }
+            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
+            if (country_code)
+                cc_code = country_code;
+        });
     return cc_code;
 }   // ip2Country
 
 //-----------------------------------------------------------------------------
-std::string ServerLobby::ipv62Country(const SocketAddress& addr) const
+/** Returns the country code of an IPv6 address, called by the database
+ *  thread. */
+std::string ServerLobby::ipv62Country(const SocketAddress& addr)
 {
     if (!m_db || !m_ipv6_geolocation_table_exists)
         return "";
 
-    std::string cc_code;
     const std::string& ipv6 = addr.toString(false/*show_port*/);
+    std::string cc_code;
     std::string query = StringUtils::insertValues(
         "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= upperIPv6(\"%s\") AND `ip_end` >= upperIPv6(\"%s\") "
+        "WHERE `ip_start` <= upperIPv6(?1) AND `ip_end` >= upperIPv6(?1) "
         "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ipv6_geolocation_table.c_str(), ipv6.c_str(),
-        ipv6.c_str());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        ServerConfig::m_ipv6_geolocation_table.c_str());
+    m_db_connector->execute(query, [ipv6](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_text(stmt, 1, ipv6.c_str(), -1, SQLITE_TRANSIENT);
+        },
+        [&cc_code](sqlite3_stmt* stmt)
         {
             const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
+            if (country_code)
+                cc_code = country_code;
+        });
+    return cc_code;
+}   // ipv62Country
+
+//-----------------------------------------------------------------------------
+/** Rebuilds the index of active bans from the ban tables and replaces the
+ *  old one, called by the database thread. A ban which starts or expires is
+ *  noticed at the next rebuild (at most 1 minute later).
+ */
+void ServerLobby::loadBanIndex()
+{
+    std::shared_ptr<BanIndex> index = std::make_shared<BanIndex>();
+    const std::string active = " WHERE datetime('now') > "
+        "datetime(starting_time) AND (expired_days is NULL OR datetime"
+        "(starting_time, '+'||expired_days||' days') > datetime('now'));";
+    auto read_ban = [](sqlite3_stmt* stmt, int column, BanIndex::Ban* ban)
+        {
+            ban->m_row_id = sqlite3_column_int(stmt, 0);
+            const char* reason = (char*)sqlite3_column_text(stmt, column);
+            const char* desc = (char*)sqlite3_column_text(stmt, column + 1);
+            ban->m_reason = reason ? reason : "";
+            ban->m_description = desc ? desc : "";
+        };
+
+    if (m_ip_ban_table_exists)
+    {
+        std::vector<IPRangeIndex<uint32_t>::Range> ranges;
+        std::string query =
+            "SELECT rowid, ip_start, ip_end, reason, description FROM ";
+        query += ServerConfig::m_ip_ban_table;
+        query += active;
+        m_db_connector->execute(query, nullptr, [&](sqlite3_stmt* stmt)
+            {
+                BanIndex::Ban ban;
+                read_ban(stmt, 3, &ban);
+                ban.m_ip_start = sqlite3_column_int64(stmt, 1);
+                ban.m_ip_end = sqlite3_column_int64(stmt, 2);
+                if (ban.m_ip_end < 0 || ban.m_ip_start > 0xffffffffLL)
+                    return;
+                ranges.push_back({
+                    (uint32_t)std::max(ban.m_ip_start, (int64_t)0),
+                    (uint32_t)std::min(ban.m_ip_end, (int64_t)0xffffffffLL),
+                    (int)index->m_ip_bans.size() });
+                index->m_ip_bans.push_back(ban);
+            });
+        index->m_ip_index = IPRangeIndex<uint32_t>(ranges);
+    }
+
+    if (m_ipv6_ban_table_exists)
+    {
+        std::vector<IPRangeIndex<IPv6Key>::Range> ranges;
+        std::string query =
+            "SELECT rowid, ipv6_cidr, reason, description FROM ";
+        query += ServerConfig::m_ipv6_ban_table;
+        query += active;
+        m_db_connector->execute(query, nullptr, [&](sqlite3_stmt* stmt)
+            {
+                const char* cidr = (char*)sqlite3_column_text(stmt, 1);
+                IPv6Key start, end;
+                if (!cidr || !getIPv6CIDRRange(cidr, &start, &end))
+                    return;
+                BanIndex::Ban ban;
+                read_ban(stmt, 2, &ban);
+                ban.m_ipv6_cidr = cidr;
+                ranges.push_back({ start, end,
+                    (int)index->m_ipv6_bans.size() });
+                index->m_ipv6_bans.push_back(ban);
+            });
+        index->m_ipv6_index = IPRangeIndex<IPv6Key>(ranges);
+    }
+
+    if (m_online_id_ban_table_exists)
+    {
+        std::string query =
+            "SELECT rowid, online_id, reason, description FROM ";
+        query += ServerConfig::m_online_id_ban_table;
+        query += active;
+        m_db_connector->execute(query, nullptr, [&](sqlite3_stmt* stmt)
+            {
+                BanIndex::Ban ban;
+                read_ban(stmt, 2, &ban);
+                uint32_t online_id = (uint32_t)sqlite3_column_int64(stmt, 1);
+                index->m_online_id_bans[online_id] = ban;
+            });
+    }
+    std::atomic_store(&m_ban_index,
+        std::shared_ptr<const BanIndex>(index));
+}   // loadBanIndex
+
+//-----------------------------------------------------------------------------
+/** Loads the geolocation tables into memory, called once by the database
+ *  thread as the tables do not change while the server runs.
+ */
+void ServerLobby::loadGeolocationIndex()
+{
+    std::shared_ptr<GeolocationIndex> index =
+        std::make_shared<GeolocationIndex>();
+    // Each country code is only stored once
+    std::map<std::string, int> country_ids;
+    auto get_country = [&](sqlite3_stmt* stmt)->int
+        {
+            const char* cc = (char*)sqlite3_column_text(stmt, 2);
+            std::string country_code = cc ? cc : "";
+            auto it = country_ids.find(country_code);
+            if (it != country_ids.end())
+                return it->second;
+            int id = (int)index->m_country_codes.size();
+            index->m_country_codes.push_back(country_code);
+            country_ids[country_code] = id;
+            return id;
+        };
+
+    if (m_ip_geolocation_table_exists)
+    {
+        std::vector<IPRangeIndex<uint32_t>::Range> ranges;
+        std::string query = "SELECT ip_start, ip_end, country_code FROM ";
+        query += ServerConfig::m_ip_geolocation_table;
+        query += ";";
+        m_db_connector->execute(query, nullptr, [&](sqlite3_stmt* stmt)
+            {
+                int64_t ip_start = sqlite3_column_int64(stmt, 0);
+                int64_t ip_end = sqlite3_column_int64(stmt, 1);
+                if (ip_end < 0 || ip_start > 0xffffffffLL)
+                    return;
+                ranges.push_back({ (uint32_t)std::max(ip_start, (int64_t)0),
+                    (uint32_t)std::min(ip_end, (int64_t)0xffffffffLL),
+                    get_country(stmt) });
+            });
+        index->m_ip_index = IPRangeIndex<uint32_t>(ranges);
+    }
+
+    if (m_ipv6_geolocation_table_exists)
+    {
+        // The table stores the upper 64 bits of the addresses
+        std::vector<IPRangeIndex<uint64_t>::Range> ranges;
+        std::string query = "SELECT ip_start, ip_end, country_code FROM ";
+        query += ServerConfig::m_ipv6_geolocation_table;
+        query += ";";
+        m_db_connector->execute(query, nullptr, [&](sqlite3_stmt* stmt)
+            {
+                ranges.push_back({ (uint64_t)sqlite3_column_int64(stmt, 0),
+                    (uint64_t)sqlite3_column_int64(stmt, 1),
+                    get_country(stmt) });
+            });
+        index->m_ipv6_index = IPRangeIndex<uint64_t>(ranges);
+    }
+    Log::info("ServerLobby", "Loaded %d IPv4 and %d IPv6 geolocation "
+        "segments.", (int)index->m_ip_index.getNumSegments(),
+        (int)index->m_ipv6_index.getNumSegments());
+    std::atomic_store(&m_geolocation_index,
+        std::shared_ptr<const GeolocationIndex>(index));
+}   // loadGeolocationIndex
+
+//-----------------------------------------------------------------------------
+/** Tests if a player is banned using the ban index, the trigger count of the
+ *  ban is updated later by the database thread.
+ *  \param online_id Online id of the player, 0 if not logged in.
+ *  \param reason Set to the reason of the ban.
+ */
+bool ServerLobby::findBan(const BanIndex& index, const SocketAddress& addr,
+                          uint32_t online_id, std::string* reason)
+{
+    const BanIndex::Ban* ban = NULL;
+    std::string query;
+    std::function<void(sqlite3_stmt* stmt)> bind_function;
+    if (addr.isIPv6())
+    {
+        IPv6Key key;
+        int i = getIPv6Key(addr.toString(false).c_str(), &key) ?
+            index.m_ipv6_index.find(key) : -1;
+        if (i != -1)
+        {
+            ban = &index.m_ipv6_bans[i];
+            query = StringUtils::insertValues(
+                "UPDATE %s SET trigger_count = trigger_count + 1, "
+                "last_trigger = datetime('now') "
+                "WHERE ipv6_cidr = ?;", ServerConfig::m_ipv6_ban_table.c_str());
+            const std::string cidr = ban->m_ipv6_cidr;
+            bind_function = [cidr](sqlite3_stmt* stmt)
+                {
+                    sqlite3_bind_text(stmt, 1, cidr.c_str(), -1,
+                        SQLITE_TRANSIENT);
+                };
         }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
+    }
+    else
+    {
+        int i = index.m_ip_index.find(addr.getIP());
+        if (i != -1)
+        {
+            ban = &index.m_ip_bans[i];
+            query = StringUtils::insertValues(
+                "UPDATE %s SET trigger_count = trigger_count + 1, "
+                "last_trigger = datetime('now') "
+                "WHERE ip_start = ? AND ip_end = ?;",
+                ServerConfig::m_ip_ban_table.c_str());
+            const int64_t ip_start = ban->m_ip_start;
+            const int64_t ip_end = ban->m_ip_end;
+            bind_function = [ip_start, ip_end](sqlite3_stmt* stmt)
+                {
+                    sqlite3_bind_int64(stmt, 1, ip_start);
+                    sqlite3_bind_int64(stmt, 2, ip_end);
+                };
         }
     }
+    if (ban)
+    {
+        Log::info("ServerLobby", "%s banned by IP: %s "
+            "(rowid: %d, description: %s).", addr.toString().c_str(),
+            ban->m_reason.c_str(), ban->m_row_id,
+            ban->m_description.c_str());
+    }
+    else if (online_id != 0)
+    {
+        auto it = index.m_online_id_bans.find(online_id);
+        if (it == index.m_online_id_bans.end())
+            return false;
+        ban = &it->second;
+        Log::info("ServerLobby", "%s banned by online id: %s "
+            "(online id: %u rowid: %d, description: %s).",
+            addr.toString().c_str(), ban->m_reason.c_str(), online_id,
+            ban->m_row_id, ban->m_description.c_str());
+        query = StringUtils::insertValues(
+            "UPDATE %s SET trigger_count = trigger_count + 1, "
+            "last_trigger = datetime('now') "
+            "WHERE online_id = ?;",
+            ServerConfig::m_online_id_ban_table.c_str());
+        bind_function = [online_id](sqlite3_stmt* stmt)
+            {
+                sqlite3_bind_int64(stmt, 1, online_id);
+            };
+    }
     else
+        return false;
+
+    *reason = ban->m_reason;
+    m_db_connector->addWrite(DatabaseConnector::QT_BAN_CHECK, query,
+        bind_function);
+    return true;
+}   // findBan
+
+//-----------------------------------------------------------------------------
+/** Returns the country code of an address using the geolocation index. */
+std::string ServerLobby::findCountry(const GeolocationIndex& index,
+                                     const SocketAddress& addr) const
+{
+    int i = -1;
+    if (addr.isIPv6())
     {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return "";
+        IPv6Key key;
+        if (getIPv6Key(addr.toString(false).c_str(), &key))
+            i = index.m_ipv6_index.find(key.first);
     }
-    return cc_code;
-}   // ipv62Country
+    else if (!addr.isLAN())
+        i = index.m_ip_index.find(addr.getIP());
+    return i == -1 ? "" : index.m_country_codes[i];
+}   // findCountry
 
 #endif
 
@@ -1313,7 +1549,8 @@ void ServerLobby::writePlayerReport(Event* event)
             reporter->getAddress().getIP(), reporter_npp->getOnlineId(),
             reporting_peer->getAddress().getIP(), reporting_npp->getOnlineId());
     }
-    bool written = easySQLQuery(query,
+    std::weak_ptr<STKPeer> reporter_wp = event->getPeerSP();
+    m_db_connector->addWrite(DatabaseConnector::QT_PLAYER_REPORT, query,
         [reporter_npp, reporting_npp, info](sqlite3_stmt* stmt)
         {
             // SQLITE_TRANSIENT to copy string
@@ -1344,16 +1581,19 @@ void ServerLobby::writePlayerReport(Event* event)
                 Log::error("easySQLQuery", "Failed to bind %s.",
                     StringUtils::wideToUtf8(reporting_npp->getName()).c_str());
             }
+        },
+        [this, reporter_wp, reporting_npp](bool written)
+        {
+            auto reporter = reporter_wp.lock();
+            if (!written || !reporter)
+                return;
+            NetworkString* success = getNetworkString();
+            success->setSynchronous(true);
+            success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
+                .encodeString(reporting_npp->getName());
+            reporter->sendPacket(success, true/*reliable*/);
+            delete success;
         });
-    if (written)
-    {
-        NetworkString* success = getNetworkString();
-        success->setSynchronous(true);
-        success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
-            .encodeString(reporting_npp->getName());
-        event->getPeer()->sendPacket(success, true/*reliable*/);
-        delete success;
-    }
 #endif
 }   // writePlayerReport
 
@@ -1378,6 +1618,8 @@ void ServerLobby::asynchronousUpdate()
     }
 
 #ifdef ENABLE_SQLITE3
+    if (m_db_connector)
+        m_db_connector->handleCallbacks();
     pollDatabase();
 #endif
 
@@ -3372,10 +3614,26 @@ void ServerLobby::saveIPBanTable(const SocketAddress& addr)
         "INSERT INTO %s (ip_start, ip_end) "
         "VALUES (%u, %u);",
         ServerConfig::m_ip_ban_table.c_str(), addr.getIP(), addr.getIP());
-    easySQLQuery(query);
+    m_db_connector->addWrite(DatabaseConnector::QT_CONSOLE, query);
+    updateBanList();
 #endif
 }   // saveIPBanTable
 
+//-----------------------------------------------------------------------------
+/** Rebuilds the ban index after the ban tables are changed, without waiting
+ *  for the next database poll. */
+void ServerLobby::updateBanList()
+{
+#ifdef ENABLE_SQLITE3
+    if (!m_db_connector)
+        return;
+    m_db_connector->addQuery(DatabaseConnector::QT_CONSOLE, [this]()
+        {
+            loadBanIndex();
+        });
+#endif
+}   // updateBanList
+
 //-----------------------------------------------------------------------------
 bool ServerLobby::handleAssets(const NetworkString& ns, STKPeer* peer)
 {
@@ -3572,20 +3830,105 @@ void ServerLobby::connectionRequested(Event* event)
     online_id = data.getUInt32();
     encrypted_size = data.getUInt32();
 
-    // Will be disconnected if banned by IP
-    testBannedForIP(peer.get());
-    if (peer->isDisconnected())
+#ifdef ENABLE_SQLITE3
+    std::shared_ptr<const BanIndex> ban_index =
+        std::atomic_load(&m_ban_index);
+    std::shared_ptr<const GeolocationIndex> geolocation_index =
+        std::atomic_load(&m_geolocation_index);
+    if (ban_index && geolocation_index)
+    {
+        std::string reason;
+        if (findBan(*ban_index, peer->getAddress(), online_id, &reason))
+        {
+            kickPlayerWithReason(peer.get(), reason.c_str());
+            return;
+        }
+        handleConnectionChecked(peer, data, player_count, online_id,
+            encrypted_size, findCountry(*geolocation_index,
+            peer->getAddress()));
         return;
-
-    testBannedForIPv6(peer.get());
-    if (peer->isDisconnected())
+    }
+    else if (m_db_connector)
+    {
+        // The ban checks and geolocation are done by the database thread,
+        // the connection is handled in the callback (which is run by this
+        // thread later)
+        struct CheckResult
+        {
+            bool m_banned = false;
+            std::string m_reason;
+            std::string m_country_code;
+        };
+        auto result = std::make_shared<CheckResult>();
+        const SocketAddress addr = peer->getAddress();
+        m_db_connector->addQuery(DatabaseConnector::QT_BAN_CHECK,
+            [this, result, addr, online_id]()
+            {
+                result->m_banned = testBannedForIP(addr, &result->m_reason) ||
+                    testBannedForIPv6(addr, &result->m_reason) ||
+                    (online_id != 0 &&
+                    testBannedForOnlineId(addr, online_id, &result->m_reason));
+            });
+        std::weak_ptr<STKPeer> peer_wp = peer;
+        auto remaining = std::make_shared<BareNetworkString>(
+            data.getCurrentData(), data.size());
+        m_db_connector->addQuery(DatabaseConnector::QT_GEOLOCATION,
+            [this, result, addr]()
+            {
+                if (result->m_banned)
+                    return;
+                result->m_country_code = addr.isIPv6() ?
+                    ipv62Country(addr) : ip2Country(addr);
+            },
+            [this, result, peer_wp, remaining, player_count, online_id,
+            encrypted_size]()
+            {
+                std::shared_ptr<STKPeer> peer = peer_wp.lock();
+                if (!peer || peer->isDisconnected())
+                    return;
+                if (result->m_banned)
+                {
+                    kickPlayerWithReason(peer.get(),
+                        result->m_reason.c_str());
+                    return;
+                }
+                handleConnectionChecked(peer, *remaining, player_count,
+                    online_id, encrypted_size, result->m_country_code);
+            });
         return;
+    }
+#endif
+    handleConnectionChecked(peer, data, player_count, online_id,
+        encrypted_size, ""/*country_code*/);
+}   // connectionRequested
 
-    if (online_id != 0)
-        testBannedForOnlineId(peer.get(), online_id);
-    // Will be disconnected if banned by online id
-    if (peer->isDisconnected())
+//-----------------------------------------------------------------------------
+/** Continues handling a connection request after the ban checks.
+ *  \param data The request after the encrypted size.
+ *  \param country_code Country code found by geolocation, used if the player
+ *  validation does not tell it.
+ */
+void ServerLobby::handleConnectionChecked(std::shared_ptr<STKPeer> peer,
+                                          BareNetworkString& data,
+                                          unsigned player_count,
+                                          uint32_t online_id,
+                                          uint32_t encrypted_size,
+                                          const std::string& country_code)
+{
+    // The state may have changed while waiting for the database
+    if (!allowJoinedPlayersWaiting() &&
+        (m_state.load() != WAITING_FOR_START_GAME ||
+        m_game_setup->isGrandPrixStarted()))
+    {
+        NetworkString *message = getNetworkString(2);
+        message->setSynchronous(true);
+        message->addUInt8(LE_CONNECTION_REFUSED).addUInt8(RR_BUSY);
+        peer->sendPacket(message, true/*reliable*/, false/*encrypted*/);
+        peer->reset();
+        delete message;
+        Log::verbose("ServerLobby", "Player refused: selection started");
         return;
+    }
 
     unsigned total_players = 0;
     STKHost::get()->updatePlayers(NULL, NULL, &total_players);
@@ -3638,8 +3981,9 @@ void ServerLobby::connectionRequested(Event* event)
 
     if (encrypted_size != 0)
     {
-        m_pending_connection[peer] = std::make_pair(online_id,
-            BareNetworkString(data.getCurrentData(), encrypted_size));
+        m_pending_connection[peer] = std::make_tuple(online_id,
+            BareNetworkString(data.getCurrentData(), encrypted_size),
+            country_code);
     }
     else
     {
@@ -3647,9 +3991,9 @@ void ServerLobby::connectionRequested(Event* event)
         if (online_id > 0)
             data.decodeStringW(&online_name);
         handleUnencryptedConnection(peer, data, online_id, online_name,
-            false/*is_pending_connection*/);
+            false/*is_pending_connection*/, country_code);
     }
-}   // connectionRequested
+}   // handleConnectionChecked
 
 //-----------------------------------------------------------------------------
 void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
@@ -3716,13 +4060,6 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
         }
     }
 
-#ifdef ENABLE_SQLITE3
-    if (country_code.empty() && !peer->getAddress().isIPv6())
-        country_code = ip2Country(peer->getAddress());
-    if (country_code.empty() && peer->getAddress().isIPv6())
-        country_code = ipv62Country(peer->getAddress());
-#endif
-
     auto red_blue = STKHost::get()->getAllPlayersTeamInfo();
     for (unsigned i = 0; i < player_count; i++)
     {
@@ -3784,9 +4121,12 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
     message_ack->addUInt8(LE_CONNECTION_ACCEPTED).addUInt32(peer->getHostId())
         .addUInt32(ServerConfig::m_server_version);
 
-    message_ack->addUInt16(
-        (uint16_t)stk_config->m_network_capabilities.size());
-    for (const std::string& cap : stk_config->m_network_capabilities)
+    std::set<std::string> server_caps = stk_config->m_network_capabilities;
+    // Clients only acknowledge states if delta state is enabled
+    if (!ServerConfig::m_delta_state)
+        server_caps.erase("delta_state");
+    message_ack->addUInt16((uint16_t)server_caps.size());
+    for (const std::string& cap : server_caps)
         message_ack->encodeString(cap);
 
     message_ack->addFloat(auto_start_timer)
@@ -3855,17 +4195,19 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
 #ifdef ENABLE_SQLITE3
     if (m_server_stats_table.empty() || peer->isAIPeer())
         return;
+    // All values are bound so the prepared statement is reused, the peer is
+    // not used by the database thread
+    const bool ipv6 = ServerConfig::m_ipv6_connection &&
+        peer->getAddress().isIPv6();
     std::string query;
-    if (ServerConfig::m_ipv6_connection && peer->getAddress().isIPv6())
+    if (ipv6)
     {
         query = StringUtils::insertValues(
             "INSERT INTO %s "
             "(host_id, ip, ipv6 ,port, online_id, username, player_num, "
             "country_code, version, os, ping) "
-            "VALUES (%u, 0, \"%s\" ,%u, %u, ?, %u, ?, ?, ?, %u);",
-            m_server_stats_table.c_str(), peer->getHostId(),
-            peer->getAddress().toString(false), peer->getAddress().getPort(),
-            online_id, player_count, peer->getAveragePing());
+            "VALUES (?1, 0, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10);",
+            m_server_stats_table.c_str());
     }
     else
     {
@@ -3873,24 +4215,41 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
             "INSERT INTO %s "
             "(host_id, ip, port, online_id, username, player_num, "
             "country_code, version, os, ping) "
-            "VALUES (%u, %u, %u, %u, ?, %u, ?, ?, ?, %u);",
-            m_server_stats_table.c_str(), peer->getHostId(),
-            peer->getAddress().getIP(), peer->getAddress().getPort(),
-            online_id, player_count, peer->getAveragePing());
+            "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10);",
+            m_server_stats_table.c_str());
     }
-    easySQLQuery(query, [peer, country_code](sqlite3_stmt* stmt)
-        {
-            if (sqlite3_bind_text(stmt, 1, StringUtils::wideToUtf8(
-                peer->getPlayerProfiles()[0]->getName()).c_str(),
+    const uint32_t host_id = peer->getHostId();
+    const uint32_t ip = peer->getAddress().getIP();
+    const std::string ipv6_addr = peer->getAddress().toString(false);
+    const uint16_t port = peer->getAddress().getPort();
+    const std::string username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    const int ping = peer->getAveragePing();
+    auto version_os = StringUtils::extractVersionOS(peer->getUserVersion());
+    m_db_connector->addWrite(DatabaseConnector::QT_SERVER_STATS, query,
+        [ipv6, host_id, ip, ipv6_addr, port, online_id, username,
+        player_count, country_code, version_os, ping](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, host_id);
+            if (ipv6)
+            {
+                sqlite3_bind_text(stmt, 2, ipv6_addr.c_str(), -1,
+                    SQLITE_TRANSIENT);
+            }
+            else
+                sqlite3_bind_int64(stmt, 2, ip);
+            sqlite3_bind_int(stmt, 3, port);
+            sqlite3_bind_int64(stmt, 4, online_id);
+            if (sqlite3_bind_text(stmt, 5, username.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(
-                    peer->getPlayerProfiles()[0]->getName()).c_str());
+                    username.c_str());
             }
+            sqlite3_bind_int(stmt, 6, player_count);
             if (country_code.empty())
             {
-                if (sqlite3_bind_null(stmt, 2) != SQLITE_OK)
+                if (sqlite3_bind_null(stmt, 7) != SQLITE_OK)
                 {
                     Log::error("easySQLQuery",
                         "Failed to bind NULL for country code.");
@@ -3898,27 +4257,26 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
             }
             else
             {
-                if (sqlite3_bind_text(stmt, 2, country_code.c_str(),
+                if (sqlite3_bind_text(stmt, 7, country_code.c_str(),
                     -1, SQLITE_TRANSIENT) != SQLITE_OK)
                 {
                     Log::error("easySQLQuery", "Failed to bind country: %s.",
                         country_code.c_str());
                 }
             }
-            auto version_os =
-                StringUtils::extractVersionOS(peer->getUserVersion());
-            if (sqlite3_bind_text(stmt, 3, version_os.first.c_str(),
+            if (sqlite3_bind_text(stmt, 8, version_os.first.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
                     version_os.first.c_str());
             }
-            if (sqlite3_bind_text(stmt, 4, version_os.second.c_str(),
+            if (sqlite3_bind_text(stmt, 9, version_os.second.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
                     version_os.second.c_str());
             }
+            sqlite3_bind_int(stmt, 10, ping);
         }
     );
 #endif
@@ -4070,6 +4428,7 @@ void ServerLobby::updateServerOwner()
         // graphics-client-server
         if (peer->isValidated() && !peer->isAIPeer() &&
             (m_process_type == PT_MAIN ||
+            STKProcess::hasIndependentChildren() ||
             peer->getHostId() == m_client_server_host_id.load()))
         {
             owner = peer;
@@ -4479,15 +4838,19 @@ void ServerLobby::handlePendingConnection()
         }
         else
         {
-            const uint32_t online_id = it->second.first;
+            const uint32_t online_id = std::get<0>(it->second);
             auto key = m_keys.find(online_id);
             if (key != m_keys.end() && key->second.m_tried == false)
             {
+                // Prefer the country code told by the validation
+                const std::string& country_code =
+                    key->second.m_country_code.empty() ?
+                    std::get<2>(it->second) : key->second.m_country_code;
                 try
                 {
-                    if (decryptConnectionRequest(peer, it->second.second,
+                    if (decryptConnectionRequest(peer, std::get<1>(it->second),
                         key->second.m_aes_key, key->second.m_aes_iv, online_id,
-                        key->second.m_name, key->second.m_country_code))
+                        key->second.m_name, country_code))
                     {
                         it = m_pending_connection.erase(it);
                         m_keys.erase(online_id);
@@ -4789,82 +5152,83 @@ void ServerLobby::resetServer()
 }   // resetServer
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForIP(STKPeer* peer) const
+/** Tests if an IPv4 address is banned, called by the database thread
+ *  until the ban index is loaded.
+ *  \param reason Set to the reason of the ban.
+ */
+bool ServerLobby::testBannedForIP(const SocketAddress& addr,
+                                  std::string* reason) const
 {
 #ifdef ENABLE_SQLITE3
     if (!m_db || !m_ip_ban_table_exists)
-        return;
+        return false;
 
     // Test for IPv4
-    if (peer->getAddress().isIPv6())
-        return;
+    if (addr.isIPv6())
+        return false;
 
     int row_id = -1;
-    unsigned ip_start = 0;
-    unsigned ip_end = 0;
+    int64_t ip_start = 0;
+    int64_t ip_end = 0;
     std::string query = StringUtils::insertValues(
         "SELECT rowid, ip_start, ip_end, reason, description FROM %s "
-        "WHERE ip_start <= %u AND ip_end >= %u "
+        "WHERE ip_start <= ?1 AND ip_end >= ?1 "
         "AND datetime('now') > datetime(starting_time) AND "
         "(expired_days is NULL OR datetime"
         "(starting_time, '+'||expired_days||' days') > datetime('now')) "
         "LIMIT 1;",
-        ServerConfig::m_ip_ban_table.c_str(),
-        peer->getAddress().getIP(), peer->getAddress().getIP());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        ServerConfig::m_ip_ban_table.c_str());
+    const uint32_t ip = addr.getIP();
+    m_db_connector->execute(query, [ip](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, ip);
+        },
+        [&](sqlite3_stmt* stmt)
         {
             row_id = sqlite3_column_int(stmt, 0);
-            ip_start = (unsigned)sqlite3_column_int64(stmt, 1);
-            ip_end = (unsigned)sqlite3_column_int64(stmt, 2);
-            const char* reason = (char*)sqlite3_column_text(stmt, 3);
+            ip_start = sqlite3_column_int64(stmt, 1);
+            ip_end = sqlite3_column_int64(stmt, 2);
+            const char* r = (char*)sqlite3_column_text(stmt, 3);
             const char* desc = (char*)sqlite3_column_text(stmt, 4);
+            *reason = r ? r : "";
             Log::info("ServerLobby", "%s banned by IP: %s "
                 "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ip_start = %u AND ip_end = %u;",
-            ServerConfig::m_ip_ban_table.c_str(), ip_start, ip_end);
-        easySQLQuery(query);
-    }
+                addr.toString().c_str(), reason->c_str(), row_id, desc);
+        });
+    if (row_id == -1)
+        return false;
+
+    query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + 1, "
+        "last_trigger = datetime('now') "
+        "WHERE ip_start = ? AND ip_end = ?;",
+        ServerConfig::m_ip_ban_table.c_str());
+    easySQLQuery(query, [ip_start, ip_end](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, ip_start);
+            sqlite3_bind_int64(stmt, 2, ip_end);
+        });
+    return true;
+#else
+    return false;
 #endif
 }   // testBannedForIP
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForIPv6(STKPeer* peer) const
+/** Tests if an IPv6 address is banned, called by the database thread
+ *  until the ban index is loaded.
+ *  \param reason Set to the reason of the ban.
+ */
+bool ServerLobby::testBannedForIPv6(const SocketAddress& addr,
+                                    std::string* reason) const
 {
 #ifdef ENABLE_SQLITE3
     if (!m_db || !m_ipv6_ban_table_exists)
-        return;
+        return false;
 
     // Test for IPv6
-    if (!peer->getAddress().isIPv6())
-        return;
+    if (!addr.isIPv6())
+        return false;
 
     int row_id = -1;
     std::string ipv6_cidr;
@@ -4876,120 +5240,102 @@ void ServerLobby::testBannedForIPv6(STKPeer* peer) const
         "(starting_time, '+'||expired_days||' days') > datetime('now')) "
         "LIMIT 1;",
         ServerConfig::m_ipv6_ban_table.c_str());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (sqlite3_bind_text(stmt, 1,
-            peer->getAddress().toString(false).c_str(), -1, SQLITE_TRANSIENT)
-            != SQLITE_OK)
+    const std::string ipv6 = addr.toString(false);
+    m_db_connector->execute(query, [this, ipv6](sqlite3_stmt* stmt)
         {
-            Log::error("ServerLobby", "Error binding ipv6 addr for query: %s",
-                sqlite3_errmsg(m_db));
-        }
-
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+            if (sqlite3_bind_text(stmt, 1, ipv6.c_str(), -1, SQLITE_TRANSIENT)
+                != SQLITE_OK)
+            {
+                Log::error("ServerLobby",
+                    "Error binding ipv6 addr for query: %s",
+                    sqlite3_errmsg(m_db));
+            }
+        },
+        [&](sqlite3_stmt* stmt)
         {
             row_id = sqlite3_column_int(stmt, 0);
             ipv6_cidr = (char*)sqlite3_column_text(stmt, 1);
-            const char* reason = (char*)sqlite3_column_text(stmt, 2);
+            const char* r = (char*)sqlite3_column_text(stmt, 2);
             const char* desc = (char*)sqlite3_column_text(stmt, 3);
+            *reason = r ? r : "";
             Log::info("ServerLobby", "%s banned by IP: %s "
                 "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+                addr.toString().c_str(), reason->c_str(), row_id, desc);
+        });
+    if (row_id == -1)
+        return false;
+
+    query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + 1, "
+        "last_trigger = datetime('now') "
+        "WHERE ipv6_cidr = ?;", ServerConfig::m_ipv6_ban_table.c_str());
+    easySQLQuery(query, [ipv6_cidr](sqlite3_stmt* stmt)
         {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ipv6_cidr = ?;", ServerConfig::m_ipv6_ban_table.c_str());
-        easySQLQuery(query, [ipv6_cidr](sqlite3_stmt* stmt)
+            if (sqlite3_bind_text(stmt, 1, ipv6_cidr.c_str(),
+                -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
-                if (sqlite3_bind_text(stmt, 1, ipv6_cidr.c_str(),
-                    -1, SQLITE_TRANSIENT) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery", "Failed to bind %s.",
-                        ipv6_cidr.c_str());
-                }
-            });
-    }
+                Log::error("easySQLQuery", "Failed to bind %s.",
+                    ipv6_cidr.c_str());
+            }
+        });
+    return true;
+#else
+    return false;
 #endif
 }   // testBannedForIPv6
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForOnlineId(STKPeer* peer,
-                                        uint32_t online_id) const
+/** Tests if an online id is banned, called by the database thread until
+ *  the ban index is loaded.
+ *  \param reason Set to the reason of the ban.
+ */
+bool ServerLobby::testBannedForOnlineId(const SocketAddress& addr,
+                                        uint32_t online_id,
+                                        std::string* reason) const
 {
 #ifdef ENABLE_SQLITE3
     if (!m_db || !m_online_id_ban_table_exists)
-        return;
+        return false;
 
     int row_id = -1;
     std::string query = StringUtils::insertValues(
         "SELECT rowid, reason, description FROM %s "
-        "WHERE online_id = %u "
+        "WHERE online_id = ? "
         "AND datetime('now') > datetime(starting_time) AND "
         "(expired_days is NULL OR datetime"
         "(starting_time, '+'||expired_days||' days') > datetime('now')) "
         "LIMIT 1;",
-        ServerConfig::m_online_id_ban_table.c_str(), online_id);
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        ServerConfig::m_online_id_ban_table.c_str());
+    m_db_connector->execute(query, [online_id](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, online_id);
+        },
+        [&](sqlite3_stmt* stmt)
         {
             row_id = sqlite3_column_int(stmt, 0);
-            const char* reason = (char*)sqlite3_column_text(stmt, 1);
+            const char* r = (char*)sqlite3_column_text(stmt, 1);
             const char* desc = (char*)sqlite3_column_text(stmt, 2);
+            *reason = r ? r : "";
             Log::info("ServerLobby", "%s banned by online id: %s "
                 "(online id: %u rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, online_id,
+                addr.toString().c_str(), reason->c_str(), online_id,
                 row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+        });
+    if (row_id == -1)
+        return false;
+
+    query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + 1, "
+        "last_trigger = datetime('now') "
+        "WHERE online_id = ?;",
+        ServerConfig::m_online_id_ban_table.c_str());
+    easySQLQuery(query, [online_id](sqlite3_stmt* stmt)
         {
-            Log::error("ServerLobby", "Error finalize database: %s",
-                sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database: %s",
-            sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE online_id = %u;",
-            ServerConfig::m_online_id_ban_table.c_str(), online_id);
-        easySQLQuery(query);
-    }
+            sqlite3_bind_int64(stmt, 1, online_id);
+        });
+    return true;
+#else
+    return false;
 #endif
 }   // testBannedForOnlineId
 
@@ -4999,6 +5345,7 @@ void ServerLobby::listBanTable()
 #ifdef ENABLE_SQLITE3
     if (!m_db)
         return;
+    std::unique_lock<std::mutex> ul = m_db_connector->lock();
     auto printer = [](void* data, int argc, char** argv, char** name)
         {
             for (int i = 0; i < argc; i++)
@@ -5028,6 +5375,110 @@ void ServerLobby::listBanTable()
 #endif
 }   // listBanTable
 
+//-----------------------------------------------------------------------------
+void ServerLobby::printDatabaseStats()
+{
+#ifdef ENABLE_SQLITE3
+    if (!m_db_connector)
+    {
+        std::cout << "No database" << std::endl;
+        return;
+    }
+    std::cout << m_db_connector->getStats();
+#endif
+}   // printDatabaseStats
+
+//-----------------------------------------------------------------------------
+/** Compares the time needed to test random IPv4 addresses for bans and
+ *  geolocation with queries and with the in memory indexes, the results are
+ *  logged by the database thread when finished.
+ *  \param count Number of addresses to test.
+ */
+void ServerLobby::benchmarkDatabaseIndex(unsigned count)
+{
+#ifdef ENABLE_SQLITE3
+    if (!m_db_connector)
+    {
+        std::cout << "No database" << std::endl;
+        return;
+    }
+    m_db_connector->addQuery(DatabaseConnector::QT_CONSOLE, [this, count]()
+        {
+            std::shared_ptr<const BanIndex> ban_index =
+                std::atomic_load(&m_ban_index);
+            std::shared_ptr<const GeolocationIndex> geolocation_index =
+                std::atomic_load(&m_geolocation_index);
+            if (!ban_index || !geolocation_index)
+            {
+                Log::warn("ServerLobby", "Database index not loaded yet.");
+                return;
+            }
+            RandomGenerator rg;
+            std::vector<uint32_t> ips(count);
+            for (uint32_t& ip : ips)
+                ip = ((uint32_t)rg.get(65536) << 16) | rg.get(65536);
+
+            // Same query as testBannedForIP without the trigger update
+            std::string query = StringUtils::insertValues(
+                "SELECT rowid, reason FROM %s "
+                "WHERE ip_start <= ?1 AND ip_end >= ?1 "
+                "AND datetime('now') > datetime(starting_time) AND "
+                "(expired_days is NULL OR datetime"
+                "(starting_time, '+'||expired_days||' days') > "
+                "datetime('now')) LIMIT 1;",
+                ServerConfig::m_ip_ban_table.c_str());
+            std::vector<std::string> sql_results(count);
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned i = 0; i < count; i++)
+            {
+                const uint32_t ip = ips[i];
+                bool banned = false;
+                if (m_ip_ban_table_exists)
+                {
+                    m_db_connector->execute(query, [ip](sqlite3_stmt* stmt)
+                        {
+                            sqlite3_bind_int64(stmt, 1, ip);
+                        },
+                        [&banned](sqlite3_stmt* stmt) { banned = true; });
+                }
+                sql_results[i] = banned ?
+                    "banned" : ip2Country(SocketAddress(ip));
+            }
+            auto sql_end = std::chrono::steady_clock::now();
+
+            std::vector<std::string> index_results(count);
+            for (unsigned i = 0; i < count; i++)
+            {
+                const uint32_t ip = ips[i];
+                index_results[i] = ban_index->m_ip_index.find(ip) != -1 ?
+                    "banned" : findCountry(*geolocation_index,
+                    SocketAddress(ip));
+            }
+            auto index_end = std::chrono::steady_clock::now();
+
+            unsigned mismatches = 0;
+            for (unsigned i = 0; i < count; i++)
+            {
+                if (sql_results[i] != index_results[i])
+                    mismatches++;
+            }
+            using namespace std::chrono;
+            double sql_us =
+                (double)duration_cast<nanoseconds>(sql_end - start).count() /
+                1000.0;
+            double index_us = (double)duration_cast<nanoseconds>
+                (index_end - sql_end).count() / 1000.0;
+            Log::info("ServerLobby", "%u lookups: queries %.3fus, index "
+                "%.3fus per address (%d ban and %d geolocation segments), "
+                "%u different results.", count,
+                sql_us / std::max(count, 1u), index_us / std::max(count, 1u),
+                (int)ban_index->m_ip_index.getNumSegments(),
+                (int)geolocation_index->m_ip_index.getNumSegments(),
+                mismatches);
+        });
+#endif
+}   // benchmarkDatabaseIndex
+
 //-----------------------------------------------------------------------------
 float ServerLobby::getStartupBoostOrPenaltyForKart(uint32_t ping,
                                                    unsigned kart_id)
@@ -33,12 +33,14 @@
 #include <memory>
 #include <mutex>
 #include <set>
+#include <tuple>
 
 #ifdef ENABLE_SQLITE3
 #include <sqlite3.h>
 #endif
 
 class BareNetworkString;
+class DatabaseConnector;
 class NetworkItemManager;
 class NetworkString;
 class NetworkPlayerProfile;
@@ -83,6 +85,22 @@ private:
 #ifdef ENABLE_SQLITE3
     sqlite3* m_db;
 
+    /** Runs all queries except during initialization, NULL if there is no
+     *  database. */
+    DatabaseConnector* m_db_connector;
+
+    struct BanIndex;
+
+    struct GeolocationIndex;
+
+    /** Active bans, rebuilt by the database thread and replaced with
+     *  std::atomic_store, so a connecting player is tested without queries.
+     *  NULL until the first load. */
+    std::shared_ptr<const BanIndex> m_ban_index;
+
+    /** Geolocation tables, loaded once by the database thread. */
+    std::shared_ptr<const GeolocationIndex> m_geolocation_index;
+
     std::string m_server_stats_table;
 
     bool m_ip_ban_table_exists;
@@ -104,9 +122,19 @@ private:
 
     void checkTableExists(const std::string& table, bool& result);
 
-    std::string ip2Country(const SocketAddress& addr) const;
+    std::string ip2Country(const SocketAddress& addr);
+
+    std::string ipv62Country(const SocketAddress& addr);
+
+    void loadBanIndex();
+
+    void loadGeolocationIndex();
+
+    bool findBan(const BanIndex& index, const SocketAddress& addr,
+                 uint32_t online_id, std::string* reason);
 
-    std::string ipv62Country(const SocketAddress& addr) const;
+    std::string findCountry(const GeolocationIndex& index,
+                            const SocketAddress& addr) const;
 #endif
     void initDatabase();
 
@@ -178,8 +206,10 @@ private:
 
     std::map<uint32_t, KeyData> m_keys;
 
+    /** Online id, encrypted connection request and the country code found by
+     *  geolocation of peers waiting for their key. */
     std::map<std::weak_ptr<STKPeer>,
-        std::pair<uint32_t, BareNetworkString>,
+        std::tuple<uint32_t, BareNetworkString, std::string>,
         std::owner_less<std::weak_ptr<STKPeer> > > m_pending_connection;
 
     std::map<std::string, uint64_t> m_pending_peer_connection;
@@ -314,6 +344,11 @@ private:
         std::swap(m_keys, new_keys);
     }
     void handlePendingConnection();
+    void handleConnectionChecked(std::shared_ptr<STKPeer> peer,
+                                 BareNetworkString& data,
+                                 unsigned player_count, uint32_t online_id,
+                                 uint32_t encrypted_size,
+                                 const std::string& country_code);
     void handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
                                      BareNetworkString& data,
                                      uint32_t online_id,
@@ -369,9 +404,12 @@ private:
     void clientInGameWantsToBackLobby(Event* event);
     void clientSelectingAssetsWantsToBackLobby(Event* event);
     void kickPlayerWithReason(STKPeer* peer, const char* reason) const;
-    void testBannedForIP(STKPeer* peer) const;
-    void testBannedForIPv6(STKPeer* peer) const;
-    void testBannedForOnlineId(STKPeer* peer, uint32_t online_id) const;
+    bool testBannedForIP(const SocketAddress& addr,
+                         std::string* reason) const;
+    bool testBannedForIPv6(const SocketAddress& addr,
+                           std::string* reason) const;
+    bool testBannedForOnlineId(const SocketAddress& addr, uint32_t online_id,
+                               std::string* reason) const;
     void writeDisconnectInfoTable(STKPeer* peer);
     void writePlayerReport(Event* event);
     bool supportsAI();
@@ -404,6 +442,8 @@ public:
     void saveInitialItems(std::shared_ptr<NetworkItemManager> nim);
     void saveIPBanTable(const SocketAddress& addr);
     void listBanTable();
+    void printDatabaseStats();
+    void benchmarkDatabaseIndex(unsigned count);
     void initServerStatsTable();
     bool isAIProfile(const std::shared_ptr<NetworkPlayerProfile>& npp) const
     {
@@ -21,9 +21,22 @@
 #include "network/network_config.hpp"
 #include "network/rewinder.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/state_relevancy.hpp"
 #include "items/projectile_manager.hpp"
 #include "utils/log.hpp"
 
+#include <mutex>
+
+// ============================================================================
+/** A client receives many states per second which are deleted after the next
+ *  confirmed state, so their buffers are kept for reuse instead of being
+ *  freed. */
+static std::mutex g_buffer_pool_mutex;
+static std::vector<std::vector<uint8_t> > g_pooled_buffers;
+/** Limits of the pool, larger buffers are freed. */
+static const unsigned MAX_POOLED_BUFFERS = 128;
+static const size_t MAX_POOLED_BUFFER_CAPACITY = 65536;
+
 /** Constructor for a state: it only takes the size, and allocates a buffer
  *  for all state info.
  *  \param size Necessary buffer size for a state.
@@ -48,18 +61,19 @@ void RewindInfo::setTicks(int ticks)
 
 // ============================================================================
 RewindInfoState::RewindInfoState(int ticks, int start_offset,
-                                 std::vector<std::string>& rewinder_using,
                                  std::vector<uint8_t>& buffer)
                : RewindInfo(ticks, true/*is_confirmed*/)
 {
-    std::swap(m_rewinder_using, rewinder_using);
     m_start_offset = start_offset;
-    m_buffer = new BareNetworkString();
-    std::swap(m_buffer->getBuffer(), buffer);
+    m_buffer = new BareNetworkString(0);
+    // Copy into a recycled buffer, so the buffer of the caller (usually a
+    // pooled received message) is kept too
+    m_buffer->getBuffer() = getPooledBuffer();
+    m_buffer->getBuffer().assign(buffer.begin(), buffer.end());
 }   // RewindInfoState
 
 // ------------------------------------------------------------------------
-/** Constructor used only in unit testing (without list of rewinder using).
+/** Constructor used only in unit testing (without rewinder names and ids).
  */
 RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
                                  bool is_confirmed)
@@ -69,6 +83,45 @@ RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
     m_buffer = buffer;
 }   // RewindInfoState
 
+// ------------------------------------------------------------------------
+RewindInfoState::~RewindInfoState()
+{
+    if (m_buffer)
+        releasePooledBuffer(&m_buffer->getBuffer());
+    delete m_buffer;
+}   // ~RewindInfoState
+
+// ------------------------------------------------------------------------
+/** Returns an empty buffer, which has the capacity of a previous state if
+ *  one is available in the pool.
+ */
+std::vector<uint8_t> RewindInfoState::getPooledBuffer()
+{
+    std::vector<uint8_t> buffer;
+    std::lock_guard<std::mutex> lock(g_buffer_pool_mutex);
+    if (!g_pooled_buffers.empty())
+    {
+        std::swap(buffer, g_pooled_buffers.back());
+        g_pooled_buffers.pop_back();
+    }
+    return buffer;
+}   // getPooledBuffer
+
+// ------------------------------------------------------------------------
+/** Moves the content of the buffer into the pool if the pool is not full and
+ *  the buffer is not too big.
+ */
+void RewindInfoState::releasePooledBuffer(std::vector<uint8_t>* buffer)
+{
+    if (buffer->capacity() == 0 ||
+        buffer->capacity() > MAX_POOLED_BUFFER_CAPACITY)
+        return;
+    buffer->clear();
+    std::lock_guard<std::mutex> lock(g_buffer_pool_mutex);
+    if (g_pooled_buffers.size() < MAX_POOLED_BUFFERS)
+        g_pooled_buffers.push_back(std::move(*buffer));
+}   // releasePooledBuffer
+
 // ------------------------------------------------------------------------
 /** Rewinds to this state. This is called while going forwards in time
  *  again to reach current time. It will call rewindToState().
@@ -78,23 +131,44 @@ void RewindInfoState::restore()
 {
     m_buffer->reset();
     m_buffer->skip(m_start_offset);
-    for (const std::string& name : m_rewinder_using)
+    RewindManager* rwm = RewindManager::get();
+
+    // Names of new rewinder ids (or all ids once per second)
+    const unsigned names_size = m_buffer->getUInt8();
+    for (unsigned i = 0; i < names_size; i++)
+    {
+        const uint16_t id = m_buffer->getUInt16();
+        std::string name;
+        m_buffer->decodeString(&name);
+        rwm->setRewinderName(id, name);
+    }
+
+    const unsigned rewinder_size = m_buffer->getUInt8();
+    for (unsigned i = 0; i < rewinder_size; i++)
     {
+        const uint16_t id = m_buffer->getUInt16();
         const uint16_t data_size = m_buffer->getUInt16();
+        if (data_size == StateRelevancy::OMITTED_STATE)
+        {
+            // The server didn't send the state of this rewinder, so it keeps
+            // the state predicted at these ticks
+            if (std::shared_ptr<Rewinder> r = rwm->getRewinderByID(id))
+                restorePredictedState(r.get());
+            continue;
+        }
         const unsigned current_offset_now = m_buffer->getCurrentOffset();
-        std::shared_ptr<Rewinder> r =
-            RewindManager::get()->getRewinder(name);
+        std::shared_ptr<Rewinder> r = rwm->getRewinderByID(id);
 
-        if (!r)
+        if (!r && !rwm->getRewinderName(id).empty())
         {
             // For now we only need to get missing rewinder from
             // projectile_manager
-            r = ProjectileManager::get()->addRewinderFromNetworkState(name);
+            r = ProjectileManager::get()->addRewinderFromNetworkState(
+                rwm->getRewinderName(id));
         }
         if (!r)
         {
-            Log::error("RewindInfoState", "Missing rewinder %s",
-                name.c_str());
+            Log::error("RewindInfoState", "Missing rewinder id %d", id);
             m_buffer->skip(data_size);
             continue;
         }
@@ -121,6 +195,102 @@ void RewindInfoState::restore()
     }   // for all rewinder
 }   // restore
 
+// ----------------------------------------------------------------------------
+/** Restores the state predicted in this client for a rewinder which was
+ *  omitted from this state by the server, see StateRelevancy. Without it the
+ *  rewinder would be considered as removed in server after the rewind.
+ *  \param r The rewinder to restore.
+ */
+void RewindInfoState::restorePredictedState(Rewinder* r)
+{
+    const std::string* predicted =
+        RewindManager::get()->getPredictedState(getTicks(),
+        r->getUniqueIdentity());
+    if (!predicted)
+    {
+        Log::warn("RewindInfoState", "Missing predicted state of %s.",
+            r->getUniqueIdentity().c_str());
+        return;
+    }
+    BareNetworkString state(predicted->data(), (int)predicted->size());
+    try
+    {
+        r->restoreState(&state, state.size());
+    }
+    catch (std::exception& e)
+    {
+        Log::error("RewindInfoState", "Restore predicted state error: %s",
+            e.what());
+    }
+}   // restorePredictedState
+
+// ----------------------------------------------------------------------------
+/** Checks if any rewinder in this (confirmed) state differs from the state
+ *  predicted in this client at the same ticks. Rewinders which are not in
+ *  the predicted states (like a flyable created by the server) always count
+ *  as diverged. Rewinders omitted by the server (see StateRelevancy) keep
+ *  their predicted state, so they never diverge.
+ *  \param predicted Predicted states indexed by the unique identity.
+ *  \param num_found Increased by the number of predicted rewinders found
+ *         in this state, if it's less than the number of predicted states
+ *         a rewinder was removed in server (see RewindManager::
+ *         canSkipRewind).
+ */
+bool RewindInfoState::isDiverged(
+                          const std::map<std::string, std::string>& predicted,
+                          unsigned* num_found)
+{
+    m_buffer->reset();
+    m_buffer->skip(m_start_offset);
+    RewindManager* rwm = RewindManager::get();
+    bool diverged = false;
+    try
+    {
+        // The names are needed to find the rewinders, they are set again
+        // when the state is restored
+        const unsigned names_size = m_buffer->getUInt8();
+        for (unsigned i = 0; i < names_size; i++)
+        {
+            const uint16_t id = m_buffer->getUInt16();
+            std::string name;
+            m_buffer->decodeString(&name);
+            rwm->setRewinderName(id, name);
+        }
+
+        const unsigned rewinder_size = m_buffer->getUInt8();
+        for (unsigned i = 0; i < rewinder_size && !diverged; i++)
+        {
+            const uint16_t id = m_buffer->getUInt16();
+            const uint16_t data_size = m_buffer->getUInt16();
+            auto it = predicted.find(rwm->getRewinderName(id));
+            if (it != predicted.end())
+                (*num_found)++;
+            // Omitted rewinders keep their predicted state
+            if (data_size == StateRelevancy::OMITTED_STATE)
+                continue;
+            const unsigned current_offset_now = m_buffer->getCurrentOffset();
+            std::shared_ptr<Rewinder> r = rwm->getRewinderByID(id);
+            if (it == predicted.end() || !r)
+            {
+                diverged = true;
+                break;
+            }
+            BareNetworkString state(it->second.data(),
+                (int)it->second.size());
+            diverged = r->isStateDiverged(&state, m_buffer, data_size);
+            m_buffer->reset();
+            m_buffer->skip(current_offset_now + data_size);
+        }
+    }
+    catch (std::exception& e)
+    {
+        Log::error("RewindInfoState", "Compare state error: %s", e.what());
+        diverged = true;
+    }
+    m_buffer->reset();
+    return diverged;
+}   // isDiverged
+
 // ============================================================================
 RewindInfoEvent::RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
                                  BareNetworkString *buffer, bool is_confirmed)
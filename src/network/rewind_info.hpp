@@ -27,9 +27,12 @@
 
 #include <assert.h>
 #include <functional>
+#include <map>
 #include <string>
 #include <vector>
 
+class Rewinder;
+
 /** Used to store rewind information for a given time for all rewind
  *  instances.
  *  Rewind information can either be a state (for example a kart would
@@ -92,25 +95,30 @@ public:
 class RewindInfoState: public RewindInfo
 {
 private:
-    std::vector<std::string> m_rewinder_using;
-
+    /** Offset of the rewinder names in \ref m_buffer. */
     int m_start_offset;
 
     /** Pointer to the buffer which stores all states. */
     BareNetworkString *m_buffer;
 
+    static std::vector<uint8_t> getPooledBuffer();
+    static void releasePooledBuffer(std::vector<uint8_t>* buffer);
+    void restorePredictedState(Rewinder* r);
+
 public:
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, int start_offset,
-                    std::vector<std::string>& rewinder_using,
                     std::vector<uint8_t>& buffer);
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
     // ------------------------------------------------------------------------
-    virtual ~RewindInfoState()                             { delete m_buffer; }
+    virtual ~RewindInfoState();
     // ------------------------------------------------------------------------
     virtual void restore();
     // ------------------------------------------------------------------------
+    bool isDiverged(const std::map<std::string, std::string>& predicted,
+                    unsigned* num_found);
+    // ------------------------------------------------------------------------
     /** Returns a pointer to the state buffer. */
     BareNetworkString *getBuffer() const { return m_buffer; }
     // ------------------------------------------------------------------------
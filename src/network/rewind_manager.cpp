@@ -23,9 +23,11 @@
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/protocols/game_protocol.hpp"
+#include "network/protocols/lobby_protocol.hpp"
 #include "network/rewinder.hpp"
 #include "network/rewind_info.hpp"
 #include "network/smooth_network_body.hpp"
+#include "network/tick_profiler.hpp"
 #include "physics/physics.hpp"
 #include "race/history.hpp"
 #include "tracks/check_manager.hpp"
@@ -87,12 +89,20 @@ void RewindManager::reset()
     m_is_rewinding = false;
     m_not_rewound_ticks.store(0);
     m_overall_state_size = 0;
+    m_all_names_sent_ticks = -1;
+    m_rewind_count = 0;
+    m_skipped_rewind_count = 0;
+    m_predicted_state.clear();
     m_state_frequency = stk_config->getPhysicsFPS() /
         NetworkConfig::get()->getStateFrequency();
 
     if (!m_enable_rewind_manager) return;
 
     clearExpiredRewinder();
+    // The world ticks start from 0 again, and all names are sent in the
+    // first state
+    for (auto& free_id : m_free_rewinder_ids)
+        free_id.first = 0;
     m_rewind_queue.reset();
 }   // reset
 
@@ -154,29 +164,58 @@ void RewindManager::addNetworkState(BareNetworkString *buffer, int ticks)
 void RewindManager::saveState()
 {
     PROFILER_PUSH_CPU_MARKER("RewindManager - save state", 0x20, 0x7F, 0x20);
+    TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_STATE);
     auto gp = GameProtocol::lock();
     if (!gp)
         return;
     gp->startNewState();
 
-    m_overall_state_size = 0;
-    std::vector<std::string> rewinder_using;
+    // Names of new rewinders are sent for one second, and names of all
+    // rewinders once per second (or when a player live joined recently),
+    // so that clients can map the ids even if some states are lost
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    const int resend_ticks = stk_config->time2Ticks(1.0f);
+    bool send_all_names = m_all_names_sent_ticks == -1 ||
+        ticks - m_all_names_sent_ticks >= resend_ticks;
+    if (auto lp = LobbyProtocol::get<LobbyProtocol>())
+        send_all_names = send_all_names || lp->hasLiveJoiningRecently();
+    if (send_all_names)
+        m_all_names_sent_ticks = ticks;
+    for (auto& p : m_all_rewinder)
+    {
+        auto r = p.second.lock();
+        if (!r)
+            continue;
+        const RewinderIDInfo& info = m_rewinder_ids[r->getRewinderID()];
+        if (send_all_names || ticks - info.m_added_ticks < resend_ticks)
+            gp->addRewinderName(r->getRewinderID(), info.m_name);
+    }
 
+    // The same states are used as keyframe of a streamed history
+    const bool keyframe = history->needsKeyframe(ticks);
+    std::map<std::string, std::string> keyframe_states;
+    m_overall_state_size = 0;
     for (auto& p : m_all_rewinder)
     {
-        // TODO: check if it's worth passing in a sufficiently large buffer from
-        // GameProtocol - this would save the copy operation.
         BareNetworkString* buffer = NULL;
-        if (auto r = p.second.lock())
-            buffer = r->saveState(&rewinder_using);
+        auto r = p.second.lock();
+        if (r)
+            buffer = r->saveState();
         if (buffer != NULL)
         {
             m_overall_state_size += buffer->size();
-            gp->addState(buffer);
+            if (keyframe)
+            {
+                keyframe_states[p.first] = std::string(buffer->getData(),
+                    buffer->getTotalSize());
+            }
+            gp->addState(r.get(), buffer);
         }
         delete buffer;    // buffer can be freed
     }
-    gp->finalizeState(rewinder_using);
+    gp->finalizeState();
+    if (keyframe)
+        history->addKeyframe(ticks, keyframe_states);
     PROFILER_POP_CPU_MARKER();
 }   // saveState
 
@@ -209,6 +248,9 @@ void RewindManager::update(int ticks_not_used)
             if (auto r = p.second.lock())
                 ret.push_back(r->getLocalStateRestoreFunction());
         }
+        auto& predicted = m_predicted_state[ticks];
+        predicted.clear();
+        savePredictedStates(&predicted);
     }
     else
     {
@@ -220,6 +262,49 @@ void RewindManager::update(int ticks_not_used)
     PROFILER_POP_CPU_MARKER();
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Saves the state predicted in this client of all rewinders which don't
+ *  have a state in the given map yet.
+ *  \param predicted The predicted states indexed by the unique identity.
+ */
+void RewindManager::savePredictedStates(
+                                std::map<std::string, std::string>* predicted)
+{
+    for (auto& p : m_all_rewinder)
+    {
+        if (predicted->find(p.first) != predicted->end())
+            continue;
+        auto r = p.second.lock();
+        if (!r)
+            continue;
+        BareNetworkString* buffer = r->savePredictedState();
+        if (buffer)
+        {
+            (*predicted)[p.first] = std::string(buffer->getCurrentData(),
+                buffer->size());
+        }
+        delete buffer;
+    }
+}   // savePredictedStates
+
+// ----------------------------------------------------------------------------
+/** Returns the state of a rewinder predicted in this client at the given
+ *  ticks, or NULL if it was not saved.
+ *  \param ticks The ticks of a state.
+ *  \param name The unique identity of the rewinder.
+ */
+const std::string* RewindManager::getPredictedState(int ticks,
+                                               const std::string& name) const
+{
+    auto it = m_predicted_state.find(ticks);
+    if (it == m_predicted_state.end())
+        return NULL;
+    auto state = it->second.find(name);
+    if (state == it->second.end())
+        return NULL;
+    return &state->second;
+}   // getPredictedState
+
 // ----------------------------------------------------------------------------
 /** Replays all events from the last event played till the specified time.
  *  \param world_ticks Up to (and inclusive) which time events will be replayed.
@@ -228,6 +313,7 @@ void RewindManager::update(int ticks_not_used)
  */
 void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
 {
+    TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_REWIND);
     // We add the RewindInfoEventFunction to rewind queue before and after
     // possible rewind, some RewindInfoEventFunction can be created during
     // rewind
@@ -241,8 +327,19 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     // be getTime()+dt - world time has not been updated yet).
     m_rewind_queue.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
 
+    // Most confirmed states are the same as predicted (apart from small
+    // physics differences), a rewind is only needed if they diverged
+    if (needs_rewind && canSkipRewind(rewind_ticks))
+    {
+        needs_rewind = false;
+        m_skipped_rewind_count++;
+        eraseBefore(&m_local_state, rewind_ticks);
+        eraseBefore(&m_predicted_state, rewind_ticks);
+    }
+
     if (needs_rewind)
     {
+        m_rewind_count++;
         Log::setPrefix("Rewind");
         PROFILER_PUSH_CPU_MARKER("Rewind", 128, 128, 128);
         rewindTo(rewind_ticks, world_ticks, fast_forward);
@@ -265,6 +362,36 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     m_is_rewinding = false;
 }   // playEventsTill
 
+// ----------------------------------------------------------------------------
+/** Checks if a rewind to a confirmed state can be skipped, which is the case
+ *  if the confirmed state(s) match the state predicted at the same ticks
+ *  and no events need to be replayed. A rewinder which is predicted but
+ *  missing from the confirmed state (like a disconnected kart or a flyable
+ *  rejected by the server) needs a rewind, so that it's removed in
+ *  computeError.
+ *  \param rewind_ticks Ticks of the confirmed state.
+ */
+bool RewindManager::canSkipRewind(int rewind_ticks)
+{
+    if (m_rewind_queue.hasUnplayedEventsFrom(rewind_ticks))
+        return false;
+    auto it = m_predicted_state.find(rewind_ticks);
+    if (it == m_predicted_state.end())
+        return false;
+    std::vector<RewindInfo*> states =
+        m_rewind_queue.getConfirmedStates(rewind_ticks);
+    if (states.empty())
+        return false;
+    unsigned num_found = 0;
+    for (RewindInfo* ri : states)
+    {
+        RewindInfoState* state = dynamic_cast<RewindInfoState*>(ri);
+        if (!state || state->isDiverged(it->second, &num_found))
+            return false;
+    }
+    return num_found == it->second.size();
+}   // canSkipRewind
+
 // ----------------------------------------------------------------------------
 /** Adds a Rewinder to the list of all rewinders.
  *  \return true If successfully added, false otherwise.
@@ -275,10 +402,108 @@ bool RewindManager::addRewinder(std::shared_ptr<Rewinder> rewinder)
     // Maximum 1 bit to store no of rewinder used
     if (m_all_rewinder.size() == 255)
         return false;
-    m_all_rewinder[rewinder->getUniqueIdentity()] = rewinder;
+    const std::string& uid = rewinder->getUniqueIdentity();
+    if (NetworkConfig::get()->isServer())
+    {
+        uint16_t id;
+        const int ticks = World::getWorld() ?
+            World::getWorld()->getTicksSinceStart() : 0;
+        auto it = m_rewinder_id_map.find(uid);
+        if (it != m_rewinder_id_map.end())
+            id = it->second;
+        else if (!m_free_rewinder_ids.empty() &&
+                 m_free_rewinder_ids.front().first <= ticks)
+        {
+            id = m_free_rewinder_ids.front().second;
+            m_free_rewinder_ids.pop_front();
+            m_rewinder_id_map[uid] = id;
+            m_rewinder_ids[id].m_name = uid;
+        }
+        else
+        {
+            if (m_rewinder_ids.size() > 65535)
+            {
+                Log::error("RewindManager", "No rewinder id left.");
+                return false;
+            }
+            id = (uint16_t)m_rewinder_ids.size();
+            m_rewinder_id_map[uid] = id;
+            m_rewinder_ids.emplace_back();
+            m_rewinder_ids.back().m_name = uid;
+        }
+        RewinderIDInfo& info = m_rewinder_ids[id];
+        info.m_rewinder = rewinder;
+        info.m_added_ticks = ticks;
+        rewinder->setRewinderID(id);
+    }
+    m_all_rewinder[uid] = rewinder;
     return true;
 }   // addRewinder
 
+// ----------------------------------------------------------------------------
+/** Called in server when a rewinder expired (like a flyable which exploded),
+ *  so its id can be used by a new rewinder later.
+ *  \param uid The unique identity of the expired rewinder.
+ */
+void RewindManager::freeRewinderID(const std::string& uid)
+{
+    if (!NetworkConfig::get()->isServer())
+        return;
+    auto it = m_rewinder_id_map.find(uid);
+    if (it == m_rewinder_id_map.end())
+        return;
+    const uint16_t id = it->second;
+    m_rewinder_id_map.erase(it);
+    m_rewinder_ids[id].m_name.clear();
+    m_rewinder_ids[id].m_rewinder.reset();
+    // Late states for the old rewinder may still arrive in clients, and
+    // they need to receive the new name before the id is used
+    const int ticks = World::getWorld() ?
+        World::getWorld()->getTicksSinceStart() : 0;
+    m_free_rewinder_ids.emplace_back(ticks + stk_config->time2Ticks(5.0f),
+        id);
+}   // freeRewinderID
+
+// ----------------------------------------------------------------------------
+/** Sets the unique identity of a rewinder id, called in client when the
+ *  name of an id is received in a state.
+ *  \param id The rewinder id.
+ *  \param name The unique identity of the rewinder.
+ */
+void RewindManager::setRewinderName(uint16_t id, const std::string& name)
+{
+    assert(NetworkConfig::get()->isClient());
+    if (id >= m_rewinder_ids.size())
+        m_rewinder_ids.resize(id + 1);
+    RewinderIDInfo& info = m_rewinder_ids[id];
+    if (info.m_name != name)
+    {
+        info.m_name = name;
+        info.m_rewinder.reset();
+    }
+}   // setRewinderName
+
+// ----------------------------------------------------------------------------
+/** Returns the rewinder using the given id, the rewinder is looked up by its
+ *  name only the first time (or after it was recreated) and cached later.
+ *  \param id The rewinder id.
+ *  \return The rewinder, or nullptr if it's not found or the name of this
+ *  id is unknown yet.
+ */
+std::shared_ptr<Rewinder> RewindManager::getRewinderByID(uint16_t id)
+{
+    if (id >= m_rewinder_ids.size())
+        return nullptr;
+    RewinderIDInfo& info = m_rewinder_ids[id];
+    if (auto r = info.m_rewinder.lock())
+        return r;
+    if (info.m_name.empty())
+        return nullptr;
+    std::shared_ptr<Rewinder> r = getRewinder(info.m_name);
+    info.m_rewinder = r;
+    return r;
+}   // getRewinderByID
+
 // ----------------------------------------------------------------------------
 /** Rewinds to the specified time, then goes forward till the current
  *  World::getTime() is reached again: it will replay everything before
@@ -297,6 +522,11 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
     bool is_history = history->replayHistory();
     history->setReplayHistory(false);
 
+    // Rewinders omitted from the confirmed state by the server keep their
+    // predicted state (see RewindInfoState::restore). Rewinders without one
+    // (like after live join) keep their current state instead.
+    savePredictedStates(&m_predicted_state[rewind_ticks]);
+
     // First save all current transforms so that the error
     // can be computed between the transforms before and after
     // the rewind.
@@ -381,7 +611,18 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
     // Now go forward through the list of rewind infos till we reach 'now':
     while (world->getTicksSinceStart() < now_ticks)
     { 
-        m_rewind_queue.replayAllEvents(world->getTicksSinceStart());
+        const int ticks = world->getTicksSinceStart();
+        m_rewind_queue.replayAllEvents(ticks);
+
+        // The states predicted before the rewind are outdated, save the
+        // replayed ones so later confirmed states are compared with them
+        if (!fast_forward && ticks > exact_rewind_ticks &&
+            shouldSaveState(ticks))
+        {
+            auto& predicted = m_predicted_state[ticks];
+            predicted.clear();
+            savePredictedStates(&predicted);
+        }
 
         // Now simulate the next time step
         if (!fast_forward)
@@ -401,6 +642,11 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
             r->computeError();
     }
 
+    if (fast_forward)
+        m_predicted_state.clear();
+    else
+        eraseBefore(&m_predicted_state, exact_rewind_ticks);
+
     history->setReplayHistory(is_history);
     m_is_rewinding = false;
     mergeRewindInfoEventFunction();
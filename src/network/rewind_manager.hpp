@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <atomic>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <map>
@@ -93,9 +94,51 @@ private:
 
     std::map<int, std::vector<std::function<void()> > > m_local_state;
 
+    /** States predicted by this client at the ticks a state is saved in
+     *  server, indexed by ticks and the unique identity of the rewinder.
+     *  A rewind is skipped if the confirmed state doesn't differ from
+     *  them, and rewinders omitted from a confirmed state are restored from
+     *  them. */
+    std::map<int, std::map<std::string, std::string> > m_predicted_state;
+
+    /** Number of rewinds done and skipped since the last reset. */
+    unsigned m_rewind_count;
+    unsigned m_skipped_rewind_count;
+
     /** A list of all objects that can be rewound. */
     std::map<std::string, std::weak_ptr<Rewinder> > m_all_rewinder;
 
+    /** Information about a rewinder id used in network states. */
+    struct RewinderIDInfo
+    {
+        /** Unique identity of the rewinder. */
+        std::string m_name;
+        /** Cached rewinder, so a state can be restored without looking up
+         *  the name. */
+        std::weak_ptr<Rewinder> m_rewinder;
+        /** World ticks when the rewinder was added (server only). */
+        int m_added_ticks;
+        RewinderIDInfo() : m_added_ticks(0) {}
+    };
+
+    /** All rewinder ids, indexed by the id. In server the ids are assigned
+     *  in addRewinder, in client they are set from the names sent in
+     *  states. */
+    std::vector<RewinderIDInfo> m_rewinder_ids;
+
+    /** Maps the unique identity to the rewinder id (server only), so a
+     *  rewinder added again (like a kart after live join) keeps its id. */
+    std::map<std::string, uint16_t> m_rewinder_id_map;
+
+    /** Ids of expired rewinders (server only) with the world ticks from
+     *  which they can be used again. They are not reused immediately, so
+     *  clients don't apply states still in flight for the old rewinder to
+     *  the new one. */
+    std::deque<std::pair<int, uint16_t> > m_free_rewinder_ids;
+
+    /** World ticks when the names of all rewinders were sent last time. */
+    int m_all_names_sent_ticks;
+
     /** The queue that stores all rewind infos. */
     RewindQueue m_rewind_queue;
 
@@ -126,6 +169,7 @@ private:
         {
             if (it->second.expired())
             {
+                freeRewinderID(it->first);
                 it = m_all_rewinder.erase(it);
                 continue;
             }
@@ -133,7 +177,19 @@ private:
         }
     }
     // ------------------------------------------------------------------------
+    void freeRewinderID(const std::string& uid);
+    // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
+    // ------------------------------------------------------------------------
+    bool canSkipRewind(int rewind_ticks);
+    // ------------------------------------------------------------------------
+    void savePredictedStates(std::map<std::string, std::string>* predicted);
+    // ------------------------------------------------------------------------
+    template<typename T> static void eraseBefore(std::map<int, T>* m,
+                                                 int ticks)
+    {
+        m->erase(m->begin(), m->lower_bound(ticks));
+    }   // eraseBefore
 
 public:
     // First static functions to manage rewinding.
@@ -188,6 +244,23 @@ public:
     // ------------------------------------------------------------------------
     bool addRewinder(std::shared_ptr<Rewinder> rewinder);
     // ------------------------------------------------------------------------
+    void setRewinderName(uint16_t id, const std::string& name);
+    // ------------------------------------------------------------------------
+    std::shared_ptr<Rewinder> getRewinderByID(uint16_t id);
+    // ------------------------------------------------------------------------
+    const std::string* getPredictedState(int ticks,
+                                         const std::string& name) const;
+    // ------------------------------------------------------------------------
+    /** Returns the unique identity of the rewinder id, or an empty string if
+     *  the name of this id is unknown. */
+    const std::string& getRewinderName(uint16_t id) const
+    {
+        static const std::string empty;
+        if (id >= m_rewinder_ids.size())
+            return empty;
+        return m_rewinder_ids[id].m_name;
+    }   // getRewinderName
+    // ------------------------------------------------------------------------
     /** Returns true if currently a rewind is happening. */
     bool isRewinding() const { return m_is_rewinding; }
 
@@ -220,6 +293,10 @@ public:
     void resetSmoothNetworkBody()     { m_schedule_reset_network_body = true; }
     // ------------------------------------------------------------------------
     void handleResetSmoothNetworkBody();
+    // ------------------------------------------------------------------------
+    unsigned getRewindCount() const                  { return m_rewind_count; }
+    // ------------------------------------------------------------------------
+    unsigned getSkippedRewindCount() const   { return m_skipped_rewind_count; }
 
 };   // RewindManager
 
@@ -28,6 +28,11 @@
 #include "network/rewind_manager.hpp"
 
 #include <algorithm>
+#include <chrono>
+
+/** Number of ticks the ring buffer is created with, it is doubled when more
+ *  ticks are needed. */
+static const unsigned INITIAL_TICKS = 256;
 
 /** The RewindQueue stores one TimeStepInfo for each time step done.
  *  The TimeStepInfo stores all states and events to be used at the
@@ -45,6 +50,11 @@
  */
 RewindQueue::RewindQueue()
 {
+    m_slots.resize(INITIAL_TICKS);
+    m_slot_mask = INITIAL_TICKS - 1;
+    m_first_ticks = 0;
+    m_num_ticks = 0;
+    m_size = 0;
     reset();
 }   // RewindQueue
 
@@ -74,13 +84,23 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    for (int ticks = m_first_ticks; ticks < m_first_ticks + m_num_ticks;
+         ticks++)
+    {
+        TickSlot& slot = m_slots[getSlotIndex(ticks)];
+        for (RewindInfo* ri : slot)
+            delete ri;
+        slot.clear();
+    }
 
-    m_all_rewind_info.clear();
-    m_current = m_all_rewind_info.end();
+    m_first_slot = 0;
+    m_first_ticks = 0;
+    m_num_ticks = 0;
+    m_size = 0;
+    m_current_ticks = 0;
+    m_current_index = 0;
     m_latest_confirmed_state_time = -1;
+    m_latest_unplayed_event_ticks = -1;
 }   // reset
 
 // ----------------------------------------------------------------------------
@@ -94,25 +114,119 @@ void RewindQueue::reset()
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
+    const bool at_end = !hasMoreRewindInfo();
+    const int ticks = ri->getTicks();
+    reserveTicks(ticks);
 
-    while (i != m_all_rewind_info.begin())
+    TickSlot& slot = m_slots[getSlotIndex(ticks)];
+    unsigned index = 0;
+    if (ri->isEvent())
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
-        // Now test if 'ri' needs to be inserted after the
-        // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        index = (unsigned)slot.size();
+        slot.push_back(ri);
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
     else
-        m_all_rewind_info.insert(i, ri);  
+        slot.insert(slot.begin(), ri);
+    m_size++;
+
+    if (at_end)
+    {
+        m_current_ticks = ticks;
+        m_current_index = index;
+    }
+    else if (m_current_ticks == ticks && index <= m_current_index)
+    {
+        // Keep pointing to the same info which was moved back
+        m_current_index++;
+    }
+    else if (ticks < m_current_ticks && ri->isEvent() &&
+             ticks > m_latest_unplayed_event_ticks)
+    {
+        m_latest_unplayed_event_ticks = ticks;
+    }
 }   // insertRewindInfo
 
+// ----------------------------------------------------------------------------
+/** Makes sure that the ring buffer has a slot for the given ticks, the
+ *  buffer is doubled in size if the ticks do not fit into it.
+ *  \param ticks The ticks which need a slot.
+ */
+void RewindQueue::reserveTicks(int ticks)
+{
+    if (m_num_ticks == 0)
+    {
+        m_first_slot = 0;
+        m_first_ticks = ticks;
+        m_num_ticks = 1;
+        return;
+    }
+
+    const int first_ticks = std::min(m_first_ticks, ticks);
+    const int num_ticks =
+        std::max(m_first_ticks + m_num_ticks - 1, ticks) - first_ticks + 1;
+    if ((size_t)num_ticks > m_slots.size())
+    {
+        size_t size = m_slots.size();
+        while (size < (size_t)num_ticks)
+            size *= 2;
+        std::vector<TickSlot> slots(size);
+        for (int i = 0; i < m_num_ticks; i++)
+        {
+            std::swap(slots[m_first_ticks - first_ticks + i],
+                m_slots[getSlotIndex(m_first_ticks + i)]);
+        }
+        std::swap(m_slots, slots);
+        m_slot_mask = (unsigned)size - 1;
+        m_first_slot = 0;
+    }
+    else
+    {
+        m_first_slot = (m_first_slot - (unsigned)(m_first_ticks - first_ticks))
+            & m_slot_mask;
+    }
+    m_first_ticks = first_ticks;
+    m_num_ticks = num_ticks;
+}   // reserveTicks
+
+// ----------------------------------------------------------------------------
+/** Moves the current position to the next RewindInfo if the current index is
+ *  after the last info of its slot, or to the end if there is none.
+ */
+void RewindQueue::skipEmptySlots()
+{
+    const int end_ticks = m_first_ticks + m_num_ticks;
+    while (m_current_ticks < end_ticks &&
+        m_current_index >= m_slots[getSlotIndex(m_current_ticks)].size())
+    {
+        m_current_ticks++;
+        m_current_index = 0;
+    }
+}   // skipEmptySlots
+
+// ----------------------------------------------------------------------------
+/** Moves the current position to the previous RewindInfo.
+ *  \return False if the current RewindInfo is the first one.
+ */
+bool RewindQueue::previous()
+{
+    if (m_current_index > 0)
+    {
+        m_current_index--;
+        return true;
+    }
+    for (int ticks = m_current_ticks - 1; ticks >= m_first_ticks; ticks--)
+    {
+        const TickSlot& slot = m_slots[getSlotIndex(ticks)];
+        if (!slot.empty())
+        {
+            m_current_ticks = ticks;
+            m_current_index = (unsigned)slot.size() - 1;
+            return true;
+        }
+    }
+    return false;
+}   // previous
+
 // ----------------------------------------------------------------------------
 /** Adds an event to the rewind data. The data to be stored must be allocated
  *  and not freed by the caller!
@@ -164,10 +278,7 @@ void RewindQueue::addNetworkEvent(EventRewinder *event_rewinder,
 {
     RewindInfo *ri = new RewindInfoEvent(ticks, event_rewinder,
                                          buffer, /*confirmed*/true);
-
-    m_network_events.lock();
-    m_network_events.getData().push_back(ri);
-    m_network_events.unlock();
+    insertNetworkRewindInfo(ri);
 }   // addNetworkEvent
 
 // ----------------------------------------------------------------------------
@@ -181,11 +292,33 @@ void RewindQueue::addNetworkEvent(EventRewinder *event_rewinder,
 void RewindQueue::addNetworkState(BareNetworkString *buffer, int ticks)
 {
     RewindInfo *ri = new RewindInfoState(ticks, buffer, /*confirmed*/true);
+    insertNetworkRewindInfo(ri);
+}   // addNetworkState
 
+// ----------------------------------------------------------------------------
+/** Adds a RewindInfo to the network rewind data, which is kept sorted by
+ *  ticks (infos with the same ticks stay in the order they are received).
+ *  Infos are usually received in order, so this is an append. This function
+ *  is threadsafe so can be called by the network thread.
+ *  \param ri The RewindInfo to add.
+ */
+void RewindQueue::insertNetworkRewindInfo(RewindInfo* ri)
+{
     m_network_events.lock();
-    m_network_events.getData().push_back(ri);
+    AllNetworkRewindInfo& info = m_network_events.getData();
+    if (info.empty() || info.back()->getTicks() <= ri->getTicks())
+        info.push_back(ri);
+    else
+    {
+        auto i = std::upper_bound(info.begin(), info.end(), ri,
+            [](const RewindInfo* a, const RewindInfo* b)
+            {
+                return a->getTicks() < b->getTicks();
+            });
+        info.insert(i, ri);
+    }
     m_network_events.unlock();
-}   // addNetworkState
+}   // insertNetworkRewindInfo
 
 // ----------------------------------------------------------------------------
 /** Merges thread-safe all data received from the network up to and including
@@ -214,19 +347,15 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
     // received state before current world time (if any)
     *rewind_ticks = -9999;
 
-    // FIXME: making m_network_events sorted would prevent the need to 
-    // go through the whole list of events
     int latest_confirmed_state = -1;
-    AllNetworkRewindInfo::iterator i = m_network_events.getData().begin();
-    while (i != m_network_events.getData().end())
+    AllNetworkRewindInfo& info = m_network_events.getData();
+    AllNetworkRewindInfo::iterator i = info.begin();
+    for (; i != info.end(); i++)
     {
-        // Ignore any events that will happen in the future. The current
-        // time step is world_ticks.
+        // The network events are sorted, so all remaining events will happen
+        // in the future. The current time step is world_ticks.
         if ((*i)->getTicks() > world_ticks)
-        {
-            i++;
-            continue;
-        }
+            break;
         // Any state of event that is received before the latest confirmed
         // state can be deleted.
         if ((*i)->getTicks() < m_latest_confirmed_state_time)
@@ -237,7 +366,6 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
                       (*i)->getTicks(),
                       m_latest_confirmed_state_time);
             delete *i;
-            i = m_network_events.getData().erase(i);
             continue;
         }
 
@@ -288,10 +416,9 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
         {
             latest_confirmed_state = (*i)->getTicks();
         }
-
-        i = m_network_events.getData().erase(i);
     }   // for i in m_network_events
 
+    info.erase(info.begin(), i);
     m_network_events.unlock();
 
     if (latest_confirmed_state > m_latest_confirmed_state_time)
@@ -327,25 +454,31 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
-
-    while (!m_all_rewind_info.empty() &&
-        (*i)->getTicks() < ticks)
+    while (m_num_ticks > 0 && m_first_ticks < ticks)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        TickSlot& slot = m_slots[m_first_slot];
+        for (RewindInfo* ri : slot)
+            delete ri;
+        m_size -= (unsigned)slot.size();
+        slot.clear();
+        m_first_slot = (m_first_slot + 1) & m_slot_mask;
+        m_first_ticks++;
+        m_num_ticks--;
     }
 
-    if (m_all_rewind_info.empty())
-        m_current = m_all_rewind_info.end();
-
+    // Move the current position to the first info which is left
+    if (m_current_ticks < m_first_ticks)
+    {
+        m_current_ticks = m_first_ticks;
+        m_current_index = 0;
+        skipEmptySlots();
+    }
 }   // cleanupOldRewindInfo
 
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return !hasMoreRewindInfo();
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -353,9 +486,43 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    return m_current_ticks < m_first_ticks + m_num_ticks;
 }   // hasMoreRewindInfo
 
+// ----------------------------------------------------------------------------
+/** Returns all RewindInfo in the order they are handled, used in unit
+ *  testing.
+ */
+std::vector<RewindInfo*> RewindQueue::getAllRewindInfo() const
+{
+    std::vector<RewindInfo*> all;
+    all.reserve(m_size);
+    for (int ticks = m_first_ticks; ticks < m_first_ticks + m_num_ticks;
+         ticks++)
+    {
+        const TickSlot& slot = m_slots[getSlotIndex(ticks)];
+        all.insert(all.end(), slot.begin(), slot.end());
+    }
+    return all;
+}   // getAllRewindInfo
+
+// ----------------------------------------------------------------------------
+/** Returns all confirmed states at the given ticks.
+ *  \param ticks Time in ticks.
+ */
+std::vector<RewindInfo*> RewindQueue::getConfirmedStates(int ticks) const
+{
+    std::vector<RewindInfo*> states;
+    if (ticks < m_first_ticks || ticks >= m_first_ticks + m_num_ticks)
+        return states;
+    for (RewindInfo* ri : m_slots[getSlotIndex(ticks)])
+    {
+        if (ri->isState() && ri->isConfirmed())
+            states.push_back(ri);
+    }
+    return states;
+}   // getConfirmedStates
+
 // ----------------------------------------------------------------------------
 /** Rewinds the rewind queue and undos all events/states stored. It stops
  *  when the first confirmed state is reached that was recorded before the
@@ -367,27 +534,35 @@ int RewindQueue::undoUntil(int undo_ticks)
 {
     // A rewind is done after a state in the past is inserted. This function
     // makes sure that m_current is not end()
-    //assert(m_current != m_all_rewind_info.end());
-    assert(!m_all_rewind_info.empty());
-    m_current = m_all_rewind_info.end();
-    m_current--;
-    while((*m_current)->getTicks() > undo_ticks ||
-        (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+    assert(m_size > 0);
+    // All events after the confirmed state are replayed
+    m_latest_unplayed_event_ticks = -1;
+    for (int ticks = m_first_ticks + m_num_ticks - 1; ticks >= m_first_ticks;
+         ticks--)
     {
-        // Undo all events and states from the current time
-        (*m_current)->undo();
-        if(m_current == m_all_rewind_info.begin())
+        const TickSlot& slot = m_slots[getSlotIndex(ticks)];
+        for (unsigned i = (unsigned)slot.size(); i > 0; i--)
         {
-            // This shouldn't happen, but add some debug info just in case
-            Log::error("undoUntil",
-                       "At %d rewinding to %d current = %d = begin",
-                       World::getWorld()->getTicksSinceStart(), undo_ticks, 
-                       (*m_current)->getTicks());
+            RewindInfo* ri = slot[i - 1];
+            if (ticks <= undo_ticks && !ri->isEvent() && ri->isConfirmed())
+            {
+                m_current_ticks = ticks;
+                m_current_index = i - 1;
+                return ticks;
+            }
+            // Undo all events and states from the current time
+            ri->undo();
         }
-        m_current--;
     }
 
-    return (*m_current)->getTicks();
+    // This shouldn't happen, but add some debug info just in case
+    m_current_ticks = m_first_ticks;
+    m_current_index = 0;
+    skipEmptySlots();
+    Log::error("undoUntil", "At %d rewinding to %d current = %d = begin",
+               World::getWorld()->getTicksSinceStart(), undo_ticks,
+               getCurrent()->getTicks());
+    return getCurrent()->getTicks();
 }   // undoUntil
 
 // ----------------------------------------------------------------------------
@@ -397,11 +572,14 @@ int RewindQueue::undoUntil(int undo_ticks)
 void RewindQueue::replayAllEvents(int ticks)
 {
     // Replay all events that happened at the current time step
-    while ( hasMoreRewindInfo() && (*m_current)->getTicks() == ticks )
+    while (hasMoreRewindInfo() && m_current_ticks == ticks)
     {
-        if ((*m_current)->isEvent())
-            (*m_current)->replay();
-        m_current++;
+        RewindInfo* ri = m_slots[getSlotIndex(ticks)][m_current_index];
+        if (ri->isEvent())
+            ri->replay();
+        // The slot is looked up again in case the replay added an info
+        if (++m_current_index >= m_slots[getSlotIndex(ticks)].size())
+            skipEmptySlots();
     }   // while current->getTIcks == ticks
 
 }   // replayAllEvents
@@ -413,6 +591,8 @@ void RewindQueue::replayAllEvents(int ticks)
  *  - Sorting order of RewindInfos with different timestamps (and a mixture
  *    of types).
  *  - Special cases that triggered incorrect behaviour previously.
+ *  It also logs the time of a typical client rewind (undo and replay) and
+ *  of adding and cleaning up the infos of each tick.
  */
 void RewindQueue::unitTesting()
 {
@@ -427,22 +607,23 @@ void RewindQueue::unitTesting()
     assert(!q0.hasMoreRewindInfo());
 
     q0.addLocalState(NULL, /*confirmed*/true, 0);
-    assert(q0.m_all_rewind_info.front()->isState());
-    assert(!q0.m_all_rewind_info.front()->isEvent());
+    assert(q0.getAllRewindInfo().front()->isState());
+    assert(!q0.getAllRewindInfo().front()->isEvent());
     assert(q0.hasMoreRewindInfo());
     assert(q0.undoUntil(0) == 0);
 
     q0.addNetworkEvent(dummy_rewinder.get(), NULL, 0);
     // Network events are not immediately merged
-    assert(q0.m_all_rewind_info.size() == 1);
+    assert(q0.getAllRewindInfo().size() == 1);
 
     bool needs_rewind;
     int rewind_ticks;
     int world_ticks = 0;
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.hasMoreRewindInfo());
-    assert(q0.m_all_rewind_info.size() == 2);
-    AllRewindInfo::iterator rii = q0.m_all_rewind_info.begin();
+    std::vector<RewindInfo*> all = q0.getAllRewindInfo();
+    assert(all.size() == 2);
+    std::vector<RewindInfo*>::iterator rii = all.begin();
     assert((*rii)->isState());
     rii++;
     assert((*rii)->isEvent());
@@ -451,8 +632,9 @@ void RewindQueue::unitTesting()
     q0.addNetworkState(NULL, 0);
     assert(q0.hasMoreRewindInfo());
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
-    assert(q0.m_all_rewind_info.size() == 3);
-    rii = q0.m_all_rewind_info.begin();
+    all = q0.getAllRewindInfo();
+    assert(all.size() == 3);
+    rii = all.begin();
     assert((*rii)->isState());
     rii++;
     assert((*rii)->isState());
@@ -465,6 +647,8 @@ void RewindQueue::unitTesting()
     q0.addLocalEvent(dummy_rewinder.get(), NULL, false, 1);
     // rii points to the 3rd element, the ones added just now
     // should be elements4 and 5:
+    all = q0.getAllRewindInfo();
+    rii = all.begin() + 2;
     rii++;
     assert((*rii)->getTicks()==1);
     rii++;
@@ -474,7 +658,8 @@ void RewindQueue::unitTesting()
     RewindQueue q1;
     q1.addLocalEvent(NULL, NULL, true, 5);
     q1.addLocalState(NULL, true, 5);
-    rii = q1.m_all_rewind_info.begin();
+    all = q1.getAllRewindInfo();
+    rii = all.begin();
     assert((*rii)->isState());
     rii++;
     assert((*rii)->isEvent());
@@ -496,12 +681,12 @@ void RewindQueue::unitTesting()
     //    event, that m_current pooints to the first event, otherwise
     //    events with same time stamp will not be handled correctly.
     //    At this stage current points to the event at time 2 from above
-    AllRewindInfo::iterator current_old = b1.m_current;
+    RewindInfo* current_old = b1.getCurrent();
     b1.addLocalEvent(NULL, NULL, true, 2);
     // Make sure that current was not modified, i.e. the new event at time
     // 2 was added at the end of the list:
-    if (current_old != b1.m_current)
-        Log::fatal("RewindQueue", "current_old != b1.m_current");
+    if (current_old != b1.getCurrent())
+        Log::fatal("RewindQueue", "current_old != b1.getCurrent()");
 
     // This should not trigger an exception, now current points to the
     // second event at the same time:
@@ -509,7 +694,7 @@ void RewindQueue::unitTesting()
     assert(ri->getTicks() == 2);
     assert(ri->isEvent());
     b1.next();
-    assert(b1.m_current == b1.m_all_rewind_info.end());
+    assert(!b1.hasMoreRewindInfo());
 
     // 3) Test that if cleanupOldRewindInfo is called, it will if necessary
     //    adjust m_current to point to the latest confirmed state.
@@ -518,7 +703,109 @@ void RewindQueue::unitTesting()
     b2.addNetworkState(NULL, 2);
     b2.addNetworkState(NULL, 3);
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
-    assert((*b2.m_current)->getTicks() == 3);
-
-
+    assert(b2.getCurrent()->getTicks() == 3);
+
+    // 4) Network infos received out of order must be merged in order, and
+    //    only up to the world ticks
+    RewindQueue b3;
+    b3.addNetworkEvent(dummy_rewinder.get(), NULL, 6);
+    b3.addNetworkEvent(dummy_rewinder.get(), NULL, 2);
+    b3.addNetworkEvent(dummy_rewinder.get(), NULL, 4);
+    b3.mergeNetworkData(2, &needs_rewind, &rewind_ticks);
+    assert(b3.getAllRewindInfo().size() == 1);
+    b3.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
+    all = b3.getAllRewindInfo();
+    assert(all.size() == 2);
+    assert(all[0]->getTicks() == 2 && all[1]->getTicks() == 4);
+    b3.mergeNetworkData(6, &needs_rewind, &rewind_ticks);
+    assert(b3.getAllRewindInfo().size() == 3);
+
+    // 5) The ring buffer must grow for more ticks than it was created with,
+    //    and infos before the first ticks must still be sorted correctly
+    RewindQueue b4;
+    for (int i = 1; i <= (int)INITIAL_TICKS * 4; i++)
+        b4.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(), true, i);
+    b4.addLocalState(NULL, true, 0);
+    all = b4.getAllRewindInfo();
+    assert(all.size() == INITIAL_TICKS * 4 + 1);
+    assert(all.front()->isState() && all.front()->getTicks() == 0);
+    assert(all.back()->getTicks() == (int)INITIAL_TICKS * 4);
+    assert(b4.getCurrent()->getTicks() == 1);
+    assert(b4.undoUntil(INITIAL_TICKS) == 0);
+    assert(b4.getCurrent()->isState());
+    b4.cleanupOldRewindInfo(INITIAL_TICKS * 4);
+    assert(b4.getAllRewindInfo().size() == 1);
+    assert(b4.getCurrent()->getTicks() == (int)INITIAL_TICKS * 4);
+
+    // 6) Network events inserted before the current info are only replayed
+    //    in a rewind, so a rewind can't be skipped
+    RewindQueue b5;
+    b5.addLocalState(NULL, true, 0);
+    b5.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(), true, 5);
+    b5.replayAllEvents(0);
+    assert(b5.getCurrent()->getTicks() == 5);
+    b5.addNetworkEvent(dummy_rewinder.get(), new BareNetworkString(), 3);
+    b5.addNetworkState(NULL, 2);
+    b5.mergeNetworkData(5, &needs_rewind, &rewind_ticks);
+    assert(needs_rewind && rewind_ticks == 2);
+    assert(b5.hasUnplayedEventsFrom(3));
+    assert(!b5.hasUnplayedEventsFrom(4));
+    assert(b5.getConfirmedStates(2).size() == 1);
+    assert(b5.getConfirmedStates(5).empty());
+    assert(b5.undoUntil(2) == 2);
+    assert(!b5.hasUnplayedEventsFrom(0));
+
+    // Benchmark: a rewind of a client with 300ms ping (36 ticks), with a
+    // few events in each tick
+    const int rewind_ticks_count = 36;
+    const int events_per_tick = 4;
+    const int rewinds = 10000;
+    RewindQueue bench;
+    bench.addLocalState(NULL, true, 0);
+    for (int t = 0; t < rewind_ticks_count; t++)
+    {
+        for (int e = 0; e < events_per_tick; e++)
+        {
+            bench.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(),
+                true, t);
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rewinds; r++)
+    {
+        bench.undoUntil(0);
+        // Skip the state like RewindManager::rewindTo
+        bench.next();
+        for (int t = 0; t < rewind_ticks_count; t++)
+            bench.replayAllEvents(t);
+    }
+    auto end = std::chrono::steady_clock::now();
+    assert(!bench.hasMoreRewindInfo());
+    Log::info("RewindQueue", "Undo and replay of %d ticks with %d events: "
+        "%.2f us per rewind.", rewind_ticks_count,
+        rewind_ticks_count * events_per_tick,
+        std::chrono::duration<double, std::micro>(end - start).count() /
+        rewinds);
+
+    // Benchmark: adding the events of a tick and deleting the ones before
+    // the latest confirmed state, which is rewind_ticks_count ago
+    const int ticks = 100000;
+    RewindQueue bench_ticks;
+    start = std::chrono::steady_clock::now();
+    for (int t = 0; t < ticks; t++)
+    {
+        for (int e = 0; e < events_per_tick; e++)
+        {
+            bench_ticks.addLocalEvent(dummy_rewinder.get(),
+                new BareNetworkString(), true, t);
+        }
+        bench_ticks.cleanupOldRewindInfo(t - rewind_ticks_count);
+    }
+    end = std::chrono::steady_clock::now();
+    assert(bench_ticks.getAllRewindInfo().size() ==
+        (size_t)(rewind_ticks_count + 1) * events_per_tick);
+    Log::info("RewindQueue", "Adding and cleaning up %d events: %.3f us per "
+        "tick.", events_per_tick,
+        std::chrono::duration<double, std::micro>(end - start).count() /
+        ticks);
 }   // unitTesting
@@ -22,7 +22,6 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
 #include <vector>
 
 class BareNetworkString;
@@ -37,26 +36,68 @@ class RewindQueue
 {
 private:
 
-    typedef std::list<RewindInfo*> AllRewindInfo;
+    /** All RewindInfo of one tick, states are stored before events. The
+     *  vector is kept when the slot is reused for a later tick, so after the
+     *  first few ticks inserting does not allocate. */
+    typedef std::vector<RewindInfo*> TickSlot;
 
-    AllRewindInfo m_all_rewind_info;
+    /** Ring buffer with one slot for each tick from m_first_ticks on, its
+     *  size is a power of two and it grows if more ticks are needed. */
+    std::vector<TickSlot> m_slots;
+
+    /** Size of m_slots minus one, to get the index of a slot. */
+    unsigned m_slot_mask;
+
+    /** Index in m_slots of the slot for m_first_ticks. */
+    unsigned m_first_slot;
+
+    /** Ticks of the first slot in use. */
+    int m_first_ticks;
+
+    /** Number of slots (ticks) in use, 0 if the queue is empty. */
+    int m_num_ticks;
+
+    /** Number of RewindInfo in all slots. */
+    unsigned m_size;
 
     /** The list of all events received from the network. They are stored
      *  in a separate thread (so this data structure is thread-save), and
      *  merged into m_rewind_info from the main thread. This design (as
      *  opposed to locking m_rewind_info) reduces the synchronisation
-     *  between main thread and network thread. */
+     *  between main thread and network thread. It is sorted by ticks, so
+     *  merging stops at the first info in the future. */
     typedef std::vector<RewindInfo*> AllNetworkRewindInfo;
     Synchronised<AllNetworkRewindInfo> m_network_events;
 
-    /** Iterator to the curren time step info to be handled. */
-    AllRewindInfo::iterator m_current;
+    /** Ticks and index in its slot of the current RewindInfo to be handled,
+     *  the ticks are m_first_ticks + m_num_ticks after the last one. */
+    int m_current_ticks;
+    unsigned m_current_index;
 
     /** Time at which the latest confirmed state is at. */
     int m_latest_confirmed_state_time;
 
+    /** Latest ticks of an event which was inserted before the current
+     *  RewindInfo, so it was not replayed yet (-1 if none). Such events are
+     *  only replayed in a rewind. */
+    int m_latest_unplayed_event_ticks;
+
 
     void cleanupOldRewindInfo(int ticks);
+    void reserveTicks(int ticks);
+    void skipEmptySlots();
+    bool previous();
+    void insertNetworkRewindInfo(RewindInfo* ri);
+    std::vector<RewindInfo*> getAllRewindInfo() const;
+    // ------------------------------------------------------------------------
+    /** Returns the index in m_slots of the given ticks, which must be in
+     *  use. */
+    unsigned getSlotIndex(int ticks) const
+    {
+        assert(ticks >= m_first_ticks && ticks < m_first_ticks + m_num_ticks);
+        return (m_first_slot + (unsigned)(ticks - m_first_ticks)) &
+               m_slot_mask;
+    }   // getSlotIndex
 
 public:
         static void unitTesting();
@@ -70,12 +111,7 @@ public:
     void addNetworkEvent(EventRewinder *event_rewinder,
                          BareNetworkString *buffer, int ticks);
     void addNetworkState(BareNetworkString *buffer, int ticks);
-    void addNetworkRewindInfo(RewindInfo* ri)
-    {
-        m_network_events.lock();
-        m_network_events.getData().push_back(ri);
-        m_network_events.unlock();
-    }
+    void addNetworkRewindInfo(RewindInfo* ri)  { insertNetworkRewindInfo(ri); }
     void mergeNetworkData(int world_ticks,  bool *needs_rewind, 
                           int *rewind_ticks);
     void replayAllEvents(int ticks);
@@ -83,6 +119,7 @@ public:
     bool hasMoreRewindInfo() const;
     int  undoUntil(int undo_ticks);
     void insertRewindInfo(RewindInfo *ri);
+    std::vector<RewindInfo*> getConfirmedStates(int ticks) const;
 
     // ------------------------------------------------------------------------
     /** Returns the time of the latest confirmed state. */
@@ -91,12 +128,21 @@ public:
         return m_latest_confirmed_state_time;
     }
     // ------------------------------------------------------------------------
+    /** Returns true if an event at or after the given ticks was inserted
+     *  before the current RewindInfo, so it can only be replayed by a
+     *  rewind. */
+    bool hasUnplayedEventsFrom(int ticks) const
+    {
+        return m_latest_unplayed_event_ticks >= ticks;
+    }   // hasUnplayedEventsFrom
+    // ------------------------------------------------------------------------
     /** Sets the current element to be the next one and returns the next
      *  RewindInfo element. */
     void next()
     {
-        assert(m_current != m_all_rewind_info.end());
-        m_current++;
+        assert(hasMoreRewindInfo());
+        m_current_index++;
+        skipEmptySlots();
         return;
     }   // operator++
 
@@ -105,7 +151,8 @@ public:
      *  least one more RewindInfo (see hasMoreRewindInfo()). */
     RewindInfo* getCurrent()
     {
-        return (m_current != m_all_rewind_info.end() ) ? *m_current : NULL;
+        return hasMoreRewindInfo() ?
+               m_slots[getSlotIndex(m_current_ticks)][m_current_index] : NULL;
     }   // getNext
 
 };   // RewindQueue
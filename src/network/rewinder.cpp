@@ -18,8 +18,11 @@
 
 #include "network/rewinder.hpp"
 
+#include "network/network_string.hpp"
 #include "network/rewind_manager.hpp"
 
+#include <cstring>
+
 // ----------------------------------------------------------------------------
 /** Add this object to the list of all rewindable
  *  objects in the rewind manager.
@@ -28,3 +31,27 @@ bool Rewinder::rewinderAdd()
 {
     return RewindManager::get()->addRewinder(shared_from_this());
 }   // rewinderAdd
+
+// ----------------------------------------------------------------------------
+/** Compares the remaining bytes of a predicted state with the next bytes of
+ *  a confirmed state.
+ *  \param predicted The predicted state.
+ *  \param confirmed The confirmed state.
+ *  \param size Number of bytes left in the confirmed state of this rewinder.
+ *  \return True if the predicted state doesn't have the same bytes left.
+ */
+bool Rewinder::isDataDiverged(const BareNetworkString* predicted,
+                              const BareNetworkString* confirmed, int size)
+{
+    return size < 0 || predicted->size() != (unsigned)size ||
+        confirmed->size() < (unsigned)size ||
+        memcmp(predicted->getCurrentData(), confirmed->getCurrentData(),
+        size) != 0;
+}   // isDataDiverged
+
+// ----------------------------------------------------------------------------
+bool Rewinder::isStateDiverged(BareNetworkString* predicted,
+                               BareNetworkString* confirmed, int count)
+{
+    return isDataDiverged(predicted, confirmed, count);
+}   // isStateDiverged
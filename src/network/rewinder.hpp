@@ -19,6 +19,8 @@
 #ifndef HEADER_REWINDER_HPP
 #define HEADER_REWINDER_HPP
 
+#include "utils/types.hpp"
+
 #include <cassert>
 #include <functional>
 #include <string>
@@ -44,6 +46,8 @@ class Rewinder : public std::enable_shared_from_this<Rewinder>
 {
 protected:
     void setUniqueIdentity(const std::string& uid)  { m_unique_identity = uid; }
+    static bool isDataDiverged(const BareNetworkString* predicted,
+                               const BareNetworkString* confirmed, int size);
 private:
     /** Currently it has 2 usages:
      *  1. Create the required flyable if the firing event missed using this
@@ -56,8 +60,16 @@ private:
     */
     std::string m_unique_identity;
 
+    /** Compact id of the unique identity used in network states, assigned
+     *  by the RewindManager in server, see RewindManager::addRewinder. */
+    uint16_t m_rewinder_id;
+
 public:
-    Rewinder(const std::string& ui = "")             { m_unique_identity = ui; }
+    Rewinder(const std::string& ui = "")
+    {
+        m_unique_identity = ui;
+        m_rewinder_id = 0;
+    }
 
     virtual ~Rewinder() {}
 
@@ -72,10 +84,10 @@ public:
 
     /** Provides a copy of the state of the object in one memory buffer.
      *  The memory is managed by the RewindManager.
-     *  \param[out] ru The unique identity of rewinder writing to.
-     *  \return The address of the memory buffer with the state.
+     *  \return The address of the memory buffer with the state, or NULL if
+     *  no state needs to be sent for this rewinder.
      */
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru) = 0;
+    virtual BareNetworkString* saveState() = 0;
 
     /** Called when an event needs to be undone. This is called while going
      *  backwards for rewinding - all stored events will get an 'undo' call.
@@ -106,12 +118,31 @@ public:
     virtual std::function<void()> getLocalStateRestoreFunction()
                                                              { return nullptr; }
     // -------------------------------------------------------------------------
+    /** Called in client when a state is saved in server, returns the state
+     *  predicted locally which is compared with the confirmed state later
+     *  (see isStateDiverged), or NULL if it can't be compared. In this case
+     *  every confirmed state including this rewinder causes a rewind. */
+    virtual BareNetworkString* savePredictedState()             { return NULL; }
+    // -------------------------------------------------------------------------
+    /** Called in client to check if a confirmed state differs from the
+     *  predicted state of the same ticks, by default they must be equal.
+     *  \param predicted The state from savePredictedState.
+     *  \param confirmed The confirmed state, which is read up to count bytes.
+     *  \param count Number of bytes of the confirmed state.
+     *  \return True if the rewinder diverged, so a rewind is needed. */
+    virtual bool isStateDiverged(BareNetworkString* predicted,
+                                 BareNetworkString* confirmed, int count);
+    // -------------------------------------------------------------------------
     const std::string& getUniqueIdentity() const
     {
         assert(!m_unique_identity.empty() && m_unique_identity.size() < 255);
         return m_unique_identity;
     }
     // -------------------------------------------------------------------------
+    void setRewinderID(uint16_t id)                      { m_rewinder_id = id; }
+    // -------------------------------------------------------------------------
+    uint16_t getRewinderID() const                     { return m_rewinder_id; }
+    // -------------------------------------------------------------------------
     bool rewinderAdd();
     // -------------------------------------------------------------------------
     template<typename T> std::shared_ptr<T> getShared()
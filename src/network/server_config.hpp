@@ -129,6 +129,15 @@ namespace ServerConfig
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false, "enable-console",
         "Enable network console, which can do for example kickban."));
 
+    SERVER_CFG_PREFIX IntServerConfigParam m_lobbies
+        SERVER_CFG_DEFAULT(IntServerConfigParam(1, "lobbies",
+        "Number of independent lobbies run by this server process, all "
+        "using the same configuration. Karts, tracks and worker threads are "
+        "shared, each lobby has its own race. The lobbies use consecutive "
+        "ports starting from server-port and a number is appended to the "
+        "server name and server statistics tables of the additional lobbies. "
+        "The network console only controls the first lobby."));
+
     SERVER_CFG_PREFIX IntServerConfigParam m_server_max_players
         SERVER_CFG_DEFAULT(IntServerConfigParam(8, "server-max-players",
         "Maximum number of players on the server, setting this to a value "
@@ -344,6 +353,35 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_delta_state
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
+        "delta-state",
+        "Send states as a difference to the latest state acknowledged by each "
+        "client, which saves most of the upload bandwidth of a server, clients "
+        "not supporting it or losing states will receive full states."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_state_relevancy
+        SERVER_CFG_DEFAULT(IntServerConfigParam(0,
+        "state-relevancy",
+        "Send states of karts and items far away from the karts of a client "
+        "less frequently to that client: 0 disabled, 1 enabled, 2 only "
+        "measure the bandwidth which would be saved and the CPU time used "
+        "(see relevancystats in network console) without changing the "
+        "states sent. Spectators always receive full states."));
+
+    SERVER_CFG_PREFIX FloatServerConfigParam m_state_relevancy_distance
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(50.0f,
+        "state-relevancy-distance",
+        "Karts and items within this distance (in meters) of a kart of a "
+        "client are sent to it in every state, the further away the less "
+        "frequently they are sent."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_state_relevancy_max_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(4,
+        "state-relevancy-max-interval",
+        "The state of the furthest karts and items is sent once every this "
+        "number of states, 1 to disable reducing the frequency."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_sql_management
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "sql-management",
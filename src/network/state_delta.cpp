@@ -0,0 +1,214 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/state_delta.hpp"
+
+#include "network/network_string.hpp"
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace StateDelta
+{
+// ----------------------------------------------------------------------------
+/** Adds an unsigned integer using 7 bits per byte, the highest bit tells
+ *  if more bytes follow. */
+void addVarUInt(BareNetworkString* ns, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        ns->addUInt8((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    ns->addUInt8((uint8_t)value);
+}   // addVarUInt
+
+// ----------------------------------------------------------------------------
+/** Reads an unsigned integer written by addVarUInt. */
+uint32_t getVarUInt(const BareNetworkString* ns)
+{
+    uint32_t value = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7)
+    {
+        uint8_t byte = ns->getUInt8();
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    throw std::out_of_range("getVarUInt too many bytes.");
+}   // getVarUInt
+
+// ----------------------------------------------------------------------------
+/** Returns the byte of the XOR-ed state at position i, the baseline is
+ *  treated as zero padded if it is shorter than the new state. */
+inline uint8_t xorAt(const std::vector<uint8_t>& baseline,
+                     const uint8_t* state, unsigned i)
+{
+    return i < baseline.size() ? state[i] ^ baseline[i] : state[i];
+}   // xorAt
+
+// ----------------------------------------------------------------------------
+/** Encodes the state as a delta to the baseline.
+ *  \param baseline Full state the receiver already has.
+ *  \param state Pointer to the new full state.
+ *  \param state_size Size of the new state.
+ *  \param out Network string the delta is appended to.
+ */
+void encode(const std::vector<uint8_t>& baseline, const uint8_t* state,
+            unsigned state_size, BareNetworkString* out)
+{
+    addVarUInt(out, state_size);
+    unsigned i = 0;
+    while (i < state_size)
+    {
+        uint8_t mask = 0;
+        const unsigned group_end = std::min(i + 8, state_size);
+        for (unsigned j = i; j < group_end; j++)
+        {
+            if (xorAt(baseline, state, j) != 0)
+                mask |= 1 << (j - i);
+        }
+        out->addUInt8(mask);
+        if (mask != 0)
+        {
+            for (unsigned j = i; j < group_end; j++)
+            {
+                uint8_t x = xorAt(baseline, state, j);
+                if (x != 0)
+                    out->addUInt8(x);
+            }
+            i = group_end;
+            continue;
+        }
+
+        // Count how many more unchanged groups follow this one
+        uint32_t unchanged = 0;
+        i = group_end;
+        while (i < state_size)
+        {
+            const unsigned next_end = std::min(i + 8, state_size);
+            bool changed = false;
+            for (unsigned j = i; j < next_end; j++)
+            {
+                if (xorAt(baseline, state, j) != 0)
+                {
+                    changed = true;
+                    break;
+                }
+            }
+            if (changed)
+                break;
+            unchanged++;
+            i = next_end;
+        }
+        addVarUInt(out, unchanged);
+    }
+}   // encode
+
+// ----------------------------------------------------------------------------
+/** Rebuilds a full state from a baseline and a delta created by encode().
+ *  Throws std::out_of_range if the delta is malformed.
+ *  \param baseline Full state the delta was encoded against.
+ *  \param in Network string with the delta at the current offset.
+ *  \param state The rebuilt full state.
+ */
+void decode(const std::vector<uint8_t>& baseline, const BareNetworkString* in,
+            std::vector<uint8_t>* state)
+{
+    const uint32_t state_size = getVarUInt(in);
+    // Avoid allocating memory for any malformed packet
+    if (state_size > 1024 * 1024)
+        throw std::out_of_range("Invalid delta state size.");
+    state->resize(state_size);
+    for (unsigned i = 0; i < state_size; i++)
+        (*state)[i] = i < baseline.size() ? baseline[i] : 0;
+
+    unsigned i = 0;
+    while (i < state_size)
+    {
+        const unsigned group_end = std::min(i + 8, (unsigned)state_size);
+        uint8_t mask = in->getUInt8();
+        if (mask != 0)
+        {
+            for (unsigned j = i; j < group_end; j++)
+            {
+                if ((mask & (1 << (j - i))) != 0)
+                    (*state)[j] ^= in->getUInt8();
+            }
+            i = group_end;
+            continue;
+        }
+        uint64_t skip = ((uint64_t)getVarUInt(in) + 1) * 8;
+        if (i + skip > state_size)
+            i = state_size;
+        else
+            i += (unsigned)skip;
+    }
+}   // decode
+
+// ----------------------------------------------------------------------------
+/** Checks that resized and partly modified states survive a round trip
+ *  through encode and decode, and that unchanged states stay small. */
+void unitTesting()
+{
+    BareNetworkString ns;
+    const uint32_t values[] = { 0, 1, 127, 128, 300, 16384, 0xffffffff };
+    for (uint32_t v : values)
+        addVarUInt(&ns, v);
+    for (uint32_t v : values)
+    {
+        if (getVarUInt(&ns) != v)
+            Log::fatal("StateDelta", "Varint round trip failed for %u", v);
+    }
+
+    std::vector<uint8_t> baseline;
+    for (unsigned i = 0; i < 1000; i++)
+        baseline.push_back((uint8_t)(i * 7 + 3));
+
+    // Identical state, longer, shorter and sparse modified states
+    std::vector<std::vector<uint8_t> > states;
+    states.push_back(baseline);
+    states.push_back(baseline);
+    states.back().resize(1013, 42);
+    states.push_back(std::vector<uint8_t>(baseline.begin(),
+        baseline.begin() + 555));
+    states.push_back(baseline);
+    states.back()[0] ^= 1;
+    states.back()[500] = 0;
+    states.back()[999] ^= 0x80;
+    states.push_back(std::vector<uint8_t>());
+
+    for (unsigned t = 0; t < states.size(); t++)
+    {
+        const std::vector<uint8_t>& state = states[t];
+        BareNetworkString delta;
+        encode(baseline, state.data(), (unsigned)state.size(), &delta);
+        std::vector<uint8_t> result;
+        decode(baseline, &delta, &result);
+        if (result != state || delta.size() != 0)
+            Log::fatal("StateDelta", "Round trip failed in test %d", t);
+        if (t == 0 && delta.getTotalSize() > 8)
+        {
+            Log::fatal("StateDelta", "Unchanged state too large: %d bytes",
+                delta.getTotalSize());
+        }
+    }
+}   // unitTesting
+
+}   // namespace StateDelta
@@ -0,0 +1,51 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STATE_DELTA_HPP
+#define HEADER_STATE_DELTA_HPP
+
+#include "utils/types.hpp"
+
+#include <vector>
+
+class BareNetworkString;
+
+/** \ingroup network
+ *  Encodes a world state snapshot as a difference to an older snapshot
+ *  (the baseline) which the receiver is known to have. The new state is
+ *  XOR-ed with the baseline and split into groups of 8 bytes, each group is
+ *  written as a bitmask of non-zero bytes followed by those bytes only.
+ *  Consecutive unchanged groups are run-length encoded with a varint, so
+ *  an unchanged kart only costs a few bytes.
+ */
+namespace StateDelta
+{
+    void addVarUInt(BareNetworkString* ns, uint32_t value);
+    // ------------------------------------------------------------------------
+    uint32_t getVarUInt(const BareNetworkString* ns);
+    // ------------------------------------------------------------------------
+    void encode(const std::vector<uint8_t>& baseline, const uint8_t* state,
+                unsigned state_size, BareNetworkString* out);
+    // ------------------------------------------------------------------------
+    void decode(const std::vector<uint8_t>& baseline,
+                const BareNetworkString* in, std::vector<uint8_t>* state);
+    // ------------------------------------------------------------------------
+    void unitTesting();
+};   // namespace StateDelta
+
+#endif
@@ -0,0 +1,196 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/state_relevancy.hpp"
+
+#include "karts/abstract_kart.hpp"
+#include "modes/linear_world.hpp"
+#include "network/network_string.hpp"
+#include "network/rewinder.hpp"
+#include "network/server_config.hpp"
+#include "network/stk_peer.hpp"
+#include "tracks/arena_graph.hpp"
+#include "tracks/drive_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// ----------------------------------------------------------------------------
+StateRelevancy::StateRelevancy()
+{
+    m_state_count = 0;
+    m_lap_length = 0.0f;
+    m_full_bytes.store(0);
+    m_sent_bytes.store(0);
+    m_filter_time_us.store(0);
+}   // StateRelevancy
+
+// ----------------------------------------------------------------------------
+/** Called when the server starts a new state, it saves the graph location
+ *  of each kart which is used for all peers.
+ */
+void StateRelevancy::startNewState()
+{
+    m_entries.clear();
+    m_state_count++;
+    m_kart_distance.clear();
+    m_kart_node.clear();
+    m_lap_length = 0.0f;
+
+    World* world = World::getWorld();
+    LinearWorld* lw = dynamic_cast<LinearWorld*>(world);
+    WorldWithRank* wwr = dynamic_cast<WorldWithRank*>(world);
+    if (lw && DriveGraph::get())
+        m_lap_length = DriveGraph::get()->getLapLength();
+    for (unsigned i = 0; i < world->getNumKarts(); i++)
+    {
+        if (m_lap_length > 0.0f)
+        {
+            m_kart_distance.push_back(
+                lw->getDistanceDownTrackForKart(i, false));
+        }
+        else if (wwr && ArenaGraph::get())
+            m_kart_node.push_back(wwr->getSectorForKart(world->getKart(i)));
+    }
+}   // startNewState
+
+// ----------------------------------------------------------------------------
+/** Remembers where the state of a rewinder is in the full state.
+ *  \param rewinder The rewinder saving the state.
+ *  \param offset Offset of the rewinder id in the full state.
+ *  \param size Size of the rewinder id, data size and data.
+ */
+void StateRelevancy::addState(const Rewinder* rewinder, unsigned offset,
+                              unsigned size)
+{
+    Entry e;
+    e.m_offset = offset;
+    e.m_size = size;
+    e.m_id = rewinder->getRewinderID();
+    const AbstractKart* kart = dynamic_cast<const AbstractKart*>(rewinder);
+    e.m_kart_id = kart ? (int)kart->getWorldKartId() : -1;
+    const Moveable* moveable = dynamic_cast<const Moveable*>(rewinder);
+    e.m_has_position = moveable != NULL;
+    if (moveable)
+        e.m_xyz = moveable->getXYZ();
+    m_entries.push_back(e);
+}   // addState
+
+// ----------------------------------------------------------------------------
+/** Returns the distance of a rewinder to a kart. Rewinders physically close
+ *  to the kart are always near, otherwise for karts the larger of the
+ *  straight and graph distance is used, so karts on a parallel part of the
+ *  track or behind a wall in an arena are considered far.
+ */
+float StateRelevancy::getDistance(const Entry& e, unsigned kart_id) const
+{
+    World* world = World::getWorld();
+    if (kart_id >= world->getNumKarts())
+        return 0.0f;
+    const AbstractKart* kart = world->getKart(kart_id);
+    float distance = (kart->getXYZ() - e.m_xyz).length();
+    if (distance <= ServerConfig::m_state_relevancy_distance ||
+        e.m_kart_id == -1)
+        return distance;
+
+    const unsigned other_id = (unsigned)e.m_kart_id;
+    if (kart_id < m_kart_distance.size() &&
+        other_id < m_kart_distance.size())
+    {
+        float along = std::fabs(m_kart_distance[kart_id] -
+            m_kart_distance[other_id]);
+        along = std::min(along, std::fabs(m_lap_length - along));
+        distance = std::max(distance, along);
+    }
+    else if (kart_id < m_kart_node.size() && other_id < m_kart_node.size() &&
+        m_kart_node[kart_id] != Graph::UNKNOWN_SECTOR &&
+        m_kart_node[other_id] != Graph::UNKNOWN_SECTOR)
+    {
+        distance = std::max(distance, ArenaGraph::get()->getDistance(
+            m_kart_node[kart_id], m_kart_node[other_id]));
+    }
+    return distance;
+}   // getDistance
+
+// ----------------------------------------------------------------------------
+/** Returns every how many states the rewinder should be sent to the peer,
+ *  1 means in every state.
+ */
+unsigned StateRelevancy::getInterval(const STKPeer* peer,
+                                     const Entry& e) const
+{
+    const std::set<unsigned>& karts = peer->getAvailableKartIDs();
+    if (!e.m_has_position || karts.empty())
+        return 1;
+
+    float distance = std::numeric_limits<float>::max();
+    for (unsigned kart_id : karts)
+    {
+        if (e.m_kart_id == (int)kart_id)
+            return 1;
+        distance = std::min(distance, getDistance(e, kart_id));
+    }
+    const float near = ServerConfig::m_state_relevancy_distance;
+    if (near <= 0.0f || distance <= near)
+        return 1;
+    const int max_interval = ServerConfig::m_state_relevancy_max_interval;
+    if (max_interval <= 1)
+        return 1;
+    return std::min((unsigned)max_interval, (unsigned)(distance / near) + 1);
+}   // getInterval
+
+// ----------------------------------------------------------------------------
+/** Creates the state sent to a peer by omitting the data of the rewinders
+ *  which are not relevant to it in this state.
+ *  \param peer The peer receiving the state.
+ *  \param state The full state.
+ *  \param out The filtered state, only written if anything is omitted.
+ *  \return True if the data of any rewinder was omitted.
+ */
+bool StateRelevancy::filterState(const STKPeer* peer,
+                                 const BareNetworkString& state,
+                                 BareNetworkString* out) const
+{
+    if (m_entries.empty())
+        return false;
+
+    // The number of rewinder states is just before the first rewinder id
+    const unsigned count_offset = m_entries[0].m_offset - 1;
+    const uint8_t* data = (const uint8_t*)state.getData();
+    std::vector<uint8_t>& buffer = out->getBuffer();
+    buffer.assign(data, data + count_offset + 1);
+    bool filtered = false;
+    for (const Entry& e : m_entries)
+    {
+        const unsigned interval = getInterval(peer, e);
+        if (interval > 1 && (m_state_count + e.m_id) % interval != 0)
+        {
+            // Keep the rewinder id, so the client knows the rewinder still
+            // exists
+            filtered = true;
+            buffer.insert(buffer.end(), data + e.m_offset,
+                data + e.m_offset + 2);
+            out->addUInt16(OMITTED_STATE);
+            continue;
+        }
+        buffer.insert(buffer.end(), data + e.m_offset,
+            data + e.m_offset + e.m_size);
+    }
+    return filtered;
+}   // filterState
@@ -0,0 +1,119 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STATE_RELEVANCY_HPP
+#define HEADER_STATE_RELEVANCY_HPP
+
+#include "utils/types.hpp"
+#include "utils/vec3.hpp"
+
+#include <atomic>
+#include <vector>
+
+class BareNetworkString;
+class Rewinder;
+class STKPeer;
+
+/** \ingroup network
+ *  Decides which rewinder states in a server state are sent to each peer.
+ *  Rewinders with a position (karts and flyables) are ranked by their
+ *  distance to the closest kart of the peer, karts additionally by the
+ *  distance along the drive graph or in the arena graph. Close rewinders
+ *  are sent in every state, far ones only once every few states, staggered
+ *  by rewinder id so the packet size stays even. Rewinders without a
+ *  position (like the item manager or flags) and states for spectators are
+ *  always sent in full.
+ *  A rewinder which is not sent keeps its id in the state, followed by
+ *  OMITTED_STATE instead of the data size, so the client can tell it apart
+ *  from a rewinder which doesn't exist in server anymore, and keeps its
+ *  predicted state (see RewindInfoState::restore).
+ */
+class StateRelevancy
+{
+public:
+    /** Written instead of the data size of a rewinder which is omitted. */
+    static const uint16_t OMITTED_STATE = 0xffff;
+
+private:
+    /** Location of a rewinder state inside the full state. */
+    struct Entry
+    {
+        /** Offset of the rewinder id in the full state. */
+        unsigned m_offset;
+        /** Size of id, data size and data. */
+        unsigned m_size;
+        /** Rewinder id, used to stagger sending of far rewinders. */
+        uint16_t m_id;
+        /** World kart id if the rewinder is a kart, or -1. */
+        int m_kart_id;
+        /** False if the rewinder is always sent. */
+        bool m_has_position;
+        /** Position of the rewinder when the state was saved. */
+        Vec3 m_xyz;
+    };
+
+    /** All rewinder states in the current full state. */
+    std::vector<Entry> m_entries;
+
+    /** Increased for each state, used to decide which far rewinders are sent
+     *  in this state. */
+    unsigned m_state_count;
+
+    /** Distance down the track (linear races) or arena graph node (battle
+     *  and soccer) of each kart, updated when a new state starts. */
+    std::vector<float> m_kart_distance;
+    std::vector<int> m_kart_node;
+
+    /** Lap length used to wrap the distance down the track, or 0 if karts
+     *  are not in a linear race. */
+    float m_lap_length;
+
+    /** Statistics for comparing the filtered states to the full states,
+     *  written in main thread and read by the network console. */
+    std::atomic<uint64_t> m_full_bytes, m_sent_bytes, m_filter_time_us;
+
+    float getDistance(const Entry& e, unsigned kart_id) const;
+    unsigned getInterval(const STKPeer* peer, const Entry& e) const;
+
+public:
+    StateRelevancy();
+    // ------------------------------------------------------------------------
+    void startNewState();
+    // ------------------------------------------------------------------------
+    void addState(const Rewinder* rewinder, unsigned offset, unsigned size);
+    // ------------------------------------------------------------------------
+    bool filterState(const STKPeer* peer, const BareNetworkString& state,
+                     BareNetworkString* out) const;
+    // ------------------------------------------------------------------------
+    /** Adds the size of a full state, the size of the state sent to a peer
+     *  and the time used to filter it. */
+    void addStats(unsigned full_bytes, unsigned sent_bytes, uint64_t time_us)
+    {
+        m_full_bytes.fetch_add(full_bytes, std::memory_order_relaxed);
+        m_sent_bytes.fetch_add(sent_bytes, std::memory_order_relaxed);
+        m_filter_time_us.fetch_add(time_us, std::memory_order_relaxed);
+    }   // addStats
+    // ------------------------------------------------------------------------
+    uint64_t getFullBytes() const              { return m_full_bytes.load(); }
+    // ------------------------------------------------------------------------
+    uint64_t getSentBytes() const              { return m_sent_bytes.load(); }
+    // ------------------------------------------------------------------------
+    uint64_t getFilterTimeUs() const       { return m_filter_time_us.load(); }
+};   // class StateRelevancy
+
+#endif
@@ -36,8 +36,10 @@
 #include "network/child_loop.hpp"
 #include "network/stk_ipv6.hpp"
 #include "network/stk_peer.hpp"
+#include "network/tick_profiler.hpp"
 #include "utils/log.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 
@@ -74,6 +76,10 @@
 STKHost *STKHost::m_stk_host[PT_COUNT];
 bool     STKHost::m_enable_console = false;
 
+// The broadcast pool is shared by all lobbies of a multi-lobby server
+static std::mutex g_broadcast_pool_mutex;
+static std::weak_ptr<ThreadPool> g_broadcast_pool;
+
 std::shared_ptr<LobbyProtocol> STKHost::create(ChildLoop* cl)
 {
     ProcessType pt = STKProcess::getType();
@@ -277,6 +283,9 @@ STKHost::STKHost(bool server)
         addr.port = ServerConfig::m_server_port;
         if (addr.port == 0 && !UserConfigParams::m_random_server_port)
             addr.port = stk_config->m_server_port;
+        // Each lobby of a multi-lobby server uses the next port
+        if (addr.port != 0 && STKProcess::hasIndependentChildren())
+            addr.port += STKProcess::getType();
         // Reserve 1 peer to deliver full server message
         int peer_count = ServerConfig::m_server_max_players + 1;
         // 1 more peer to hold ai peer
@@ -303,7 +312,17 @@ STKHost::STKHost(bool server)
                               "ENet server host.");
     }
     if (server)
+    {
         Log::info("STKHost", "Server port is %d", getPrivatePort());
+        std::lock_guard<std::mutex> lock(g_broadcast_pool_mutex);
+        m_broadcast_pool = g_broadcast_pool.lock();
+        if (!m_broadcast_pool)
+        {
+            m_broadcast_pool = std::make_shared<ThreadPool>(
+                ThreadPool::getDefaultThreadCount(4), "Broadcast");
+            g_broadcast_pool = m_broadcast_pool;
+        }
+    }
 }   // STKHost
 
 // ----------------------------------------------------------------------------
@@ -319,6 +338,8 @@ void STKHost::init()
     m_shutdown         = false;
     m_authorised       = false;
     m_network          = NULL;
+    m_wake_network     = NULL;
+    m_listener_waiting.store(false);
     m_exit_timeout.store(std::numeric_limits<uint64_t>::max());
     m_client_ping.store(0);
 
@@ -334,8 +355,10 @@ void STKHost::init()
     Network::openLog();  // Open packet log file
     ProtocolManager::createInstance();
 
-    // Optional: start the network console
-    if (m_enable_console)
+    // Optional: start the network console, only for the first lobby of a
+    // multi-lobby server
+    if (m_enable_console &&
+        !(STKProcess::hasIndependentChildren() && STKProcess::isChild()))
     {
         m_network_console = std::thread(std::bind(&NetworkConsole::mainLoop,
             this));
@@ -352,6 +375,8 @@ STKHost::~STKHost()
     // soon as possible
     if (m_client_loop)
         m_client_loop->abort();
+    for (ChildLoop* cl : m_child_lobbies)
+        cl->abort();
 
     NetworkConfig::get()->clearActivePlayersForClient();
     requestShutdown();
@@ -363,7 +388,8 @@ STKHost::~STKHost()
     stopListening();
 
     // Drop all unsent packets
-    for (auto& p : m_enet_cmd)
+    ENetCommand p;
+    while (m_enet_cmd.pop(&p))
     {
         if (std::get<3>(p) == ECT_SEND_PACKET)
         {
@@ -371,13 +397,20 @@ STKHost::~STKHost()
             enet_packet_destroy(packet);
         }
     }
+    delete m_wake_network;
     delete m_network;
+    Event::clearPool();
     enet_deinitialize();
     if (m_client_loop)
     {
         m_client_loop_thread.join();
         delete m_client_loop;
     }
+    for (unsigned i = 0; i < m_child_lobbies.size(); i++)
+    {
+        m_child_lobby_threads[i].join();
+        delete m_child_lobbies[i];
+    }
 }   // ~STKHost
 
 //-----------------------------------------------------------------------------
@@ -390,6 +423,37 @@ void STKHost::shutdown()
     destroy();
 }   // shutdown
 
+//-----------------------------------------------------------------------------
+/** Starts the additional lobbies of a multi-lobby server, each runs in its
+ *  own thread with its own process type, so it has its own protocols, world
+ *  and physics. Called by the main process after its lobby is created.
+ *  \param count Number of additional lobbies.
+ */
+void STKHost::startChildLobbies(unsigned count)
+{
+    assert(STKProcess::getType() == PT_MAIN);
+    assert(STKProcess::hasIndependentChildren());
+    if (count > PT_COUNT - PT_CHILD)
+    {
+        Log::warn("STKHost", "At most %d lobbies are supported.",
+            PT_COUNT - PT_CHILD + 1);
+        count = PT_COUNT - PT_CHILD;
+    }
+    for (unsigned i = 0; i < count; i++)
+    {
+        ChildLoopConfig clc;
+        clc.m_lan_server = NetworkConfig::get()->isLAN();
+        clc.m_login_id = NetworkConfig::get()->getCurrentUserId();
+        clc.m_token = NetworkConfig::get()->getCurrentUserToken();
+        clc.m_server_ai = NetworkConfig::get()->getNumFixedAI();
+        clc.m_process_type = STKProcess::getChildType(i);
+        ChildLoop* cl = new ChildLoop(clc);
+        m_child_lobbies.push_back(cl);
+        m_child_lobby_threads.emplace_back(std::bind(&ChildLoop::run, cl));
+    }
+    Log::info("STKHost", "Started %d additional lobbies.", count);
+}   // startChildLobbies
+
 //-----------------------------------------------------------------------------
 /** Get the stun network string required for binding request
  *  \param stun_tansaction_id 16 bytes array for filling to validate later.
@@ -767,6 +831,25 @@ void STKHost::setErrorMessage(const irr::core::stringw &message)
 void STKHost::startListening()
 {
     m_exit_timeout.store(std::numeric_limits<uint64_t>::max());
+    if (!m_wake_network)
+    {
+        // Bind to loopback with any port and send to itself
+        SocketAddress loopback = isIPv6Socket() ?
+            SocketAddress("::1", 0, AF_INET6) : SocketAddress(127, 0, 0, 1);
+        ENetAddress eaddr = loopback.toENetAddress();
+        m_wake_network = new Network(1, 1, 0, 0, &eaddr);
+        if (m_wake_network->getENetHost() != NULL)
+            loopback.setPort(m_wake_network->getPort());
+        if (m_wake_network->getENetHost() == NULL ||
+            connect(m_wake_network->getENetHost()->socket,
+            loopback.getSockaddr(), loopback.getSocklen()) != 0)
+        {
+            Log::warn("STKHost", "No wake up socket available, network "
+                "commands will be handled with more delay.");
+            delete m_wake_network;
+            m_wake_network = NULL;
+        }
+    }
     m_listening_thread = std::thread(std::bind(&STKHost::mainLoop, this,
         STKProcess::getType()));
 }   // startListening
@@ -795,6 +878,8 @@ void STKHost::mainLoop(ProcessType pt)
     std::string thread_name = "STKHost";
     if (pt == PT_CHILD)
         thread_name += "_child";
+    else if (pt > PT_CHILD)
+        thread_name += "_child" + StringUtils::toString(pt - PT_CHILD);
     VS::setThreadName(thread_name.c_str());
 
     STKProcess::init(pt);
@@ -909,10 +994,9 @@ void STKHost::mainLoop(ProcessType pt)
                                 player_name.c_str(), ap, max_ping);
                             p.second->setWarnedForHighPing(true);
                             p.second->setDisconnected(true);
-                            std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-                            m_enet_cmd.emplace_back(p.second->getENetPeer(),
-                                (ENetPacket*)NULL, PDI_KICK_HIGH_PING,
-                                ECT_DISCONNECT, p.first->address);
+                            // This is the listening thread, so no need to
+                            // queue the enet command
+                            enet_peer_disconnect(p.first, PDI_KICK_HIGH_PING);
                         }
                         else if (!p.second->hasWarnedForHighPing())
                         {
@@ -924,7 +1008,11 @@ void STKHost::mainLoop(ProcessType pt)
                             NetworkString msg(PROTOCOL_LOBBY_ROOM);
                             msg.setSynchronous(true);
                             msg.addUInt8(LobbyProtocol::LE_BAD_CONNECTION);
-                            p.second->sendPacket(&msg, /*reliable*/true);
+                            ENetPacket* packet = p.second->createPacket(&msg,
+                                /*reliable*/true, /*encrypted*/true);
+                            if (packet && enet_peer_send(p.first,
+                                EVENT_CHANNEL_NORMAL, packet) < 0)
+                                enet_packet_destroy(packet);
                         }
                     }
                 }
@@ -994,12 +1082,13 @@ void STKHost::mainLoop(ProcessType pt)
             peer_lock.unlock();
         }
 
-        std::vector<std::tuple<ENetPeer*, ENetPacket*, uint32_t,
-            ENetCommandType, ENetAddress> > copied_list;
-        std::unique_lock<std::mutex> lock(m_enet_cmd_mutex);
-        std::swap(copied_list, m_enet_cmd);
-        lock.unlock();
-        for (auto& p : copied_list)
+        waitForEvents(host, direct_socket);
+        // Only the time of handing the packets to enet is measured, the
+        // packets are sent in enet_host_service below
+        TickProfiler::Scope tick_profiler_scope(
+            TickProfiler::TP_NETWORK_SEND);
+        ENetCommand p;
+        while (m_enet_cmd.pop(&p))
         {
             ENetPeer* peer = std::get<0>(p);
             ENetAddress& ea = std::get<4>(p);
@@ -1046,9 +1135,11 @@ void STKHost::mainLoop(ProcessType pt)
                 break;
             }
         }
+        tick_profiler_scope.end();
 
         bool need_ping_update = false;
-        while (enet_host_service(host, &event, 10) != 0)
+        // waitForEvents already waited, so only handle what is available now
+        while (enet_host_service(host, &event, 0) != 0)
         {
             auto lp = LobbyProtocol::get<LobbyProtocol>();
             if (!is_server &&
@@ -1223,6 +1314,90 @@ void STKHost::mainLoop(ProcessType pt)
     Log::info("STKHost", "Listening has been stopped.");
 }   // mainLoop
 
+// ----------------------------------------------------------------------------
+/** Waits in the listening thread until a packet arrives on one of the
+ *  sockets or an enet command is added, or at most 10ms so enet can handle
+ *  its timeouts and resends.
+ *  \param host The enet host.
+ *  \param direct_socket Optional socket for LAN requests.
+ */
+void STKHost::waitForEvents(ENetHost* host, Network* direct_socket)
+{
+    ENetSocketSet read_set;
+    ENET_SOCKETSET_EMPTY(read_set);
+    ENET_SOCKETSET_ADD(read_set, host->socket);
+    ENetSocket max_socket = host->socket;
+    if (direct_socket)
+    {
+        ENetSocket s = direct_socket->getENetHost()->socket;
+        ENET_SOCKETSET_ADD(read_set, s);
+        max_socket = std::max(max_socket, s);
+    }
+
+    // Without wake up socket poll for enet commands every millisecond
+    uint32_t timeout = 1;
+    if (m_wake_network)
+    {
+        ENetSocket s = m_wake_network->getENetHost()->socket;
+        ENET_SOCKETSET_ADD(read_set, s);
+        max_socket = std::max(max_socket, s);
+        m_listener_waiting.store(true);
+        // Pairs with the fence in wakeListener, a command added before the
+        // flag is set is seen here, any later one sends a wake up byte
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        timeout = m_enet_cmd.empty() ? 10 : 0;
+    }
+    if (timeout > 0)
+        enet_socketset_select(max_socket, &read_set, NULL, timeout);
+    m_listener_waiting.store(false);
+
+    if (m_wake_network)
+    {
+        char buffer[64];
+        while (recv(m_wake_network->getENetHost()->socket, buffer,
+            sizeof(buffer), 0) > 0);
+    }
+}   // waitForEvents
+
+// ----------------------------------------------------------------------------
+/** Wakes up the listening thread if it is waiting for events, called after
+ *  adding enet commands. */
+void STKHost::wakeListener()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_listener_waiting.exchange(false))
+        return;
+    char c = 0;
+    send(m_wake_network->getENetHost()->socket, &c, 1, 0);
+}   // wakeListener
+
+// ----------------------------------------------------------------------------
+/** Adds enet commands which will be run in the listening thread in the same
+ *  order, commands of one call are not interleaved with commands of other
+ *  threads (unless there are more than a quarter of the queue size). If the
+ *  queue is full it waits for the listening thread to handle the commands,
+ *  so it must not be called from the listening thread.
+ *  \param cmds The commands.
+ *  \param count Number of commands.
+ */
+void STKHost::addEnetCommands(const ENetCommand* cmds, size_t count)
+{
+    assert(std::this_thread::get_id() != m_listening_thread.get_id());
+    const size_t max_batch = m_enet_cmd.getCapacity() / 4;
+    while (count > 0)
+    {
+        const size_t n = std::min(count, max_batch);
+        while (!m_enet_cmd.pushBatch(cmds, n))
+        {
+            wakeListener();
+            std::this_thread::yield();
+        }
+        cmds += n;
+        count -= n;
+    }
+    wakeListener();
+}   // addEnetCommands
+
 // ----------------------------------------------------------------------------
 /** Handles a direct request given to a socket. This is typically a LAN 
  *  request, but can also be used if the server is public (i.e. not behind
@@ -1240,7 +1415,8 @@ void STKHost::handleDirectSocketRequest(Network* direct_socket,
     char buffer[LEN];
 
     SocketAddress sender;
-    int len = direct_socket->receiveRawPacket(buffer, LEN, &sender, 1);
+    // No need to wait, waitForEvents returns when data arrives
+    int len = direct_socket->receiveRawPacket(buffer, LEN, &sender, 0);
     if(len<=0) return;
     BareNetworkString message(buffer, len);
     std::string command;
@@ -1339,12 +1515,15 @@ std::shared_ptr<STKPeer> STKHost::getServerPeerForClient() const
  */
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    std::unique_lock<std::mutex> lock(m_peers_mutex);
     for (auto p : m_peers)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second);
     }
+    lock.unlock();
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1354,12 +1533,15 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
  */
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    std::unique_lock<std::mutex> lock(m_peers_mutex);
     for (auto p : m_peers)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second);
     }
+    lock.unlock();
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1371,16 +1553,19 @@ void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    std::unique_lock<std::mutex> lock(m_peers_mutex);
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(p.second);
         }
     }
+    lock.unlock();
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1392,17 +1577,62 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
 void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    std::unique_lock<std::mutex> lock(m_peers_mutex);
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isValidated())
             continue;
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(p.second);
     }
+    lock.unlock();
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends the same data to a list of peers. The packets are created (and
+ *  encrypted with the key of each peer) without holding any lock, in
+ *  parallel if there are many peers, and then handed to the listening thread
+ *  together.
+ *  \param peers Peers to send the data to.
+ *  \param data Data to sent.
+ *  \param reliable If the data should be sent reliable or now.
+ */
+void STKHost::sendPacketToPeers(
+    const std::vector<std::shared_ptr<STKPeer> >& peers, NetworkString *data,
+    bool reliable)
+{
+    std::vector<ENetPacket*> packets(peers.size(), NULL);
+    auto create_packet = [&peers, &packets, data, reliable](unsigned i)
+        {
+            packets[i] = peers[i]->createPacket(data, reliable,
+                /*encrypted*/true);
+        };
+    // Only worth the synchronisation with many peers
+    if (m_broadcast_pool && peers.size() >= 4)
+        m_broadcast_pool->parallelFor((unsigned)peers.size(), create_packet);
+    else
+    {
+        for (unsigned i = 0; i < peers.size(); i++)
+            create_packet(i);
+    }
+
+    std::vector<ENetCommand> cmds;
+    cmds.reserve(peers.size());
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        if (packets[i] == NULL)
+            continue;
+        cmds.emplace_back(peers[i]->getENetPeer(), packets[i],
+            EVENT_CHANNEL_NORMAL, ECT_SEND_PACKET,
+            peers[i]->getENetAddress());
+    }
+    if (!cmds.empty())
+        addEnetCommands(cmds.data(), cmds.size());
+}   // sendPacketToPeers
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
@@ -22,6 +22,7 @@
 #ifndef STK_HOST_HPP
 #define STK_HOST_HPP
 
+#include "utils/mpsc_queue.hpp"
 #include "utils/stk_process.hpp"
 #include "utils/synchronised.hpp"
 #include "utils/time.hpp"
@@ -59,6 +60,7 @@ class ServerLobby;
 class ChildLoop;
 class SocketAddress;
 class STKPeer;
+class ThreadPool;
 
 using namespace irr;
 
@@ -71,6 +73,12 @@ enum ENetCommandType : unsigned int
 
 class STKHost
 {
+public:
+    /** A command run in the listening thread, see \ref addEnetCommand. */
+    typedef std::tuple</*peer receive*/ENetPeer*,
+        /*packet to send*/ENetPacket*, /*integer data*/uint32_t,
+        ENetCommandType, ENetAddress> ENetCommand;
+
 private:
     /** Singleton pointer to the instance. */
     static STKHost* m_stk_host[PT_COUNT];
@@ -80,6 +88,11 @@ private:
 
     std::thread m_client_loop_thread;
 
+    /** Additional lobbies of a multi-lobby server (main process only). */
+    std::vector<ChildLoop*> m_child_lobbies;
+
+    std::vector<std::thread> m_child_lobby_threads;
+
     /** ENet host interfacing sockets. */
     Network* m_network;
 
@@ -90,13 +103,21 @@ private:
     mutable std::mutex m_peers_mutex;
 
     /** Let (atm enet_peer_send and enet_peer_disconnect) run in the listening
-     *  thread. */
-    std::vector<std::tuple</*peer receive*/ENetPeer*,
-        /*packet to send*/ENetPacket*, /*integer data*/uint32_t,
-        ENetCommandType, ENetAddress> > m_enet_cmd;
+     *  thread. Filled by any thread except the listening thread itself. */
+    MPSCQueue<ENetCommand> m_enet_cmd{4096};
+
+    /** Loopback socket connected to itself, a byte sent to it wakes up the
+     *  listening thread when it waits for network events. */
+    Network* m_wake_network;
 
-    /** Protect \ref m_enet_cmd from multiple threads usage. */
-    std::mutex m_enet_cmd_mutex;
+    /** True while the listening thread waits for network events, so
+     *  \ref m_wake_network only needs to be used then. */
+    std::atomic_bool m_listener_waiting;
+
+    /** Creates the (encrypted) packets of a message sent to many peers in
+     *  parallel (server only), shared by all lobbies of a multi-lobby
+     *  server. */
+    std::shared_ptr<ThreadPool> m_broadcast_pool;
 
     /** The list of peers connected to this instance. */
     std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
@@ -170,6 +191,10 @@ private:
     // ------------------------------------------------------------------------
     void mainLoop(ProcessType pt);
     // ------------------------------------------------------------------------
+    void waitForEvents(ENetHost* host, Network* direct_socket);
+    // ------------------------------------------------------------------------
+    void wakeListener();
+    // ------------------------------------------------------------------------
     void getIPFromStun(int socket, const std::string& stun_address,
                        short family, SocketAddress* result);
 public:
@@ -243,6 +268,8 @@ public:
     //-------------------------------------------------------------------------
     void shutdown();
     //-------------------------------------------------------------------------
+    void startChildLobbies(unsigned count);
+    //-------------------------------------------------------------------------
     void sendPacketToAllPeersInServer(NetworkString *data,
                                       bool reliable = true);
     // ------------------------------------------------------------------------
@@ -289,10 +316,15 @@ public:
     void addEnetCommand(ENetPeer* peer, ENetPacket* packet, uint32_t i,
                         ENetCommandType ect, ENetAddress ea)
     {
-        std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-        m_enet_cmd.emplace_back(peer, packet, i, ect, ea);
+        ENetCommand cmd(peer, packet, i, ect, ea);
+        addEnetCommands(&cmd, 1);
     }
     // ------------------------------------------------------------------------
+    void addEnetCommands(const ENetCommand* cmds, size_t count);
+    // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<std::shared_ptr<STKPeer> >& peers,
+                           NetworkString *data, bool reliable = true);
+    // ------------------------------------------------------------------------
     /** Returns the last error (or "" if no error has happened). */
     const irr::core::stringw& getErrorMessage() const
                                                     { return m_error_message; }
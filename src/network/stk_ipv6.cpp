@@ -480,6 +480,54 @@ extern "C" int insideIPv6CIDR(const char* ipv6_cidr, const char* ipv6_in)
     return 1;
 }   // andIPv6
 
+// ----------------------------------------------------------------------------
+/** Converts an IPv6 address to its upper and lower 64 bits.
+ *  \return False if the address is invalid. */
+bool getIPv6Key(const char* ipv6, std::pair<uint64_t, uint64_t>* key)
+{
+    struct in6_addr v6_in;
+    if (stk_inet_pton6(ipv6, &v6_in) != 1)
+        return false;
+    key->first = key->second = 0;
+    for (unsigned i = 0; i < 8; i++)
+    {
+        key->first = (key->first << 8) | v6_in.s6_addr[i];
+        key->second = (key->second << 8) | v6_in.s6_addr[i + 8];
+    }
+    return true;
+}   // getIPv6Key
+
+// ----------------------------------------------------------------------------
+/** Returns the first and last address of an IPv6 CIDR block, a block
+ *  matches the same addresses as insideIPv6CIDR.
+ *  \return False if the CIDR is invalid. */
+bool getIPv6CIDRRange(const char* ipv6_cidr,
+                      std::pair<uint64_t, uint64_t>* start,
+                      std::pair<uint64_t, uint64_t>* end)
+{
+    const char* mask_location = strchr(ipv6_cidr, '/');
+    if (mask_location == NULL ||
+        mask_location - ipv6_cidr >= INET6_ADDRSTRLEN)
+        return false;
+    char ipv6[INET6_ADDRSTRLEN] = {};
+    memcpy(ipv6, ipv6_cidr, mask_location - ipv6_cidr);
+    if (!getIPv6Key(ipv6, start))
+        return false;
+
+    int mask_length = atoi(mask_location + 1);
+    if (mask_length > 128 || mask_length <= 0)
+        return false;
+    uint64_t upper_mask = mask_length >= 64 ?
+        ~0ULL : ~(~0ULL >> mask_length);
+    uint64_t lower_mask = mask_length <= 64 ?
+        0 : mask_length == 128 ? ~0ULL : ~(~0ULL >> (mask_length - 64));
+    start->first &= upper_mask;
+    start->second &= lower_mask;
+    end->first = start->first | ~upper_mask;
+    end->second = start->second | ~lower_mask;
+    return true;
+}   // getIPv6CIDRRange
+
 #ifndef ENABLE_IPV6
 // ----------------------------------------------------------------------------
 extern "C" int isIPv6Socket()
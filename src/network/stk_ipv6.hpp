@@ -17,6 +17,7 @@
 
 #include <enet/enet.h>
 #include <string>
+#include <utility>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,3 +35,7 @@ std::string getIPV6ReadableFromIn6(const struct sockaddr_in6* in);
 bool sameIPV6(const struct sockaddr_in6* in_1,
               const struct sockaddr_in6* in_2);
 bool isIPv4MappedAddress(const struct sockaddr_in6* in6);
+bool getIPv6Key(const char* ipv6, std::pair<uint64_t, uint64_t>* key);
+bool getIPv6CIDRRange(const char* ipv6_cidr,
+                      std::pair<uint64_t, uint64_t>* start,
+                      std::pair<uint64_t, uint64_t>* end);
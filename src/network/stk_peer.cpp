@@ -27,6 +27,7 @@
 #include "network/socket_address.hpp"
 #include "network/stk_ipv6.hpp"
 #include "network/stk_host.hpp"
+#include "network/tick_profiler.hpp"
 #include "utils/log.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/time.hpp"
@@ -47,6 +48,7 @@ STKPeer::STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id)
     m_always_spectate.store(ASM_NONE);
     m_average_ping.store(0);
     m_packet_loss.store(0);
+    m_state_bytes_saved.store(0);
     m_waiting_for_game.store(true);
     m_spectator.store(false);
     m_disconnected.store(false);
@@ -101,13 +103,35 @@ void STKPeer::reset()
  *  \param encrypted If the data is sent encrypted or not.
  */
 void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+{
+    ENetPacket* packet = createPacket(data, reliable, encrypted);
+    if (packet)
+    {
+        m_host->addEnetCommand(m_enet_peer, packet,
+                encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
+                ECT_SEND_PACKET, m_address);
+    }
+}   // sendPacket
+
+//-----------------------------------------------------------------------------
+/** Creates (and encrypts if needed) the ENet packet to be sent to this peer,
+ *  which is later sent in the listening thread of STKHost. It can be called
+ *  by multiple threads for different peers at the same time.
+ *  \param data The data to send.
+ *  \param reliable If the data is sent reliable or not.
+ *  \param encrypted If the data is sent encrypted or not.
+ *  \return The packet, or NULL if this peer is disconnected.
+ */
+ENetPacket* STKPeer::createPacket(NetworkString *data, bool reliable,
+                                  bool encrypted)
 {
     if (m_disconnected.load())
-        return;
+        return NULL;
 
     ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
     {
+        TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_ENCRYPTION);
         packet = m_crypto->encryptSend(*data, reliable);
     }
     else
@@ -119,19 +143,14 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
             ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
     }
 
-    if (packet)
+    if (packet && Network::m_connection_debug)
     {
-        if (Network::m_connection_debug)
-        {
-            Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
-                packet->dataLength, getAddress().toString().c_str(),
-                StkTime::getRealTime());
-        }
-        m_host->addEnetCommand(m_enet_peer, packet,
-                encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
-                ECT_SEND_PACKET, m_address);
+        Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
+            packet->dataLength, getAddress().toString().c_str(),
+            StkTime::getRealTime());
     }
-}   // sendPacket
+    return packet;
+}   // createPacket
 
 //-----------------------------------------------------------------------------
 /** Returns if the peer is connected or not.
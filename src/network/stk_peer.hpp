@@ -122,6 +122,9 @@ protected:
 
     std::atomic<int> m_packet_loss;
 
+    /** Bytes saved by sending delta instead of full states to this peer. */
+    std::atomic<int64_t> m_state_bytes_saved;
+
     std::set<unsigned> m_available_kart_ids;
 
     std::string m_user_version;
@@ -139,6 +142,9 @@ public:
     void sendPacket(NetworkString *data, bool reliable = true,
                     bool encrypted = true);
     // ------------------------------------------------------------------------
+    ENetPacket* createPacket(NetworkString *data, bool reliable,
+                             bool encrypted);
+    // ------------------------------------------------------------------------
     void disconnect();
     // ------------------------------------------------------------------------
     void kick();
@@ -221,6 +227,8 @@ public:
     // ------------------------------------------------------------------------
     ENetPeer* getENetPeer() const                       { return m_enet_peer; }
     // ------------------------------------------------------------------------
+    const ENetAddress& getENetAddress() const             { return m_address; }
+    // ------------------------------------------------------------------------
     void setWaitingForGame(bool val)         { m_waiting_for_game.store(val); }
     // ------------------------------------------------------------------------
     bool isWaitingForGame() const         { return m_waiting_for_game.load(); }
@@ -275,6 +283,11 @@ public:
     // ------------------------------------------------------------------------
     int getPacketLoss() const                  { return m_packet_loss.load(); }
     // ------------------------------------------------------------------------
+    void addStateBytesSaved(int bytes)
+                                       { m_state_bytes_saved.fetch_add(bytes); }
+    // ------------------------------------------------------------------------
+    int64_t getStateBytesSaved() const   { return m_state_bytes_saved.load(); }
+    // ------------------------------------------------------------------------
     const std::array<int, AS_TOTAL>& getAddonsScores() const
                                                     { return m_addons_scores; }
     // ------------------------------------------------------------------------
@@ -0,0 +1,361 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/tick_profiler.hpp"
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+TickProfiler TickProfiler::m_tick_profiler[PT_COUNT];
+
+// ----------------------------------------------------------------------------
+TickProfiler::TickProfiler()
+{
+    m_enabled.store(false);
+    m_trace_ticks.store(0);
+    reset();
+}   // TickProfiler
+
+// ----------------------------------------------------------------------------
+/** Clears all histograms, the current tick and the recorded trace. */
+void TickProfiler::reset()
+{
+    for (unsigned i = 0; i < TP_COUNT; i++)
+    {
+        m_tick_time[i].store(0);
+        Histogram& h = m_histograms[i];
+        for (unsigned j = 0; j < BUCKETS; j++)
+            h.m_buckets[j].store(0);
+        h.m_count.store(0);
+        h.m_total.store(0);
+        h.m_max.store(0);
+    }
+    std::lock_guard<std::mutex> lock(m_trace_mutex);
+    m_trace_events.clear();
+}   // reset
+
+// ----------------------------------------------------------------------------
+const char* TickProfiler::getSectionName(Section section)
+{
+    switch (section)
+    {
+    case TP_TICK:         return "tick";
+    case TP_PHYSICS:      return "physics";
+    case TP_REWIND:       return "rewind";
+    case TP_ITEMS:        return "items";
+    case TP_AI:           return "ai";
+    case TP_STATE:        return "state";
+    case TP_ENCRYPTION:   return "encryption";
+    case TP_NETWORK_SEND: return "network_send";
+    default:              return "unknown";
+    }
+}   // getSectionName
+
+// ----------------------------------------------------------------------------
+/** Returns the histogram bucket of a value, values below EXACT_BUCKETS have
+ *  their own bucket, larger ones use the 3 bits after the highest set bit.
+ */
+unsigned TickProfiler::getBucket(uint64_t value)
+{
+    if (value < EXACT_BUCKETS)
+        return (unsigned)value;
+    const uint64_t max_value = (2ULL << MAX_EXPONENT) - 1;
+    if (value > max_value)
+        value = max_value;
+    unsigned exponent = 0;
+    for (unsigned shift = 32; shift > 0; shift /= 2)
+    {
+        if (value >> (exponent + shift))
+            exponent += shift;
+    }
+    unsigned sub_bucket = (unsigned)(value >> (exponent - 3)) - 8;
+    return EXACT_BUCKETS + (exponent - 4) * 8 + sub_bucket;
+}   // getBucket
+
+// ----------------------------------------------------------------------------
+/** Returns the largest value stored in a bucket. */
+uint64_t TickProfiler::getBucketUpperBound(unsigned bucket)
+{
+    if (bucket < EXACT_BUCKETS)
+        return bucket;
+    unsigned exponent = (bucket - EXACT_BUCKETS) / 8 + 4;
+    uint64_t sub_bucket = (bucket - EXACT_BUCKETS) % 8;
+    return ((9 + sub_bucket) << (exponent - 3)) - 1;
+}   // getBucketUpperBound
+
+// ----------------------------------------------------------------------------
+void TickProfiler::addToHistogram(Histogram* h, uint64_t value)
+{
+    h->m_buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    h->m_count.fetch_add(1, std::memory_order_relaxed);
+    h->m_total.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = h->m_max.load(std::memory_order_relaxed);
+    while (value > max &&
+        !h->m_max.compare_exchange_weak(max, value,
+        std::memory_order_relaxed));
+}   // addToHistogram
+
+// ----------------------------------------------------------------------------
+/** Adds the time since start to a section of the current tick, ends the
+ *  tick if it is TP_TICK. Can be called by any thread of the process. */
+void TickProfiler::add(Section section,
+                       const std::chrono::steady_clock::time_point& start)
+{
+    auto now = std::chrono::steady_clock::now();
+    uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (now - start).count();
+    m_tick_time[section].fetch_add(duration, std::memory_order_relaxed);
+
+    if (m_trace_ticks.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_trace_mutex);
+        if (m_trace_events.size() < MAX_TRACE_EVENTS)
+        {
+            TraceEvent te;
+            te.m_section = section;
+            te.m_thread = (unsigned)
+                (std::hash<std::thread::id>()(std::this_thread::get_id()) %
+                100000);
+            te.m_start = start < m_trace_start ? 0 :
+                std::chrono::duration_cast<std::chrono::nanoseconds>
+                (start - m_trace_start).count();
+            te.m_duration = duration;
+            m_trace_events.push_back(te);
+        }
+    }
+    if (section == TP_TICK)
+        endTick();
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Adds the time of each section in the finished tick to its histogram. */
+void TickProfiler::endTick()
+{
+    for (unsigned i = 0; i < TP_COUNT; i++)
+    {
+        addToHistogram(&m_histograms[i],
+            m_tick_time[i].exchange(0, std::memory_order_relaxed));
+    }
+    if (m_trace_ticks.load(std::memory_order_relaxed) > 0)
+        m_trace_ticks.fetch_sub(1);
+}   // endTick
+
+// ----------------------------------------------------------------------------
+/** Returns the smallest bucket bound which at least percentile (0 to 1) of
+ *  the ticks are below. */
+uint64_t TickProfiler::getPercentile(Section section, double percentile) const
+{
+    const Histogram& h = m_histograms[section];
+    uint64_t count = h.m_count.load();
+    if (count == 0)
+        return 0;
+    uint64_t target = (uint64_t)std::ceil((double)count * percentile);
+    if (target == 0)
+        target = 1;
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < BUCKETS; i++)
+    {
+        sum += h.m_buckets[i].load();
+        if (sum >= target)
+            return std::min(getBucketUpperBound(i), h.m_max.load());
+    }
+    return h.m_max.load();
+}   // getPercentile
+
+// ----------------------------------------------------------------------------
+/** Returns the time per tick of each section. */
+std::string TickProfiler::getSummary() const
+{
+    std::ostringstream oss;
+    uint64_t ticks = m_histograms[TP_TICK].m_count.load();
+    if (ticks == 0)
+        return "No ticks\n";
+    oss << ticks << " ticks, time per tick (ms):\n";
+    for (unsigned i = 0; i < TP_COUNT; i++)
+    {
+        const Histogram& h = m_histograms[i];
+        uint64_t count = h.m_count.load();
+        if (count == 0)
+            continue;
+        Section s = (Section)i;
+        oss << "    " << getSectionName(s) << ": average " <<
+            (float)h.m_total.load() / 1000000.0f / (float)count <<
+            ", p50 " << (float)getPercentile(s, 0.5) / 1000000.0f <<
+            ", p99 " << (float)getPercentile(s, 0.99) / 1000000.0f <<
+            ", p99.9 " << (float)getPercentile(s, 0.999) / 1000000.0f <<
+            ", max " << (float)h.m_max.load() / 1000000.0f << "\n";
+    }
+    return oss.str();
+}   // getSummary
+
+// ----------------------------------------------------------------------------
+/** Returns the summary of each enabled profiler (one for each lobby). */
+std::string TickProfiler::getSummaryOfAll()
+{
+    std::ostringstream oss;
+    for (unsigned i = 0; i < PT_COUNT; i++)
+    {
+        if (!m_tick_profiler[i].isEnabled())
+            continue;
+        oss << "Process " << i << ": " << m_tick_profiler[i].getSummary();
+    }
+    if (oss.str().empty())
+        oss << "No server running\n";
+    return oss.str();
+}   // getSummaryOfAll
+
+// ----------------------------------------------------------------------------
+/** Starts recording each section of the next ticks for the Chrome trace,
+ *  the previous trace is cleared. */
+void TickProfiler::startTraceOfAll(int ticks)
+{
+    for (unsigned i = 0; i < PT_COUNT; i++)
+    {
+        TickProfiler& tp = m_tick_profiler[i];
+        if (!tp.isEnabled())
+            continue;
+        std::lock_guard<std::mutex> lock(tp.m_trace_mutex);
+        tp.m_trace_events.clear();
+        tp.m_trace_start = std::chrono::steady_clock::now();
+        tp.m_trace_ticks.store(ticks);
+    }
+}   // startTraceOfAll
+
+// ----------------------------------------------------------------------------
+/** Writes the histograms of all enabled profilers as JSON, the values are in
+ *  nanoseconds and each bucket is written as [upper bound, count].
+ */
+bool TickProfiler::writeJSONOfAll(const std::string& filename)
+{
+    std::ofstream ofs(filename);
+    if (!ofs.good())
+    {
+        Log::error("TickProfiler", "Cannot write %s.", filename.c_str());
+        return false;
+    }
+    ofs << "{\"unit\":\"ns\",\"processes\":[";
+    bool first_process = true;
+    for (unsigned i = 0; i < PT_COUNT; i++)
+    {
+        const TickProfiler& tp = m_tick_profiler[i];
+        if (!tp.isEnabled())
+            continue;
+        if (!first_process)
+            ofs << ",";
+        first_process = false;
+        ofs << "\n{\"process\":" << i << ",\"sections\":{";
+        for (unsigned j = 0; j < TP_COUNT; j++)
+        {
+            const Histogram& h = tp.m_histograms[j];
+            Section s = (Section)j;
+            ofs << (j == 0 ? "" : ",") << "\n\"" << getSectionName(s) <<
+                "\":{\"count\":" << h.m_count.load() << ",\"total\":" <<
+                h.m_total.load() << ",\"max\":" << h.m_max.load() <<
+                ",\"p50\":" << tp.getPercentile(s, 0.5) << ",\"p90\":" <<
+                tp.getPercentile(s, 0.9) << ",\"p99\":" <<
+                tp.getPercentile(s, 0.99) << ",\"p999\":" <<
+                tp.getPercentile(s, 0.999) << ",\"buckets\":[";
+            bool first_bucket = true;
+            for (unsigned k = 0; k < BUCKETS; k++)
+            {
+                uint64_t n = h.m_buckets[k].load();
+                if (n == 0)
+                    continue;
+                ofs << (first_bucket ? "" : ",") << "[" <<
+                    getBucketUpperBound(k) << "," << n << "]";
+                first_bucket = false;
+            }
+            ofs << "]}";
+        }
+        ofs << "}}";
+    }
+    ofs << "]}\n";
+    return ofs.good();
+}   // writeJSONOfAll
+
+// ----------------------------------------------------------------------------
+/** Writes the recorded trace in the Chrome trace event format, which can be
+ *  opened in chrome://tracing or Perfetto. Each process is shown as its own
+ *  pid. */
+bool TickProfiler::writeChromeTraceOfAll(const std::string& filename)
+{
+    std::ofstream ofs(filename);
+    if (!ofs.good())
+    {
+        Log::error("TickProfiler", "Cannot write %s.", filename.c_str());
+        return false;
+    }
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (unsigned i = 0; i < PT_COUNT; i++)
+    {
+        TickProfiler& tp = m_tick_profiler[i];
+        std::lock_guard<std::mutex> lock(tp.m_trace_mutex);
+        for (const TraceEvent& te : tp.m_trace_events)
+        {
+            ofs << (first ? "" : ",") << "\n{\"name\":\"" <<
+                getSectionName(te.m_section) << "\",\"cat\":\"tick\","
+                "\"ph\":\"X\",\"pid\":" << i << ",\"tid\":" << te.m_thread <<
+                ",\"ts\":" << (double)te.m_start / 1000.0 << ",\"dur\":" <<
+                (double)te.m_duration / 1000.0 << "}";
+            first = false;
+        }
+    }
+    ofs << "]}\n";
+    return ofs.good();
+}   // writeChromeTraceOfAll
+
+// ----------------------------------------------------------------------------
+/** Checks the bucket boundaries and the percentiles. */
+void TickProfiler::unitTesting()
+{
+    for (uint64_t v = 0; v < 100000; v++)
+    {
+        assert(getBucket(v) < BUCKETS);
+        assert(v <= getBucketUpperBound(getBucket(v)));
+        assert(getBucket(v) == 0 ||
+            v > getBucketUpperBound(getBucket(v) - 1));
+    }
+    assert(getBucket(~0ULL) == BUCKETS - 1);
+    assert(getBucketUpperBound(BUCKETS - 1) == (2ULL << MAX_EXPONENT) - 1);
+    // At most 12.5% too large
+    for (unsigned b = EXACT_BUCKETS; b < BUCKETS; b++)
+    {
+        assert((double)(getBucketUpperBound(b) - getBucketUpperBound(b - 1)) <=
+            (double)(getBucketUpperBound(b - 1) + 1) * 0.125 + 1.0);
+    }
+
+    TickProfiler* tp = new TickProfiler();
+    for (uint64_t i = 1; i <= 1000; i++)
+        addToHistogram(&tp->m_histograms[TP_PHYSICS], i * 1000);
+    assert(tp->m_histograms[TP_PHYSICS].m_count.load() == 1000);
+    assert(tp->m_histograms[TP_PHYSICS].m_max.load() == 1000000);
+    assert(tp->getPercentile(TP_PHYSICS, 0.5) >= 500000 &&
+        tp->getPercentile(TP_PHYSICS, 0.5) <= 500000 * 1.125);
+    assert(tp->getPercentile(TP_PHYSICS, 1.0) == 1000000);
+    assert(tp->getPercentile(TP_AI, 0.5) == 0);
+    tp->reset();
+    assert(tp->m_histograms[TP_PHYSICS].m_count.load() == 0);
+    delete tp;
+}   // unitTesting
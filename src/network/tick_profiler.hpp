@@ -0,0 +1,182 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TICK_PROFILER_HPP
+#define HEADER_TICK_PROFILER_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/stk_process.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** Measures how long each part of a server tick takes, without graphics
+ *  (unlike \ref Profiler). The time of each section is summed during a tick
+ *  (also from other threads like the listening thread of STKHost) and added
+ *  to a histogram when the tick ends. The histograms use 8 buckets for each
+ *  power of two, so percentiles have an error of at most 12.5%, and
+ *  recording only needs a few atomic additions.
+ *  Each process (lobby) has its own profiler, which is only enabled if it
+ *  is a server.
+ */
+class TickProfiler : public NoCopy
+{
+public:
+    enum Section : unsigned int
+    {
+        TP_TICK = 0,
+        TP_PHYSICS,
+        TP_REWIND,
+        TP_ITEMS,
+        TP_AI,
+        TP_STATE,
+        TP_ENCRYPTION,
+        TP_NETWORK_SEND,
+        TP_COUNT
+    };
+
+    /** Measures the time until the end of the scope. */
+    class Scope : public NoCopy
+    {
+    private:
+        TickProfiler* m_profiler;
+
+        Section m_section;
+
+        std::chrono::steady_clock::time_point m_start;
+
+    public:
+        // --------------------------------------------------------------------
+        /** \param enabled False if nothing is measured, so a scope can be
+         *  used only in some cases. */
+        Scope(Section section, bool enabled = true)
+        {
+            m_profiler = TickProfiler::get();
+            if (!enabled || !m_profiler->isEnabled())
+            {
+                m_profiler = NULL;
+                return;
+            }
+            m_section = section;
+            m_start = std::chrono::steady_clock::now();
+        }   // Scope
+        // --------------------------------------------------------------------
+        ~Scope()                                                    { end(); }
+        // --------------------------------------------------------------------
+        /** Ends the measurement before the end of the scope. */
+        void end()
+        {
+            if (m_profiler)
+                m_profiler->add(m_section, m_start);
+            m_profiler = NULL;
+        }   // end
+    };   // Scope
+
+private:
+    /** Values below this are stored exactly. */
+    static const unsigned EXACT_BUCKETS = 16;
+
+    /** Values are in nanoseconds, larger ones are clamped. */
+    static const unsigned MAX_EXPONENT = 40;
+
+    static const unsigned BUCKETS = EXACT_BUCKETS +
+        (MAX_EXPONENT - 3) * 8;
+
+    static const size_t MAX_TRACE_EVENTS = 1000000;
+
+    struct Histogram
+    {
+        std::array<std::atomic<uint64_t>, BUCKETS> m_buckets;
+        std::atomic<uint64_t> m_count, m_total, m_max;
+    };
+
+    struct TraceEvent
+    {
+        Section m_section;
+        unsigned m_thread;
+        uint64_t m_start;
+        uint64_t m_duration;
+    };
+
+    static TickProfiler m_tick_profiler[PT_COUNT];
+
+    std::atomic_bool m_enabled;
+
+    /** Time of each section in the current tick. */
+    std::array<std::atomic<uint64_t>, TP_COUNT> m_tick_time;
+
+    Histogram m_histograms[TP_COUNT];
+
+    /** Number of ticks which are still traced. */
+    std::atomic<int> m_trace_ticks;
+
+    std::mutex m_trace_mutex;
+
+    std::chrono::steady_clock::time_point m_trace_start;
+
+    std::vector<TraceEvent> m_trace_events;
+
+    // ------------------------------------------------------------------------
+    static unsigned getBucket(uint64_t value);
+    // ------------------------------------------------------------------------
+    static uint64_t getBucketUpperBound(unsigned bucket);
+    // ------------------------------------------------------------------------
+    static void addToHistogram(Histogram* h, uint64_t value);
+    // ------------------------------------------------------------------------
+    uint64_t getPercentile(Section section, double percentile) const;
+    // ------------------------------------------------------------------------
+    void add(Section section,
+             const std::chrono::steady_clock::time_point& start);
+    // ------------------------------------------------------------------------
+    void endTick();
+
+public:
+    TickProfiler();
+    // ------------------------------------------------------------------------
+    /** Returns the profiler of the calling process. */
+    static TickProfiler* get()
+                            { return &m_tick_profiler[STKProcess::getType()]; }
+    // ------------------------------------------------------------------------
+    static std::string getSummaryOfAll();
+    // ------------------------------------------------------------------------
+    static void startTraceOfAll(int ticks);
+    // ------------------------------------------------------------------------
+    static bool writeJSONOfAll(const std::string& filename);
+    // ------------------------------------------------------------------------
+    static bool writeChromeTraceOfAll(const std::string& filename);
+    // ------------------------------------------------------------------------
+    static const char* getSectionName(Section section);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    void reset();
+    // ------------------------------------------------------------------------
+    std::string getSummary() const;
+    // ------------------------------------------------------------------------
+    /** Only servers record ticks. */
+    void setEnabled(bool val)                          { m_enabled.store(val); }
+    // ------------------------------------------------------------------------
+    bool isEnabled() const
+                      { return m_enabled.load(std::memory_order_relaxed); }
+};   // TickProfiler
+
+#endif
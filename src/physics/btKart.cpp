@@ -33,10 +33,11 @@
 #define ROLLING_INFLUENCE_FIX
 
 // ============================================================================
-btKart::btKart(btRigidBody* chassis, btVehicleRaycaster* raycaster,
+btKart::btKart(btRigidBody* chassis, btKartRaycaster* raycaster,
                Kart *kart)
       : m_vehicleRaycaster(raycaster), m_fixed_body(0, 0, 0)
 {
+    m_prefetched_wheel_rays     = NULL;
     m_chassisBody               = chassis;
     m_indexRightAxis            = 0;
     m_indexUpAxis               = 1;
@@ -203,6 +204,25 @@ void btKart::updateWheelTransformsWS(btWheelInfo& wheel,
                                                 wheel.m_wheelAxleCS;
 }   // updateWheelTransformsWS
 
+// ----------------------------------------------------------------------------
+/** Returns the ray that rayCast() casts for a wheel (with fraction 1), so
+ *  that the rays of all karts can be cast at once.
+ *  \param index Index of the wheel.
+ *  \param from, to On return the start and end of the ray.
+ */
+void btKart::getWheelRay(int index, btVector3 *from, btVector3 *to) const
+{
+    const btWheelInfo &wheel = m_wheelInfo[index];
+    const btTransform &chassis_trans = getChassisWorldTransform();
+    *from = chassis_trans(wheel.m_chassisConnectionPointCS);
+    const btVector3 direction = chassis_trans.getBasis() *
+                                wheel.m_wheelDirectionCS;
+    btScalar max_susp_len = wheel.getSuspensionRestLength()
+                          + wheel.m_maxSuspensionTravel;
+    btScalar raylen = max_susp_len + 0.5f;
+    *to = *from + direction * raylen;
+}   // getWheelRay
+
 // ----------------------------------------------------------------------------
 /** Updates all wheel transform informations. This is used just after a rewind
  *  to update all m_hardPointWS (which is used by stk to determine the terrain
@@ -279,7 +299,15 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
 
     btAssert(m_vehicleRaycaster);
 
-    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+    // Use the result of the ray against the track if it was already cast
+    // together with the rays of all karts (and the ray didn't change)
+    const TriangleMesh::Ray* track_ray = m_prefetched_wheel_rays ?
+        &m_prefetched_wheel_rays[index] : NULL;
+    if (track_ray &&
+        (track_ray->m_from != source || track_ray->m_to != target))
+        track_ray = NULL;
+    void* object = m_vehicleRaycaster->castRay(source, target, rayResults,
+                                               track_ray);
 
     wheel.m_raycastInfo.m_groundObject = 0;
 
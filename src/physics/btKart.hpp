@@ -69,7 +69,11 @@ private:
     btScalar calcRollingFriction(btWheelContactPoint& contactPoint);
 
     btScalar            m_damping;
-    btVehicleRaycaster *m_vehicleRaycaster;
+    btKartRaycaster    *m_vehicleRaycaster;
+
+    /** The results of the wheel rays against the track, which are cast for
+     *  all karts at once (see STKDynamicsWorld::updateActions()), or NULL. */
+    const TriangleMesh::Ray *m_prefetched_wheel_rays;
 
     /** Sliding (skidding) will only be permited when this is true. Also check
      *  the friction parameter in the wheels since friction directly affects
@@ -140,13 +144,15 @@ public:
      *         (this is used to get access to the kart properties).
      */
                        btKart(btRigidBody* chassis,
-                              btVehicleRaycaster* raycaster,
+                              btKartRaycaster* raycaster,
                               Kart *kart);
      virtual          ~btKart();
     void               reset();
     void               debugDraw(btIDebugDraw* debugDrawer);
     const btTransform& getChassisWorldTransform() const;
     btScalar           rayCast(unsigned int index, float fraction=1.0f);
+    void               getWheelRay(int index, btVector3 *from,
+                                   btVector3 *to) const;
     virtual void       updateVehicle(btScalar step);
     void               resetSuspension();
     btScalar           getSteeringValue(int wheel) const;
@@ -192,6 +198,11 @@ public:
     /** Returns the number of wheels of this vehicle. */
     inline int getNumWheels() const { return int(m_wheelInfo.size());}
     // ------------------------------------------------------------------------
+    /** Sets the results of the wheel rays cast against the track, one for
+     *  each wheel in the order of getWheelRay(), or NULL. */
+    void setPrefetchedWheelRays(const TriangleMesh::Ray *rays)
+                                            { m_prefetched_wheel_rays = rays; }
+    // ------------------------------------------------------------------------
     /** Returns the chassis (rigid) body. */
     inline btRigidBody* getRigidBody() { return m_chassisBody; }
     // ------------------------------------------------------------------------
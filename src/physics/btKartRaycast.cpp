@@ -19,14 +19,25 @@
 #include "physics/triangle_mesh.hpp"
 #include "tracks/track.hpp"
 
+/** Casts a ray for a wheel.
+ *  \param from, to Start and end of the ray.
+ *  \param result On return the information about the hit.
+ *  \param track_ray If not NULL, the result of this ray against the main
+ *         track mesh, which was cast for all karts together. Then only the
+ *         other objects are tested.
+ *  \return The body hit, or NULL if nothing was hit.
+ */
 void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
-                               btVehicleRaycasterResult& result)
+                               btVehicleRaycasterResult& result,
+                               const TriangleMesh::Ray* track_ray)
 {
     // ========================================================================
     class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
     {
     private:
         int m_triangle_index;
+        /** An object that is not tested by the ray. */
+        const btCollisionObject* m_ignored_object;
     public:
         /** Constructor, initialises the triangle index. */
         ClosestWithNormal(const btVector3 &from,
@@ -34,6 +45,7 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
                           : btCollisionWorld::ClosestRayResultCallback(from,to)
         {
             m_triangle_index = -1;
+            m_ignored_object = NULL;
         }   // CloestWithNormal
         // --------------------------------------------------------------------
         /** Stores the index of the triangle hit. */
@@ -50,6 +62,29 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
                 normalInWorldSpace);
         }
         // --------------------------------------------------------------------
+        virtual bool needsCollision(btBroadphaseProxy* proxy) const
+        {
+            if (proxy->m_clientObject == m_ignored_object)
+                return false;
+            return
+                btCollisionWorld::ClosestRayResultCallback::needsCollision(proxy);
+        }
+        // --------------------------------------------------------------------
+        /** Uses the result of a ray that was already cast against the given
+         *  track body, which is then not tested again. */
+        void setTrackResult(btCollisionObject* body,
+                            const TriangleMesh::Ray& ray)
+        {
+            m_ignored_object = body;
+            if (ray.m_triangle_index < 0)
+                return;
+            m_closestHitFraction = ray.m_hit_fraction;
+            m_collisionObject    = body;
+            m_hitNormalWorld     = ray.m_hit_normal;
+            m_hitPointWorld      = ray.m_hit_point;
+            m_triangle_index     = ray.m_triangle_index;
+        }
+        // --------------------------------------------------------------------
         /** Returns the index of the triangle which was hit, or -1 if
          *  no triangle was hit. */
         int getTriangleIndex() const { return m_triangle_index; }
@@ -59,6 +94,16 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
 
     ClosestWithNormal rayCallback(from,to);
 
+    if (track_ray)
+    {
+        // The track body is only skipped if the ray would test it
+        btCollisionObject* body = const_cast<btRigidBody*>(
+            Track::getCurrentTrack()->getTriangleMesh().getBody());
+        if (body && body->getBroadphaseHandle() &&
+            rayCallback.needsCollision(body->getBroadphaseHandle()))
+            rayCallback.setTrackResult(body, *track_ray);
+    }
+
     m_dynamicsWorld->rayTest(from, to, rayCallback);
 
     if (rayCallback.hasHit())
@@ -18,6 +18,7 @@ class btDynamicsWorld;
 #include "LinearMath/btAlignedObjectArray.h"
 #include "BulletDynamics/Vehicle/btWheelInfo.h"
 #include "BulletDynamics/Dynamics/btActionInterface.h"
+#include "physics/triangle_mesh.hpp"
 
 
 class btKartRaycaster : public btVehicleRaycaster
@@ -34,7 +35,13 @@ public:
     }
 
     virtual void* castRay(const btVector3& from,const btVector3& to,
-                          btVehicleRaycasterResult& result);
+                          btVehicleRaycasterResult& result)
+    {
+        return castRay(from, to, result, NULL);
+    }
+    void* castRay(const btVector3& from, const btVector3& to,
+                  btVehicleRaycasterResult& result,
+                  const TriangleMesh::Ray* track_ray);
 
 };
 
@@ -812,7 +812,7 @@ void PhysicalObject::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
+BareNetworkString* PhysicalObject::saveState()
 {
     bool has_live_join = false;
 
@@ -837,7 +837,6 @@ BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
         return nullptr;
     }
 
-    ru->push_back(getUniqueIdentity());
     m_last_transform = cur_transform;
     m_last_lv = current_lv;
     m_last_av = current_av;
@@ -1029,7 +1028,7 @@ void PhysicalObject::copyFromMainProcess(TrackObject* track_obj)
     {
         const TriangleMesh& old_tm = *m_triangle_mesh;
         m_triangle_mesh = new TriangleMesh(/*can_be_transformed*/true);
-        m_triangle_mesh->copyFrom(old_tm);
+        m_triangle_mesh->shareFrom(old_tm);
     }
     // At the moment no bullet collision shape here has pointer in used in
     // their member values, so we can use copy constructor directly
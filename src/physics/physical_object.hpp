@@ -284,7 +284,7 @@ public:
     void addForRewind();
     virtual void saveTransform();
     virtual void computeError();
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual BareNetworkString* saveState();
     virtual void undoEvent(BareNetworkString *buffer) {}
     virtual void rewindToEvent(BareNetworkString *buffer) {}
     virtual void restoreState(BareNetworkString *buffer, int count);
@@ -32,6 +32,7 @@
 #include "modes/soccer_world.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
+#include "network/tick_profiler.hpp"
 #include "karts/explosion_animation.hpp"
 #include "physics/btKart.hpp"
 #include "physics/irr_debug_drawer.hpp"
@@ -44,9 +45,22 @@
 #include "tracks/track_object.hpp"
 #include "utils/profiler.hpp"
 #include "utils/stk_process.hpp"
+#include "utils/thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
 
 //=============================================================================
 Physics* g_physics[PT_COUNT];
+
+// The raycast pool is shared by all lobbies of a multi-lobby server
+static std::mutex g_ray_thread_pool_mutex;
+static std::weak_ptr<ThreadPool> g_ray_thread_pool;
+
+/** With fewer karts casting their rays with worker threads is not faster. */
+static const unsigned int MIN_THREADED_RAY_KARTS = 20;
+
 // ----------------------------------------------------------------------------
 Physics* Physics::get()
 {
@@ -171,12 +185,44 @@ void Physics::removeKart(const AbstractKart *kart)
 }   // removeKart
 
 //-----------------------------------------------------------------------------
+/** Casts rays of the karts against the main track mesh at once, which is
+ *  faster than casting them one by one (see TriangleMesh::castRays()). With
+ *  many karts (e.g. on a server) the rays are split between worker threads.
+ *  \param rays The rays, on return the hit information is set.
+ *  \param num_karts Number of karts which cast these rays.
+ */
+void Physics::castTrackRays(std::vector<TriangleMesh::Ray> *rays,
+                            unsigned int num_karts)
+{
+    ThreadPool* pool = NULL;
+    if (num_karts >= MIN_THREADED_RAY_KARTS)
+    {
+        if (!m_ray_thread_pool)
+        {
+            std::lock_guard<std::mutex> lock(g_ray_thread_pool_mutex);
+            m_ray_thread_pool = g_ray_thread_pool.lock();
+            if (!m_ray_thread_pool)
+            {
+                m_ray_thread_pool = std::make_shared<ThreadPool>(
+                    ThreadPool::getDefaultThreadCount(4), "Raycast");
+                g_ray_thread_pool = m_ray_thread_pool;
+            }
+        }
+        if (m_ray_thread_pool->getThreadCount() > 0)
+            pool = m_ray_thread_pool.get();
+    }
+    Track::getCurrentTrack()->getTriangleMesh().castRays(rays->data(),
+        (unsigned int)rays->size(), pool);
+}   // castTrackRays
+
+// ----------------------------------------------------------------------------
 /** Updates the physics simulation and handles all collisions.
  *  \param ticks Number of physics steps to simulate.
  */
 void Physics::update(int ticks)
 {
     PROFILER_PUSH_CPU_MARKER("Physics", 0, 0, 0);
+    TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_PHYSICS);
 
     m_physics_loop_active = true;
     // Bullet can report the same collision more than once (up to 4
@@ -208,7 +254,7 @@ void Physics::update(int ticks)
     // clean up is then done later in the projectile manager.
     std::vector<CollisionPair>::iterator p;
     // Child process currently has no scripting engine
-    bool is_child = STKProcess::getType() == PT_CHILD;
+    bool is_child = STKProcess::isChild();
     for(p=m_all_collisions.begin(); p!=m_all_collisions.end(); ++p)
     {
         // Kart-kart collision
@@ -784,5 +830,145 @@ void Physics::draw()
 
 // ----------------------------------------------------------------------------
 
+// ----------------------------------------------------------------------------
+/** Tests that the collision list stores each pair once in the order in which
+ *  they were reported, and compares it with a linear search in a pile-up of
+ *  32 karts.
+ */
+void Physics::unitTesting()
+{
+    // The user pointers are only compared, so they can point to anything
+    const int num_karts = 32;
+    const int num_flyables = 16;
+    std::vector<UserPointer> up(num_karts + num_flyables + 1);
+    for (int i = 0; i < num_karts; i++)
+        up[i].set((AbstractKart*)&up[i]);
+    for (int i = num_karts; i < num_karts + num_flyables; i++)
+        up[i].set((Flyable*)&up[i]);
+    up.back().set((PhysicalObject*)&up.back());
+
+    // Kart pairs are sorted, others keep the reported order
+    CollisionList list;
+    list.push_back(&up[1], Vec3(1, 0, 0), &up[0], Vec3(0, 1, 0));
+    list.push_back(&up[0], Vec3(0, 0, 1), &up[1], Vec3(0, 0, 1));
+    list.push_back(&up.back(), Vec3(0, 0, 0), &up[0], Vec3(0, 0, 0));
+    list.push_back(&up[num_karts], Vec3(0, 0, 0), &up[0], Vec3(0, 0, 0));
+    list.push_back(&up[0], Vec3(0, 0, 0), &up.back(), Vec3(0, 0, 0));
+    assert(list.size() == 4);
+    assert(list[0].getUserPointer(0) == &up[0]);
+    assert(list[0].getContactPointCS(0) == Vec3(0, 1, 0));
+    assert(list[1].getUserPointer(0) == &up.back());
+    assert(list[2].getUserPointer(0) == &up[num_karts]);
+    assert(list[3].getUserPointer(0) == &up[0]);
+    list.clear();
+    assert(list.empty());
+
+    // Create the reported collisions of a few ticks of a pile-up: karts
+    // in a small area touch their neighbours, flyables hit a kart, and each
+    // collision is reported several times in both orders (one for each
+    // contact point and island).
+    std::vector<std::vector<CollisionPair> > ticks;
+    for (int t = 0; t < 64; t++)
+    {
+        std::vector<Vec3> xyz;
+        for (int i = 0; i < num_karts; i++)
+            xyz.push_back(Vec3((rand() % 1000) / 100.0f, 0,
+                               (rand() % 1000) / 100.0f));
+        std::vector<CollisionPair> reported;
+        for (int i = 0; i < num_karts; i++)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                if ((xyz[i] - xyz[j]).length2() > 2.5f * 2.5f)
+                    continue;
+                for (int k = 0; k < 4; k++)
+                {
+                    reported.push_back(CollisionPair(&up[i], xyz[i],
+                                                     &up[j], xyz[j]));
+                    reported.push_back(CollisionPair(&up[j], xyz[j],
+                                                     &up[i], xyz[i]));
+                }
+            }
+        }
+        for (int i = num_karts; i < num_karts + num_flyables; i++)
+        {
+            const int kart = rand() % num_karts;
+            for (int k = 0; k < 4; k++)
+            {
+                reported.push_back(CollisionPair(&up[i], xyz[kart],
+                                                 &up[kart], xyz[kart]));
+            }
+        }
+        for (unsigned int i = (unsigned int)reported.size(); i > 1; i--)
+            std::swap(reported[i - 1], reported[rand() % i]);
+        ticks.push_back(reported);
+    }
+
+    const int iterations = 2000;
+    size_t unique = 0, total = 0;
+    std::vector<CollisionPair> linear;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (const std::vector<CollisionPair>& reported : ticks)
+        {
+            linear.clear();
+            for (const CollisionPair& p : reported)
+            {
+                if (std::find(linear.begin(), linear.end(), p) ==
+                    linear.end())
+                    linear.push_back(p);
+            }
+            unique += linear.size();
+            total += reported.size();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    const double linear_us =
+        std::chrono::duration<double, std::micro>(end - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        for (const std::vector<CollisionPair>& reported : ticks)
+        {
+            list.clear();
+            for (const CollisionPair& p : reported)
+                list.push_back(p);
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    const double hashed_us =
+        std::chrono::duration<double, std::micro>(end - start).count();
+
+    // Both must give the same pairs in the same order
+    for (const std::vector<CollisionPair>& reported : ticks)
+    {
+        linear.clear();
+        list.clear();
+        for (const CollisionPair& p : reported)
+        {
+            if (std::find(linear.begin(), linear.end(), p) == linear.end())
+                linear.push_back(p);
+            list.push_back(p);
+        }
+        assert(list.size() == linear.size());
+        for (unsigned int i = 0; i < list.size(); i++)
+        {
+            assert(list[i] == linear[i]);
+            assert(list[i].getContactPointCS(0) ==
+                   linear[i].getContactPointCS(0));
+        }
+    }
+
+    const int num_ticks = iterations * (int)ticks.size();
+    Log::info("Physics", "Pile-up of %d karts, %.1f reported and %.1f unique "
+        "collisions per tick: linear search %.2f us, hash table %.2f us per "
+        "tick.", num_karts, (float)total / num_ticks,
+        (float)unique / num_ticks, linear_us / num_ticks, hashed_us / num_ticks);
+}   // unitTesting
+
+// ----------------------------------------------------------------------------
+
 /* EOF */
 
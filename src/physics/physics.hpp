@@ -24,6 +24,8 @@
   * Contains various physics utilities.
   */
 
+#include <algorithm>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -31,10 +33,13 @@
 
 #include "physics/irr_debug_drawer.hpp"
 #include "physics/stk_dynamics_world.hpp"
+#include "physics/triangle_mesh.hpp"
 #include "physics/user_pointer.hpp"
+#include "utils/types.hpp"
 
 class AbstractKart;
 class STKDynamicsWorld;
+class ThreadPool;
 class Vec3;
 
 /**
@@ -48,11 +53,7 @@ private:
      *  substep might be taken, resulting in potentially even more
      *  duplicates. To handle this, all collisions (i.e. pair of objects)
      *  are stored in a vector, but only one entry per collision pair
-     *  of objects.
-     *  While this is a natural application of std::set, the set has some
-     *  overhead (since it will likely use a tree to sort the entries).
-     *  Considering that the number of collisions is usually rather small
-     *  a simple list and linear search is faster is is being used here. */
+     *  of objects (see CollisionList). */
     class CollisionPair
     {
     private:
@@ -81,7 +82,7 @@ private:
         /** Tests if two collision pairs involve the same objects. This test
          *  is simplified (i.e. no test if p.b==a and p.a==b) since the
          *  elements are sorted. */
-        bool operator==(const CollisionPair &p)
+        bool operator==(const CollisionPair &p) const
         {
             return (p.m_up[0]==m_up[0] && p.m_up[1]==m_up[1]);
         }   // operator==
@@ -102,19 +103,69 @@ private:
     };  // CollisionPair
 
     // ========================================================================
-    // This class is the list of collision objects, where each collision
-    // pair is stored as most once.
+    /** This class is the list of collision objects, where each collision
+     *  pair is stored as most once. The pairs are kept in the order in which
+     *  they were reported. An open addressing hash table of indices into the
+     *  list is used to find an existing pair, since with many karts in a
+     *  pile-up a linear search for each reported pair becomes expensive. */
     class CollisionList : public std::vector<CollisionPair>
     {
     private:
-        void push_back(CollisionPair p) {
-            // only add a pair if it's not already in there
-            for(iterator i=begin(); i!=end(); i++) {
-                if((*i)==p) return;
+        /** The index of a pair in this vector for each slot of the hash
+         *  table, or -1 if the slot is empty. The size is a power of two,
+         *  and at most half of the slots are used. */
+        std::vector<int> m_table;
+        // --------------------------------------------------------------------
+        /** Returns the first slot in the hash table to try for a pair. */
+        size_t getSlot(const CollisionPair &p) const
+        {
+            uint64_t h =
+                (uint64_t)(uintptr_t)p.getUserPointer(0)*0x9E3779B97F4A7C15ULL
+              ^ (uint64_t)(uintptr_t)p.getUserPointer(1)*0xC2B2AE3D27D4EB4FULL;
+            return (size_t)(h >> 32) & (m_table.size() - 1);
+        }   // getSlot
+        // --------------------------------------------------------------------
+        void rehash(size_t table_size)
+        {
+            m_table.assign(table_size, -1);
+            for (unsigned int i = 0; i < size(); i++)
+            {
+                size_t slot = getSlot((*this)[i]);
+                while (m_table[slot] != -1)
+                    slot = (slot + 1) & (table_size - 1);
+                m_table[slot] = i;
             }
-            std::vector<CollisionPair>::push_back(p);
-        };  // push_back
+        }   // rehash
     public:
+        /** Removes all pairs, keeping the size of the hash table. */
+        void clear()
+        {
+            std::vector<CollisionPair>::clear();
+            std::fill(m_table.begin(), m_table.end(), -1);
+        }   // clear
+        // --------------------------------------------------------------------
+        /** Adds a collision pair, unless the objects are already in the
+         *  list. */
+        void push_back(const CollisionPair &p)
+        {
+            if (2 * (size() + 1) > m_table.size())
+                rehash(std::max<size_t>(32, 2 * m_table.size()));
+            // only add a pair if it's not already in there
+            const size_t mask = m_table.size() - 1;
+            for (size_t slot = getSlot(p); ; slot = (slot + 1) & mask)
+            {
+                const int index = m_table[slot];
+                if (index == -1)
+                {
+                    m_table[slot] = (int)size();
+                    std::vector<CollisionPair>::push_back(p);
+                    return;
+                }
+                if ((*this)[index] == p)
+                    return;
+            }
+        }   // push_back
+        // --------------------------------------------------------------------
         /** Adds information about a collision to this vector. */
         void push_back(const UserPointer *a, const btVector3 &contact_point_a,
                        const UserPointer *b, const btVector3 &contact_point_b)
@@ -147,6 +198,10 @@ private:
     btDefaultCollisionConfiguration *m_collision_conf;
     CollisionList                    m_all_collisions;
 
+    /** Worker threads to cast the rays of many karts, shared by all lobbies
+     *  of a server and only created when needed. */
+    std::shared_ptr<ThreadPool>      m_ray_thread_pool;
+
              Physics();
     virtual ~Physics();
 
@@ -158,6 +213,8 @@ public:
     // ----------------------------------------------------------------------------------------
     static void destroy();
     // ----------------------------------------------------------------------------------------
+    static void unitTesting();
+    // ----------------------------------------------------------------------------------------
     void  init             (const Vec3 &min_world, const Vec3 &max_world);
     void  addKart          (const AbstractKart *k);
     void  addBody          (btRigidBody* b) {m_dynamics_world->addRigidBody(b);}
@@ -166,6 +223,8 @@ public:
     void  KartKartCollision(AbstractKart *ka, const Vec3 &contact_point_a,
                             AbstractKart *kb, const Vec3 &contact_point_b);
     void  update           (int ticks);
+    void  castTrackRays    (std::vector<TriangleMesh::Ray> *rays,
+                            unsigned int num_karts);
     void  draw             ();
     STKDynamicsWorld*
           getPhysicsWorld  () const {return m_dynamics_world;}
@@ -0,0 +1,68 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "physics/stk_dynamics_world.hpp"
+
+#include "physics/btKart.hpp"
+#include "physics/physics.hpp"
+#include "tracks/track.hpp"
+
+// ----------------------------------------------------------------------------
+/** Casts the wheel rays of all karts against the track at once before the
+ *  karts are updated. Each kart then uses the results for the part of its
+ *  raycasts that is against the track, as long as its rays didn't change.
+ *  \param time_step Duration of the physics step.
+ */
+void STKDynamicsWorld::updateActions(btScalar time_step)
+{
+    m_karts.clear();
+    m_wheel_rays.clear();
+    if (Track::getCurrentTrack())
+    {
+        for (int i = 0; i < m_actions.size(); i++)
+        {
+            btKart* kart = dynamic_cast<btKart*>(m_actions[i]);
+            if (!kart)
+                continue;
+            m_karts.push_back(kart);
+            for (int j = 0; j < kart->getNumWheels(); j++)
+            {
+                TriangleMesh::Ray ray;
+                kart->getWheelRay(j, &ray.m_from, &ray.m_to);
+                m_wheel_rays.push_back(ray);
+            }
+        }
+    }
+
+    if (!m_wheel_rays.empty())
+    {
+        Physics::get()->castTrackRays(&m_wheel_rays,
+                                      (unsigned int)m_karts.size());
+        unsigned int first = 0;
+        for (btKart* kart : m_karts)
+        {
+            kart->setPrefetchedWheelRays(&m_wheel_rays[first]);
+            first += kart->getNumWheels();
+        }
+    }
+
+    btDiscreteDynamicsWorld::updateActions(time_step);
+
+    for (btKart* kart : m_karts)
+        kart->setPrefetchedWheelRays(NULL);
+}   // updateActions
@@ -21,12 +21,29 @@
 
 #include "btBulletDynamicsCommon.h"
 
+#include "physics/triangle_mesh.hpp"
+
+#include <vector>
+
+class btKart;
+
 /** A thin wrapper around bullet's btDiscreteDynamicsWorld. Used to
  *  be able to query and set the 'left over' time from a previous
- *  time step, which is needed for more precise rewind/replays.
+ *  time step, which is needed for more precise rewind/replays. It also
+ *  casts the wheel rays of all karts together.
  */
 class STKDynamicsWorld : public btDiscreteDynamicsWorld
 {
+private:
+    /** The karts whose wheel rays were cast in updateActions(). */
+    std::vector<btKart*> m_karts;
+
+    /** The wheel rays of all karts, in the order of m_karts. */
+    std::vector<TriangleMesh::Ray> m_wheel_rays;
+
+protected:
+    virtual void updateActions(btScalar time_step);
+
 public:
     /** The standard constructor which just created a btDiscreteDynamicsWorld. */
     STKDynamicsWorld(btDispatcher*             dispatcher,
@@ -19,30 +19,175 @@
 #include "physics/triangle_mesh.hpp"
 
 #include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "main_loop.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
+#include "utils/thread_pool.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/** Smaller meshes are built faster than their bvh is loaded. */
+static const unsigned int MIN_CACHED_TRIANGLES = 1024;
+
+/** Identifies a file of the bvh cache ('STKB'). */
+static const uint32_t BVH_CACHE_MAGIC = 0x424b5453;
+
+/** Increase this if the format of the bvh cache changes. */
+static const uint32_t BVH_CACHE_VERSION = 1;
+
+/** Number of uint32_t in the header of the bvh cache, before the hash. */
+static const unsigned int BVH_HEADER_SIZE = 6;
+
+#if __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+ #include <emmintrin.h>
+ #define SIMD_SSE2_SUPPORT (1)
+#endif
+
+// ----------------------------------------------------------------------------
+/** The values which btQuantizedBvh::walkStacklessTreeAgainstRay() uses to
+ *  test a ray against the nodes of a bvh, for 4 rays. The tests of all rays
+ *  against a node are done at once, and give the same results as bullet.
+ */
+class RayPacket
+{
+private:
+#ifdef SIMD_SSE2_SUPPORT
+    /** The x, y and z values of the 4 rays. */
+    __m128 m_from[3], m_inv_dir[3], m_sign[3], m_aabb_min[3], m_aabb_max[3];
+    __m128 m_lambda_max;
+#else
+    btVector3    m_from[4], m_inv_dir[4], m_aabb_min[4], m_aabb_max[4];
+    unsigned int m_sign[4][3];
+    btScalar     m_lambda_max[4];
+#endif
+
+public:
+    // ------------------------------------------------------------------------
+    /** Sets the i-th ray. */
+    void setRay(unsigned int i, const btVector3 &from, const btVector3 &to)
+    {
+        btVector3 aabb_min = from;
+        btVector3 aabb_max = from;
+        aabb_min.setMin(to);
+        aabb_max.setMax(to);
+        btVector3 dir = to - from;
+        dir.normalize();
+        const btScalar lambda_max = dir.dot(to - from);
+        btVector3 inv_dir;
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            inv_dir[j] = dir[j] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT)
+                                                 : btScalar(1.0) / dir[j];
+        }
+#ifdef SIMD_SSE2_SUPPORT
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            ((float*)&m_from[j])[i]     = from[j];
+            ((float*)&m_inv_dir[j])[i]  = inv_dir[j];
+            ((int32_t*)&m_sign[j])[i]   = inv_dir[j] < 0.0 ? -1 : 0;
+            ((float*)&m_aabb_min[j])[i] = aabb_min[j];
+            ((float*)&m_aabb_max[j])[i] = aabb_max[j];
+        }
+        ((float*)&m_lambda_max)[i] = lambda_max;
+#else
+        m_from[i]       = from;
+        m_inv_dir[i]    = inv_dir;
+        m_aabb_min[i]   = aabb_min;
+        m_aabb_max[i]   = aabb_max;
+        m_lambda_max[i] = lambda_max;
+        for (unsigned int j = 0; j < 3; j++)
+            m_sign[i][j] = inv_dir[j] < 0.0;
+#endif
+    }   // setRay
+    // ------------------------------------------------------------------------
+    /** Returns a bit mask of the active rays which overlap the node, i.e.
+     *  for which TestAabbAgainstAabb2() and btRayAabb2() are true. */
+    int overlaps(const btOptimizedBvhNode &node, int active) const
+    {
+#ifdef SIMD_SSE2_SUPPORT
+        __m128 node_min[3], node_max[3];
+        __m128 miss = _mm_setzero_ps();
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            node_min[j] = _mm_set1_ps(node.m_aabbMinOrg[j]);
+            node_max[j] = _mm_set1_ps(node.m_aabbMaxOrg[j]);
+            miss = _mm_or_ps(miss,
+                _mm_or_ps(_mm_cmpgt_ps(m_aabb_min[j], node_max[j]),
+                          _mm_cmplt_ps(m_aabb_max[j], node_min[j])));
+        }
+        // Most nodes are already missed by the aabbs of the rays
+        if ((_mm_movemask_ps(miss) & active) == active)
+            return 0;
+
+        __m128 t_min = _mm_setzero_ps(), t_max = _mm_setzero_ps();
+        // bullet tests the aabbs in the order x, z, y and the ray in the
+        // order x, y, z, which doesn't change the result
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            // bounds[sign] and bounds[1-sign] of btRayAabb2()
+            const __m128 sign   = m_sign[j];
+            const __m128 b_near = _mm_or_ps(_mm_and_ps(sign, node_max[j]),
+                                            _mm_andnot_ps(sign, node_min[j]));
+            const __m128 b_far  = _mm_or_ps(_mm_and_ps(sign, node_min[j]),
+                                            _mm_andnot_ps(sign, node_max[j]));
+            const __m128 t_near = _mm_mul_ps(_mm_sub_ps(b_near, m_from[j]),
+                                             m_inv_dir[j]);
+            const __m128 t_far  = _mm_mul_ps(_mm_sub_ps(b_far, m_from[j]),
+                                             m_inv_dir[j]);
+            if (j == 0)
+            {
+                t_min = t_near;
+                t_max = t_far;
+                continue;
+            }
+            miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmpgt_ps(t_min, t_far),
+                                             _mm_cmpgt_ps(t_near, t_max)));
+            // Same as "if (t_near > t_min) t_min = t_near;", also for NaN
+            t_min = _mm_max_ps(t_near, t_min);
+            t_max = _mm_min_ps(t_far, t_max);
+        }
+        const __m128 hit = _mm_and_ps(_mm_cmplt_ps(t_min, m_lambda_max),
+                                      _mm_cmpgt_ps(t_max, _mm_setzero_ps()));
+        return _mm_movemask_ps(_mm_andnot_ps(miss, hit)) & active;
+#else
+        const btVector3 bounds[2] = { node.m_aabbMinOrg, node.m_aabbMaxOrg };
+        int result = 0;
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            if ((active & (1 << i)) == 0)
+                continue;
+            btScalar param = 1.0;
+            if (TestAabbAgainstAabb2(m_aabb_min[i], m_aabb_max[i],
+                                     node.m_aabbMinOrg, node.m_aabbMaxOrg) &&
+                btRayAabb2(m_from[i], m_inv_dir[i], m_sign[i], bounds, param,
+                           0.0f, m_lambda_max[i]))
+                result |= 1 << i;
+        }
+        return result;
+#endif
+    }   // overlaps
+};   // RayPacket
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
  */
-TriangleMesh::TriangleMesh(bool can_be_transformed) : m_mesh()
+TriangleMesh::TriangleMesh(bool can_be_transformed)
+            : m_geometry(std::make_shared<Geometry>())
 {
     m_body               = NULL;
     m_free_body          = true;
+    m_shared_geometry    = false;
     m_motion_state       = NULL;
     m_can_be_transformed = can_be_transformed;
-    // FIXME: on VS in release mode this statement actually overwrites
-    // part of the data of m_mesh, causing a crash later. Debugging
-    // shows that apparently m_collision_shape is at the same address
-    // as m_mesh->m_use32bitIndices and m_use4componentVertices
-    // (and m_mesh->m_weldingThreshold at m_normals
     m_collision_shape  = NULL;
     m_collision_object = NULL;
     m_user_pointer.set(this);
@@ -69,33 +214,38 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
                                const btVector3 &n3,
                                const Material* m)
 {
-    m_triangleIndex2Material.push_back(m);
+    assert(!m_shared_geometry);
+    Geometry& g = *m_geometry;
+    g.m_triangleIndex2Material.push_back(m);
 
     btVector3 normal = (t2-t1).cross(t3-t1);
     normal.normalize();
-    m_normals.push_back( normal.angle(n1)>stk_config->m_smooth_angle_limit
-                         ? normal : n1                                     );
-    m_normals.push_back( normal.angle(n2)>stk_config->m_smooth_angle_limit
-                         ? normal : n2                                     );
-    m_normals.push_back( normal.angle(n3)>stk_config->m_smooth_angle_limit
-                         ? normal : n3                                     );
-    m_mesh.addTriangle(t1, t2, t3);
+    g.m_normals.push_back( normal.angle(n1)>stk_config->m_smooth_angle_limit
+                           ? normal : n1                                     );
+    g.m_normals.push_back( normal.angle(n2)>stk_config->m_smooth_angle_limit
+                           ? normal : n2                                     );
+    g.m_normals.push_back( normal.angle(n3)>stk_config->m_smooth_angle_limit
+                           ? normal : n3                                     );
+    g.m_mesh.addTriangle(t1, t2, t3);
 
     // Area of triangle ABC
     btVector3 edge1 = t2 - t1;
     btVector3 edge2 = t3 - t1;
-    m_p1p2p3.push_back(edge1.cross(edge2).length2());
+    g.m_p1p2p3.push_back(edge1.cross(edge2).length2());
 }   // addTriangle
 
 // -----------------------------------------------------------------------------
-/** Creates a collision body only, which can be used for raycasting, but
- *  has no physical properties.
+/** Creates a collision body only, which can be used for raycasts, but
+ *  has no physical properties. Building the bvh of a large mesh takes a
+ *  noticeable time, so it is cached in the cached data directory, in a file
+ *  named after a hash of the triangles. If the mesh changes (or bullet is
+ *  updated) the bvh is built again and the cache is overwritten.
  *  @param serialized_bhv if non-null, load the serialized bhv from file instead
  *                        of builing it on the fly
  */
 void TriangleMesh::createCollisionShape(bool create_collision_object, const char* serialized_bhv)
 {
-    if(m_triangleIndex2Material.size()==0)
+    if(getNumTriangles()==0)
     {
         m_collision_shape  = NULL;
         m_motion_state     = NULL;
@@ -104,59 +254,54 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
         return;
     }
     // Now convert the triangle mesh into a static rigid body
-    btBvhTriangleMeshShape* bhv_triangle_mesh;
+    btBvhTriangleMeshShape* bhv_triangle_mesh = NULL;
 
-    if (serialized_bhv != NULL)
+    if (m_shared_geometry)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
-        if (bhv == NULL)
-        {
+        // The shape was created by the mesh this geometry is shared with
+        bhv_triangle_mesh =
+            static_cast<btBvhTriangleMeshShape*>(m_geometry->m_collision_shape);
+        assert(bhv_triangle_mesh);
+    }
+    else if (serialized_bhv != NULL)
+    {
+        bhv_triangle_mesh = loadBvh(serialized_bhv, /*has_header*/false,
+                                    /*hash*/0);
+        if (bhv_triangle_mesh == NULL)
             Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
+    }
+    else if (file_manager &&
+             getNumTriangles() >= MIN_CACHED_TRIANGLES)
+    {
+        const uint64_t hash = getHash();
+        char name[64];
+        snprintf(name, sizeof(name), "bvh-%016llx.dat",
+                 (unsigned long long)hash);
+        const std::string filename = file_manager->getCachedDataDir() + name;
+        bhv_triangle_mesh = loadBvh(filename, /*has_header*/true, hash);
+        if (bhv_triangle_mesh == NULL)
         {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
+            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_geometry->m_mesh,
+                                    false /* useQuantizedAabbCompression */);
+            saveBvh(filename, hash, bhv_triangle_mesh->getOptimizedBvh());
         }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
-
+        else
+            file_manager->touchCachedData(filename);
     }
-    else
-    {
-        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
 
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+    if (bhv_triangle_mesh == NULL)
+    {
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_geometry->m_mesh,
+                                    false /* useQuantizedAabbCompression */);
     }
 
+    if (!m_shared_geometry)
+    {
+        assert(m_geometry->m_collision_shape == NULL);
+        m_geometry->m_collision_shape = bhv_triangle_mesh;
+        bhv_triangle_mesh->setUserPointer(&m_user_pointer);
+    }
     m_collision_shape = bhv_triangle_mesh;
-    m_collision_shape->setUserPointer(&m_user_pointer);
     if(create_collision_object)
     {
         m_collision_object = new btCollisionObject();
@@ -168,6 +313,138 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
 
 }   // createCollisionShape
 
+// -----------------------------------------------------------------------------
+/** Returns a 64 bit FNV-1a hash of all triangles, which is used to find the
+ *  cached bvh of this mesh.
+ */
+uint64_t TriangleMesh::getHash() const
+{
+    uint64_t hash = FileUtils::FNV_HASH_BASIS;
+    auto add = [&hash](const void* data, size_t size)
+        {
+            FileUtils::addToHash(&hash, data, size);
+        };
+    const uint32_t n = getNumTriangles();
+    add(&n, sizeof(n));
+    for (unsigned int i = 0; i < n; i++)
+    {
+        btVector3 p[3];
+        getTriangle(i, p, p + 1, p + 2);
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            const float xyz[3] = { p[j].getX(), p[j].getY(), p[j].getZ() };
+            add(xyz, sizeof(xyz));
+        }
+    }
+    return hash;
+}   // getHash
+
+// -----------------------------------------------------------------------------
+/** Loads a serialized bvh and creates the collision shape with it.
+ *  \param filename Name of the file.
+ *  \param has_header True for a file of the bvh cache, which starts with a
+ *         header to detect a different mesh, bullet version or data layout
+ *         (see saveBvh). Otherwise the file only contains the bvh (as
+ *         little endian).
+ *  \param hash Hash of the mesh (see getHash), if has_header is true.
+ *  \return The collision shape, or NULL if the file could not be used.
+ */
+btBvhTriangleMeshShape* TriangleMesh::loadBvh(const std::string& filename,
+                                              bool has_header, uint64_t hash)
+{
+    FILE* fd = FileUtils::fopenU8Path(filename, "rb");
+    if (!fd)
+        return NULL;
+    fseek(fd, 0, SEEK_END);
+    long size = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+    bool swap_endian = !IS_LITTLE_ENDIAN;
+    if (has_header)
+    {
+        uint32_t header[BVH_HEADER_SIZE];
+        uint64_t file_hash = 0;
+        if (fread(header, sizeof(header), 1, fd) != 1 ||
+            fread(&file_hash, sizeof(file_hash), 1, fd) != 1 ||
+            header[0] != BVH_CACHE_MAGIC || header[1] != BVH_CACHE_VERSION ||
+            header[2] != BT_BULLET_VERSION ||
+            header[3] != sizeof(btOptimizedBvh) ||
+            header[4] != sizeof(btOptimizedBvhNode) ||
+            header[5] != getNumTriangles() || file_hash != hash)
+        {
+            fclose(fd);
+            return NULL;
+        }
+        size -= sizeof(header) + sizeof(file_hash);
+        // The cache is always written in the native byte order
+        swap_endian = false;
+    }
+    if (size <= (long)sizeof(btOptimizedBvh))
+    {
+        fclose(fd);
+        return NULL;
+    }
+
+    void* bytes = btAlignedAlloc(size, 16);
+    bool ok = fread(bytes, size, 1, fd) == 1;
+    fclose(fd);
+    btOptimizedBvh* bvh = NULL;
+    if (ok)
+    {
+        bvh = btOptimizedBvh::deSerializeInPlace(bytes, (unsigned)size,
+                                                 swap_endian);
+    }
+    if (bvh == NULL || bvh->isQuantized() ||
+        bvh->calculateSerializeBufferSize() != (unsigned)size)
+    {
+        btAlignedFree(bytes);
+        return NULL;
+    }
+
+    btBvhTriangleMeshShape* shape =
+        new btBvhTriangleMeshShape(&m_geometry->m_mesh,
+                                   false /* useQuantizedAabbCompression */,
+                                   false /* buildBvh */);
+    shape->setOptimizedBvh(bvh);
+    // Do *NOT* free the bytes now, 'deSerializeInPlace' makes the
+    // btOptimizedBvh object directly at this memory location
+    m_geometry->m_serialized_bvh = bytes;
+    return shape;
+}   // loadBvh
+
+// -----------------------------------------------------------------------------
+/** Saves the bvh in the cache (see FileUtils::writeFileAtomic).
+ *  \param filename Name of the file.
+ *  \param hash Hash of the mesh (see getHash).
+ *  \param bvh The bvh to save.
+ *  \return True if the file was written.
+ */
+bool TriangleMesh::saveBvh(const std::string& filename, uint64_t hash,
+                           btOptimizedBvh* bvh) const
+{
+    const unsigned size = bvh->calculateSerializeBufferSize();
+    void* bytes = btAlignedAlloc(size, 16);
+    if (!bvh->serialize(bytes, size, /*swap_endian*/false))
+    {
+        btAlignedFree(bytes);
+        return false;
+    }
+
+    const uint32_t header[BVH_HEADER_SIZE] =
+    {
+        BVH_CACHE_MAGIC, BVH_CACHE_VERSION, BT_BULLET_VERSION,
+        sizeof(btOptimizedBvh), sizeof(btOptimizedBvhNode),
+        getNumTriangles()
+    };
+    const bool ok = FileUtils::writeFileAtomic(filename, [&](FILE* fd)
+        {
+            return fwrite(header, sizeof(header), 1, fd) == 1 &&
+                   fwrite(&hash, sizeof(hash), 1, fd) == 1 &&
+                   fwrite(bytes, size, 1, fd) == 1;
+        });
+    btAlignedFree(bytes);
+    return ok;
+}   // saveBvh
+
 // -----------------------------------------------------------------------------
 /** Creates the physics body for this triangle mesh. If the body already
  *  exists (because it was created by a previous call to createBody)
@@ -231,10 +508,45 @@ void TriangleMesh::removeAll()
         delete m_collision_object;
         m_collision_object = NULL;
     }
-    delete m_collision_shape;
     m_collision_shape = NULL;
+    // A shared shape is freed together with the geometry, when the last
+    // mesh using it is deleted
+    if (m_geometry.use_count() == 1)
+        m_geometry->freeCollisionShape();
 }   // removeAll
 
+// ----------------------------------------------------------------------------
+/** Frees the collision shape, and the memory of its bvh if it was loaded.
+ */
+void TriangleMesh::Geometry::freeCollisionShape()
+{
+    delete m_collision_shape;
+    m_collision_shape = NULL;
+    if (m_serialized_bvh)
+    {
+        ((btOptimizedBvh*)m_serialized_bvh)->~btOptimizedBvh();
+        btAlignedFree(m_serialized_bvh);
+        m_serialized_bvh = NULL;
+    }
+}   // freeCollisionShape
+
+// ----------------------------------------------------------------------------
+/** Makes this (empty) mesh use the triangles, materials and collision shape
+ *  of another mesh instead of copying them. This is used for the copy of the
+ *  track in a child process, which only needs its own physical body. The
+ *  geometry is reference counted, so the meshes can be deleted in any order.
+ *  \param tm The mesh to share the geometry with, which must not be changed
+ *         anymore, i.e. its collision shape must be created (if it has any
+ *         triangles).
+ */
+void TriangleMesh::shareFrom(const TriangleMesh& tm)
+{
+    assert(getNumTriangles() == 0 && !m_collision_shape);
+    assert(tm.getNumTriangles() == 0 || tm.m_geometry->m_collision_shape);
+    m_geometry = tm.m_geometry;
+    m_shared_geometry = true;
+}   // shareFrom
+
 // -----------------------------------------------------------------------------
 /** Interpolates the normal at the given position for the triangle with
  *  a given index. The position must be inside of the given triangle.
@@ -378,13 +690,38 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
                                     m_collision_object ? m_collision_object : m_body,
                                     m_collision_shape, world_trans,
                                     ray_callback);
-    // Get the index of the triangle hit
-    int index = ray_callback.m_index;
-    if(ray_callback.hasHit())
+    Ray ray;
+    ray.m_from           = from;
+    ray.m_to             = to;
+    ray.m_hit_point      = ray_callback.m_hitPointWorld;
+    ray.m_hit_normal     = ray_callback.m_hitNormalWorld;
+    ray.m_hit_fraction   = ray_callback.m_closestHitFraction;
+    ray.m_triangle_index = ray_callback.hasHit() ? ray_callback.m_index : -1;
+    return getRayResult(ray, xyz, material, normal, interpolate_normal);
+}   // castRay
+
+// ----------------------------------------------------------------------------
+/** Returns the information of a ray cast by castRays() in the same way as
+ *  castRay() does.
+ *  \param ray The ray.
+ *  \param xyz On return contains the point hit.
+ *  \param material On return contains the material of the triangle hit,
+ *         or NULL if nothing was hit.
+ *  \param normal If not NULL, on return contains the normal of the triangle
+ *         hit (or (0,1,0) if nothing was hit).
+ *  \param interpolate_normal If the normal should be interpolated from the
+ *         normals of the triangle vertices.
+ *  \return True if a triangle was hit.
+ */
+bool TriangleMesh::getRayResult(const Ray& ray, btVector3 *xyz,
+                                const Material **material, btVector3 *normal,
+                                bool interpolate_normal) const
+{
+    if(ray.m_triangle_index >= 0)
     {
-        *xyz      = ray_callback.m_hitPointWorld;
+        *xyz      = ray.m_hit_point;
         xyz->setW(0.0f);
-        *material = m_triangleIndex2Material[index];
+        *material = m_geometry->m_triangleIndex2Material[ray.m_triangle_index];
 
         if(normal)
         {
@@ -392,19 +729,380 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
             // the normal of the triangle interpolate the normal at the
             // hit position based on the three normals of the triangle.
             if(interpolate_normal)
-                *normal = getInterpolatedNormal(ray_callback.m_index,
-                                                ray_callback.m_hitPointWorld);
+                *normal = getInterpolatedNormal(ray.m_triangle_index,
+                                                ray.m_hit_point);
             else
-                *normal = ray_callback.m_hitNormalWorld;
+                *normal = ray.m_hit_normal;
             normal->normalize();
         }
+        return true;
     }
+    *material = NULL;
+    if(normal)
+        normal->setValue(0, 1, 0);
+    return false;
+}   // getRayResult
+
+// ----------------------------------------------------------------------------
+/** Casts many rays against this mesh, which is faster than calling castRay()
+ *  for each of them: the bvh is traversed once for 4 rays, which are tested
+ *  against each node together (with SSE2 if available). The results are
+ *  exactly the ones castRay() would give.
+ *  \param rays The rays, on return the hit information is set.
+ *  \param count Number of rays.
+ *  \param pool If not NULL, the rays are split between its threads.
+ */
+void TriangleMesh::castRays(Ray* rays, unsigned int count,
+                            ThreadPool* pool) const
+{
+    // Each job casts up to 4 packets of 4 rays
+    const unsigned int jobs = (count + 15) / 16;
+    auto cast_job = [rays, count, this](unsigned int job)
+    {
+        const unsigned int last = std::min(job * 16 + 16, count);
+        for (unsigned int i = job * 16; i < last; i += 4)
+            castRayPacket(rays + i, std::min(last - i, 4u));
+    };
+    if (pool)
+    {
+        pool->parallelFor(jobs, cast_job);
+        return;
+    }
+    for (unsigned int i = 0; i < jobs; i++)
+        cast_job(i);
+}   // castRays
+
+// ----------------------------------------------------------------------------
+/** Casts up to 4 rays by walking the bvh like btQuantizedBvh::
+ *  walkStacklessTreeAgainstRay() does for each of them. A ray that misses a
+ *  node waits until the walk reaches the end of that subtree, and subtrees
+ *  missed by all rays are skipped. The triangles are then tested in the same
+ *  order and with the same computations as bullet would, so each ray gets
+ *  the same hit as castRay().
+ *  \param rays The rays.
+ *  \param count Number of rays, between 1 and 4.
+ */
+void TriangleMesh::castRayPacket(Ray* rays, unsigned int count) const
+{
+    assert(count > 0 && count <= 4);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        rays[i].m_hit_fraction   = 1.0f;
+        rays[i].m_triangle_index = -1;
+    }
+    if (!m_collision_shape)
+        return;
+    assert(m_collision_shape->getShapeType() == TRIANGLE_MESH_SHAPE_PROXYTYPE);
+    btBvhTriangleMeshShape* shape =
+        static_cast<btBvhTriangleMeshShape*>(m_collision_shape);
+
+    btTransform world_trans;
+    if (m_body)
+        world_trans = m_body->getWorldTransform();
     else
+        world_trans.setIdentity();
+    const btTransform world_to_local = world_trans.inverse();
+
+    /** Stores the closest triangle hit by a ray, like the callback used by
+     *  btCollisionWorld::rayTestSingle(). */
+    class PacketRayCallback : public btTriangleRaycastCallback
     {
-        *material = NULL;
-        if(normal)
-            normal->setValue(0, 1, 0);
+    public:
+        btVector3 m_normal;
+        int       m_triangle_index;
+        // --------------------------------------------------------------------
+        PacketRayCallback()
+            : btTriangleRaycastCallback(btVector3(0, 0, 0), btVector3(0, 0, 0))
+        {
+            m_triangle_index = -1;
+        }   // PacketRayCallback
+        // --------------------------------------------------------------------
+        virtual btScalar reportHit(const btVector3 &normal, btScalar fraction,
+                                   int part, int triangle_index)
+        {
+            m_normal         = normal;
+            m_triangle_index = triangle_index;
+            return fraction;
+        }   // reportHit
+    };   // PacketRayCallback
+
+    PacketRayCallback callback[4];
+    for (unsigned int i = 0; i < count; i++)
+    {
+        callback[i].m_from = world_to_local * rays[i].m_from;
+        callback[i].m_to   = world_to_local * rays[i].m_to;
     }
-    return ray_callback.hasHit();
 
-}   // castRay
+    const btOptimizedBvh* bvh = shape->getOptimizedBvh();
+    if (bvh->isQuantized())
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            shape->performRaycast(&callback[i], callback[i].m_from,
+                                  callback[i].m_to);
+        }
+    }
+    else
+    {
+        // Precompute the values of walkStacklessTreeAgainstRay()
+        RayPacket packet;
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            // Unused lanes repeat the first ray, they are never active
+            packet.setRay(i, callback[i < count ? i : 0].m_from,
+                          callback[i < count ? i : 0].m_to);
+        }
+
+        const btOptimizedBvhNode* nodes = &bvh->getContiguousNodeArray()[0];
+        const int num_nodes = bvh->getNumNodes();
+        // Index of the node at which each inactive ray continues the walk,
+        // i.e. the end of the subtree it missed
+        int resume[4] = { 0, 0, 0, 0 };
+        int next_resume = num_nodes;
+        int active = (1 << count) - 1;
+        int cur = 0;
+        while (cur < num_nodes)
+        {
+            if (cur >= next_resume)
+            {
+                next_resume = num_nodes;
+                for (unsigned int i = 0; i < count; i++)
+                {
+                    if (resume[i] <= cur)
+                        active |= 1 << i;
+                    else if ((active & (1 << i)) == 0)
+                        next_resume = std::min(next_resume, resume[i]);
+                }
+            }
+            if (active == 0)
+            {
+                cur = next_resume;
+                continue;
+            }
+            const btOptimizedBvhNode& node = nodes[cur];
+            const int hit = packet.overlaps(node, active);
+            if (node.m_escapeIndex == -1)
+            {
+                for (unsigned int i = 0; i < count; i++)
+                {
+                    if ((hit & (1 << i)) == 0)
+                        continue;
+                    btVector3 triangle[3];
+                    getTriangle(node.m_triangleIndex, &triangle[0],
+                                &triangle[1], &triangle[2]);
+                    callback[i].processTriangle(triangle, node.m_subPart,
+                                                node.m_triangleIndex);
+                }
+                cur++;
+            }
+            else if (hit == 0)
+            {
+                cur += node.m_escapeIndex;
+            }
+            else
+            {
+                if (hit != active)
+                {
+                    for (unsigned int i = 0; i < count; i++)
+                    {
+                        if ((active & ~hit & (1 << i)) != 0)
+                            resume[i] = cur + node.m_escapeIndex;
+                    }
+                    next_resume = std::min(next_resume,
+                                           cur + node.m_escapeIndex);
+                    active = hit;
+                }
+                cur++;
+            }
+        }   // while cur < num_nodes
+    }
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (callback[i].m_triangle_index < 0)
+            continue;
+        Ray& ray = rays[i];
+        ray.m_hit_fraction   = callback[i].m_hitFraction;
+        ray.m_triangle_index = callback[i].m_triangle_index;
+        ray.m_hit_normal     = world_trans.getBasis() * callback[i].m_normal;
+        ray.m_hit_point.setInterpolate3(ray.m_from, ray.m_to,
+                                        ray.m_hit_fraction);
+    }
+}   // castRayPacket
+
+// ----------------------------------------------------------------------------
+/** Checks that a bvh loaded from the cache gives the same raycasts as the
+ *  built one, and that it is not used for a different mesh.
+ */
+void TriangleMesh::unitTesting()
+{
+    const int n = 40;
+    auto create_mesh = [n](TriangleMesh* mesh, float bump)
+    {
+        auto height = [bump](int x, int z)
+        {
+            return sinf(x * 0.3f) * cosf(z * 0.2f) * 5.0f +
+                   (x == 7 && z == 9 ? bump : 0.0f);
+        };
+        for (int x = 0; x < n; x++)
+        {
+            for (int z = 0; z < n; z++)
+            {
+                btVector3 p[4] =
+                {
+                    btVector3(float(x),     height(x,     z    ), float(z)),
+                    btVector3(float(x),     height(x,     z + 1), float(z + 1)),
+                    btVector3(float(x + 1), height(x + 1, z + 1), float(z + 1)),
+                    btVector3(float(x + 1), height(x + 1, z    ), float(z))
+                };
+                btVector3 normal(0, 1, 0);
+                mesh->addTriangle(p[0], p[1], p[2], normal, normal, normal,
+                                  NULL);
+                mesh->addTriangle(p[0], p[2], p[3], normal, normal, normal,
+                                  NULL);
+            }
+        }
+    };
+
+    TriangleMesh built(/*can_be_transformed*/false);
+    create_mesh(&built, 0.0f);
+    assert(built.getNumTriangles() >= MIN_CACHED_TRIANGLES);
+    char name[64];
+    snprintf(name, sizeof(name), "bvh-%016llx.dat",
+             (unsigned long long)built.getHash());
+    const std::string filename = file_manager->getCachedDataDir() + name;
+    remove(FileUtils::getPortableWritingPath(filename).c_str());
+    built.createCollisionShape();
+    assert(built.m_geometry->m_serialized_bvh == NULL);
+
+    TriangleMesh loaded(/*can_be_transformed*/false);
+    create_mesh(&loaded, 0.0f);
+    loaded.createCollisionShape();
+    assert(loaded.m_geometry->m_serialized_bvh != NULL);
+
+#ifndef NDEBUG
+    // Returns the hit point, or a point below the mesh if nothing was hit
+    auto cast_ray = [](const TriangleMesh& mesh, const btVector3& from,
+                       const btVector3& to)
+    {
+        btVector3 xyz(0, -100.0f, 0);
+        const Material* material;
+        mesh.castRay(from, to, &xyz, &material);
+        return xyz;
+    };
+    for (int i = 0; i < 1000; i++)
+    {
+        const btVector3 from((rand() % (n * 100)) / 100.0f, 20.0f,
+                             (rand() % (n * 100)) / 100.0f);
+        const btVector3 to = from + btVector3(rand() % 11 - 5.0f, -40.0f,
+                                              rand() % 11 - 5.0f);
+        assert(cast_ray(built, from, to) == cast_ray(loaded, from, to));
+    }
+
+    // A mesh which shares the geometry of another one uses the same shape,
+    // which stays valid when the other mesh is deleted
+    TriangleMesh* original = new TriangleMesh(/*can_be_transformed*/false);
+    create_mesh(original, 0.0f);
+    original->createCollisionShape();
+    TriangleMesh shared(/*can_be_transformed*/false);
+    shared.shareFrom(*original);
+    shared.createCollisionShape();
+    assert(&shared.getCollisionShape() == &original->getCollisionShape());
+    assert(shared.getNumTriangles() == built.getNumTriangles());
+    delete original;
+    for (int i = 0; i < 100; i++)
+    {
+        const btVector3 from((rand() % (n * 100)) / 100.0f, 20.0f,
+                             (rand() % (n * 100)) / 100.0f);
+        const btVector3 to = from + btVector3(0.0f, -40.0f, 0.0f);
+        assert(cast_ray(built, from, to) == cast_ray(shared, from, to));
+    }
+#endif
+
+    // castRays() must give exactly the results of castRay(). Like in a race
+    // each kart casts 4 short wheel rays (which are cast together) and a
+    // long ray for the terrain, some karts are outside of the mesh.
+    const unsigned int num_karts = 24;
+    std::vector<Ray> rays(num_karts * 5);
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        const btVector3 kart((rand() % (n * 120)) / 100.0f - 0.1f * n, 6.0f,
+                             (rand() % (n * 120)) / 100.0f - 0.1f * n);
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            Ray& wheel = rays[i * 4 + j];
+            wheel.m_from = kart + btVector3(j % 2 * 0.8f - 0.4f, 0.0f,
+                                            j / 2 * 1.2f - 0.6f);
+            wheel.m_to   = wheel.m_from + btVector3(0.05f * (i % 3), -3.5f,
+                                                    0.0f);
+        }
+        Ray& terrain = rays[num_karts * 4 + i];
+        terrain.m_from = kart;
+        terrain.m_to   = kart + btVector3(0.0f, -10000.0f, 0.0f);
+    }
+    ThreadPool pool(2, "RayTest");
+    for (ThreadPool* p : { (ThreadPool*)NULL, &pool })
+    {
+        built.castRays(rays.data(), (unsigned int)rays.size(), p);
+#ifndef NDEBUG
+        for (const Ray& ray : rays)
+        {
+            btVector3 xyz(0, 0, 0), xyz_batch(0, 0, 0), normal, normal_batch;
+            const Material *material, *material_batch;
+            const bool hit = built.castRay(ray.m_from, ray.m_to, &xyz,
+                                           &material, &normal, true);
+            assert(built.getRayResult(ray, &xyz_batch, &material_batch,
+                                      &normal_batch, true) == hit);
+            assert(xyz == xyz_batch && normal == normal_batch);
+        }
+#endif
+    }
+
+    const int iterations = 2000;
+    btVector3 sum(0, 0, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (const Ray& ray : rays)
+        {
+            btVector3 xyz(0, 0, 0);
+            const Material* material;
+            built.castRay(ray.m_from, ray.m_to, &xyz, &material);
+            sum += xyz;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    const double single_us =
+        std::chrono::duration<double, std::micro>(end - start).count();
+    double batch_us[2];
+    for (unsigned int j = 0; j < 2; j++)
+    {
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            built.castRays(rays.data(), (unsigned int)rays.size(),
+                           j == 0 ? NULL : &pool);
+            sum += rays[i % rays.size()].m_hit_point;
+        }
+        end = std::chrono::steady_clock::now();
+        batch_us[j] =
+            std::chrono::duration<double, std::micro>(end - start).count();
+    }
+    Log::info("TriangleMesh", "%d rays of %d karts: castRay %.2f us, "
+        "castRays %.2f us, with %d threads %.2f us per tick (%f).",
+        (int)rays.size(), num_karts, single_us / iterations,
+        batch_us[0] / iterations, pool.getThreadCount(),
+        batch_us[1] / iterations, sum.length());
+
+    // A different mesh must not use the bvh of this one
+    TriangleMesh changed(/*can_be_transformed*/false);
+    create_mesh(&changed, 1.0f);
+    const uint64_t hash = changed.getHash();
+    assert(hash != built.getHash());
+    btBvhTriangleMeshShape* shape = changed.loadBvh(filename,
+                                                    /*has_header*/true, hash);
+    assert(shape == NULL);
+    delete shape;
+
+    remove(FileUtils::getPortableWritingPath(filename).c_str());
+}   // unitTesting
@@ -19,13 +19,18 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <memory>
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
 #include "physics/user_pointer.hpp"
 #include "utils/aligned_array.hpp"
+#include "utils/types.hpp"
 
+class btOptimizedBvh;
 class Material;
+class ThreadPool;
 
 /**
  * \brief A special class to store a triangle mesh with a separate material per triangle.
@@ -34,29 +39,84 @@ class Material;
 class TriangleMesh
 {
 private:
+    /** The triangles with their materials and normals, and the collision
+     *  shape built from them. They don't change after the collision shape
+     *  is created, so the copy of a mesh used in a child process shares
+     *  them with the mesh of the main process (see shareFrom()). */
+    struct Geometry
+    {
+        std::vector<const Material*> m_triangleIndex2Material;
+        btTriangleMesh               m_mesh;
+
+        /** The three normals for each triangle. */
+        AlignedArray<btVector3>      m_normals;
+
+        /** Pre-compute value used in smoothing. */
+        AlignedArray<float>          m_p1p2p3;
+
+        /** The collision shape, which is owned by the geometry so that it
+         *  is freed when no mesh uses it anymore. */
+        btCollisionShape            *m_collision_shape;
+
+        /** If the bvh was loaded from a file, it is constructed in place in
+         *  this memory, which must be freed after the collision shape. */
+        void                        *m_serialized_bvh;
+
+        Geometry() : m_collision_shape(NULL), m_serialized_bvh(NULL) {}
+        ~Geometry() { freeCollisionShape(); }
+        void freeCollisionShape();
+    };
+
     UserPointer                  m_user_pointer;
-    std::vector<const Material*> m_triangleIndex2Material;
+    std::shared_ptr<Geometry>    m_geometry;
     btRigidBody                 *m_body;
     /** Keep track if the physical body was created here or not. */
     bool                         m_free_body;
 
+    /** True if the geometry (including the collision shape) is shared with
+     *  another mesh, and therefore must not be changed. */
+    bool                         m_shared_geometry;
+
     btCollisionObject           *m_collision_object;
-    btTriangleMesh               m_mesh;
     btVector3 dummy1, dummy2;
     btDefaultMotionState        *m_motion_state;
+    /** The collision shape of the geometry once this mesh is converted. */
     btCollisionShape            *m_collision_shape;
 
-    /** The three normals for each triangle. */
-    AlignedArray<btVector3>      m_normals;
-
-    /** Pre-compute value used in smoothing. */
-    AlignedArray<float>          m_p1p2p3;
-
     /** If the rigid body can be transformed (which means that normalising
      *  the normals need to update the vertices and normals used according
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    // ------------------------------------------------------------------------
+    uint64_t getHash() const;
+    // ------------------------------------------------------------------------
+    btBvhTriangleMeshShape* loadBvh(const std::string& filename,
+                                    bool has_header, uint64_t hash);
+    // ------------------------------------------------------------------------
+    bool saveBvh(const std::string& filename, uint64_t hash,
+                 btOptimizedBvh* bvh) const;
+
+public:
+    /** A ray for castRays(), which casts many rays at once. */
+    struct Ray
+    {
+        /** Start and end of the ray in world coordinates. */
+        btVector3 m_from, m_to;
+        /** The point hit in world coordinates. */
+        btVector3 m_hit_point;
+        /** The (not interpolated) normal of the triangle hit. */
+        btVector3 m_hit_normal;
+        /** Fraction of the ray until the hit point. */
+        float m_hit_fraction;
+        /** Index of the triangle hit, or -1 if nothing was hit. */
+        int m_triangle_index;
+    };
+
+private:
+    // ------------------------------------------------------------------------
+    void castRayPacket(Ray* rays, unsigned int count) const;
+
 public:
     class RigidBodyTriangleMesh : public btRigidBody
     {
@@ -85,6 +145,7 @@ public:
     void removeCollisionObject();
     btVector3 getInterpolatedNormal(unsigned int index,
                                     const btVector3 &position) const;
+    static void unitTesting();
     // ------------------------------------------------------------------------
     /** In case of physical objects of shape 'exact', the physical body is
      *  created outside of the mesh. Since raycasts need the body's world
@@ -102,7 +163,15 @@ public:
     const btRigidBody *getBody() const { return m_body; }
     // ------------------------------------------------------------------------
     const Material* getMaterial(int n) const
-                                          {return m_triangleIndex2Material[n];}
+    {
+        return m_geometry->m_triangleIndex2Material[n];
+    }   // getMaterial
+    // ------------------------------------------------------------------------
+    /** Returns the number of triangles of this mesh. */
+    unsigned int getNumTriangles() const
+    {
+        return (unsigned int)m_geometry->m_triangleIndex2Material.size();
+    }   // getNumTriangles
     // ------------------------------------------------------------------------
     const btCollisionShape &getCollisionShape() const
                                           { return *m_collision_shape; }
@@ -113,13 +182,19 @@ public:
                  btVector3 *xyz, const Material **material,
                  btVector3 *normal=NULL, bool interpolate_normal=false) const;
     // ------------------------------------------------------------------------
+    void castRays(Ray* rays, unsigned int count, ThreadPool* pool=NULL) const;
+    // ------------------------------------------------------------------------
+    bool getRayResult(const Ray& ray, btVector3 *xyz,
+                      const Material **material, btVector3 *normal=NULL,
+                      bool interpolate_normal=false) const;
+    // ------------------------------------------------------------------------
     /** Returns the points of the 'indx' triangle.
      *  \param indx Index of the triangle to get.
      *  \param p1,p2,p3 On return the three points of the triangle. */
     void getTriangle(unsigned int indx, btVector3 *p1, btVector3 *p2,
                      btVector3 *p3) const
     {
-        const IndexedMeshArray &m = m_mesh.getIndexedMeshArray();
+        const IndexedMeshArray &m = m_geometry->m_mesh.getIndexedMeshArray();
         btVector3 *p = &(((btVector3*)(m[0].m_vertexBase))[3*indx]);
         *p1 = p[0];
         *p2 = p[1];
@@ -132,32 +207,22 @@ public:
     void getNormals(unsigned int indx, btVector3 *n1, 
                     btVector3 *n2, btVector3 *n3) const
     {
-        assert(indx < m_triangleIndex2Material.size());
+        assert(indx < m_geometry->m_triangleIndex2Material.size());
         unsigned int n = indx*3;
-        *n1 = m_normals[n  ];
-        *n2 = m_normals[n+1];
-        *n3 = m_normals[n+2];
+        *n1 = m_geometry->m_normals[n  ];
+        *n2 = m_geometry->m_normals[n+1];
+        *n3 = m_geometry->m_normals[n+2];
     }   // getNormals
     // ------------------------------------------------------------------------
     /** Returns basically the area of the triangle, which is needed when
      *  smoothing the normals. */
     float getP1P2P3(unsigned int indx) const
     {
-        assert(indx < m_p1p2p3.size());
-        return m_p1p2p3[indx];
+        assert(indx < m_geometry->m_p1p2p3.size());
+        return m_geometry->m_p1p2p3[indx];
     }
     // ------------------------------------------------------------------------
-    void copyFrom(const TriangleMesh& tm)
-    {
-        for (int i = 0; i < tm.m_mesh.getNumTriangles(); i++)
-        {
-            btVector3 v[6];
-            tm.getTriangle(i, v, v + 1, v + 2);
-            tm.getNormals(i, v + 3, v + 4, v + 5);
-            const Material* m = tm.getMaterial(i);
-            addTriangle(v[0], v[1], v[2], v[3], v[4], v[5], m);
-        }
-    }
+    void shareFrom(const TriangleMesh& tm);
 };
 #endif
 /* EOF */
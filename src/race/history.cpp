@@ -18,20 +18,33 @@
 
 #include "race/history.hpp"
 
-#include <stdio.h>
-
+#include "config/stk_config.hpp"
 #include "io/file_manager.hpp"
+#include "items/projectile_manager.hpp"
 #include "modes/world.hpp"
 #include "karts/abstract_kart.hpp"
 #include "karts/controller/controller.hpp"
 #include "network/network_config.hpp"
+#include "network/network_string.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/rewinder.hpp"
 #include "physics/physics.hpp"
 #include "race/race_manager.hpp"
+#include "tracks/check_manager.hpp"
 #include "tracks/track.hpp"
 #include "utils/constants.hpp"
 #include "utils/file_utils.hpp"
 
+#include <cstring>
+#include <zlib.h>
+
+/** "STKH" at the start of a binary history file. */
+static const uint32_t HISTORY_MAGIC = 0x53544b48;
+static const uint32_t HISTORY_VERSION = 2;
+/** Size of a chunk header: type, flags, first and last ticks, size and
+ *  stored size. */
+static const unsigned CHUNK_HEADER_SIZE = 18;
+
 History* history = 0;
 bool History::m_online_history_replay = false;
 //-----------------------------------------------------------------------------
@@ -40,32 +53,77 @@ bool History::m_online_history_replay = false;
 History::History()
 {
     m_replay_history = false;
+    m_streaming = false;
+    m_compress = false;
+    m_event_index = 0;
+    m_file = NULL;
+    m_next_chunk = 0;
+    m_last_keyframe_ticks = 0;
+    m_keyframe_interval = 10.0f;
+    m_seek_ticks = -1;
 }   // History
 
 //-----------------------------------------------------------------------------
-/** Initialise the history for a new recording. It especially allocates memory
- *  to store the history.
+History::~History()
+{
+    if (isStreaming())
+        Save();
+    closeFile();
+}   // ~History
+
+//-----------------------------------------------------------------------------
+/** Initialise the history for a new recording. If streaming is enabled, the
+ *  history file is created and the header is written.
  */
 void History::initRecording()
 {
-    allocateMemory();
     m_event_index = 0;
     m_all_input_events.clear();
+    m_all_input_events.reserve(1024);
+    if (!m_streaming || STKProcess::isChild())
+        return;
+
+    closeFile();
+    m_file = openFile("wb");
+    if (!m_file)
+    {
+        Log::warn("History", "Can't open history.dat file for writing - "
+                             "can't stream history.");
+        return;
+    }
+    writeHeader(m_file);
+    m_last_keyframe_ticks = 0;
 }   // initRecording
 
 //-----------------------------------------------------------------------------
-/** Allocates memory for the history. This is used when recording as well
- *  as when replaying (since in replay the data is read into memory first).
- *  \param number_of_frames Maximum number of frames to store.
+/** Opens history.dat in the current directory, or if that fails in the
+ *  config directory.
+ *  \param mode Mode for fopen.
  */
-void History::allocateMemory(int size)
+FILE* History::openFile(const char* mode)
 {
-    m_all_input_events.clear();
-    if(size<0)
-        m_all_input_events.reserve(1024);
-    else
-        m_all_input_events.resize(size);
-}   // allocateMemory
+    std::string fn = "history.dat";
+    FILE* fd = FileUtils::fopenU8Path(fn, mode);
+    if (!fd)
+    {
+        fn = file_manager->getUserConfigFile("history.dat");
+        fd = FileUtils::fopenU8Path(fn, mode);
+    }
+    if (fd)
+    {
+        Log::info("History", "%s '%s'.", mode[0] == 'r' ? "Reading" : "Writing",
+            fn.c_str());
+    }
+    return fd;
+}   // openFile
+
+//-----------------------------------------------------------------------------
+void History::closeFile()
+{
+    if (m_file)
+        fclose(m_file);
+    m_file = NULL;
+}   // closeFile
 
 //-----------------------------------------------------------------------------
 /** Stores an input event (e.g. acceleration or steering event) into the
@@ -88,18 +146,288 @@ void History::addEvent(int kart_id, PlayerAction pa, int value)
 }   // addEvent
 
 //-----------------------------------------------------------------------------
-/** Sets the kart position and controls to the recorded history value.
- *  \param world_ticks WOrld time in ticks.
- *  \param ticks Number of time steps.
+/** Called once per time step while recording, writes the events of the last
+ *  second if streaming is enabled.
+ *  \param world_ticks World time in ticks.
  */
-void History::updateReplay(int world_ticks)
+void History::updateRecording(int world_ticks)
+{
+    if (!isStreaming() || m_all_input_events.empty())
+        return;
+    if (world_ticks - m_all_input_events.front().m_world_ticks <
+        stk_config->time2Ticks(1.0f))
+        return;
+    writeEvents(m_file, 0, (unsigned)m_all_input_events.size());
+    m_all_input_events.clear();
+    fflush(m_file);
+}   // updateRecording
+
+//-----------------------------------------------------------------------------
+/** Returns true if a keyframe should be added at the given ticks, which is
+ *  only done when streaming.
+ *  \param world_ticks World time in ticks.
+ */
+bool History::needsKeyframe(int world_ticks) const
+{
+    return isStreaming() && world_ticks - m_last_keyframe_ticks >=
+        stk_config->time2Ticks(m_keyframe_interval);
+}   // needsKeyframe
+
+//-----------------------------------------------------------------------------
+/** Writes a keyframe with the states of all rewinders, so a replay can seek
+ *  to these ticks without simulating everything before.
+ *  \param world_ticks World time in ticks.
+ *  \param states The states (see Rewinder::saveState) indexed by the
+ *         unique identity of the rewinder.
+ */
+void History::addKeyframe(int world_ticks,
+                          const std::map<std::string, std::string>& states)
+{
+    if (!isStreaming() || states.empty())
+        return;
+    m_last_keyframe_ticks = world_ticks;
+    // Write all events before the keyframe first, so the chunks are sorted
+    writeEvents(m_file, 0, (unsigned)m_all_input_events.size());
+    m_all_input_events.clear();
+
+    BareNetworkString data;
+    data.addUInt16((uint16_t)states.size());
+    for (auto& p : states)
+    {
+        data.encodeString(p.first);
+        data.addUInt32((uint32_t)p.second.size());
+        data.getBuffer().insert(data.getBuffer().end(), p.second.begin(),
+            p.second.end());
+    }
+    writeChunk(m_file, HC_KEYFRAME, world_ticks, world_ticks, data);
+    fflush(m_file);
+}   // addKeyframe
+
+//-----------------------------------------------------------------------------
+/** Writes the start of the file and the header chunk with the race setup.
+ */
+void History::writeHeader(FILE* fd)
+{
+    BareNetworkString start(8);
+    start.addUInt32(HISTORY_MAGIC).addUInt32(HISTORY_VERSION);
+    fwrite(start.getData(), 1, start.getTotalSize(), fd);
+
+    World *world   = World::getWorld();
+    const int num_karts = world->getNumKarts();
+    assert(num_karts > 0);
+    BareNetworkString header;
+    header.encodeString(std::string(STK_VERSION))
+        .addUInt8((uint8_t)num_karts)
+        .addUInt8((uint8_t)RaceManager::get()->getNumPlayers())
+        .addUInt8((uint8_t)RaceManager::get()->getDifficulty())
+        .addUInt8(RaceManager::get()->getReverseTrack() ? 1 : 0)
+        .encodeString(Track::getCurrentTrack()->getIdent());
+    for (int k = 0; k < num_karts; k++)
+        header.encodeString(world->getKart(k)->getIdent());
+    writeChunk(fd, HC_HEADER, 0, 0, header);
+}   // writeHeader
+
+//-----------------------------------------------------------------------------
+/** Writes a chunk, which is compressed if enabled (and if it gets smaller).
+ *  \param fd The history file.
+ *  \param type Type of the chunk.
+ *  \param first_ticks Ticks of the first data in the chunk.
+ *  \param last_ticks Ticks of the last data in the chunk.
+ *  \param data Data of the chunk.
+ */
+void History::writeChunk(FILE* fd, ChunkType type, int first_ticks,
+                         int last_ticks, const BareNetworkString& data)
+{
+    const uint32_t size = data.getTotalSize();
+    const Bytef* stored = (const Bytef*)data.getData();
+    uLongf stored_size = size;
+    std::vector<Bytef> compressed;
+    if (m_compress && size > 0)
+    {
+        uLongf compressed_size = compressBound(size);
+        compressed.resize(compressed_size);
+        if (compress2(compressed.data(), &compressed_size, stored, size,
+            Z_DEFAULT_COMPRESSION) == Z_OK && compressed_size < size)
+        {
+            stored = compressed.data();
+            stored_size = compressed_size;
+        }
+    }
+
+    BareNetworkString chunk_header(CHUNK_HEADER_SIZE);
+    chunk_header.addUInt8(type).addUInt8(stored_size != size ? 1 : 0)
+        .addUInt32(first_ticks).addUInt32(last_ticks).addUInt32(size)
+        .addUInt32((uint32_t)stored_size);
+    fwrite(chunk_header.getData(), 1, chunk_header.getTotalSize(), fd);
+    fwrite(stored, 1, stored_size, fd);
+}   // writeChunk
+
+//-----------------------------------------------------------------------------
+/** Writes input events into chunks of one second.
+ *  \param fd The history file.
+ *  \param start Index of the first event to write.
+ *  \param end Index after the last event to write.
+ */
+void History::writeEvents(FILE* fd, unsigned start, unsigned end)
+{
+    const int chunk_ticks = stk_config->time2Ticks(1.0f);
+    unsigned i = start;
+    while (i < end)
+    {
+        const int first_ticks = m_all_input_events[i].m_world_ticks;
+        unsigned j = i;
+        while (j < end &&
+            m_all_input_events[j].m_world_ticks - first_ticks < chunk_ticks)
+            j++;
+        BareNetworkString data((j - i) * 10 + 4);
+        data.addUInt32(j - i);
+        for (unsigned k = i; k < j; k++)
+        {
+            const InputEvent& ie = m_all_input_events[k];
+            data.addUInt32(ie.m_world_ticks).addUInt8((uint8_t)ie.m_kart_index)
+                .addUInt8((uint8_t)ie.m_action).addUInt32(ie.m_value);
+        }
+        writeChunk(fd, HC_EVENTS, first_ticks,
+            m_all_input_events[j - 1].m_world_ticks, data);
+        i = j;
+    }
+}   // writeEvents
+
+//-----------------------------------------------------------------------------
+/** Reads the (uncompressed) data of a chunk in the replayed file.
+ *  \param chunk The chunk to read.
+ *  \param data Returns the data.
+ *  \return False if the chunk can't be read.
+ */
+bool History::readChunk(const ChunkInfo& chunk, BareNetworkString* data)
+{
+    std::vector<uint8_t> stored(chunk.m_stored_size);
+    if (fseek(m_file, chunk.m_offset, SEEK_SET) != 0 ||
+        fread(stored.data(), 1, stored.size(), m_file) != stored.size())
+        return false;
+    if (!chunk.m_compressed)
+    {
+        data->getBuffer() = std::move(stored);
+        data->reset();
+        return true;
+    }
+    std::vector<uint8_t>& buffer = data->getBuffer();
+    buffer.resize(chunk.m_size);
+    uLongf size = chunk.m_size;
+    if (uncompress(buffer.data(), &size, stored.data(), stored.size()) !=
+        Z_OK || size != chunk.m_size)
+        return false;
+    data->reset();
+    return true;
+}   // readChunk
+
+//-----------------------------------------------------------------------------
+/** Loads the next chunk of input events in replay.
+ *  \return False if there are no more events.
+ */
+bool History::loadNextEvents()
+{
+    while (m_next_chunk < m_chunks.size())
+    {
+        const ChunkInfo& chunk = m_chunks[m_next_chunk++];
+        if (chunk.m_type != HC_EVENTS)
+            continue;
+        BareNetworkString data;
+        if (!readChunk(chunk, &data))
+        {
+            Log::warn("History", "Can't read events at %d.",
+                chunk.m_first_ticks);
+            continue;
+        }
+        m_all_input_events.clear();
+        m_event_index = 0;
+        try
+        {
+            const unsigned count = data.getUInt32();
+            for (unsigned i = 0; i < count; i++)
+            {
+                InputEvent ie;
+                ie.m_world_ticks = (int)data.getUInt32();
+                ie.m_kart_index = data.getUInt8();
+                ie.m_action = (PlayerAction)data.getUInt8();
+                ie.m_value = (int)data.getUInt32();
+                m_all_input_events.push_back(ie);
+            }
+        }
+        catch (std::exception& e)
+        {
+            Log::warn("History", "Problems reading events at %d: %s",
+                chunk.m_first_ticks, e.what());
+        }
+        if (!m_all_input_events.empty())
+            return true;
+    }
+    return false;
+}   // loadNextEvents
+
+//-----------------------------------------------------------------------------
+/** Restores the states of all rewinders from a keyframe, the world time is
+ *  set to the keyframe ticks.
+ *  \param chunk The keyframe chunk.
+ *  \return False if the keyframe can't be used (rewinding is disabled).
+ */
+bool History::restoreKeyframe(const ChunkInfo& chunk)
+{
+    if (!RewindManager::isEnabled() || !RewindManager::exists())
+        return false;
+    BareNetworkString data;
+    if (!readChunk(chunk, &data))
+        return false;
+
+    // The world time is set first, like in RewindManager::rewindTo
+    World::getWorld()->setTicksForRewind(chunk.m_first_ticks);
+    RewindManager* rwm = RewindManager::get();
+    try
+    {
+        const unsigned count = data.getUInt16();
+        for (unsigned i = 0; i < count; i++)
+        {
+            std::string name;
+            data.decodeString(&name);
+            const uint32_t size = data.getUInt32();
+            if (size > data.size())
+                throw std::out_of_range("Keyframe state out of range.");
+            std::shared_ptr<Rewinder> r = rwm->getRewinder(name);
+            if (!r)
+            {
+                r = ProjectileManager::get()
+                    ->addRewinderFromNetworkState(name);
+            }
+            if (r)
+            {
+                BareNetworkString state(data.getCurrentData(), (int)size);
+                r->restoreState(&state, (int)size);
+            }
+            data.skip((int)size);
+        }
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("History", "Problems restoring keyframe at %d: %s",
+            chunk.m_first_ticks, e.what());
+    }
+    Track::getCurrentTrack()->getCheckManager()->resetAfterRewind();
+    return true;
+}   // restoreKeyframe
+
+//-----------------------------------------------------------------------------
+/** Sets the kart controls to the recorded events up to the given time.
+ *  \param world_ticks World time in ticks.
+ */
+void History::replayEvents(int world_ticks)
 {
     World *world = World::getWorld();
 
-    while (m_event_index < m_all_input_events.size() &&
-        m_all_input_events[m_event_index].m_world_ticks <= world_ticks)
+    while (m_event_index < m_all_input_events.size() || loadNextEvents())
     {
         const InputEvent &ie = m_all_input_events[m_event_index];
+        if (ie.m_world_ticks > world_ticks)
+            break;
         AbstractKart *kart = world->getKart(ie.m_kart_index);
         Log::verbose("history", "time %d event-time %d action %d %d",
             world->getTicksSinceStart(), ie.m_world_ticks, ie.m_action,
@@ -107,12 +435,77 @@ void History::updateReplay(int world_ticks)
         kart->getController()->action(ie.m_action, ie.m_value);
         m_event_index++;
     }   // while we have events for current time step.
+}   // replayEvents
+
+//-----------------------------------------------------------------------------
+/** Fast forwards the replay to the given ticks. The latest keyframe before
+ *  it is restored if possible, and the remaining ticks are simulated.
+ *  \param world_ticks World time in ticks to seek to.
+ */
+void History::seekReplay(int world_ticks)
+{
+    World *world = World::getWorld();
+    int keyframe = -1;
+    for (unsigned i = 0; i < m_chunks.size(); i++)
+    {
+        if (m_chunks[i].m_type == HC_KEYFRAME &&
+            m_chunks[i].m_first_ticks <= world_ticks &&
+            m_chunks[i].m_first_ticks > world->getTicksSinceStart())
+            keyframe = i;
+    }
+    Log::info("History", "Seeking from %d to %d ticks%s.",
+        world->getTicksSinceStart(), world_ticks,
+        keyframe == -1 ? "" : " using a keyframe");
+
+    if (keyframe != -1 && restoreKeyframe(m_chunks[keyframe]))
+    {
+        // Continue with the events from the keyframe on
+        const int ticks = m_chunks[keyframe].m_first_ticks;
+        m_next_chunk = 0;
+        while (m_next_chunk < m_chunks.size() &&
+            (m_chunks[m_next_chunk].m_type != HC_EVENTS ||
+            m_chunks[m_next_chunk].m_last_ticks < ticks))
+            m_next_chunk++;
+        m_all_input_events.clear();
+        m_event_index = 0;
+        while ((m_event_index < m_all_input_events.size() ||
+            loadNextEvents()) &&
+            m_all_input_events[m_event_index].m_world_ticks < ticks)
+            m_event_index++;
+    }
+
+    while (world->getTicksSinceStart() < world_ticks)
+    {
+        replayEvents(world->getTicksSinceStart());
+        world->updateWorld(1);
+        world->updateTime(1);
+    }
+}   // seekReplay
+
+//-----------------------------------------------------------------------------
+/** Sets the kart position and controls to the recorded history value.
+ *  \param world_ticks WOrld time in ticks.
+ *  \param ticks Number of time steps.
+ */
+void History::updateReplay(int world_ticks)
+{
+    World *world = World::getWorld();
+    if (m_seek_ticks > world_ticks)
+    {
+        seekReplay(m_seek_ticks);
+        world_ticks = world->getTicksSinceStart();
+    }
+    m_seek_ticks = -1;
 
-    // Check if we have reached the end of the buffer
+    replayEvents(world_ticks);
+
+    // Check if we have reached the end of the history
     if(m_event_index >= m_all_input_events.size())
     {
         Log::info("History", "Replay finished");
-        m_event_index= 0;
+        m_event_index = 0;
+        m_next_chunk = 0;
+        m_all_input_events.clear();
         // This is useful to use a reproducable rewind problem:
         // replay it with history, for debugging only
 #undef DO_REWIND_AT_END_OF_HISTORY
@@ -128,20 +521,21 @@ void History::updateReplay(int world_ticks)
 
 //-----------------------------------------------------------------------------
 /** Saves the history stored in the internal data structures into a file called
- *  history.dat.
+ *  history.dat. If the history is streamed, only the events not written yet
+ *  are written.
  */
 void History::Save()
 {
-    FILE *fd = fopen("history.dat","w");
-    if(fd)
-        Log::info("History", "Saved in ./history.dat.");
-    else
+    if (isStreaming())
     {
-        std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = FileUtils::fopenU8Path(fn, "w");
-        if(fd)
-            Log::info("History", "Saved in '%s'.", fn.c_str());
+        writeEvents(m_file, 0, (unsigned)m_all_input_events.size());
+        m_all_input_events.clear();
+        fflush(m_file);
+        Log::info("History", "Saved streamed history.");
+        return;
     }
+
+    FILE *fd = openFile("wb");
     if(!fd)
     {
         Log::info("History", "Can't open history.dat file for writing - can't save history.");
@@ -149,163 +543,113 @@ void History::Save()
                              "or the config directory is writable.");
         return;
     }
-
-    World *world   = World::getWorld();
-    const int num_karts = world->getNumKarts();
-    fprintf(fd, "STK-version:      %s\n",   STK_VERSION);
-    fprintf(fd, "History-version:  %d\n",   1);
-    fprintf(fd, "numkarts:         %d\n",   num_karts);
-    fprintf(fd, "numplayers:       %d\n", RaceManager::get()->getNumPlayers());
-    fprintf(fd, "difficulty:       %d\n", RaceManager::get()->getDifficulty());
-    fprintf(fd, "reverse: %c\n", RaceManager::get()->getReverseTrack() ? 'y' : 'n');
-
-    fprintf(fd, "track: %s\n", Track::getCurrentTrack()->getIdent().c_str());
-
-    assert(num_karts > 0);
-
-    int k;
-    for(k=0; k<num_karts; k++)
-    {
-        fprintf(fd, "model %d: %s\n",k, world->getKart(k)->getIdent().c_str());
-    }
-    fprintf(fd, "count:     %zu\n", m_all_input_events.size());
-
-    for (unsigned int i = 0; i < m_all_input_events.size(); i++)
-    {
-        fprintf(fd, "%d %d %d %d\n",
-                m_all_input_events[i].m_world_ticks,
-                m_all_input_events[i].m_kart_index,
-                m_all_input_events[i].m_action,
-                m_all_input_events[i].m_value      );
-    }   // for i
-
-    fprintf(fd, "History file end.\n");
+    writeHeader(fd);
+    writeEvents(fd, 0, (unsigned)m_all_input_events.size());
     fclose(fd);
 }   // Save
 
 //-----------------------------------------------------------------------------
-/** Loads a history from history.dat in the current directory.
+/** Loads a history from history.dat in the current directory. Only the
+ *  header is read, the chunks of events are read when they are replayed.
  */
 void History::Load()
 {
-    char s[1024], s1[1024];
-    int  n;
-
-    FILE *fd = fopen("history.dat","r");
-    if(fd)
-        Log::info("History", "Reading ./history.dat");
-    else
-    {
-        std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = FileUtils::fopenU8Path(fn, "r");
-        if(fd)
-            Log::info("History", "Reading '%s'.", fn.c_str());
-    }
-    if(!fd)
+    closeFile();
+    m_file = openFile("rb");
+    if(!m_file)
         Log::fatal("History", "Could not open history.dat");
 
-    if (fgets(s, 1023, fd) == NULL)
+    BareNetworkString start(8);
+    start.getBuffer().resize(8);
+    if (fread(start.getData(), 1, 8, m_file) != 8)
         Log::fatal("History", "Could not read history.dat.");
-
-    // Check for unsupported hsitory file formats:
-    if (sscanf(s, "Version-2: %1023s", s1) == 1 ||
-        sscanf(s, "Version-1: %1023s", s1) == 1)
+    if (memcmp(start.getData(), "STK-", 4) == 0 ||
+        memcmp(start.getData(), "Vers", 4) == 0)
     {
         Log::fatal("History",
-                   "Old history file format is not supported anymore.");
+                   "Text history files are not supported anymore.");
     }
-
-    if (sscanf(s,"STK-version: %1023s",s1)!=1)
-        Log::fatal("History", "No Version information found in history "
-                              "file (bogus history file).");
-    if (strcmp(s1,STK_VERSION))
-        Log::warn("History", "History is version '%s', STK version is '%s'.",
-                  s1, STK_VERSION);
-
-    if (fgets(s, 1023, fd) == NULL)
-        Log::fatal("History", "Could not read history.dat.");
-
-    int version;
-    if (sscanf(s, "History-version: %1023d", &version) != 1)
-        Log::fatal("Invalid version number found: '%s'", s);
-
-    if (version != 1)
-        Log::fatal("History",
-                   "Old-style history files are not supported anymore.");
-
-    if (fgets(s, 1023, fd) == NULL)
-        Log::fatal("History", "Could not read history.dat.");
-
-    unsigned int num_karts;
-    if(sscanf(s, "numkarts: %u", &num_karts)!=1)
-        Log::fatal("History", "No number of karts found in history file.");
-    RaceManager::get()->setNumKarts(num_karts);
-
-    fgets(s, 1023, fd);
-    if(sscanf(s, "numplayers: %d",&n)!=1)
-        Log::fatal("History", "No number of players found in history file.");
-    RaceManager::get()->setNumPlayers(n);
-
-    fgets(s, 1023, fd);
-    if(sscanf(s, "difficulty: %d",&n)!=1)
-        Log::fatal("History", "No difficulty found in history file.");
-    RaceManager::get()->setDifficulty((RaceManager::Difficulty)n);
-
-
-    fgets(s, 1023, fd);
-    char r;
-    if (sscanf(s, "reverse: %c", &r) != 1)
-        Log::fatal("History", "Could not read reverse information: '%s'", s);
-    RaceManager::get()->setReverseTrack(r == 'y');
-
-    fgets(s, 1023, fd);
-    if(sscanf(s, "track: %1023s",s1)!=1)
-        Log::warn("History", "Track not found in history file.");
-    RaceManager::get()->setTrack(s1);
-    // This value doesn't really matter, but should be defined, otherwise
-    // the racing phase can switch to 'ending'
-    RaceManager::get()->setNumLaps(100);
-
-    for(unsigned int i=0; i<num_karts; i++)
+    if (start.getUInt32() != HISTORY_MAGIC)
+        Log::fatal("History", "No history file (bogus history file).");
+    const uint32_t version = start.getUInt32();
+    if (version != HISTORY_VERSION)
+        Log::fatal("History", "Unsupported history version %d.", version);
+
+    // Index all chunks, a chunk which was not written completely (when the
+    // game crashed while streaming) ends the file
+    fseek(m_file, 0, SEEK_END);
+    const long file_size = ftell(m_file);
+    fseek(m_file, 8, SEEK_SET);
+    m_chunks.clear();
+    BareNetworkString chunk_header(CHUNK_HEADER_SIZE);
+    chunk_header.getBuffer().resize(CHUNK_HEADER_SIZE);
+    while (fread(chunk_header.getData(), 1, CHUNK_HEADER_SIZE, m_file) ==
+           CHUNK_HEADER_SIZE)
     {
-        fgets(s, 1023, fd);
-        if(sscanf(s, "model %d: %1023s",&n, s1) != 2)
-            Log::fatal("History", "No model information for kart %d found.", i);
-        m_kart_ident.push_back(s1);
-        if(i<RaceManager::get()->getNumPlayers() && !m_online_history_replay)
+        chunk_header.reset();
+        ChunkInfo chunk;
+        chunk.m_type = (ChunkType)chunk_header.getUInt8();
+        chunk.m_compressed = chunk_header.getUInt8() != 0;
+        chunk.m_first_ticks = (int)chunk_header.getUInt32();
+        chunk.m_last_ticks = (int)chunk_header.getUInt32();
+        chunk.m_size = chunk_header.getUInt32();
+        chunk.m_stored_size = chunk_header.getUInt32();
+        chunk.m_offset = ftell(m_file);
+        if (chunk.m_offset + (long)chunk.m_stored_size > file_size)
         {
-            RaceManager::get()->setPlayerKart(i, s1);
+            Log::warn("History", "Incomplete chunk at the end of file.");
+            break;
         }
-    }   // for i<nKarts
-    // FIXME: The model information is currently ignored
-
-    fgets(s, 1023, fd);
-    int count;
-    if(sscanf(s,"count: %d",&count)!=1)
-        Log::fatal("History", "Number of records not found in history file.");
-
-    allocateMemory(count);
-    m_event_index = 0;
+        m_chunks.push_back(chunk);
+        fseek(m_file, chunk.m_stored_size, SEEK_CUR);
+    }
 
-    // We need to disable the rewind manager here (otherwise setting the
-    // KartControl data would access the rewind manager).
-    bool rewind_manager_was_enabled = RewindManager::isEnabled();
-    RewindManager::setEnable(false);
+    BareNetworkString header;
+    if (m_chunks.empty() || m_chunks[0].m_type != HC_HEADER ||
+        !readChunk(m_chunks[0], &header))
+        Log::fatal("History", "No header found in history file.");
 
-    for (int i=0; i<count; i++)
+    try
     {
-        fgets(s, 1023, fd);
-        InputEvent &ie = m_all_input_events[i];
-        int action = 0;
-        if (sscanf(s, "%d %d %d %d\n", &ie.m_world_ticks, &ie.m_kart_index,
-            &action, &ie.m_value) != 4)
+        std::string s;
+        header.decodeString(&s);
+        if (s != STK_VERSION)
         {
-            Log::warn("History", "Problems reading event: '%s'", s);
+            Log::warn("History", "History is version '%s', STK version "
+                      "is '%s'.", s.c_str(), STK_VERSION);
         }
-        ie.m_action = (PlayerAction)action;
-    }   // for i
-    RewindManager::setEnable(rewind_manager_was_enabled);
+        const unsigned num_karts = header.getUInt8();
+        RaceManager::get()->setNumKarts(num_karts);
+        const unsigned num_players = header.getUInt8();
+        RaceManager::get()->setNumPlayers(num_players);
+        RaceManager::get()->setDifficulty(
+            (RaceManager::Difficulty)header.getUInt8());
+        RaceManager::get()->setReverseTrack(header.getUInt8() != 0);
+        header.decodeString(&s);
+        RaceManager::get()->setTrack(s);
+        // This value doesn't really matter, but should be defined, otherwise
+        // the racing phase can switch to 'ending'
+        RaceManager::get()->setNumLaps(100);
+
+        m_kart_ident.clear();
+        for(unsigned int i=0; i<num_karts; i++)
+        {
+            header.decodeString(&s);
+            m_kart_ident.push_back(s);
+            if(i<num_players && !m_online_history_replay)
+            {
+                RaceManager::get()->setPlayerKart(i, s);
+            }
+        }   // for i<nKarts
+        // FIXME: The model information is currently ignored
+    }
+    catch (std::exception& e)
+    {
+        Log::fatal("History", "Invalid header in history file: %s",
+            e.what());
+    }
 
-    fclose(fd);
+    m_all_input_events.clear();
+    m_event_index = 0;
+    m_next_chunk = 0;
 }   // Load
-
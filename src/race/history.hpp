@@ -22,21 +22,62 @@
 
 #include "input/input.hpp"
 #include "karts/controller/kart_control.hpp"
+#include "utils/stk_process.hpp"
 
+#include <cstdint>
+#include <cstdio>
+#include <map>
 #include <string>
 #include <vector>
 
+class BareNetworkString;
 class Kart;
 
 /**
   * \ingroup race
+  * Records the input events of a race into history.dat, and replays them.
+  * The file is binary: a header chunk with the race setup is followed by
+  * chunks of input events (one per second) and keyframes, each chunk can be
+  * compressed. A keyframe stores the state of all rewinders, so a replay
+  * can seek to any ticks by restoring the last keyframe before it and only
+  * simulating from there. If streaming is enabled, the chunks are written
+  * while the race is running instead of only when the history is saved.
   */
 class History
 {
 private:
+    /** Type of a chunk in the history file. */
+    enum ChunkType : uint8_t
+    {
+        HC_HEADER = 0,
+        HC_EVENTS = 1,
+        HC_KEYFRAME = 2
+    };
+
+    /** Location of a chunk in the history file, used to load chunks only
+     *  when they are needed in replay. */
+    struct ChunkInfo
+    {
+        ChunkType m_type;
+        /** Ticks of the first and last event, or of the keyframe. */
+        int m_first_ticks;
+        int m_last_ticks;
+        /** Offset of the (possibly compressed) data in the file. */
+        long m_offset;
+        uint32_t m_size;
+        uint32_t m_stored_size;
+        bool m_compressed;
+    };
+
     /** True if a history should be replayed, */
     bool m_replay_history;
 
+    /** True if chunks are written while recording. */
+    bool m_streaming;
+
+    /** True if chunks are compressed with zlib. */
+    bool m_compress;
+
     /** Points to the last used input event index. */
     unsigned int m_event_index;
 
@@ -57,18 +98,52 @@ private:
     };   // InputEvent
     // ------------------------------------------------------------------------
 
-    /** All input events. */
+    /** All input events (in replay only the ones of the current chunk, and
+     *  in streaming only the ones not written yet). */
     std::vector<InputEvent> m_all_input_events;
 
-    void  allocateMemory(int size=-1);
+    /** The file which is replayed or streamed to, NULL otherwise. */
+    FILE* m_file;
+
+    /** All chunks of the replayed file. */
+    std::vector<ChunkInfo> m_chunks;
+
+    /** Index of the next chunk to check for events in replay. */
+    unsigned m_next_chunk;
+
+    /** World ticks of the last keyframe written. */
+    int m_last_keyframe_ticks;
+
+    /** Seconds between keyframes. */
+    float m_keyframe_interval;
+
+    /** Ticks the replay should seek to, -1 if none. */
+    int m_seek_ticks;
+
+    FILE* openFile(const char* mode);
+    void  closeFile();
+    void  writeHeader(FILE* fd);
+    void  writeChunk(FILE* fd, ChunkType type, int first_ticks,
+                     int last_ticks, const BareNetworkString& data);
+    void  writeEvents(FILE* fd, unsigned start, unsigned end);
+    bool  readChunk(const ChunkInfo& chunk, BareNetworkString* data);
+    bool  loadNextEvents();
+    bool  restoreKeyframe(const ChunkInfo& chunk);
+    void  replayEvents(int world_ticks);
+    void  seekReplay(int world_ticks);
 public:
     static bool m_online_history_replay;
           History        ();
+         ~History        ();
     void  initRecording  ();
     void  Save           ();
     void  Load           ();
     void  updateReplay(int world_ticks);
+    void  updateRecording(int world_ticks);
     void  addEvent(int kart_id, PlayerAction pa, int value);
+    bool  needsKeyframe(int world_ticks) const;
+    void  addKeyframe(int world_ticks,
+                      const std::map<std::string, std::string>& states);
 
     // -------------------I-----------------------------------------------------
     /** Returns the identifier of the n-th kart. */
@@ -82,6 +157,25 @@ public:
     // ------------------------------------------------------------------------
     /** Set if replay is enabled or not. */
     void  setReplayHistory(bool b) { m_replay_history=b;  }
+    // ------------------------------------------------------------------------
+    /** Writes the history while recording instead of only when saving it. */
+    void  setStreaming(bool b) { m_streaming = b; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the history is written while recording, which is
+     *  only done by the main process. */
+    bool  isStreaming() const
+    {
+        return m_streaming && m_file != NULL && !STKProcess::isChild();
+    }   // isStreaming
+    // ------------------------------------------------------------------------
+    /** Compresses the chunks of the history file. */
+    void  setCompress(bool b) { m_compress = b; }
+    // ------------------------------------------------------------------------
+    /** Sets the seconds between two keyframes. */
+    void  setKeyframeInterval(float s) { m_keyframe_interval = s; }
+    // ------------------------------------------------------------------------
+    /** Starts the replay at the given ticks. */
+    void  setSeekTicks(int ticks) { m_seek_ticks = ticks; }
 };
 
 extern History* history;
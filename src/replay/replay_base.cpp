@@ -18,7 +18,9 @@
 #include "replay/replay_base.hpp"
 
 #include "io/file_manager.hpp"
+#include "network/network_string.hpp"
 #include "utils/file_utils.hpp"
+#include "utils/mini_glm.hpp"
 
 // -----------------------------------------------------------------------------
 ReplayBase::ReplayBase()
@@ -34,7 +36,7 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
 {
     FILE* fd = FileUtils::fopenU8Path(full_path ? getReplayFilename(replay_file_number) :
         file_manager->getReplayDir() + getReplayFilename(replay_file_number),
-        writeable ? "w" : "r");
+        writeable ? "wb" : "rb");
     if (!fd)
     {
         return NULL;
@@ -42,3 +44,135 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
     return fd;
 
 }   // openReplayFile
+
+// -----------------------------------------------------------------------------
+/** Writes the information about a replay for the index of a binary file.
+ *  \param index The information about the replay.
+ *  \param s The string to write to.
+ */
+void ReplayBase::encodeIndex(const ReplayIndex& index, BareNetworkString* s)
+{
+    s->encodeString(index.m_stk_version)
+        .addUInt8((uint8_t)index.m_kart_list.size());
+    for (unsigned int i = 0; i < index.m_kart_list.size(); i++)
+    {
+        s->encodeString(index.m_kart_list[i])
+            .encodeString(index.m_name_list[i])
+            .addFloat(index.m_kart_color[i]);
+    }
+    s->addUInt8(index.m_reverse ? 1 : 0)
+        .addUInt8((uint8_t)index.m_difficulty)
+        .encodeString(index.m_minor_mode).encodeString(index.m_track_name)
+        .addUInt16((uint16_t)index.m_laps).addFloat(index.m_min_time)
+        .addUInt64(index.m_replay_uid);
+}   // encodeIndex
+
+// -----------------------------------------------------------------------------
+/** Reads the information about a replay from the index of a binary file, it
+ *  throws an exception if the index is too short.
+ *  \param s The string with the index.
+ *  \param index The information about the replay.
+ */
+void ReplayBase::decodeIndex(const BareNetworkString& s, ReplayIndex* index)
+{
+    s.decodeString(&index->m_stk_version);
+    const unsigned int num_karts = s.getUInt8();
+    index->m_kart_list.resize(num_karts);
+    index->m_name_list.resize(num_karts);
+    index->m_kart_color.resize(num_karts);
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        s.decodeString(&index->m_kart_list[i]);
+        s.decodeStringW(&index->m_name_list[i]);
+        index->m_kart_color[i] = s.getFloat();
+    }
+    index->m_reverse = s.getUInt8() != 0;
+    index->m_difficulty = s.getUInt8();
+    s.decodeString(&index->m_minor_mode);
+    s.decodeString(&index->m_track_name);
+    index->m_laps = s.getUInt16();
+    index->m_min_time = s.getFloat();
+    index->m_replay_uid = s.getUInt64();
+}   // decodeIndex
+
+// -----------------------------------------------------------------------------
+/** Writes an event of a kart, the rotation and most values are quantized
+ *  the same way as in network states (see CompressNetworkBody).
+ */
+void ReplayBase::encodeEvent(const TransformEvent& t, const PhysicInfo& p,
+                             const BonusInfo& b, const KartReplayEvent& k,
+                             BareNetworkString* s)
+{
+    using namespace MiniGLM;
+    const btVector3& xyz = t.m_transform.getOrigin();
+    s->addFloat(t.m_time).addFloat(xyz.x()).addFloat(xyz.y())
+        .addFloat(xyz.z())
+        .addUInt32(compressQuaternion(t.m_transform.getRotation()))
+        .addUInt16(toFloat16(p.m_speed)).addUInt16(toFloat16(p.m_steer));
+    for (unsigned int i = 0; i < 4; i++)
+        s->addUInt16(toFloat16(p.m_suspension_length[i]));
+    s->addUInt8((uint8_t)p.m_skidding_state).addUInt8((uint8_t)b.m_attachment)
+        .addUInt16(toFloat16(b.m_nitro_amount))
+        .addUInt8((uint8_t)b.m_item_amount).addUInt8((uint8_t)b.m_item_type)
+        .addUInt16((uint16_t)b.m_special_value).addFloat(k.m_distance)
+        .addUInt8((uint8_t)k.m_nitro_usage)
+        .addUInt8((uint8_t)k.m_skidding_effect)
+        .addUInt8((k.m_zipper_usage ? 1 : 0) | (k.m_red_skidding ? 2 : 0) |
+                  (k.m_jumping ? 4 : 0));
+}   // encodeEvent
+
+// -----------------------------------------------------------------------------
+/** Reads an event written by encodeEvent, it throws an exception if the
+ *  string is too short.
+ */
+void ReplayBase::decodeEvent(const BareNetworkString& s, ReplayEvent* e)
+{
+    using namespace MiniGLM;
+    e->m_transform.m_time = s.getFloat();
+    const float x = s.getFloat();
+    const float y = s.getFloat();
+    const float z = s.getFloat();
+    e->m_transform.m_transform = btTransform(
+        decompressbtQuaternion(s.getUInt32()), btVector3(x, y, z));
+    e->m_physic.m_speed = toFloat32((short)s.getUInt16());
+    e->m_physic.m_steer = toFloat32((short)s.getUInt16());
+    for (unsigned int i = 0; i < 4; i++)
+        e->m_physic.m_suspension_length[i] = toFloat32((short)s.getUInt16());
+    e->m_physic.m_skidding_state = s.getUInt8();
+    e->m_bonus.m_attachment = s.getUInt8();
+    e->m_bonus.m_nitro_amount = toFloat32((short)s.getUInt16());
+    e->m_bonus.m_item_amount = s.getUInt8();
+    e->m_bonus.m_item_type = s.getUInt8();
+    e->m_bonus.m_special_value = s.getInt16();
+    e->m_kart.m_distance = s.getFloat();
+    e->m_kart.m_nitro_usage = s.getUInt8();
+    e->m_kart.m_skidding_effect = s.getUInt8();
+    const uint8_t flags = s.getUInt8();
+    e->m_kart.m_zipper_usage = (flags & 1) != 0;
+    e->m_kart.m_red_skidding = (flags & 2) != 0;
+    e->m_kart.m_jumping = (flags & 4) != 0;
+}   // decodeEvent
+
+// -----------------------------------------------------------------------------
+/** Writes a binary replay file: the magic, version and size of the index,
+ *  the index, and then the events of each kart (the number of events
+ *  followed by the events).
+ *  \param fd The file to write to.
+ *  \param index Information about the replay.
+ *  \param karts The events of each kart.
+ *  \return False if writing failed.
+ */
+bool ReplayBase::writeBinaryReplay(FILE* fd, const ReplayIndex& index,
+                            const std::vector<BareNetworkString>& karts) const
+{
+    BareNetworkString index_data;
+    encodeIndex(index, &index_data);
+    BareNetworkString header(BINARY_REPLAY_HEADER_SIZE);
+    header.addUInt32(BINARY_REPLAY_MAGIC).addUInt32(getCurrentReplayVersion())
+        .addUInt32(index_data.getTotalSize());
+    fwrite(header.getData(), 1, header.getTotalSize(), fd);
+    fwrite(index_data.getData(), 1, index_data.getTotalSize(), fd);
+    for (const BareNetworkString& kart : karts)
+        fwrite(kart.getData(), 1, kart.getTotalSize(), fd);
+    return ferror(fd) == 0;
+}   // writeBinaryReplay
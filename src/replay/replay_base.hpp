@@ -22,10 +22,14 @@
 #include "LinearMath/btTransform.h"
 #include "utils/no_copy.hpp"
 
+#include "irrString.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
 #include <vector>
 
+class BareNetworkString;
+
 /**
   * \ingroup race
   */
@@ -97,6 +101,58 @@ protected:
         bool        m_jumping;
     };   // KartReplayEvent
 
+    // ------------------------------------------------------------------------
+    /** All values of a kart recorded at a certain time. */
+    struct ReplayEvent
+    {
+        TransformEvent  m_transform;
+        PhysicInfo      m_physic;
+        BonusInfo       m_bonus;
+        KartReplayEvent m_kart;
+    };   // ReplayEvent
+
+    // ------------------------------------------------------------------------
+    /** The information about a replay in the index of a binary replay file,
+     *  which is all that is read to list the replays. */
+    struct ReplayIndex
+    {
+        std::string                     m_stk_version;
+        std::vector<std::string>        m_kart_list;
+        std::vector<irr::core::stringw> m_name_list;
+        std::vector<float>              m_kart_color;
+        bool                            m_reverse;
+        unsigned int                    m_difficulty;
+        std::string                     m_minor_mode;
+        std::string                     m_track_name;
+        unsigned int                    m_laps;
+        float                           m_min_time;
+        uint64_t                        m_replay_uid;
+    };   // ReplayIndex
+
+    /** First bytes of a binary replay file ("STKR"), text replay files start
+     *  with "version:". */
+    static const uint32_t BINARY_REPLAY_MAGIC = 0x53544b52;
+
+    /** Size of the magic, version and size of the index at the start of a
+     *  binary replay file. */
+    static const unsigned int BINARY_REPLAY_HEADER_SIZE = 12;
+
+    /** Size of an event written by encodeEvent. */
+    static const unsigned int BINARY_REPLAY_EVENT_SIZE = 47;
+
+    // ------------------------------------------------------------------------
+    static void encodeIndex(const ReplayIndex& index, BareNetworkString* s);
+    // ------------------------------------------------------------------------
+    static void decodeIndex(const BareNetworkString& s, ReplayIndex* index);
+    // ------------------------------------------------------------------------
+    static void encodeEvent(const TransformEvent& t, const PhysicInfo& p,
+                            const BonusInfo& b, const KartReplayEvent& k,
+                            BareNetworkString* s);
+    // ------------------------------------------------------------------------
+    static void decodeEvent(const BareNetworkString& s, ReplayEvent* e);
+    // ------------------------------------------------------------------------
+    bool writeBinaryReplay(FILE* fd, const ReplayIndex& index,
+                           const std::vector<BareNetworkString>& karts) const;
     // ------------------------------------------------------------------------
     FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1);
     // ------------------------------------------------------------------------
@@ -105,7 +161,10 @@ protected:
     // ------------------------------------------------------------------------
     /** Returns the version number of the replay file recorderd by this executable.
      *  This is also used as a maximum supported version by this exexcutable. */
-    unsigned int getCurrentReplayVersion() const { return 4; }
+    unsigned int getCurrentReplayVersion() const { return 5; }
+    // ------------------------------------------------------------------------
+    /** Version of the first binary replay files, older ones are text. */
+    unsigned int getMinBinaryReplayVersion() const { return 5; }
 
     // ------------------------------------------------------------------------
     /** This is used to check that a loaded replay file can still
@@ -23,6 +23,7 @@
 #include "karts/ghost_kart.hpp"
 #include "karts/controller/ghost_controller.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
@@ -93,6 +94,9 @@ void ReplayPlay::loadAllReplayFile()
     for (std::set<std::string>::iterator i  = files.begin();
                                          i != files.end(); ++i)
     {
+        // Text replays which were converted are listed by their binary file
+        if (files.find(getConvertedFilename(*i)) != files.end())
+            continue;
         if (!addReplayFile(*i, false, j))
         {
             // Skip invalid replay file
@@ -104,40 +108,101 @@ void ReplayPlay::loadAllReplayFile()
 }   // loadAllReplayFile
 
 //-----------------------------------------------------------------------------
+/** Adds a replay to the list of replays, only the index (header) of the file
+ *  is read, the events are read when the replay is loaded. Text replays in
+ *  the replay directory of the user are converted to a binary file next to
+ *  them, so they are faster to list and load next time.
+ *  \param fn Name of the replay file.
+ *  \param custom_replay True if fn is a full path (the stock replays).
+ *  \param call_index Used as UID of old replays without one.
+ */
 bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int call_index)
 {
-
-    char s[1024], s1[1024];
     if (StringUtils::getExtension(fn) != "replay") return false;
     FILE* fd = FileUtils::fopenU8Path(custom_replay ? fn :
-        file_manager->getReplayDir() + fn, "r");
+        file_manager->getReplayDir() + fn, "rb");
     if (fd == NULL) return false;
     ReplayData rd;
 
     // custom_replay is true when full path of filename is given
     rd.m_custom_replay_file = custom_replay;
     rd.m_filename = fn;
+    rd.m_track = NULL;
+
+    uint8_t magic[4];
+    bool success;
+    if (fread(magic, 1, 4, fd) == 4 &&
+        BareNetworkString((char*)magic, 4).getUInt32() == BINARY_REPLAY_MAGIC)
+    {
+        success = readBinaryIndex(fd, fn, &rd);
+    }
+    else
+    {
+        rewind(fd);
+        success = readTextIndex(fd, fn, call_index, &rd);
+    }
+    fclose(fd);
+    if (!success)
+        return false;
+
+    if (!custom_replay && rd.m_replay_version < getMinBinaryReplayVersion())
+        convertToBinary(&rd);
+
+    // If former official tracks are present as addons, show the matching replays.
+    if (rd.m_track_name.compare("greenvalley") == 0)
+        rd.m_track_name = std::string("addon_green-valley");
+    if (rd.m_track_name.compare("mansion") == 0)
+        rd.m_track_name = std::string("addon_blackhill-mansion");
+
+    Track* t = track_manager->getTrack(rd.m_track_name);
+    if (t == NULL)
+    {
+        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
+        rd.m_track_name.c_str(), fn.c_str());
+        return false;
+    }
 
+    rd.m_track = t;
+    m_replay_file_list.push_back(rd);
+
+    assert(m_replay_file_list.size() > 0);
+    // Force to use custom replay file immediately
+    if (custom_replay)
+        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+
+    return true;
+
+}   // addReplayFile
+
+//-----------------------------------------------------------------------------
+/** Reads the header of a text replay file (version 3 and 4).
+ *  \param fd The file, at its start.
+ *  \param fn Name of the file for messages.
+ *  \param call_index Used as UID of version 3 replays.
+ *  \param rd Where the header is stored.
+ */
+bool ReplayPlay::readTextIndex(FILE *fd, const std::string& fn,
+                               int call_index, ReplayData* rd)
+{
+    char s[1024], s1[1024];
     fgets(s, 1023, fd);
     unsigned int version;
     if (sscanf(s,"version: %u", &version) != 1)
     {
         Log::warn("Replay", "No Version information "
                   "found in replay file (bogus replay file).");
-        fclose(fd);
         return false;
     }
-    if (version > getCurrentReplayVersion() ||
+    if (version >= getMinBinaryReplayVersion() ||
         version < getMinSupportedReplayVersion() )
     {
         Log::warn("Replay", "Replay is version '%d'", version);
         Log::warn("Replay", "STK replay version is '%d'", getCurrentReplayVersion());
         Log::warn("Replay", "Minimum supported replay version is '%d'", getMinSupportedReplayVersion());
         Log::warn("Replay", "Skipped '%s'", fn.c_str());
-        fclose(fd);
         return false;
     }
-        rd.m_replay_version = version;
+    rd->m_replay_version = version;
 
     if (version >= 4)
     {
@@ -145,13 +210,12 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         if(sscanf(s, "stk_version: %1023s", s1) != 1)
         {
             Log::warn("Replay", "No STK release version found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
-        rd.m_stk_version = s1;
+        rd->m_stk_version = s1;
     }
     else
-        rd.m_stk_version = "";
+        rd->m_stk_version = "";
 
     while(true)
     {
@@ -169,21 +233,21 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             break;
         }
 
-        rd.m_kart_list.push_back(std::string(s1));
+        rd->m_kart_list.push_back(std::string(s1));
         if (scanned == 2)
         {
             // If username of kart is present, use it
-            rd.m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
-            if (rd.m_name_list.size() == 1)
+            rd->m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
+            if (rd->m_name_list.size() == 1)
             {
                 // First user is the game master and the "owner" of this replay file
-                rd.m_user_name = rd.m_name_list[0];
+                rd->m_user_name = rd->m_name_list[0];
             }
         } else
         { // scanned == 1
             // If username is not present, kart display name will default to kart name
             // (see GhostController::getName)
-            rd.m_name_list.push_back("");
+            rd->m_name_list.push_back("");
         }
 
         // Read kart color data
@@ -194,13 +258,12 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             if(sscanf(s, "kart_color: %f", &f) != 1)
             {
                 Log::warn("Replay", "Kart color missing in replay file, '%s'.", fn.c_str());
-                fclose(fd);
                 return false;
             }
-            rd.m_kart_color.push_back(f);
+            rd->m_kart_color.push_back(f);
         }
         else
-            rd.m_kart_color.push_back(0.0f); // Use default kart color
+            rd->m_kart_color.push_back(0.0f); // Use default kart color
     }
 
     int reverse = 0;
@@ -208,16 +271,14 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     if(sscanf(s, "reverse: %d", &reverse) != 1)
     {
         Log::warn("Replay", "No reverse info found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
-    rd.m_reverse = reverse != 0;
+    rd->m_reverse = reverse != 0;
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "difficulty: %u", &rd.m_difficulty) != 1)
+    if (sscanf(s, "difficulty: %u", &rd->m_difficulty) != 1)
     {
         Log::warn("Replay", " No difficulty found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
@@ -227,83 +288,220 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         if (sscanf(s, "mode: %1023s", s1) != 1)
         {
             Log::warn("Replay", "Replay mode not found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
-        rd.m_minor_mode = s1;
+        rd->m_minor_mode = s1;
     }
     // Assume time-trial mode for old replays
     else
-        rd.m_minor_mode = "time-trial";
+        rd->m_minor_mode = "time-trial";
 
 
     fgets(s, 1023, fd);
     if (sscanf(s, "track: %1023s", s1) != 1)
     {
         Log::warn("Replay", "Track info not found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
-    rd.m_track_name = std::string(s1);
-
-    // If former official tracks are present as addons, show the matching replays.
-    if (rd.m_track_name.compare("greenvalley") == 0)
-        rd.m_track_name = std::string("addon_green-valley");
-    if (rd.m_track_name.compare("mansion") == 0)
-        rd.m_track_name = std::string("addon_blackhill-mansion");
-
-    Track* t = track_manager->getTrack(rd.m_track_name);
-    if (t == NULL)
-    {
-        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
-        rd.m_track_name.c_str(), fn.c_str());
-        fclose(fd);
-        return false;
-    }
-
-    rd.m_track = t;
+    rd->m_track_name = std::string(s1);
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "laps: %u", &rd.m_laps) != 1)
+    if (sscanf(s, "laps: %u", &rd->m_laps) != 1)
     {
         Log::warn("Replay", "No number of laps found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "min_time: %f", &rd.m_min_time) != 1)
+    if (sscanf(s, "min_time: %f", &rd->m_min_time) != 1)
     {
         Log::warn("Replay", "Finish time not found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
     if (version >= 4)
     {
         fgets(s, 1023, fd);
-        if (sscanf(s, "replay_uid: %" PRIu64, &rd.m_replay_uid) != 1)
+        if (sscanf(s, "replay_uid: %" PRIu64, &rd->m_replay_uid) != 1)
         {
             Log::warn("Replay", "Replay UID not found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
     }
     // No UID in old replay format
     else
-        rd.m_replay_uid = call_index;
+        rd->m_replay_uid = call_index;
 
-    fclose(fd);
-    m_replay_file_list.push_back(rd);
+    return true;
 
-    assert(m_replay_file_list.size() > 0);
-    // Force to use custom replay file immediately
-    if (custom_replay)
-        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+}   // readTextIndex
 
+//-----------------------------------------------------------------------------
+/** Reads the index of a binary replay file, which follows the magic, version
+ *  and size of the index.
+ *  \param fd The file, after the magic.
+ *  \param fn Name of the file for messages.
+ *  \param rd Where the index is stored.
+ */
+bool ReplayPlay::readBinaryIndex(FILE *fd, const std::string& fn,
+                                 ReplayData* rd)
+{
+    uint8_t header[8];
+    if (fread(header, 1, 8, fd) != 8)
+    {
+        Log::warn("Replay", "Truncated replay file, '%s'.", fn.c_str());
+        return false;
+    }
+    BareNetworkString hs((char*)header, 8);
+    const unsigned int version = hs.getUInt32();
+    const unsigned int index_size = hs.getUInt32();
+    if (version > getCurrentReplayVersion() ||
+        version < getMinBinaryReplayVersion())
+    {
+        Log::warn("Replay", "Replay is version '%d'", version);
+        Log::warn("Replay", "STK replay version is '%d'", getCurrentReplayVersion());
+        Log::warn("Replay", "Skipped '%s'", fn.c_str());
+        return false;
+    }
+    rd->m_replay_version = version;
+
+    if (index_size == 0 || index_size > getRemainingSize(fd))
+    {
+        Log::warn("Replay", "Truncated replay file, '%s'.", fn.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data(index_size);
+    if (fread(data.data(), 1, index_size, fd) != index_size)
+    {
+        Log::warn("Replay", "Truncated replay file, '%s'.", fn.c_str());
+        return false;
+    }
+
+    ReplayIndex index;
+    try
+    {
+        decodeIndex(BareNetworkString((char*)data.data(), index_size), &index);
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("Replay", "Invalid index in replay file '%s': %s.",
+            fn.c_str(), e.what());
+        return false;
+    }
+    rd->m_stk_version = index.m_stk_version.c_str();
+    rd->m_kart_list   = index.m_kart_list;
+    rd->m_name_list   = index.m_name_list;
+    rd->m_kart_color  = index.m_kart_color;
+    rd->m_reverse     = index.m_reverse;
+    rd->m_difficulty  = index.m_difficulty;
+    rd->m_minor_mode  = index.m_minor_mode;
+    rd->m_track_name  = index.m_track_name;
+    rd->m_laps        = index.m_laps;
+    rd->m_min_time    = index.m_min_time;
+    rd->m_replay_uid  = index.m_replay_uid;
+    // First user is the game master and the "owner" of this replay file
+    if (!rd->m_name_list.empty())
+        rd->m_user_name = rd->m_name_list[0];
     return true;
+}   // readBinaryIndex
 
-}   // addReplayFile
+//-----------------------------------------------------------------------------
+/** Returns the name of the binary file a text replay is converted to.
+ *  \param fn Name of the text replay file.
+ */
+std::string ReplayPlay::getConvertedFilename(const std::string& fn)
+{
+    return StringUtils::removeExtension(fn) + ".bin.replay";
+}   // getConvertedFilename
+
+//-----------------------------------------------------------------------------
+/** Returns the number of bytes from the current position to the end of a
+ *  file, so sizes read from the file can be checked before allocating.
+ */
+unsigned int ReplayPlay::getRemainingSize(FILE *fd)
+{
+    const long pos = ftell(fd);
+    if (pos < 0 || fseek(fd, 0, SEEK_END) != 0)
+        return 0;
+    const long end = ftell(fd);
+    fseek(fd, pos, SEEK_SET);
+    return end > pos ? (unsigned int)(end - pos) : 0;
+}   // getRemainingSize
+
+//-----------------------------------------------------------------------------
+/** Converts a text replay in the replay directory of the user to the binary
+ *  format. The binary replay is written next to the text file (see
+ *  getConvertedFilename), the text file is kept unchanged.
+ *  \param rd The header of the replay, its file name and version are updated
+ *         if the conversion succeeded.
+ */
+bool ReplayPlay::convertToBinary(ReplayData* rd)
+{
+    const std::string full_path = file_manager->getReplayDir() +
+        rd->m_filename;
+    FILE* fd = FileUtils::fopenU8Path(full_path, "rb");
+    if (!fd)
+        return false;
+    std::vector<std::vector<ReplayEvent> > events;
+    bool success = readTextEvents(fd, *rd, &events);
+    fclose(fd);
+    if (!success)
+        return false;
+
+    ReplayIndex index;
+    index.m_stk_version = StringUtils::wideToUtf8(rd->m_stk_version);
+    index.m_kart_list   = rd->m_kart_list;
+    index.m_name_list   = rd->m_name_list;
+    index.m_kart_color  = rd->m_kart_color;
+    index.m_reverse     = rd->m_reverse;
+    index.m_difficulty  = rd->m_difficulty;
+    index.m_minor_mode  = rd->m_minor_mode;
+    index.m_track_name  = rd->m_track_name;
+    index.m_laps        = rd->m_laps;
+    index.m_min_time    = rd->m_min_time;
+    index.m_replay_uid  = rd->m_replay_uid;
+
+    std::vector<BareNetworkString> karts;
+    for (const std::vector<ReplayEvent>& kart : events)
+    {
+        karts.emplace_back(4 + (int)kart.size() * BINARY_REPLAY_EVENT_SIZE);
+        karts.back().addUInt32((uint32_t)kart.size());
+        for (const ReplayEvent& e : kart)
+        {
+            encodeEvent(e.m_transform, e.m_physic, e.m_bonus, e.m_kart,
+                &karts.back());
+        }
+    }
+
+    const std::string binary_fn = getConvertedFilename(rd->m_filename);
+    const std::string binary_path = file_manager->getReplayDir() + binary_fn;
+    // Write to a temporary file first, so an interrupted conversion doesn't
+    // leave a truncated binary replay
+    const std::string tmp_path = binary_path + ".tmp";
+    fd = FileUtils::fopenU8Path(tmp_path, "wb");
+    if (!fd)
+        return false;
+    success = writeBinaryReplay(fd, index, karts);
+    success = fclose(fd) == 0 && success;
+    if (success && FileUtils::renameU8Path(tmp_path, binary_path) != 0)
+    {
+        // Rename doesn't replace an existing file on windows
+        file_manager->removeFile(binary_path);
+        success = FileUtils::renameU8Path(tmp_path, binary_path) == 0;
+    }
+    if (!success)
+    {
+        Log::warn("Replay", "Can't convert '%s' to the binary format.",
+            rd->m_filename.c_str());
+        file_manager->removeFile(tmp_path);
+        return false;
+    }
+    Log::info("Replay", "Converted '%s' to '%s'.", rd->m_filename.c_str(),
+        binary_fn.c_str());
+    rd->m_filename = binary_fn;
+    rd->m_replay_version = getCurrentReplayVersion();
+    return true;
+}   // convertToBinary
 
 //-----------------------------------------------------------------------------
 void ReplayPlay::load()
@@ -321,8 +519,6 @@ void ReplayPlay::load()
 //-----------------------------------------------------------------------------
 void ReplayPlay::loadFile(bool second_replay)
 {
-    char s[1024];
-
     int replay_index = second_replay ? m_second_replay_file : m_current_replay_file;
     int replay_file_number = second_replay ? 2 : 1;
 
@@ -340,168 +536,258 @@ void ReplayPlay::loadFile(bool second_replay)
     Log::info("Replay", "Reading replay file '%s'.",
                     getReplayFilename(replay_file_number).c_str());
 
-    ReplayData &rd = m_replay_file_list[replay_index];
-    unsigned int num_kart = (unsigned int)m_replay_file_list.at(replay_index)
-                                                            .m_kart_list.size();
-    unsigned int lines_to_skip = (rd.m_replay_version == 3) ? 7 : 10;
-    lines_to_skip += (rd.m_replay_version == 3) ? num_kart : 2*num_kart;
+    const ReplayData &rd = m_replay_file_list[replay_index];
+    std::vector<std::vector<ReplayEvent> > events;
+    if (rd.m_replay_version >= getMinBinaryReplayVersion())
+        readBinaryEvents(fd, rd, &events);
+    else
+        readTextEvents(fd, rd, &events);
+    fclose(fd);
 
-    for (unsigned int i = 0; i < lines_to_skip; i++)
-        fgets(s, 1023, fd);
+    for (unsigned int i = 0; i < events.size(); i++)
+        addGhostKart(rd, i, events[i]);
+}   // loadFile
 
-    // eof actually doesn't trigger here, since it requires first to try
-    // reading behind eof, but still it's clearer this way.
-    while(!feof(fd))
+//-----------------------------------------------------------------------------
+/** Reads the events of all karts from a binary replay file. The file is read
+ *  with a single read, and the events have a fixed size, so this is much
+ *  faster than parsing a text replay.
+ *  \param fd The file.
+ *  \param rd The index of the replay.
+ *  \param karts Where the events of each kart are stored.
+ */
+bool ReplayPlay::readBinaryEvents(FILE *fd, const ReplayData& rd,
+                                  std::vector<std::vector<ReplayEvent> >* karts)
+{
+    fseek(fd, 0, SEEK_END);
+    long size = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+    if (size <= (long)BINARY_REPLAY_HEADER_SIZE)
+        return false;
+    std::vector<uint8_t> data(size);
+    if (fread(data.data(), 1, size, fd) != (size_t)size)
     {
-        if(fgets(s, 1023, fd)==NULL)  // eof reached
-            break;
-        readKartData(fd, s, second_replay);
+        Log::error("Replay", "Can't read replay data.");
+        return false;
     }
 
-    fclose(fd);
-}   // loadFile
+    BareNetworkString s((char*)data.data(), (int)size);
+    try
+    {
+        s.skip(8);
+        s.skip(s.getUInt32());
+        for (unsigned int i = 0; i < rd.m_kart_list.size(); i++)
+        {
+            const unsigned int count = s.getUInt32();
+            if (count > s.size() / BINARY_REPLAY_EVENT_SIZE)
+            {
+                Log::warn("Replay", "Truncated replay data.");
+                return false;
+            }
+            karts->emplace_back();
+            karts->back().resize(count);
+            for (unsigned int j = 0; j < count; j++)
+                decodeEvent(s, &karts->back()[j]);
+        }
+    }
+    catch (std::exception& e)
+    {
+        // Keep the events which could be read
+        Log::warn("Replay", "Truncated replay data: %s.", e.what());
+        if (!karts->empty())
+            karts->back().clear();
+        return false;
+    }
+    return true;
+}   // readBinaryEvents
 
 //-----------------------------------------------------------------------------
-/** Reads all data from a replay file for a specific kart.
- *  \param fd The file descriptor from which to read.
+/** Reads the events of all karts from a text replay file (version 3 and 4).
+ *  \param fd The file, at its start.
+ *  \param rd The header of the replay.
+ *  \param karts Where the events of each kart are stored.
  */
-void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+bool ReplayPlay::readTextEvents(FILE *fd, const ReplayData& rd,
+                                std::vector<std::vector<ReplayEvent> >* karts)
 {
     char s[1024];
+    unsigned int num_kart = (unsigned int)rd.m_kart_list.size();
+    unsigned int lines_to_skip = (rd.m_replay_version == 3) ? 7 : 10;
+    lines_to_skip += (rd.m_replay_version == 3) ? num_kart : 2*num_kart;
 
-    int replay_index = second_replay ? m_second_replay_file
-                                     : m_current_replay_file;
-
-    const unsigned int kart_num = (unsigned int)m_ghost_karts.size();
-    unsigned int first_loaded_f_num = 0;
-
-    if (!second_replay && m_second_replay_enabled)
-        first_loaded_f_num = (unsigned int)m_replay_file_list.at(m_second_replay_file)
-                                                             .m_kart_list.size();
-
-    ReplayData &rd = m_replay_file_list[replay_index];
-    m_ghost_karts.push_back(std::make_shared<GhostKart>
-        (rd.m_kart_list.at(kart_num-first_loaded_f_num), kart_num, kart_num + 1,
-        rd.m_kart_color.at(kart_num-first_loaded_f_num)));
-    m_ghost_karts[kart_num]->init(RaceManager::KT_GHOST);
-    Controller* controller = new GhostController(getGhostKart(kart_num).get(),
-                                                 rd.m_name_list[kart_num-first_loaded_f_num]);
-    getGhostKart(kart_num)->setController(controller);
-
-    unsigned int size;
-    if(sscanf(next_line,"size: %u",&size)!=1)
-        Log::fatal("Replay", "Number of records not found in replay file "
-            "for kart %d.", kart_num);
-
-    for(unsigned int i=0; i<size; i++)
-    {
+    for (unsigned int i = 0; i < lines_to_skip; i++)
         fgets(s, 1023, fd);
-        float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4, nitro_amount, distance;
-        int skidding_state, attachment, item_amount, item_type, special_value,
-            nitro, zipper, skidding, red_skidding, jumping;
 
-        // Check for EV_TRANSFORM event:
-        // -----------------------------
+    // eof actually doesn't trigger here, since it requires first to try
+    // reading behind eof, but still it's clearer this way.
+    while(!feof(fd) && karts->size() < num_kart)
+    {
+        if(fgets(s, 1023, fd)==NULL)  // eof reached
+            break;
 
-        // Up to STK 0.9.3 replays
-        if (rd.m_replay_version == 3)
+        unsigned int size;
+        if(sscanf(s,"size: %u",&size)!=1)
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4,
-                &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==19)
-            {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = 0;    //not saved in version 3 replays
-                bi.m_attachment           = 0;    //not saved in version 3 replays
-                bi.m_nitro_amount         = 0;    //not saved in version 3 replays
-                bi.m_item_amount          = 0;    //not saved in version 3 replays
-                bi.m_item_type            = 0;    //not saved in version 3 replays
-                bi.m_special_value        = 0;    //not saved in version 3 replays
-                kre.m_distance            = 0.0f; //not saved in version 3 replays
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
-            }
-            else
-            {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
-            }
+            Log::warn("Replay", "Number of records not found in replay file "
+                "for kart %d.", (int)karts->size());
+            return false;
+        }
+        // Each record takes a line, so this bounds the number of records
+        if (size > getRemainingSize(fd))
+        {
+            Log::warn("Replay", "Invalid number of records in replay file "
+                "for kart %d.", (int)karts->size());
+            return false;
         }
+        karts->emplace_back();
+        std::vector<ReplayEvent>& events = karts->back();
+        events.reserve(size);
 
-        //version 4 replays (STK 0.9.4 and higher)
-        else
+        for(unsigned int i=0; i<size; i++)
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
-                &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
-                &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==26)
+            fgets(s, 1023, fd);
+            float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4, nitro_amount, distance;
+            int skidding_state, attachment, item_amount, item_type, special_value,
+                nitro, zipper, skidding, red_skidding, jumping;
+
+            // Check for EV_TRANSFORM event:
+            // -----------------------------
+
+            // Up to STK 0.9.3 replays
+            if (rd.m_replay_version == 3)
             {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = skidding_state;
-                bi.m_attachment           = attachment;
-                bi.m_nitro_amount         = nitro_amount;
-                bi.m_item_amount          = item_amount;
-                bi.m_item_type            = item_type;
-                bi.m_special_value        = special_value;
-                kre.m_distance            = distance;
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
+                if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
+                    &time,
+                    &x, &y, &z,
+                    &rx, &ry, &rz, &rw,
+                    &speed, &steer, &w1, &w2, &w3, &w4,
+                    &nitro, &zipper, &skidding, &red_skidding, &jumping
+                    )==19)
+                {
+                    btQuaternion q(rx, ry, rz, rw);
+                    btVector3 xyz(x, y, z);
+                    PhysicInfo pi             = {0};
+                    BonusInfo bi              = {0};
+                    KartReplayEvent kre       = {0};
+
+                    pi.m_speed                = speed;
+                    pi.m_steer                = steer;
+                    pi.m_suspension_length[0] = w1;
+                    pi.m_suspension_length[1] = w2;
+                    pi.m_suspension_length[2] = w3;
+                    pi.m_suspension_length[3] = w4;
+                    pi.m_skidding_state       = 0;    //not saved in version 3 replays
+                    bi.m_attachment           = 0;    //not saved in version 3 replays
+                    bi.m_nitro_amount         = 0;    //not saved in version 3 replays
+                    bi.m_item_amount          = 0;    //not saved in version 3 replays
+                    bi.m_item_type            = 0;    //not saved in version 3 replays
+                    bi.m_special_value        = 0;    //not saved in version 3 replays
+                    kre.m_distance            = 0.0f; //not saved in version 3 replays
+                    kre.m_nitro_usage         = nitro;
+                    kre.m_zipper_usage        = zipper!=0;
+                    kre.m_skidding_effect     = skidding;
+                    kre.m_red_skidding        = red_skidding!=0;
+                    kre.m_jumping             = jumping != 0;
+                    ReplayEvent e;
+                    e.m_transform.m_time      = time;
+                    e.m_transform.m_transform = btTransform(q, xyz);
+                    e.m_physic                = pi;
+                    e.m_bonus                 = bi;
+                    e.m_kart                  = kre;
+                    events.push_back(e);
+                }
+                else
+                {
+                    // Invalid record found
+                    // ---------------------
+                    Log::warn("Replay", "Can't read replay data line %d:", i);
+                    Log::warn("Replay", "%s", s);
+                    Log::warn("Replay", "Ignored.");
+                }
             }
+
+            //version 4 replays (STK 0.9.4 and higher)
             else
             {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
+                if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
+                    &time,
+                    &x, &y, &z,
+                    &rx, &ry, &rz, &rw,
+                    &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
+                    &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
+                    &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
+                    )==26)
+                {
+                    btQuaternion q(rx, ry, rz, rw);
+                    btVector3 xyz(x, y, z);
+                    PhysicInfo pi             = {0};
+                    BonusInfo bi              = {0};
+                    KartReplayEvent kre       = {0};
+
+                    pi.m_speed                = speed;
+                    pi.m_steer                = steer;
+                    pi.m_suspension_length[0] = w1;
+                    pi.m_suspension_length[1] = w2;
+                    pi.m_suspension_length[2] = w3;
+                    pi.m_suspension_length[3] = w4;
+                    pi.m_skidding_state       = skidding_state;
+                    bi.m_attachment           = attachment;
+                    bi.m_nitro_amount         = nitro_amount;
+                    bi.m_item_amount          = item_amount;
+                    bi.m_item_type            = item_type;
+                    bi.m_special_value        = special_value;
+                    kre.m_distance            = distance;
+                    kre.m_nitro_usage         = nitro;
+                    kre.m_zipper_usage        = zipper!=0;
+                    kre.m_skidding_effect     = skidding;
+                    kre.m_red_skidding        = red_skidding!=0;
+                    kre.m_jumping             = jumping != 0;
+                    ReplayEvent e;
+                    e.m_transform.m_time      = time;
+                    e.m_transform.m_transform = btTransform(q, xyz);
+                    e.m_physic                = pi;
+                    e.m_bonus                 = bi;
+                    e.m_kart                  = kre;
+                    events.push_back(e);
+                }
+                else
+                {
+                    // Invalid record found
+                    // ---------------------
+                    Log::warn("Replay", "Can't read replay data line %d:", i);
+                    Log::warn("Replay", "%s", s);
+                    Log::warn("Replay", "Ignored.");
+                }
             }
-        }
-    }   // for i
+        }   // for i
+    }   // while !feof
+    return karts->size() == num_kart;
+}   // readTextEvents
+
+//-----------------------------------------------------------------------------
+/** Creates a ghost kart of a replay and adds its events.
+ *  \param rd The replay.
+ *  \param kart_index Index of the kart in the replay.
+ *  \param events The events of the kart.
+ */
+void ReplayPlay::addGhostKart(const ReplayData& rd, unsigned int kart_index,
+                              const std::vector<ReplayEvent>& events)
+{
+    const unsigned int kart_num = (unsigned int)m_ghost_karts.size();
+    m_ghost_karts.push_back(std::make_shared<GhostKart>
+        (rd.m_kart_list.at(kart_index), kart_num, kart_num + 1,
+        rd.m_kart_color.at(kart_index)));
+    m_ghost_karts[kart_num]->init(RaceManager::KT_GHOST);
+    Controller* controller = new GhostController(getGhostKart(kart_num).get(),
+                                                 rd.m_name_list[kart_index]);
+    getGhostKart(kart_num)->setController(controller);
 
-}   // readKartData
+    for (const ReplayEvent& e : events)
+    {
+        m_ghost_karts[kart_num]->addReplayEvent(e.m_transform.m_time,
+            e.m_transform.m_transform, e.m_physic, e.m_bonus, e.m_kart);
+    }
+}   // addGhostKart
 
 //-----------------------------------------------------------------------------
 /** call getReplayIdByUID and set the current replay file to the first one
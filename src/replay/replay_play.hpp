@@ -124,12 +124,23 @@ private:
 
           ReplayPlay();
          ~ReplayPlay();
-    void  readKartData(FILE *fd, char *next_line, bool second_replay);
+    bool  readTextIndex(FILE *fd, const std::string& fn, int call_index,
+                        ReplayData* rd);
+    bool  readBinaryIndex(FILE *fd, const std::string& fn, ReplayData* rd);
+    bool  readTextEvents(FILE *fd, const ReplayData& rd,
+                         std::vector<std::vector<ReplayEvent> >* karts);
+    bool  readBinaryEvents(FILE *fd, const ReplayData& rd,
+                           std::vector<std::vector<ReplayEvent> >* karts);
+    bool  convertToBinary(ReplayData* rd);
+    static unsigned int getRemainingSize(FILE *fd);
+    void  addGhostKart(const ReplayData& rd, unsigned int kart_index,
+                       const std::vector<ReplayEvent>& events);
 public:
     void  reset();
     void  load();
     void  loadFile(bool second_replay);
     void  loadAllReplayFile();
+    static std::string getConvertedFilename(const std::string& fn);
     // ------------------------------------------------------------------------
     static void        setSortOrder(SortOrder so)       { m_sort_order = so; }
     // ------------------------------------------------------------------------
@@ -31,6 +31,7 @@
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "physics/btKart.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
@@ -397,26 +398,25 @@ void ReplayRecorder::save()
         StringUtils::utf8ToWide(file_manager->getReplayDir() + getReplayFilename()));
     MessageQueue::add(MessageQueue::MT_GENERIC, msg);
 
-    fprintf(fd, "version: %d\n", getCurrentReplayVersion());
-    fprintf(fd, "stk_version: %s\n", STK_VERSION);
-
+    ReplayIndex index;
+    index.m_stk_version = STK_VERSION;
     unsigned int player_count = 0;
     for (unsigned int real_karts = 0; real_karts < num_karts; real_karts++)
     {
         const AbstractKart *kart = world->getKart(real_karts);
         if (kart->isGhostKart()) continue;
 
-        // XML encode the username to handle Unicode
-        fprintf(fd, "kart: %s %s\n", kart->getIdent().c_str(),
-                StringUtils::xmlEncode(kart->getController()->getName()).c_str());
-
+        index.m_kart_list.push_back(kart->getIdent());
+        index.m_name_list.push_back(kart->getController()->getName());
         if (kart->getController()->isPlayerController())
         {
-            fprintf(fd, "kart_color: %f\n", StateManager::get()->getActivePlayer(player_count)->getConstProfile()->getDefaultKartColor());
+            index.m_kart_color.push_back(StateManager::get()
+                ->getActivePlayer(player_count)->getConstProfile()
+                ->getDefaultKartColor());
             player_count++;
         }
         else
-            fprintf(fd, "kart_color: 0\n");
+            index.m_kart_color.push_back(0.0f);
     }
 
     m_last_uid = computeUID(min_time);
@@ -424,58 +424,33 @@ void ReplayRecorder::save()
     int num_laps = RaceManager::get()->getNumLaps();
     if (num_laps == 9999) num_laps = 0; // no lap in that race mode
 
-    fprintf(fd, "kart_list_end\n");
-    fprintf(fd, "reverse: %d\n",    (int)RaceManager::get()->getReverseTrack());
-    fprintf(fd, "difficulty: %d\n", RaceManager::get()->getDifficulty());
-    fprintf(fd, "mode: %s\n",       RaceManager::get()->getMinorModeName().c_str());
-    fprintf(fd, "track: %s\n",      Track::getCurrentTrack()->getIdent().c_str());
-    fprintf(fd, "laps: %d\n",       num_laps);
-    fprintf(fd, "min_time: %f\n",   min_time);
-    fprintf(fd, "replay_uid: %" PRIu64 "\n", m_last_uid);
+    index.m_reverse    = RaceManager::get()->getReverseTrack();
+    index.m_difficulty = RaceManager::get()->getDifficulty();
+    index.m_minor_mode = RaceManager::get()->getMinorModeName();
+    index.m_track_name = Track::getCurrentTrack()->getIdent();
+    index.m_laps       = num_laps;
+    index.m_min_time   = min_time;
+    index.m_replay_uid = m_last_uid;
 
+    std::vector<BareNetworkString> karts;
     for (unsigned int k = 0; k < num_karts; k++)
     {
         if (world->getKart(k)->isGhostKart()) continue;
-        fprintf(fd, "size:     %d\n", m_count_transforms[k]);
-
         unsigned int num_transforms = std::min(m_max_frames,
                                                m_count_transforms[k]);
+        karts.emplace_back(4 + num_transforms * BINARY_REPLAY_EVENT_SIZE);
+        karts.back().addUInt32(num_transforms);
         for (unsigned int i = 0; i < num_transforms; i++)
         {
-            const TransformEvent *p  = &(m_transform_events[k][i]);
-            const PhysicInfo *q      = &(m_physic_info[k][i]);
-            const BonusInfo *b      = &(m_bonus_info[k][i]);
-            const KartReplayEvent *r = &(m_kart_replay_event[k][i]);
-            fprintf(fd, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                    p->m_time,
-                    p->m_transform.getOrigin().getX(),
-                    p->m_transform.getOrigin().getY(),
-                    p->m_transform.getOrigin().getZ(),
-                    p->m_transform.getRotation().getX(),
-                    p->m_transform.getRotation().getY(),
-                    p->m_transform.getRotation().getZ(),
-                    p->m_transform.getRotation().getW(),
-                    q->m_speed,
-                    q->m_steer,
-                    q->m_suspension_length[0],
-                    q->m_suspension_length[1],
-                    q->m_suspension_length[2],
-                    q->m_suspension_length[3],
-                    q->m_skidding_state,
-                    b->m_attachment,
-                    b->m_nitro_amount,
-                    b->m_item_amount,
-                    b->m_item_type,
-                    b->m_special_value,
-                    r->m_distance,
-                    r->m_nitro_usage,
-                    (int)r->m_zipper_usage,
-                    r->m_skidding_effect,
-                    (int)r->m_red_skidding,
-                    (int)r->m_jumping
-                );
+            encodeEvent(m_transform_events[k][i], m_physic_info[k][i],
+                m_bonus_info[k][i], m_kart_replay_event[k][i], &karts.back());
         }   // for i
     }
+    if (!writeBinaryReplay(fd, index, karts))
+    {
+        Log::error("ReplayRecorder", "Failed to write '%s'.",
+            getReplayFilename().c_str());
+    }
     fclose(fd);
 }   // save
 
@@ -516,6 +516,18 @@ void GhostReplaySelection::onConfirm()
         ->removeFile(file_manager->getReplayDir() + m_file_to_be_deleted))
         Log::warn("GhostReplayInfoDialog", "Failed to delete file.");
 
+    // Also remove the text replay this file was converted from, otherwise it
+    // would be converted and listed again
+    const std::string suffix = ".bin.replay";
+    if (StringUtils::hasSuffix(m_file_to_be_deleted, suffix))
+    {
+        const std::string text_fn = m_file_to_be_deleted.substr(0,
+            m_file_to_be_deleted.size() - suffix.size()) + ".replay";
+        if (ReplayPlay::getConvertedFilename(text_fn) == m_file_to_be_deleted &&
+            file_manager->fileExists(file_manager->getReplayDir() + text_fn))
+            file_manager->removeFile(file_manager->getReplayDir() + text_fn);
+    }
+
     ModalDialog::dismiss();
     GhostReplaySelection::getInstance()->refresh();
 }   // onConfirm
@@ -25,20 +25,50 @@
 #include "tracks/arena_node.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
+#include "utils/time.hpp"
 
 #include <algorithm>
+#include <cstdio>
 #include <queue>
 
+/** Identifies a file with the shortest paths of a navmesh. */
+static const uint32_t PATH_CACHE_MAGIC = 0x50544b53;
+
+/** Must be increased if the format or the computation changes. */
+static const uint32_t PATH_CACHE_VERSION = 1;
+
 // -----------------------------------------------------------------------------
 ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
           : Graph()
 {
     loadNavmesh(navmesh);
-    buildGraph();
-    // Compute shortest distance from all nodes
-    for (unsigned int i = 0; i < getNumNodes(); i++)
-        computeDijkstra(i);
+    buildSpatialGrid();
+
+    // The shortest paths only depend on the nodes, so they are cached for
+    // each navmesh
+    const uint64_t hash = getNavmeshHash();
+    // A file shipped with the track is only read, the computed shortest
+    // paths are only written to the cache directory
+    const std::string shipped_file =
+        StringUtils::removeExtension(navmesh) + "-paths.dat";
+    const std::string cache_file = getPathCacheFile(hash);
+    bool loaded = loadPathCache(shipped_file, hash);
+    if (!loaded && !cache_file.empty() && loadPathCache(cache_file, hash))
+    {
+        file_manager->touchCachedData(cache_file);
+        loaded = true;
+    }
+    if (!loaded)
+    {
+        buildGraph();
+        computeAllShortestPaths();
+        if (!cache_file.empty())
+            savePathCache(cache_file, hash);
+    }
 
     setNearbyNodesOfAllNodes();
     if (node && RaceManager::get()->getMinorMode() == RaceManager::MINOR_MODE_SOCCER)
@@ -179,8 +209,7 @@ void ArenaGraph::buildGraph()
 {
     const unsigned int n_nodes = getNumNodes();
 
-    m_distance_matrix = std::vector<std::vector<float>>
-        (n_nodes, std::vector<float>(n_nodes, 9999.9f));
+    m_distance_matrix.assign(n_nodes * n_nodes, 9999.9f);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         ArenaNode* cur_node = getNode(i);
@@ -188,22 +217,21 @@ void ArenaGraph::buildGraph()
         {
             Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
             float distance = diff.length();
-            m_distance_matrix[i][adjacent] = distance;
+            m_distance_matrix[i * n_nodes + adjacent] = distance;
         }
-        m_distance_matrix[i][i] = 0.0f;
+        m_distance_matrix[i * n_nodes + i] = 0.0f;
     }
 
     // Allocate and initialise the previous node data structure:
-    m_parent_node = std::vector<std::vector<int16_t>>
-        (n_nodes, std::vector<int16_t>(n_nodes, Graph::UNKNOWN_SECTOR));
+    m_parent_node.assign(n_nodes * n_nodes, Graph::UNKNOWN_SECTOR);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         for (unsigned int j = 0; j < n_nodes; j++)
         {
-            if (i == j || m_distance_matrix[i][j] >= 9899.9f)
-                m_parent_node[i][j] = -1;
+            if (i == j || m_distance_matrix[i * n_nodes + j] >= 9899.9f)
+                m_parent_node[i * n_nodes + j] = -1;
             else
-                m_parent_node[i][j] = i;
+                m_parent_node[i * n_nodes + j] = i;
         }   // for j
     }   // for i
 
@@ -216,6 +244,9 @@ void ArenaGraph::buildGraph()
  *  source to j and m_parent_node[source][j] stores the last vertex visited on
  *  the shortest path from i to j before visiting j. Suppose the shortest path
  *  from i to j is i->......->k->j  then m_parent_node[i][j] = k
+ *  Only the row of source is changed, and the lengths of the edges are
+ *  computed again instead of being read from m_distance_matrix, so it can
+ *  be called for different nodes at the same time.
  */
 void ArenaGraph::computeDijkstra(int source)
 {
@@ -235,6 +266,8 @@ void ArenaGraph::computeDijkstra(int source)
     IndDistPair begin(source, 0.0f);
     queue.push(begin);
     const unsigned int n = getNumNodes();
+    float* distance = m_distance_matrix.data() + source * n;
+    int16_t* parent = m_parent_node.data() + source * n;
     std::vector<bool> visited;
     visited.resize(n, false);
     while (!queue.empty())
@@ -246,17 +279,19 @@ void ArenaGraph::computeDijkstra(int source)
         if (visited[cur_index]) continue;
         visited[cur_index] = true;
 
-        for (const int& adjacent : getNode(cur_index)->getAdjacentNodes())
+        ArenaNode* cur_node = getNode(cur_index);
+        for (const int& adjacent : cur_node->getAdjacentNodes())
         {
             // Distance already computed, can be ignored
             if (visited[adjacent]) continue;
 
-            float new_dist =
-                current.second + m_distance_matrix[cur_index][adjacent];
-            if (new_dist < m_distance_matrix[source][adjacent])
+            // Same as in buildGraph
+            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
+            float new_dist = current.second + diff.length();
+            if (new_dist < distance[adjacent])
             {
-                m_distance_matrix[source][adjacent] = new_dist;
-                m_parent_node[source][adjacent] = cur_index;
+                distance[adjacent] = new_dist;
+                parent[adjacent] = cur_index;
             }
             IndDistPair pair(adjacent, new_dist);
             queue.push(pair);
@@ -264,6 +299,134 @@ void ArenaGraph::computeDijkstra(int source)
     }
 }   // computeDijkstra
 
+// ----------------------------------------------------------------------------
+/** Computes the shortest paths from all nodes, using all cores. buildGraph
+ *  must be called first.
+ */
+void ArenaGraph::computeAllShortestPaths()
+{
+    const double start = StkTime::getRealTime();
+    ThreadPool pool(ThreadPool::getDefaultThreadCount(8), "Navmesh");
+    pool.parallelFor(getNumNodes(), [this](unsigned i)
+        {
+            computeDijkstra(i);
+        });
+    Log::info("ArenaGraph", "Computed shortest paths of %d nodes in %f "
+        "seconds with %d threads.", getNumNodes(),
+        StkTime::getRealTime() - start, pool.getThreadCount() + 1);
+}   // computeAllShortestPaths
+
+// ----------------------------------------------------------------------------
+/** Returns a hash of everything the shortest paths are computed from (the
+ *  centers of the nodes and their adjacent nodes), to find out if a cached
+ *  result can be used.
+ */
+uint64_t ArenaGraph::getNavmeshHash() const
+{
+    uint64_t hash = FileUtils::FNV_HASH_BASIS;
+    auto add = [&hash](const void* data, size_t size)
+        {
+            FileUtils::addToHash(&hash, data, size);
+        };
+    const uint32_t n = getNumNodes();
+    add(&n, sizeof(n));
+    for (unsigned int i = 0; i < n; i++)
+    {
+        const Vec3& center = getNode(i)->getCenter();
+        const float xyz[3] = { center.getX(), center.getY(), center.getZ() };
+        add(xyz, sizeof(xyz));
+        const std::vector<int>& adjacent = getNode(i)->getAdjacentNodes();
+        const uint32_t count = (uint32_t)adjacent.size();
+        add(&count, sizeof(count));
+        if (count > 0)
+            add(adjacent.data(), count * sizeof(int));
+    }
+    return hash;
+}   // getNavmeshHash
+
+// ----------------------------------------------------------------------------
+/** Returns the file in the cache directory in which the shortest paths of
+ *  the navmesh are cached, or an empty string if there is no file manager.
+ */
+std::string ArenaGraph::getPathCacheFile(uint64_t hash) const
+{
+    if (!file_manager)
+        return "";
+    char name[64];
+    snprintf(name, sizeof(name), "navmesh-paths-%016llx.dat",
+             (unsigned long long)hash);
+    return file_manager->getCachedDataDir() + name;
+}   // getPathCacheFile
+
+// ----------------------------------------------------------------------------
+/** Loads the shortest paths, if the file exists and was saved for the same
+ *  navmesh.
+ *  \param filename Name of the file.
+ *  \param hash Hash of the navmesh (see getNavmeshHash).
+ *  \return True if the shortest paths were loaded.
+ */
+bool ArenaGraph::loadPathCache(const std::string& filename, uint64_t hash)
+{
+    FILE* fd = FileUtils::fopenU8Path(filename, "rb");
+    if (!fd)
+        return false;
+    const size_t n = getNumNodes();
+    uint32_t header[3];
+    uint64_t file_hash = 0;
+    bool ok = fread(header, sizeof(header), 1, fd) == 1 &&
+              fread(&file_hash, sizeof(file_hash), 1, fd) == 1 &&
+              header[0] == PATH_CACHE_MAGIC &&
+              header[1] == PATH_CACHE_VERSION &&
+              header[2] == n && file_hash == hash;
+    if (ok)
+    {
+        m_distance_matrix.resize(n * n);
+        m_parent_node.resize(n * n);
+        ok = fread(m_distance_matrix.data(), sizeof(float), n * n, fd) ==
+                 n * n &&
+             fread(m_parent_node.data(), sizeof(int16_t), n * n, fd) == n * n;
+        if (!ok)
+        {
+            Log::warn("ArenaGraph", "Shortest paths in '%s' are incomplete.",
+                filename.c_str());
+        }
+    }
+    fclose(fd);
+    if (ok)
+    {
+        Log::info("ArenaGraph", "Loaded shortest paths of %d nodes from '%s'.",
+            (int)n, filename.c_str());
+    }
+    return ok;
+}   // loadPathCache
+
+// ----------------------------------------------------------------------------
+/** Saves the shortest paths (see FileUtils::writeFileAtomic).
+ *  \param filename Name of the file.
+ *  \param hash Hash of the navmesh (see getNavmeshHash).
+ *  \return True if the file was written.
+ */
+bool ArenaGraph::savePathCache(const std::string& filename,
+                               uint64_t hash) const
+{
+    const size_t n = getNumNodes();
+    const bool ok = FileUtils::writeFileAtomic(filename, [&](FILE* fd)
+        {
+            const uint32_t header[3] = { PATH_CACHE_MAGIC, PATH_CACHE_VERSION,
+                                         (uint32_t)n };
+            return fwrite(header, sizeof(header), 1, fd) == 1 &&
+                   fwrite(&hash, sizeof(hash), 1, fd) == 1 &&
+                   fwrite(m_distance_matrix.data(), sizeof(float), n * n,
+                          fd) == n * n &&
+                   fwrite(m_parent_node.data(), sizeof(int16_t), n * n,
+                          fd) == n * n;
+        });
+    if (!ok)
+        return false;
+    Log::info("ArenaGraph", "Saved shortest paths to '%s'.", filename.c_str());
+    return true;
+}   // savePathCache
+
 // ----------------------------------------------------------------------------
 /** THIS FUNCTION IS ONLY USED FOR UNIT-TESTING, to verify that the new
  *  Dijkstra algorithm gives the same results.
@@ -277,6 +440,7 @@ void ArenaGraph::computeDijkstra(int source)
 void ArenaGraph::computeFloydWarshall()
 {
     unsigned int n = getNumNodes();
+    std::vector<float>& d = m_distance_matrix;
 
     for (unsigned int k = 0; k < n; k++)
     {
@@ -284,12 +448,10 @@ void ArenaGraph::computeFloydWarshall()
         {
             for (unsigned int j = 0; j < n; j++)
             {
-                if ((m_distance_matrix[i][k] + m_distance_matrix[k][j]) <
-                    m_distance_matrix[i][j])
+                if ((d[i * n + k] + d[k * n + j]) < d[i * n + j])
                 {
-                    m_distance_matrix[i][j] =
-                        m_distance_matrix[i][k] + m_distance_matrix[k][j];
-                    m_parent_node[i][j] = m_parent_node[k][j];
+                    d[i * n + j] = d[i * n + k] + d[k * n + j];
+                    m_parent_node[i * n + j] = m_parent_node[k * n + j];
                 }
             }
         }
@@ -349,7 +511,8 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
         // Get the distance to all nodes at i
         ArenaNode* cur_node = getNode(i);
         std::vector<int> nearby_nodes;
-        std::vector<float> dist = m_distance_matrix[i];
+        std::vector<float> dist(m_distance_matrix.begin() + i * getNumNodes(),
+            m_distance_matrix.begin() + (i + 1) * getNumNodes());
 
         // Skip the same node
         dist[i] = 999999.0f;
@@ -371,13 +534,14 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
  *  std::vector (in reverse order). Used only for unit testing.
  */
 std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
-                      const std::vector< std::vector< int16_t > >& parent_node)
+                                                unsigned int n,
+                                     const std::vector<int16_t>& parent_node)
 {
     std::vector<int16_t> path;
     path.push_back(to);
     while(from!=to)
     {
-        to = parent_node[from][to];
+        to = parent_node[from * n + to];
         path.push_back(to);
     }
     return path;
@@ -395,14 +559,35 @@ void ArenaGraph::unitTesting()
     Track *track = track_manager->getTrack("cave");
     std::string navmesh_file_name=track->getTrackFile("navmesh.xml");
 
-    double s = StkTime::getRealTime();
+    // The shortest paths might be loaded from the cache, they must be the
+    // same as the computed ones
     ArenaGraph* ag = new ArenaGraph(navmesh_file_name);
+    std::vector<float> cached_distance = ag->m_distance_matrix;
+    std::vector<int16_t> cached_parent = ag->m_parent_node;
+    double s = StkTime::getRealTime();
+    ag->buildGraph();
+    ag->computeAllShortestPaths();
     double e = StkTime::getRealTime();
     Log::error("Time", "Dijkstra       %lf", e-s);
+    assert(cached_distance == ag->m_distance_matrix);
+    assert(cached_parent == ag->m_parent_node);
+
+    // The cache is only used for the same navmesh
+    const std::string cache = file_manager->getCachedDataDir() +
+        "navmesh-paths-test.dat";
+    assert(ag->savePathCache(cache, 1));
+    ag->m_distance_matrix.clear();
+    ag->m_parent_node.clear();
+    assert(!ag->loadPathCache(cache, 2));
+    assert(ag->loadPathCache(cache, 1));
+    assert(cached_distance == ag->m_distance_matrix);
+    assert(cached_parent == ag->m_parent_node);
+    remove(FileUtils::getPortableWritingPath(cache).c_str());
 
     // Save the Dijkstra results
-    std::vector< std::vector< float > > distance_matrix = ag->m_distance_matrix;
-    std::vector< std::vector< int16_t > > parent_node = ag->m_parent_node;
+    const unsigned int n = ag->getNumNodes();
+    std::vector<float> distance_matrix = ag->m_distance_matrix;
+    std::vector<int16_t> parent_node = ag->m_parent_node;
     ag->buildGraph();
 
     // Now compute results with Floyd-Warshall
@@ -412,15 +597,16 @@ void ArenaGraph::unitTesting()
     Log::error("Time", "Floyd-Warshall %lf", e-s);
 
     int error_count = 0;
-    for(unsigned int i=0; i<ag->m_distance_matrix.size(); i++)
+    for(unsigned int i=0; i<n; i++)
     {
-        for(unsigned int j=0; j<ag->m_distance_matrix[i].size(); j++)
+        for(unsigned int j=0; j<n; j++)
         {
-            if(ag->m_distance_matrix[i][j] - distance_matrix[i][j] > 0.001f)
+            if(ag->m_distance_matrix[i*n+j] - distance_matrix[i*n+j] > 0.001f)
             {
                 Log::error("ArenaGraph",
                            "Incorrect distance %d, %d: Dijkstra: %f F.W.: %f",
-                           i, j, distance_matrix[i][j], ag->m_distance_matrix[i][j]);
+                           i, j, distance_matrix[i*n+j],
+                           ag->m_distance_matrix[i*n+j]);
                 error_count++;
             }    // if distance is too different
 
@@ -432,16 +618,16 @@ void ArenaGraph::unitTesting()
             // debugging in the feature
 #undef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
 #ifdef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-            if(ag->m_parent_node[i][j] != parent_node[i][j])
+            if(ag->m_parent_node[i*n+j] != parent_node[i*n+j])
             {
                 error_count++;
-                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node);
-                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node);
+                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, n, parent_node);
+                std::vector<int16_t> floyd_path = getPathFromTo(i, j, n, ag->m_parent_node);
                 if(dijkstra_path.size()!=floyd_path.size())
                 {
                     Log::error("ArenaGraph",
                                "Incorrect path length %d, %d: Dijkstra: %d F.W.: %d",
-                               i, j, parent_node[i][j], ag->m_parent_node[i][j]);
+                               i, j, parent_node[i*n+j], ag->m_parent_node[i*n+j]);
                     continue;
                 }
                 Log::error("ArenaGraph", "Path problems from %d to %d:",
@@ -23,6 +23,7 @@
 #include "utils/cpp2011.hpp"
 
 #include <set>
+#include <string>
 
 class ArenaNode;
 class XMLNode;
@@ -34,11 +35,13 @@ class XMLNode;
 class ArenaGraph : public Graph
 {
 private:
-    /** The actual graph data structure, it is an adjacency matrix. */
-    std::vector<std::vector<float>> m_distance_matrix;
+    /** The actual graph data structure, it is an adjacency matrix. The
+     *  distance from i to j is stored at i * getNumNodes() + j. */
+    std::vector<float> m_distance_matrix;
 
-    /** The matrix that is used to store computed shortest paths. */
-    std::vector<std::vector<int16_t>> m_parent_node;
+    /** The matrix that is used to store computed shortest paths, with the
+     *  same layout as m_distance_matrix. */
+    std::vector<int16_t> m_parent_node;
 
     /** Used in soccer mode to colorize the goal lines in minimap. */
     std::set<int> m_red_node;
@@ -56,17 +59,27 @@ private:
     // ------------------------------------------------------------------------
     void computeDijkstra(int n);
     // ------------------------------------------------------------------------
+    void computeAllShortestPaths();
+    // ------------------------------------------------------------------------
     void computeFloydWarshall();
     // ------------------------------------------------------------------------
-    static std::vector<int16_t> getPathFromTo(int from, int to,
-                     const std::vector< std::vector< int16_t > >& parent_node);
+    uint64_t getNavmeshHash() const;
+    // ------------------------------------------------------------------------
+    std::string getPathCacheFile(uint64_t hash) const;
+    // ------------------------------------------------------------------------
+    bool loadPathCache(const std::string& filename, uint64_t hash);
+    // ------------------------------------------------------------------------
+    bool savePathCache(const std::string& filename, uint64_t hash) const;
+    // ------------------------------------------------------------------------
+    static std::vector<int16_t> getPathFromTo(int from, int to, unsigned int n,
+                                   const std::vector<int16_t>& parent_node);
     // ------------------------------------------------------------------------
     virtual bool hasLapLine() const OVERRIDE                  { return false; }
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const OVERRIDE;
 
 public:
-    static ArenaGraph* get()     { return dynamic_cast<ArenaGraph*>(m_graph); }
+    static ArenaGraph* get() { return dynamic_cast<ArenaGraph*>(Graph::get()); }
     // ------------------------------------------------------------------------
     static void unitTesting();
     // ------------------------------------------------------------------------
@@ -84,7 +97,7 @@ public:
     {
         if (i == Graph::UNKNOWN_SECTOR || j == Graph::UNKNOWN_SECTOR)
             return Graph::UNKNOWN_SECTOR;
-        return (int)(m_parent_node[j][i]);
+        return (int)(m_parent_node[j * getNumNodes() + i]);
     }
     // ------------------------------------------------------------------------
     /** Returns the distance between any two nodes */
@@ -92,7 +105,7 @@ public:
     {
         if (from == Graph::UNKNOWN_SECTOR || to == Graph::UNKNOWN_SECTOR)
             return 99999.0f;
-        return m_distance_matrix[from][to];
+        return m_distance_matrix[from * getNumNodes() + to];
     }
 
 };   // ArenaGraph
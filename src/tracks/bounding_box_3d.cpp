@@ -0,0 +1,168 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "tracks/bounding_box_3d.hpp"
+
+#include <cmath>
+
+namespace
+{
+    /** A half space n.p >= d, in double precision. */
+    struct HalfSpace
+    {
+        double m_n[3];
+        double m_d;
+    };
+    // ------------------------------------------------------------------------
+    void cross(const double* a, const double* b, double* c)
+    {
+        c[0] = a[1] * b[2] - a[2] * b[1];
+        c[1] = a[2] * b[0] - a[0] * b[2];
+        c[2] = a[0] * b[1] - a[1] * b[0];
+    }   // cross
+    // ------------------------------------------------------------------------
+    double dot(const double* a, const double* b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }   // dot
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Computes the axis aligned bounding box of all points for which
+ *  pointInside is true. Since the faces are defined by 3 of their 4 points
+ *  (which are not in one plane if the quad is not flat), this can be larger
+ *  than the box around the corners. pointInside accepts points on the same
+ *  side of all faces, so both the region inside all faces and the one
+ *  outside of all faces are used (the latter is usually empty). The
+ *  vertices of each region are intersections of 3 faces. Points exactly
+ *  on the plane of the first face, which are accepted anywhere, are
+ *  ignored.
+ *  \param min On return the minimum of the bounding box.
+ *  \param max On return the maximum of the bounding box.
+ *  \return False if a region is not limited to the area around the quad.
+ */
+bool BoundingBox3D::getBounds(Vec3* min, Vec3* max) const
+{
+    // Faces whose points are on a line (from a quad with 2 same points)
+    // don't limit anything
+    HalfSpace faces[6];
+    unsigned int num_faces = 0;
+    double center[3] = { 0, 0, 0 };
+    for (unsigned int i = 0; i < 6; i++)
+    {
+        double p[3][3];
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+                p[j][k] = m_box_faces[i][j][k];
+        }
+        for (unsigned int k = 0; k < 3; k++)
+            center[k] += (p[0][k] + p[1][k] + p[2][k]) / 18.0;
+        const double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1],
+                               p[1][2] - p[0][2] };
+        const double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1],
+                               p[2][2] - p[0][2] };
+        HalfSpace& f = faces[num_faces];
+        cross(e1, e2, f.m_n);
+        const double len = std::sqrt(dot(f.m_n, f.m_n));
+        if (len < 1e-9)
+        {
+            // Then all points are on the same side of the first face
+            if (i == 0)
+                return false;
+            continue;
+        }
+        for (unsigned int k = 0; k < 3; k++)
+            f.m_n[k] /= len;
+        f.m_d = dot(f.m_n, p[0]);
+        num_faces++;
+    }
+
+    // A large box around the quad, a region reaching it is not limited
+    const double size = 1000.0;
+    HalfSpace planes[12];
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        HalfSpace& low = planes[num_faces + 2 * k];
+        HalfSpace& high = planes[num_faces + 2 * k + 1];
+        low.m_n[0] = low.m_n[1] = low.m_n[2] = 0.0;
+        high.m_n[0] = high.m_n[1] = high.m_n[2] = 0.0;
+        low.m_n[k] = 1.0;
+        low.m_d = center[k] - size;
+        high.m_n[k] = -1.0;
+        high.m_d = -center[k] - size;
+    }
+    const unsigned int num_planes = num_faces + 6;
+
+    bool found = false;
+    for (int sign = -1; sign <= 1; sign += 2)
+    {
+        for (unsigned int i = 0; i < num_faces; i++)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+                planes[i].m_n[k] = sign * faces[i].m_n[k];
+            planes[i].m_d = sign * faces[i].m_d;
+        }
+        for (unsigned int a = 0; a < num_planes; a++)
+        {
+            for (unsigned int b = a + 1; b < num_planes; b++)
+            {
+                for (unsigned int c = b + 1; c < num_planes; c++)
+                {
+                    double bc[3], ca[3], ab[3];
+                    cross(planes[b].m_n, planes[c].m_n, bc);
+                    cross(planes[c].m_n, planes[a].m_n, ca);
+                    cross(planes[a].m_n, planes[b].m_n, ab);
+                    const double det = dot(planes[a].m_n, bc);
+                    if (std::fabs(det) < 1e-9)
+                        continue;
+                    double v[3];
+                    for (unsigned int k = 0; k < 3; k++)
+                    {
+                        v[k] = (planes[a].m_d * bc[k] + planes[b].m_d * ca[k]
+                              + planes[c].m_d * ab[k]) / det;
+                    }
+                    bool inside = true;
+                    for (unsigned int i = 0; i < num_planes && inside; i++)
+                        inside = dot(planes[i].m_n, v) - planes[i].m_d > -1e-4;
+                    if (!inside)
+                        continue;
+                    if (c >= num_faces)
+                        return false;
+                    const Vec3 vertex((float)v[0], (float)v[1], (float)v[2]);
+                    if (!found)
+                    {
+                        *min = vertex;
+                        *max = vertex;
+                        found = true;
+                    }
+                    min->min(vertex);
+                    max->max(vertex);
+                }   // for c
+            }   // for b
+        }   // for a
+    }   // for sign
+
+    if (!found)
+    {
+        // No point is inside
+        *min = Vec3((float)center[0], (float)center[1], (float)center[2]);
+        *max = *min;
+    }
+    return true;
+}   // getBounds
@@ -74,7 +74,7 @@ private:
     virtual void differentNodeColor(int n, video::SColor* c) const OVERRIDE;
 
 public:
-    static DriveGraph* get()     { return dynamic_cast<DriveGraph*>(m_graph); }
+    static DriveGraph* get() { return dynamic_cast<DriveGraph*>(Graph::get()); }
     // ------------------------------------------------------------------------
     DriveGraph(const std::string &quad_file_name,
                const std::string &graph_file_name, const bool reverse);
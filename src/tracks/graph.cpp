@@ -28,15 +28,20 @@
 #include "guiengine/engine.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/arena_node_3d.hpp"
+#include "tracks/bounding_box_3d.hpp"
 #include "tracks/drive_node_2d.hpp"
 #include "tracks/drive_node_3d.hpp"
 #include "tracks/track.hpp"
 #include "utils/log.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
 const int Graph::UNKNOWN_SECTOR = -1;
 const float Graph::MIN_HEIGHT_TESTING = -1.0f;
 const float Graph::MAX_HEIGHT_TESTING = 5.0f;
-Graph *Graph::m_graph = NULL;
+Graph *Graph::m_graph[PT_COUNT];
 // -----------------------------------------------------------------------------
 Graph::Graph()
 {
@@ -48,6 +53,11 @@ Graph::Graph()
     m_bb_min      = Vec3( 99999,  99999,  99999);
     m_bb_max      = Vec3(-99999, -99999, -99999);
     memset(m_bb_nodes, 0, 4 * sizeof(int));
+    m_grid_min_x  = 0.0f;
+    m_grid_min_z  = 0.0f;
+    m_grid_cell_size = 1.0f;
+    m_grid_width  = 0;
+    m_grid_height = 0;
 }  // Graph
 
 // -----------------------------------------------------------------------------
@@ -617,6 +627,21 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
         return;
     }   // if still on same quad
 
+    // A list of sectors must be tested in its order, see below
+    if (all_sectors || m_grid_offsets.empty())
+        findRoadSectorLinear(xyz, sector, all_sectors, ignore_vertical);
+    else
+        findRoadSectorInGrid(xyz, sector, ignore_vertical);
+}   // findRoadSector
+
+//-----------------------------------------------------------------------------
+/** Tests all quads (or all quads in all_sectors) in order, starting with the
+ *  one after the current sector. See findRoadSector for the parameters.
+ */
+void Graph::findRoadSectorLinear(const Vec3& xyz, int *sector,
+                                 std::vector<int> *all_sectors,
+                                 bool ignore_vertical) const
+{
     // Now we search through all quads, starting with
     // the current one
     int indx       = *sector;
@@ -649,7 +674,332 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
     }   // for i<m_all_nodes.size()
 
     return;
-}   // findRoadSector
+}   // findRoadSectorLinear
+
+//-----------------------------------------------------------------------------
+/** Only tests the quads in the grid cell of xyz, in the same order as
+ *  findRoadSectorLinear (starting with the quad after the current sector),
+ *  so if quads overlap (e.g. with ignore_vertical) the same quad is found.
+ *  The height of a point is still tested like in Quad::pointInside, the
+ *  grid contains all quads above each other. The quads are tested 4 at
+ *  once, the first one containing the point is used.
+ */
+void Graph::findRoadSectorInGrid(const Vec3& xyz, int *sector,
+                                 bool ignore_vertical) const
+{
+    // Points outside of the grid use the closest cell, which contains the
+    // quads which can contain any point
+    int x = (int)std::floor((xyz.getX() - m_grid_min_x) / m_grid_cell_size);
+    int z = (int)std::floor((xyz.getZ() - m_grid_min_z) / m_grid_cell_size);
+    x = std::min(std::max(x, 0), m_grid_width - 1);
+    z = std::min(std::max(z, 0), m_grid_height - 1);
+    const unsigned int cell = z * m_grid_width + x;
+    const unsigned int begin = m_grid_offsets[cell];
+    const unsigned int end = m_grid_offsets[cell + 1];
+    const unsigned int first = (unsigned int)(std::upper_bound(
+        m_grid_quads.begin() + begin, m_grid_quads.begin() + end, *sector) -
+        m_grid_quads.begin());
+
+    *sector = UNKNOWN_SECTOR;
+    const unsigned int ranges[2][2] = { { first, end }, { begin, first } };
+    for (unsigned int r = 0; r < 2; r++)
+    {
+        for (unsigned int i = ranges[r][0]; i < ranges[r][1]; i += 4)
+        {
+            unsigned int mask = m_grid_soa.pointInside4(xyz, i,
+                std::min(4u, ranges[r][1] - i), ignore_vertical);
+            if (mask == 0)
+                continue;
+            unsigned int j = 0;
+            while ((mask & (1 << j)) == 0)
+                j++;
+            *sector = m_grid_quads[i + j];
+            return;
+        }
+    }
+}   // findRoadSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Tests for many points (e.g. of all karts) at once if they are still on
+ *  the quad they were on before, which is the first test done by
+ *  findRoadSector.
+ *  \param xyz The points to test.
+ *  \param sectors The sector of each point, which can be UNKNOWN_SECTOR.
+ *         On return it is set to UNKNOWN_SECTOR for all points which are
+ *         not on their sector anymore.
+ */
+void Graph::pointInsideQuads(const std::vector<Vec3>& xyz,
+                             std::vector<int>* sectors) const
+{
+    assert(xyz.size() == sectors->size());
+    if (m_quads_soa.size() == getNumNodes())
+    {
+        m_quads_soa.pointInsideEach(xyz.data(), sectors->data(),
+                                    (unsigned int)xyz.size());
+        return;
+    }
+    for (unsigned int i = 0; i < xyz.size(); i++)
+    {
+        int& sector = (*sectors)[i];
+        if (sector != UNKNOWN_SECTOR && !getQuad(sector)->pointInside(xyz[i]))
+            sector = UNKNOWN_SECTOR;
+    }
+}   // pointInsideQuads
+
+//-----------------------------------------------------------------------------
+/** Builds the grid used by findRoadSector, it must be called after all
+ *  quads are created. The size of a cell is chosen so that there are about
+ *  4 cells for each quad. A quad is added to all cells overlapping its
+ *  2d bounding box (for 3d quads the one of all points accepted by
+ *  BoundingBox3D::pointInside). Quads whose pointInside test is not limited to the quad
+ *  (because of wrong orientation of the points) are added to all cells.
+ */
+void Graph::buildSpatialGrid()
+{
+    m_grid_offsets.clear();
+    m_grid_quads.clear();
+    m_quads_soa.clear();
+    m_grid_soa.clear();
+    if (m_all_nodes.empty())
+        return;
+
+    const float margin = 0.1f;
+    std::vector<Vec3> quad_min(m_all_nodes.size());
+    std::vector<Vec3> quad_max(m_all_nodes.size());
+    std::vector<bool> unbounded(m_all_nodes.size(), false);
+    Vec3 grid_min(99999, 99999, 99999), grid_max(-99999, -99999, -99999);
+    for (unsigned int i = 0; i < m_all_nodes.size(); i++)
+    {
+        const Quad* q = m_all_nodes[i];
+        const BoundingBox3D* bb = q->is3DQuad() ?
+            dynamic_cast<const BoundingBox3D*>(q) : NULL;
+        if (bb)
+            unbounded[i] = !bb->getBounds(&quad_min[i], &quad_max[i]);
+        if (!bb || unbounded[i])
+        {
+            quad_min[i] = (*q)[0];
+            quad_max[i] = (*q)[0];
+            for (unsigned int j = 1; j < 4; j++)
+            {
+                quad_min[i].min((*q)[j]);
+                quad_max[i].max((*q)[j]);
+            }
+        }
+        quad_min[i] -= Vec3(margin, 0, margin);
+        quad_max[i] += Vec3(margin, 0, margin);
+        grid_min.min(quad_min[i]);
+        grid_max.max(quad_max[i]);
+
+        // The test of a 2d quad is only limited to the two triangles if
+        // their points are in the expected order
+        if (!bb)
+        {
+            const Vec3 c1 = ((*q)[0] + (*q)[1] + (*q)[2]) / 3.0f;
+            const Vec3 c2 = ((*q)[0] + (*q)[2] + (*q)[3]) / 3.0f;
+            unbounded[i] =
+                !(c1.sideOfLine2D((*q)[0], (*q)[2]) < 0 &&
+                  c1.sideOfLine2D((*q)[0], (*q)[1]) >= 0 &&
+                  c1.sideOfLine2D((*q)[1], (*q)[2]) >= 0) ||
+                !(c2.sideOfLine2D((*q)[0], (*q)[2]) >= 0 &&
+                  c2.sideOfLine2D((*q)[2], (*q)[3]) > 0 &&
+                  c2.sideOfLine2D((*q)[3], (*q)[0]) >= 0);
+        }
+    }
+
+    const float area = (grid_max.getX() - grid_min.getX()) *
+                       (grid_max.getZ() - grid_min.getZ());
+    m_grid_cell_size = std::max(1.0f,
+        std::sqrt(area / (4.0f * (float)m_all_nodes.size())));
+    m_grid_min_x = grid_min.getX();
+    m_grid_min_z = grid_min.getZ();
+    m_grid_width = std::min(1024, 1 + (int)((grid_max.getX() - m_grid_min_x)
+        / m_grid_cell_size));
+    m_grid_height = std::min(1024, 1 + (int)((grid_max.getZ() - m_grid_min_z)
+        / m_grid_cell_size));
+    m_grid_cell_size = std::max(m_grid_cell_size,
+        std::max((grid_max.getX() - m_grid_min_x) / m_grid_width,
+                 (grid_max.getZ() - m_grid_min_z) / m_grid_height));
+
+    // Count the quads of each cell first, then fill them in (in order of
+    // their index, so each cell is sorted)
+    const unsigned int num_cells = m_grid_width * m_grid_height;
+    m_grid_offsets.resize(num_cells + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::vector<unsigned int> fill;
+        if (pass == 1)
+        {
+            for (unsigned int i = 1; i <= num_cells; i++)
+                m_grid_offsets[i] += m_grid_offsets[i - 1];
+            m_grid_quads.resize(m_grid_offsets[num_cells]);
+            fill.assign(m_grid_offsets.begin(), m_grid_offsets.end() - 1);
+        }
+        for (unsigned int i = 0; i < m_all_nodes.size(); i++)
+        {
+            int x0 = 0, z0 = 0;
+            int x1 = m_grid_width - 1, z1 = m_grid_height - 1;
+            if (!unbounded[i])
+            {
+                x0 = (int)((quad_min[i].getX() - m_grid_min_x) /
+                    m_grid_cell_size);
+                z0 = (int)((quad_min[i].getZ() - m_grid_min_z) /
+                    m_grid_cell_size);
+                x1 = std::min(x1, (int)((quad_max[i].getX() - m_grid_min_x) /
+                    m_grid_cell_size));
+                z1 = std::min(z1, (int)((quad_max[i].getZ() - m_grid_min_z) /
+                    m_grid_cell_size));
+            }
+            for (int z = z0; z <= z1; z++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    const unsigned int cell = z * m_grid_width + x;
+                    if (pass == 0)
+                        m_grid_offsets[cell + 1]++;
+                    else
+                        m_grid_quads[fill[cell]++] = i;
+                }
+            }
+        }   // for i < m_all_nodes.size()
+    }   // for pass
+
+    for (unsigned int i = 0; i < m_all_nodes.size(); i++)
+        m_quads_soa.add(m_all_nodes[i]);
+    for (unsigned int i = 0; i < m_grid_quads.size(); i++)
+        m_grid_soa.add(m_all_nodes[m_grid_quads[i]]);
+
+    Log::info("Graph", "Built %dx%d grid with cell size %f for %d quads, "
+        "%d entries.", m_grid_width, m_grid_height, m_grid_cell_size,
+        (int)m_all_nodes.size(), (int)m_grid_quads.size());
+}   // buildSpatialGrid
+
+//-----------------------------------------------------------------------------
+/** Compares the time of findRoadSector with and without the grid, and
+ *  checks that both find the same sectors. Each path is a sequence of
+ *  positions of a kart, e.g. from a replay, for which the sector is tracked
+ *  like TrackSector::update does. It also shows the time per tick to update
+ *  the sectors of 4, 16 and 64 karts, with and without the batched test
+ *  of LinearWorld::updateTrackSectors.
+ *  \param paths The positions of each kart.
+ */
+void Graph::benchmarkFindRoadSector(
+                          const std::vector<std::vector<Vec3> >& paths) const
+{
+    if (m_grid_offsets.empty())
+        return;
+    uint64_t time[2] = { 0, 0 };
+    std::vector<int> found[2];
+    for (int use_grid = 0; use_grid < 2; use_grid++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (const std::vector<Vec3>& path : paths)
+        {
+            int sector = UNKNOWN_SECTOR;
+            for (const Vec3& xyz : path)
+            {
+                if (sector == UNKNOWN_SECTOR ||
+                    !getQuad(sector)->pointInside(xyz))
+                {
+                    if (use_grid)
+                        findRoadSectorInGrid(xyz, &sector, false);
+                    else
+                        findRoadSectorLinear(xyz, &sector, NULL, false);
+                }
+                found[use_grid].push_back(sector);
+            }
+        }
+        time[use_grid] = std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now() - start).count();
+    }
+
+    unsigned int mismatches = 0;
+    for (unsigned int i = 0; i < found[0].size(); i++)
+    {
+        if (found[0][i] != found[1][i])
+            mismatches++;
+    }
+    const float n = (float)std::max<size_t>(found[0].size(), 1);
+    Log::info("Graph", "findRoadSector for %d positions on %d quads: "
+        "%f us per position without grid, %f us with grid, %d mismatches.",
+        (int)found[0].size(), (int)m_all_nodes.size(),
+        (float)time[0] / 1000.0f / n, (float)time[1] / 1000.0f / n,
+        mismatches);
+
+    // Per tick cost of updating the sectors of all karts, one kart after
+    // the other or batched like LinearWorld::updateTrackSectors. Each kart
+    // follows one of the paths, starting at a different position.
+    unsigned int num_ticks = 0;
+    for (const std::vector<Vec3>& path : paths)
+    {
+        if (!path.empty() && (num_ticks == 0 || path.size() < num_ticks))
+            num_ticks = (unsigned int)path.size();
+    }
+    if (num_ticks == 0)
+        return;
+    const unsigned int all_num_karts[3] = { 4, 16, 64 };
+    for (unsigned int num_karts : all_num_karts)
+    {
+        std::vector<const std::vector<Vec3>*> kart_path;
+        std::vector<unsigned int> kart_offset;
+        for (unsigned int k = 0; k < num_karts; k++)
+        {
+            const std::vector<Vec3>* path = &paths[k % paths.size()];
+            while (path->empty())
+                path = &paths[(path - paths.data() + 1) % paths.size()];
+            kart_path.push_back(path);
+            kart_offset.push_back((k / (unsigned int)paths.size()) * 37);
+        }
+        std::vector<int> sectors[2];
+        std::vector<int> previous;
+        std::vector<Vec3> xyz(num_karts);
+        mismatches = 0;
+        for (int batched = 0; batched < 2; batched++)
+        {
+            std::vector<int> sector(num_karts, UNKNOWN_SECTOR);
+            sectors[batched].reserve(num_ticks * num_karts);
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int t = 0; t < num_ticks; t++)
+            {
+                for (unsigned int k = 0; k < num_karts; k++)
+                {
+                    const std::vector<Vec3>& path = *kart_path[k];
+                    xyz[k] = path[(t + kart_offset[k]) % path.size()];
+                }
+                if (!batched)
+                {
+                    for (unsigned int k = 0; k < num_karts; k++)
+                        findRoadSector(xyz[k], &sector[k]);
+                }
+                else
+                {
+                    previous = sector;
+                    pointInsideQuads(xyz, &sector);
+                    for (unsigned int k = 0; k < num_karts; k++)
+                    {
+                        if (sector[k] != UNKNOWN_SECTOR)
+                            continue;
+                        sector[k] = previous[k];
+                        findRoadSectorInGrid(xyz[k], &sector[k], false);
+                    }
+                }
+                sectors[batched].insert(sectors[batched].end(),
+                                        sector.begin(), sector.end());
+            }
+            time[batched] =
+                std::chrono::duration_cast<std::chrono::nanoseconds>
+                (std::chrono::steady_clock::now() - start).count();
+        }
+        for (unsigned int i = 0; i < sectors[0].size(); i++)
+        {
+            if (sectors[0][i] != sectors[1][i])
+                mismatches++;
+        }
+        Log::info("Graph", "Sectors of %d karts for %d ticks: %f us per "
+            "tick for each kart, %f us per tick batched, %d mismatches.",
+            num_karts, num_ticks, (float)time[0] / 1000.0f / num_ticks,
+            (float)time[1] / 1000.0f / num_ticks, mismatches);
+    }
+}   // benchmarkFindRoadSector
 
 //-----------------------------------------------------------------------------
 /** findOutOfRoadSector finds the sector where XYZ is, but as it name
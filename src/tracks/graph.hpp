@@ -19,7 +19,9 @@
 #ifndef HEADER_GRAPH_HPP
 #define HEADER_GRAPH_HPP
 
+#include "tracks/quad_soa.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/stk_process.hpp"
 #include "utils/vec3.hpp"
 
 #include <dimension2d.h>
@@ -52,7 +54,16 @@ class RenderTarget;
 class Graph : public NoCopy
 {
 protected:
-    static Graph* m_graph;
+    static Graph* m_graph[PT_COUNT];
+
+    // ------------------------------------------------------------------------
+    /** The server created from the gui uses the graph loaded by the main
+     *  process, the lobbies of a multi-lobby server load their own. */
+    static ProcessType getGraphType()
+    {
+        return STKProcess::hasIndependentChildren() ?
+            STKProcess::getType() : PT_MAIN;
+    }   // getGraphType
 
     std::vector<Quad*> m_all_nodes;
 
@@ -66,6 +77,8 @@ protected:
     // ------------------------------------------------------------------------
     /** Map 4 bounding box points to 4 closest graph nodes. */
     void loadBoundingBoxNodes();
+    // ------------------------------------------------------------------------
+    void buildSpatialGrid();
 
 private:
     /** The 2d bounding box, used for hashing. */
@@ -90,6 +103,22 @@ private:
     /** The render target used for drawing the minimap. */
     std::unique_ptr<RenderTarget> m_render_target;
 
+    /** A 2d (x/z) uniform grid over the bounding boxes of all quads, so that
+     *  findRoadSector only tests the quads of one cell instead of all quads.
+     *  The quads of a cell are stored in m_grid_quads (sorted by index),
+     *  starting at m_grid_offsets[cell]. Empty if the grid is not built. */
+    std::vector<unsigned int> m_grid_offsets;
+    std::vector<int> m_grid_quads;
+    float m_grid_min_x, m_grid_min_z;
+    float m_grid_cell_size;
+    int m_grid_width, m_grid_height;
+
+    /** A copy of all quads, indexed like m_all_nodes, and of the quads of
+     *  each grid cell, indexed like m_grid_quads, to test 4 of them at once
+     *  with SIMD. Built together with the grid. */
+    QuadSoA m_quads_soa;
+    QuadSoA m_grid_soa;
+
     // ------------------------------------------------------------------------
     void createMesh(bool show_invisible=true,
                     bool enable_transparency=false,
@@ -106,6 +135,13 @@ private:
     virtual bool hasLapLine() const = 0;
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const = 0;
+    // ------------------------------------------------------------------------
+    void findRoadSectorLinear(const Vec3& xyz, int *sector,
+                              std::vector<int> *all_sectors,
+                              bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    void findRoadSectorInGrid(const Vec3& xyz, int *sector,
+                              bool ignore_vertical) const;
 
 public:
     static const int UNKNOWN_SECTOR;
@@ -116,13 +152,13 @@ public:
     /** Returns the one instance of this object. It is possible that there
      *  is no instance created (e.g. arena without navmesh) so we don't assert
      *  that an instance exist. */
-    static Graph* get() { return m_graph; }
+    static Graph* get()                     { return m_graph[getGraphType()]; }
     // ------------------------------------------------------------------------
     /** Set the graph (either drive or arena graph for now). */
     static void setGraph(Graph* graph)
     {
-        assert(m_graph == NULL);
-        m_graph = graph;
+        assert(m_graph[getGraphType()] == NULL);
+        m_graph[getGraphType()] = graph;
     }   // setGraph
     // ------------------------------------------------------------------------
     /** Cleans up the graph. It is possible that this function is called even
@@ -130,10 +166,11 @@ public:
      *  error if there is no instance. */
     static void destroy()
     {
-        if (m_graph)
+        ProcessType pt = getGraphType();
+        if (m_graph[pt])
         {
-            delete m_graph;
-            m_graph = NULL;
+            delete m_graph[pt];
+            m_graph[pt] = NULL;
         }
     }   // destroy
     // ------------------------------------------------------------------------
@@ -167,6 +204,12 @@ public:
                             std::vector<int> *all_sectors = NULL,
                             bool ignore_vertical = false) const;
     // ------------------------------------------------------------------------
+    void pointInsideQuads(const std::vector<Vec3>& xyz,
+                          std::vector<int>* sectors) const;
+    // ------------------------------------------------------------------------
+    void benchmarkFindRoadSector(
+                         const std::vector<std::vector<Vec3> >& paths) const;
+    // ------------------------------------------------------------------------
     const Vec3& getBBMin() const                           { return m_bb_min; }
     // ------------------------------------------------------------------------
     const Vec3& getBBMax() const                           { return m_bb_max; }
@@ -0,0 +1,596 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "tracks/physics_pack.hpp"
+
+#include "graphics/material.hpp"
+#include "graphics/material_manager.hpp"
+#include "io/file_manager.hpp"
+#include "io/xml_node.hpp"
+#include "physics/triangle_mesh.hpp"
+#include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/vec3.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+
+/** Identifies a physics pack ('STKP'). */
+static const uint32_t PHYSICS_PACK_MAGIC = 0x504b5453;
+/** Increase when the layout of the file changes. */
+static const uint32_t PHYSICS_PACK_VERSION = 2;
+/** Number of uint32 values in the header. */
+static const unsigned int PHYSICS_PACK_HEADER_SIZE = 5;
+/** Material index of triangles without a material. */
+static const uint32_t NO_MATERIAL = 0xffffffff;
+/** The number of floats stored for each triangle (3 points and 3 normals),
+ *  followed by the index of its material. */
+static const unsigned int FLOATS_PER_TRIANGLE = 18;
+/** Flag of a material: its texture path is relative to the track directory. */
+static const uint8_t MATERIAL_IN_TRACK_DIR = 1;
+/** Flag of a material: it is a default material, i.e. not found in any
+ *  materials.xml file. */
+static const uint8_t MATERIAL_IS_DEFAULT = 2;
+
+namespace
+{
+    /** Reads the pack, and checks that it is not truncated. */
+    class PackReader
+    {
+    private:
+        const std::vector<uint8_t>& m_data;
+        size_t m_pos;
+        bool m_ok;
+    public:
+        PackReader(const std::vector<uint8_t>& data)
+            : m_data(data), m_pos(0), m_ok(true) {}
+        // --------------------------------------------------------------------
+        void read(void* out, size_t size)
+        {
+            if (!m_ok || m_data.size() - m_pos < size)
+            {
+                m_ok = false;
+                memset(out, 0, size);
+                return;
+            }
+            memcpy(out, m_data.data() + m_pos, size);
+            m_pos += size;
+        }   // read
+        // --------------------------------------------------------------------
+        std::string readString()
+        {
+            uint32_t size = 0;
+            read(&size, sizeof(size));
+            if (!m_ok || m_data.size() - m_pos < size)
+            {
+                m_ok = false;
+                return "";
+            }
+            std::string s((const char*)m_data.data() + m_pos, size);
+            m_pos += size;
+            return s;
+        }   // readString
+        // --------------------------------------------------------------------
+        /** True if everything could be read, and the data is at its end. */
+        bool isComplete() const { return m_ok && m_pos == m_data.size(); }
+        // --------------------------------------------------------------------
+        bool isOk() const { return m_ok; }
+    };   // PackReader
+
+    // ------------------------------------------------------------------------
+    bool writeString(FILE* fd, const std::string& s)
+    {
+        const uint32_t size = (uint32_t)s.size();
+        return fwrite(&size, sizeof(size), 1, fd) == 1 &&
+               (size == 0 || fwrite(s.data(), size, 1, fd) == 1);
+    }   // writeString
+
+    // ------------------------------------------------------------------------
+    /** Returns the absolute path of the track directory in lower case, which
+     *  is how the full path of textures is stored in materials. */
+    std::string getTrackDir(const std::string& root)
+    {
+        core::stringc dir = file_manager->getFileSystem()->getAbsolutePath(
+            root.c_str()).c_str();
+        dir.make_lower();
+        std::string track_dir = dir.c_str();
+        if (!track_dir.empty() && track_dir.back() != '/')
+            track_dir += "/";
+        return track_dir;
+    }   // getTrackDir
+
+    // ------------------------------------------------------------------------
+    /** Adds the models used by a node of the scene file and its children. */
+    void addModels(const XMLNode* node, std::set<std::string>* models)
+    {
+        std::string model;
+        if (node->get("model", &model) && !model.empty())
+            models->insert(model);
+        for (unsigned int i = 0; i < node->getNumNodes(); i++)
+            addModels(node->getNode(i), models);
+    }   // addModels
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Returns a hash of all files the physics of the main track model is
+ *  created from: the scene file, the materials of the track and of the
+ *  game (which decide which triangles are ignored or only used for gfx
+ *  effects), all models in the track directory and all models used by the
+ *  scene (which can be outside of the track directory). The version of
+ *  STK is added too, so data shipped with STK can't be outdated.
+ *  The content is hashed (not the modification time), so that a pack
+ *  shipped with a track stays valid when the track is installed.
+ *  \param root Directory of the track, with a trailing '/'.
+ *  \param scene Name of the scene file in the track directory.
+ */
+uint64_t PhysicsPack::getInputHash(const std::string& root,
+                                   const std::string& scene)
+{
+    uint64_t hash = FileUtils::FNV_HASH_BASIS;
+    const uint32_t version = PHYSICS_PACK_VERSION;
+    FileUtils::addToHash(&hash, &version, sizeof(version));
+    FileUtils::addToHash(&hash, STK_VERSION, strlen(STK_VERSION) + 1);
+
+    // The name (which doesn't depend on the installation directory) and
+    // full path of each file
+    std::vector<std::pair<std::string, std::string> > inputs;
+    inputs.emplace_back(scene, root + scene);
+    inputs.emplace_back("materials.xml", root + "materials.xml");
+    inputs.emplace_back("data/textures/materials.xml",
+        file_manager->getAsset(FileManager::TEXTURE, "materials.xml"));
+    inputs.emplace_back("data/textures/deprecated/materials.xml",
+        file_manager->getAsset(FileManager::TEXTURE,
+                               "deprecated/materials.xml"));
+    inputs.emplace_back("data/models/materials.xml",
+        file_manager->getAsset(FileManager::MODEL, "materials.xml"));
+
+    std::set<std::string> models;
+    std::set<std::string> files;
+    file_manager->listFiles(files, root);
+    for (const std::string& file : files)
+    {
+        const std::string ext =
+            StringUtils::toLowerCase(StringUtils::getExtension(file));
+        if (ext == "spm" || ext == "b3d")
+            models.insert(file);
+    }
+    XMLNode* xml = file_manager->createXMLTree(root + scene);
+    if (xml)
+    {
+        // Static objects and lod groups of the main track model
+        if (const XMLNode* track = xml->getNode("track"))
+            addModels(track, &models);
+        if (const XMLNode* lod = xml->getNode("lod"))
+            addModels(lod, &models);
+        delete xml;
+    }
+    for (const std::string& model : models)
+        inputs.emplace_back(model, root + model);
+
+    std::vector<uint8_t> buffer(64 * 1024);
+    for (auto& input : inputs)
+    {
+        FileUtils::addToHash(&hash, input.first.c_str(), input.first.size() + 1);
+        FILE* fd = FileUtils::fopenU8Path(input.second, "rb");
+        if (!fd)
+            continue;
+        size_t size;
+        while ((size = fread(buffer.data(), 1, buffer.size(), fd)) > 0)
+            FileUtils::addToHash(&hash, buffer.data(), size);
+        fclose(fd);
+    }
+    return hash;
+}   // getInputHash
+
+// ----------------------------------------------------------------------------
+/** Returns the files in which the physics pack of a scene is searched, the
+ *  first one is next to the scene (so it can be shipped with a track, it is
+ *  never written), the other one in the cache directory.
+ *  \param root Directory of the track, with a trailing '/'.
+ *  \param scene Name of the scene file in the track directory.
+ */
+PhysicsPack::Location PhysicsPack::getLocation(const std::string& root,
+                                               const std::string& scene)
+{
+    Location location;
+    location.m_root = root;
+    location.m_hash = getInputHash(root, scene);
+    location.m_files.push_back(root + StringUtils::removeExtension(scene) +
+                               "-physics.dat");
+    char name[64];
+    snprintf(name, sizeof(name), "physics-%016llx.dat",
+             (unsigned long long)location.m_hash);
+    location.m_files.push_back(file_manager->getCachedDataDir() + name);
+    return location;
+}   // getLocation
+
+// ----------------------------------------------------------------------------
+/** Loads the first valid pack of a location.
+ *  \param location The files to search (see getLocation).
+ *  \param track_mesh, gfx_effect_mesh The (empty) meshes to which the
+ *         triangles are added.
+ *  \param aabb_min, aabb_max On return the bounding box of the track.
+ *  \return True if a pack was loaded.
+ */
+bool PhysicsPack::load(const Location& location, TriangleMesh* track_mesh,
+                       TriangleMesh* gfx_effect_mesh, Vec3* aabb_min,
+                       Vec3* aabb_max)
+{
+    for (const std::string& file : location.m_files)
+    {
+        if (load(file, location.m_hash, location.m_root, track_mesh,
+                 gfx_effect_mesh, aabb_min, aabb_max))
+        {
+            file_manager->touchCachedData(file);
+            return true;
+        }
+    }
+    return false;
+}   // load
+
+// ----------------------------------------------------------------------------
+/** Saves the pack to the last file of a location, which is the one in the
+ *  cache directory.
+ *  \return True if the pack was written.
+ */
+bool PhysicsPack::save(const Location& location,
+                       const TriangleMesh& track_mesh,
+                       const TriangleMesh& gfx_effect_mesh,
+                       const Vec3& aabb_min, const Vec3& aabb_max)
+{
+    if (location.m_files.empty())
+        return false;
+    return save(location.m_files.back(), location.m_hash, location.m_root,
+                track_mesh, gfx_effect_mesh, aabb_min, aabb_max);
+}   // save
+
+// ----------------------------------------------------------------------------
+/** Loads a pack. The whole file is checked before any triangle is added,
+ *  so the meshes are unchanged if false is returned.
+ *  \param filename Name of the file.
+ *  \param hash Hash of the files the pack must have been created from.
+ *  \param root Directory of the track.
+ */
+bool PhysicsPack::load(const std::string& filename, uint64_t hash,
+                       const std::string& root, TriangleMesh* track_mesh,
+                       TriangleMesh* gfx_effect_mesh, Vec3* aabb_min,
+                       Vec3* aabb_max)
+{
+    FILE* fd = FileUtils::fopenU8Path(filename, "rb");
+    if (!fd)
+        return false;
+    fseek(fd, 0, SEEK_END);
+    const long size = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+    std::vector<uint8_t> data(size > 0 ? size : 0);
+    const bool ok = size > 0 && fread(data.data(), size, 1, fd) == 1;
+    fclose(fd);
+    if (!ok)
+        return false;
+
+    PackReader reader(data);
+    uint32_t header[PHYSICS_PACK_HEADER_SIZE];
+    uint64_t file_hash = 0;
+    reader.read(header, sizeof(header));
+    reader.read(&file_hash, sizeof(file_hash));
+    if (!reader.isOk() || header[0] != PHYSICS_PACK_MAGIC ||
+        header[1] != PHYSICS_PACK_VERSION || file_hash != hash)
+        return false;
+
+    float aabb[6];
+    reader.read(aabb, sizeof(aabb));
+
+    const uint32_t num_materials = header[2];
+    std::vector<const Material*> materials;
+    std::vector<uint8_t> material_flags;
+    std::vector<std::string> material_names;
+    for (unsigned int i = 0; i < num_materials && reader.isOk(); i++)
+    {
+        // The flags, the full path of the texture and its second layer, and
+        // the shader
+        uint8_t flags = 0;
+        reader.read(&flags, sizeof(flags));
+        material_flags.push_back(flags);
+        for (unsigned int j = 0; j < 3; j++)
+            material_names.push_back(reader.readString());
+    }
+
+    const uint32_t num_triangles[2] = { header[3], header[4] };
+    std::vector<float> triangles[2];
+    std::vector<uint32_t> triangle_materials[2];
+    for (unsigned int i = 0; i < 2 && reader.isOk(); i++)
+    {
+        // Avoid allocating a huge array for a corrupted count
+        if ((data.size() / FLOATS_PER_TRIANGLE) / sizeof(float) <
+            num_triangles[i])
+            return false;
+        triangles[i].resize(num_triangles[i] * FLOATS_PER_TRIANGLE);
+        triangle_materials[i].resize(num_triangles[i]);
+        reader.read(triangles[i].data(), triangles[i].size() * sizeof(float));
+        reader.read(triangle_materials[i].data(),
+                    triangle_materials[i].size() * sizeof(uint32_t));
+        for (uint32_t m : triangle_materials[i])
+        {
+            if (m != NO_MATERIAL && m >= num_materials)
+                return false;
+        }
+    }
+    if (!reader.isComplete())
+    {
+        Log::warn("PhysicsPack", "Physics pack '%s' is incomplete.",
+                  filename.c_str());
+        return false;
+    }
+
+    // The materials are searched by the full path of their texture like in
+    // Track::convertTrackToBullet, so the same materials are found
+    const std::string track_dir = getTrackDir(root);
+    for (unsigned int i = 0; i < num_materials; i++)
+    {
+        std::string path = material_names[3 * i];
+        if (material_flags[i] & MATERIAL_IN_TRACK_DIR)
+            path = track_dir + path;
+        const std::string& shader = material_names[3 * i + 2];
+        if (material_flags[i] & MATERIAL_IS_DEFAULT)
+        {
+            materials.push_back(material_manager->getDefaultSPMaterial(
+                shader, path, /*full_path*/!path.empty()));
+        }
+        else
+        {
+            materials.push_back(material_manager->getMaterialSPM(path,
+                material_names[3 * i + 1], shader));
+        }
+    }
+
+    TriangleMesh* meshes[2] = { track_mesh, gfx_effect_mesh };
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        for (unsigned int j = 0; j < num_triangles[i]; j++)
+        {
+            const float* f = &triangles[i][j * FLOATS_PER_TRIANGLE];
+            btVector3 v[6];
+            for (unsigned int k = 0; k < 6; k++)
+                v[k] = btVector3(f[3 * k], f[3 * k + 1], f[3 * k + 2]);
+            const uint32_t m = triangle_materials[i][j];
+            meshes[i]->addTriangle(v[0], v[1], v[2], v[3], v[4], v[5],
+                                   m == NO_MATERIAL ? NULL : materials[m]);
+        }
+    }
+    *aabb_min = Vec3(aabb[0], aabb[1], aabb[2]);
+    *aabb_max = Vec3(aabb[3], aabb[4], aabb[5]);
+    Log::info("PhysicsPack", "Loaded %d triangles from '%s'.",
+              (int)(num_triangles[0] + num_triangles[1]), filename.c_str());
+    return true;
+}   // load
+
+// ----------------------------------------------------------------------------
+/** Saves a pack (see FileUtils::writeFileAtomic).
+ *  \param filename Name of the file.
+ *  \param hash Hash of the files the pack was created from.
+ *  \param root Directory of the track, the full path of textures in it is
+ *         stored relative to it, so the pack stays valid if the track is
+ *         moved.
+ *  \return True if the file was written.
+ */
+bool PhysicsPack::save(const std::string& filename, uint64_t hash,
+                       const std::string& root,
+                       const TriangleMesh& track_mesh,
+                       const TriangleMesh& gfx_effect_mesh,
+                       const Vec3& aabb_min, const Vec3& aabb_max)
+{
+    const TriangleMesh* meshes[2] = { &track_mesh, &gfx_effect_mesh };
+    std::vector<const Material*> materials;
+    std::map<const Material*, uint32_t> material_index;
+    std::vector<float> triangles[2];
+    std::vector<uint32_t> triangle_materials[2];
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        const unsigned int n = meshes[i]->getNumTriangles();
+        triangles[i].reserve(n * FLOATS_PER_TRIANGLE);
+        triangle_materials[i].reserve(n);
+        for (unsigned int j = 0; j < n; j++)
+        {
+            btVector3 v[6];
+            meshes[i]->getTriangle(j, v, v + 1, v + 2);
+            meshes[i]->getNormals(j, v + 3, v + 4, v + 5);
+            for (unsigned int k = 0; k < 6; k++)
+            {
+                triangles[i].push_back(v[k].getX());
+                triangles[i].push_back(v[k].getY());
+                triangles[i].push_back(v[k].getZ());
+            }
+            const Material* m = meshes[i]->getMaterial(j);
+            if (m == NULL)
+            {
+                triangle_materials[i].push_back(NO_MATERIAL);
+                continue;
+            }
+            auto it = material_index.find(m);
+            if (it == material_index.end())
+            {
+                it = material_index.insert(
+                    std::make_pair(m, (uint32_t)materials.size())).first;
+                materials.push_back(m);
+            }
+            triangle_materials[i].push_back(it->second);
+        }
+    }
+
+    // Track::convertTrackToBullet finds materials by the full path of their
+    // texture (which is in lower case), a material which is not found again
+    // the same way is a default material
+    const std::string track_dir = getTrackDir(root);
+    std::vector<std::string> material_paths;
+    std::vector<uint8_t> material_flags;
+    for (const Material* m : materials)
+    {
+        std::string path = m->getTexFullPath();
+        uint8_t flags = 0;
+        if (material_manager->getMaterialSPM(path, m->getUVTwoTexture(),
+                                             m->getShaderName()) != m)
+            flags |= MATERIAL_IS_DEFAULT;
+        if (!track_dir.empty() &&
+            path.compare(0, track_dir.size(), track_dir) == 0)
+        {
+            path = path.substr(track_dir.size());
+            flags |= MATERIAL_IN_TRACK_DIR;
+        }
+        material_paths.push_back(path);
+        material_flags.push_back(flags);
+    }
+
+    const bool ok = FileUtils::writeFileAtomic(filename, [&](FILE* fd)
+        {
+            const uint32_t header[PHYSICS_PACK_HEADER_SIZE] =
+            {
+                PHYSICS_PACK_MAGIC, PHYSICS_PACK_VERSION,
+                (uint32_t)materials.size(), track_mesh.getNumTriangles(),
+                gfx_effect_mesh.getNumTriangles()
+            };
+            const float aabb[6] =
+            {
+                aabb_min.getX(), aabb_min.getY(), aabb_min.getZ(),
+                aabb_max.getX(), aabb_max.getY(), aabb_max.getZ()
+            };
+            bool ok = fwrite(header, sizeof(header), 1, fd) == 1 &&
+                      fwrite(&hash, sizeof(hash), 1, fd) == 1 &&
+                      fwrite(aabb, sizeof(aabb), 1, fd) == 1;
+            for (unsigned int i = 0; i < materials.size(); i++)
+            {
+                ok = ok && fwrite(&material_flags[i], 1, 1, fd) == 1 &&
+                     writeString(fd, material_paths[i]) &&
+                     writeString(fd, materials[i]->getUVTwoTexture()) &&
+                     writeString(fd, materials[i]->getShaderName());
+            }
+            for (unsigned int i = 0; i < 2; i++)
+            {
+                ok = ok && (triangles[i].empty() ||
+                    (fwrite(triangles[i].data(),
+                            triangles[i].size() * sizeof(float), 1, fd) == 1 &&
+                     fwrite(triangle_materials[i].data(),
+                            triangle_materials[i].size() * sizeof(uint32_t),
+                            1, fd) == 1));
+            }
+            return ok;
+        });
+    if (!ok)
+        return false;
+    Log::info("PhysicsPack", "Saved physics pack to '%s'.", filename.c_str());
+    return true;
+}   // save
+
+// ----------------------------------------------------------------------------
+/** Checks that a pack restores the same triangles and materials, and that a
+ *  pack for different files or a truncated pack is not used.
+ */
+void PhysicsPack::unitTesting()
+{
+    // A texture in the track directory which has the same name as a
+    // texture with a material outside of it gets a default material, which
+    // must not be replaced by the other material when the pack is loaded
+    const std::string dir = file_manager->getCachedDataDir();
+    const std::string track_dir = getTrackDir(dir + "physics-test-track/");
+    const std::string texture = "physics-pack-test.png";
+    Material* global_material = material_manager->getMaterial(
+        getTrackDir(dir + "physics-test-data/") + texture,
+        /*is_full_path*/true, /*make_permanent*/false,
+        /*complain_if_not_found*/false, /*strip_path*/true,
+        /*install*/false);
+    Material* track_material =
+        material_manager->getMaterialSPM(track_dir + texture, "");
+    assert(global_material != track_material);
+    assert(material_manager->getMaterialSPM(
+        global_material->getTexFullPath(), "") == global_material);
+
+    TriangleMesh track_mesh(/*can_be_transformed*/false);
+    TriangleMesh gfx_effect_mesh(/*can_be_transformed*/false);
+    for (unsigned int i = 0; i < 100; i++)
+    {
+        const float x = (float)(i % 10), z = (float)(i / 10);
+        const btVector3 up(0, 1, 0);
+        track_mesh.addTriangle(btVector3(x, 0.1f * i, z),
+                               btVector3(x + 1, 0, z + 1),
+                               btVector3(x + 1, 0, z), up,
+                               btVector3(0.1f, 0.9f, 0).normalized(), up,
+                               i % 3 == 0 ? NULL : i % 3 == 1 ?
+                               global_material : track_material);
+    }
+    gfx_effect_mesh.addTriangle(btVector3(0, 1, 0), btVector3(5, 1, 5),
+                                btVector3(5, 1, 0), btVector3(0, 1, 0),
+                                btVector3(0, 1, 0), btVector3(0, 1, 0),
+                                NULL);
+
+    Location location;
+    location.m_root = dir + "physics-test-track/";
+    location.m_hash = 1;
+    location.m_files.push_back(dir + "physics-test.dat");
+    const std::string& file = location.m_files[0];
+    const Vec3 aabb_min(0, -1, 0), aabb_max(11, 40, 11);
+    bool saved = save(location, track_mesh, gfx_effect_mesh, aabb_min,
+                      aabb_max);
+    assert(saved);
+
+    TriangleMesh loaded_track(/*can_be_transformed*/false);
+    TriangleMesh loaded_gfx(/*can_be_transformed*/false);
+    Vec3 loaded_min, loaded_max;
+    assert(!load(file, 2, location.m_root, &loaded_track, &loaded_gfx,
+                 &loaded_min, &loaded_max));
+    assert(loaded_track.getNumTriangles() == 0);
+    bool loaded = load(location, &loaded_track, &loaded_gfx, &loaded_min,
+                       &loaded_max);
+    assert(loaded);
+    assert(loaded_min == aabb_min && loaded_max == aabb_max);
+    assert(loaded_track.getNumTriangles() == track_mesh.getNumTriangles());
+    assert(loaded_gfx.getNumTriangles() == gfx_effect_mesh.getNumTriangles());
+    for (unsigned int i = 0; i < track_mesh.getNumTriangles(); i++)
+    {
+        btVector3 a[6], b[6];
+        track_mesh.getTriangle(i, a, a + 1, a + 2);
+        track_mesh.getNormals(i, a + 3, a + 4, a + 5);
+        loaded_track.getTriangle(i, b, b + 1, b + 2);
+        loaded_track.getNormals(i, b + 3, b + 4, b + 5);
+        for (unsigned int j = 0; j < 6; j++)
+            assert(a[j] == b[j]);
+        assert(loaded_track.getMaterial(i) == track_mesh.getMaterial(i));
+    }
+
+    // A truncated pack must not add any triangles
+    FILE* fd = FileUtils::fopenU8Path(file, "rb");
+    fseek(fd, 0, SEEK_END);
+    std::vector<char> data(ftell(fd));
+    fseek(fd, 0, SEEK_SET);
+    bool read_ok = fread(data.data(), data.size(), 1, fd) == 1;
+    assert(read_ok);
+    fclose(fd);
+    fd = FileUtils::fopenU8Path(file, "wb");
+    fwrite(data.data(), data.size() - 4, 1, fd);
+    fclose(fd);
+    TriangleMesh truncated(/*can_be_transformed*/false);
+    assert(!load(location, &truncated, &loaded_gfx, &loaded_min,
+                 &loaded_max));
+    assert(truncated.getNumTriangles() == 0);
+    remove(FileUtils::getPortableWritingPath(file).c_str());
+    material_manager->popTempMaterial();
+    (void)saved; (void)loaded; (void)read_ok;
+}   // unitTesting
@@ -0,0 +1,92 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_PHYSICS_PACK_HPP
+#define HEADER_PHYSICS_PACK_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+#include <string>
+#include <vector>
+
+class Material;
+class TriangleMesh;
+class Vec3;
+
+/** \brief A compact binary file with the static physics of a track.
+ *  A server without graphics only needs the triangles (and their materials)
+ *  of the main track model to race on a track, but loading the model builds
+ *  meshes and scene nodes, which are then only walked to extract the
+ *  triangles. The pack stores the triangles of the main track model and its
+ *  static objects (i.e. everything that loadMainTrack converts to physics),
+ *  so that later loads can skip the model completely. Track objects are
+ *  still loaded as before, since they can be animated or scripted.
+ *  The pack is written to the cache directory the first time a track is
+ *  loaded without a valid pack. A pack next to the scene file (shipped with
+ *  a track) is used too, but never written.
+ * \ingroup tracks
+ */
+class PhysicsPack : public NoCopy
+{
+private:
+    PhysicsPack() {}
+    // ------------------------------------------------------------------------
+    static uint64_t getInputHash(const std::string& root,
+                                 const std::string& scene);
+    // ------------------------------------------------------------------------
+    static bool load(const std::string& filename, uint64_t hash,
+                     const std::string& root, TriangleMesh* track_mesh,
+                     TriangleMesh* gfx_effect_mesh, Vec3* aabb_min,
+                     Vec3* aabb_max);
+    // ------------------------------------------------------------------------
+    static bool save(const std::string& filename, uint64_t hash,
+                     const std::string& root,
+                     const TriangleMesh& track_mesh,
+                     const TriangleMesh& gfx_effect_mesh,
+                     const Vec3& aabb_min, const Vec3& aabb_max);
+
+public:
+    /** Files in which the pack of a track scene is searched (in this
+     *  order, the last one is in the cache directory and is the only one
+     *  written), together with the hash of the files it was created from. */
+    struct Location
+    {
+        /** Directory of the track. */
+        std::string m_root;
+        std::vector<std::string> m_files;
+        uint64_t m_hash;
+        Location() : m_hash(0) {}
+    };
+    // ------------------------------------------------------------------------
+    static Location getLocation(const std::string& root,
+                                const std::string& scene);
+    // ------------------------------------------------------------------------
+    static bool load(const Location& location, TriangleMesh* track_mesh,
+                     TriangleMesh* gfx_effect_mesh, Vec3* aabb_min,
+                     Vec3* aabb_max);
+    // ------------------------------------------------------------------------
+    static bool save(const Location& location,
+                     const TriangleMesh& track_mesh,
+                     const TriangleMesh& gfx_effect_mesh,
+                     const Vec3& aabb_min, const Vec3& aabb_max);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // PhysicsPack
+
+#endif
@@ -96,6 +96,13 @@ public:
     /** Returns the minimum height of a quad. */
     float getMinHeight() const                         { return m_min_height; }
     // ------------------------------------------------------------------------
+    /** Returns the maximum height of a quad. */
+    float getMaxHeight() const                         { return m_max_height; }
+    // ------------------------------------------------------------------------
+    float getMinHeightTesting() const          { return m_min_height_testing; }
+    // ------------------------------------------------------------------------
+    float getMaxHeightTesting() const          { return m_max_height_testing; }
+    // ------------------------------------------------------------------------
     /** Returns the index of this quad. */
     int getIndex() const
     {
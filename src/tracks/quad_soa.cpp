@@ -0,0 +1,346 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "tracks/quad_soa.hpp"
+#include "tracks/quad.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#if __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+ #include <emmintrin.h>
+ #define SIMD_SSE2_SUPPORT (1)
+#endif
+
+/** Number of unused entries at the end of each array, so that 4 floats can
+ *  always be loaded starting at any entry. */
+static const unsigned int PADDING = 3;
+
+// ----------------------------------------------------------------------------
+void QuadSoA::clear()
+{
+    for (unsigned int i = 0; i < QS_COUNT; i++)
+        m_data[i].assign(PADDING, 0.0f);
+    m_packed.clear();
+    m_quads.clear();
+}   // clear
+
+// ----------------------------------------------------------------------------
+/** Adds a copy of the data of a quad, the quad must not be changed later.
+ */
+void QuadSoA::add(const Quad* q)
+{
+    if (m_data[0].size() < PADDING)
+        clear();
+    const Quad& quad = *q;
+    float v[QS_COUNT];
+    v[QS_X0] = quad[0].getX();  v[QS_Z0] = quad[0].getZ();
+    v[QS_X1] = quad[1].getX();  v[QS_Z1] = quad[1].getZ();
+    v[QS_X2] = quad[2].getX();  v[QS_Z2] = quad[2].getZ();
+    v[QS_X3] = quad[3].getX();  v[QS_Z3] = quad[3].getZ();
+    v[QS_DX01] = v[QS_X1] - v[QS_X0];  v[QS_DZ01] = v[QS_Z1] - v[QS_Z0];
+    v[QS_DX12] = v[QS_X2] - v[QS_X1];  v[QS_DZ12] = v[QS_Z2] - v[QS_Z1];
+    v[QS_DX23] = v[QS_X3] - v[QS_X2];  v[QS_DZ23] = v[QS_Z3] - v[QS_Z2];
+    v[QS_DX30] = v[QS_X0] - v[QS_X3];  v[QS_DZ30] = v[QS_Z0] - v[QS_Z3];
+    v[QS_DX02] = v[QS_X2] - v[QS_X0];  v[QS_DZ02] = v[QS_Z2] - v[QS_Z0];
+    v[QS_MIN_H] = quad.getMinHeight();
+    v[QS_MAX_H] = quad.getMaxHeight();
+    v[QS_MIN_TESTING] = quad.getMinHeightTesting();
+    v[QS_MAX_TESTING] = quad.getMaxHeightTesting();
+    for (unsigned int i = 0; i < QS_COUNT; i++)
+        m_data[i].insert(m_data[i].end() - PADDING, v[i]);
+    m_packed.insert(m_packed.end(), v, v + QS_COUNT);
+    m_packed.resize(m_packed.size() + QS_PACKED - QS_COUNT, 0.0f);
+    m_quads.push_back(q);
+}   // add
+
+// ----------------------------------------------------------------------------
+#ifndef SIMD_SSE2_SUPPORT
+/** Same as Vec3::sideOfLine2D, with the difference of end and start of the
+ *  line precomputed. */
+static inline float sideOfLine2D(const float* const* d, unsigned int i,
+                                 QuadSoA::Field dx, QuadSoA::Field dz,
+                                 QuadSoA::Field sx, QuadSoA::Field sz,
+                                 float x, float z)
+{
+    return d[dx][i] * (z - d[sz][i]) - d[dz][i] * (x - d[sx][i]);
+}   // sideOfLine2D
+
+// ----------------------------------------------------------------------------
+/** Same test as Quad::pointInside for a 2d quad. */
+static bool pointInsideScalar(const float* const* d, unsigned int i,
+                              const Vec3& p, bool ignore_vertical)
+{
+    const float x = p.getX(), y = p.getY(), z = p.getZ();
+    if (!ignore_vertical &&
+        (y - d[QuadSoA::QS_MAX_H][i] > d[QuadSoA::QS_MAX_TESTING][i] ||
+         y - d[QuadSoA::QS_MIN_H][i] < d[QuadSoA::QS_MIN_TESTING][i]))
+        return false;
+    if (sideOfLine2D(d, i, QuadSoA::QS_DX02, QuadSoA::QS_DZ02,
+                     QuadSoA::QS_X0, QuadSoA::QS_Z0, x, z) < 0)
+    {
+        return sideOfLine2D(d, i, QuadSoA::QS_DX01, QuadSoA::QS_DZ01,
+                            QuadSoA::QS_X0, QuadSoA::QS_Z0, x, z) >= 0.0 &&
+               sideOfLine2D(d, i, QuadSoA::QS_DX12, QuadSoA::QS_DZ12,
+                            QuadSoA::QS_X1, QuadSoA::QS_Z1, x, z) >= 0.0;
+    }
+    return sideOfLine2D(d, i, QuadSoA::QS_DX23, QuadSoA::QS_DZ23,
+                        QuadSoA::QS_X2, QuadSoA::QS_Z2, x, z) >  0.0 &&
+           sideOfLine2D(d, i, QuadSoA::QS_DX30, QuadSoA::QS_DZ30,
+                        QuadSoA::QS_X3, QuadSoA::QS_Z3, x, z) >= 0.0;
+}   // pointInsideScalar
+#endif
+
+// ----------------------------------------------------------------------------
+#ifdef SIMD_SSE2_SUPPORT
+/** Same as Vec3::sideOfLine2D for 4 points and lines. */
+static inline __m128 sideOfLine2D(const __m128* d,
+                                  QuadSoA::Field dx, QuadSoA::Field dz,
+                                  QuadSoA::Field sx, QuadSoA::Field sz,
+                                  __m128 x, __m128 z)
+{
+    return _mm_sub_ps(_mm_mul_ps(d[dx], _mm_sub_ps(z, d[sz])),
+                      _mm_mul_ps(d[dz], _mm_sub_ps(x, d[sx])));
+}   // sideOfLine2D
+
+// ----------------------------------------------------------------------------
+/** Tests 4 points against 4 quads (one point per quad), the data of the
+ *  quads is given with one __m128 per field. Returns the bit mask of the
+ *  points inside. */
+static int pointInsideSSE(const __m128* d, __m128 x, __m128 y, __m128 z,
+                          bool ignore_vertical)
+{
+    const __m128 zero = _mm_setzero_ps();
+    __m128 valid = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    if (!ignore_vertical)
+    {
+        // Ordered compares, so that a NaN is not rejected, as in
+        // Quad::pointInside
+        valid = _mm_andnot_ps(
+            _mm_or_ps(_mm_cmpgt_ps(_mm_sub_ps(y, d[QuadSoA::QS_MAX_H]),
+                                   d[QuadSoA::QS_MAX_TESTING]),
+                      _mm_cmplt_ps(_mm_sub_ps(y, d[QuadSoA::QS_MIN_H]),
+                                   d[QuadSoA::QS_MIN_TESTING])), valid);
+    }
+    const __m128 s02 = sideOfLine2D(d, QuadSoA::QS_DX02, QuadSoA::QS_DZ02,
+                                    QuadSoA::QS_X0, QuadSoA::QS_Z0, x, z);
+    const __m128 s01 = sideOfLine2D(d, QuadSoA::QS_DX01, QuadSoA::QS_DZ01,
+                                    QuadSoA::QS_X0, QuadSoA::QS_Z0, x, z);
+    const __m128 s12 = sideOfLine2D(d, QuadSoA::QS_DX12, QuadSoA::QS_DZ12,
+                                    QuadSoA::QS_X1, QuadSoA::QS_Z1, x, z);
+    const __m128 s23 = sideOfLine2D(d, QuadSoA::QS_DX23, QuadSoA::QS_DZ23,
+                                    QuadSoA::QS_X2, QuadSoA::QS_Z2, x, z);
+    const __m128 s30 = sideOfLine2D(d, QuadSoA::QS_DX30, QuadSoA::QS_DZ30,
+                                    QuadSoA::QS_X3, QuadSoA::QS_Z3, x, z);
+    const __m128 first = _mm_cmplt_ps(s02, zero);
+    const __m128 in_first = _mm_and_ps(_mm_cmpge_ps(s01, zero),
+                                       _mm_cmpge_ps(s12, zero));
+    const __m128 in_second = _mm_and_ps(_mm_cmpgt_ps(s23, zero),
+                                        _mm_cmpge_ps(s30, zero));
+    const __m128 inside = _mm_or_ps(_mm_and_ps(first, in_first),
+                                    _mm_andnot_ps(first, in_second));
+    return _mm_movemask_ps(_mm_and_ps(inside, valid));
+}   // pointInsideSSE
+#endif
+
+// ----------------------------------------------------------------------------
+/** Tests one point against up to 4 consecutive quads.
+ *  \param xyz The point to test.
+ *  \param first Index of the first quad.
+ *  \param count Number of quads to test (at most 4).
+ *  \return A bit mask, bit i is set if the point is inside quad first+i.
+ */
+unsigned int QuadSoA::pointInside4(const Vec3& xyz, unsigned int first,
+                                   unsigned int count,
+                                   bool ignore_vertical) const
+{
+    assert(count <= 4 && first + count <= size());
+    unsigned int mask = 0;
+#ifdef SIMD_SSE2_SUPPORT
+    __m128 d[QS_COUNT];
+    for (unsigned int i = 0; i < QS_COUNT; i++)
+        d[i] = _mm_loadu_ps(m_data[i].data() + first);
+    mask = pointInsideSSE(d, _mm_set1_ps(xyz.getX()), _mm_set1_ps(xyz.getY()),
+        _mm_set1_ps(xyz.getZ()), ignore_vertical);
+#else
+    const float* d[QS_COUNT];
+    for (unsigned int i = 0; i < QS_COUNT; i++)
+        d[i] = m_data[i].data();
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (pointInsideScalar(d, first + i, xyz, ignore_vertical))
+            mask |= 1 << i;
+    }
+#endif
+    mask &= (1 << count) - 1;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        // 3d quads are tested with their bounding box
+        const Quad* q = m_quads[first + i];
+        if (q->is3DQuad())
+        {
+            mask &= ~(1 << i);
+            if (q->pointInside(xyz, ignore_vertical))
+                mask |= 1 << i;
+        }
+    }
+    return mask;
+}   // pointInside4
+
+// ----------------------------------------------------------------------------
+/** Tests each point against its own quad, e.g. the positions of all karts
+ *  against the quads they were on before.
+ *  \param xyz The points to test.
+ *  \param entries The index of the quad for each point, or -1. On return
+ *         it is set to -1 for all points which are not inside their quad.
+ *  \param count Number of points.
+ */
+void QuadSoA::pointInsideEach(const Vec3* xyz, int* entries,
+                              unsigned int count) const
+{
+    if (size() == 0)
+    {
+        for (unsigned int i = 0; i < count; i++)
+            entries[i] = -1;
+        return;
+    }
+#ifdef SIMD_SSE2_SUPPORT
+    for (unsigned int i = 0; i < count; i += 4)
+    {
+        const unsigned int n = std::min(4u, count - i);
+        int e[4] = { 0, 0, 0, 0 };
+        float x[4] = { 0, 0, 0, 0 }, y[4] = { 0, 0, 0, 0 };
+        float z[4] = { 0, 0, 0, 0 };
+        for (unsigned int j = 0; j < n; j++)
+        {
+            e[j] = entries[i + j] < 0 ? 0 : entries[i + j];
+            assert(e[j] < (int)size());
+            x[j] = xyz[i + j].getX();
+            y[j] = xyz[i + j].getY();
+            z[j] = xyz[i + j].getZ();
+        }
+        __m128 d[QS_PACKED];
+        for (unsigned int k = 0; k < QS_PACKED; k += 4)
+        {
+            d[k    ] = _mm_loadu_ps(&m_packed[e[0] * QS_PACKED + k]);
+            d[k + 1] = _mm_loadu_ps(&m_packed[e[1] * QS_PACKED + k]);
+            d[k + 2] = _mm_loadu_ps(&m_packed[e[2] * QS_PACKED + k]);
+            d[k + 3] = _mm_loadu_ps(&m_packed[e[3] * QS_PACKED + k]);
+            _MM_TRANSPOSE4_PS(d[k], d[k + 1], d[k + 2], d[k + 3]);
+        }
+        const int mask = pointInsideSSE(d, _mm_loadu_ps(x), _mm_loadu_ps(y),
+            _mm_loadu_ps(z), /*ignore_vertical*/false);
+        for (unsigned int j = 0; j < n; j++)
+        {
+            const Quad* q = entries[i + j] < 0 ? NULL
+                                               : m_quads[entries[i + j]];
+            // 3d quads are tested with their bounding box
+            if (q && (q->is3DQuad() ? !q->pointInside(xyz[i + j])
+                                    : (mask & (1 << j)) == 0))
+                entries[i + j] = -1;
+        }
+    }
+#else
+    const float* d[QS_COUNT];
+    for (unsigned int k = 0; k < QS_COUNT; k++)
+        d[k] = m_data[k].data();
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (entries[i] < 0)
+            continue;
+        const Quad* q = m_quads[entries[i]];
+        if (q->is3DQuad() ? !q->pointInside(xyz[i])
+                          : !pointInsideScalar(d, entries[i], xyz[i], false))
+            entries[i] = -1;
+    }
+#endif
+}   // pointInsideEach
+
+// ----------------------------------------------------------------------------
+/** Compares the results with Quad::pointInside for random points around
+ *  some quads, including points on their edges.
+ */
+void QuadSoA::unitTesting()
+{
+    std::vector<Quad*> quads;
+    // A square, a rotated and a degenerated quad, and one with the wrong
+    // orientation
+    quads.push_back(new Quad(Vec3(0, 0, 0), Vec3(1, 0, 0), Vec3(1, 0, 1),
+                             Vec3(0, 0, 1)));
+    quads.push_back(new Quad(Vec3(0, 0, 0), Vec3(0, 0, 1), Vec3(1, 0, 1),
+                             Vec3(1, 0, 0)));
+    quads.push_back(new Quad(Vec3(0.5f, 1, -1), Vec3(2, 1.5f, 0.5f),
+                             Vec3(0.5f, 2, 2), Vec3(-1, 1, 0.5f)));
+    quads.push_back(new Quad(Vec3(0, 0, 0), Vec3(1, 0, 1), Vec3(1, 0, 1),
+                             Vec3(0, 0, 1)));
+    quads.push_back(new Quad(Vec3(0, 3, 0), Vec3(2, 3, 0), Vec3(2, 3, 0.5f),
+                             Vec3(0, 3, 0.5f)));
+    quads.back()->setHeightTesting(-0.5f, 0.5f);
+
+    QuadSoA soa;
+    soa.clear();
+    for (Quad* q : quads)
+        soa.add(q);
+    assert(soa.size() == quads.size());
+
+    srand(1234);
+    std::vector<Vec3> points;
+    for (unsigned int i = 0; i < 2000; i++)
+    {
+        // Use a grid of 0.25 for many points on the edges
+        points.push_back(Vec3((float)(rand() % 13) * 0.25f - 1.0f,
+                              (float)(rand() % 17) * 0.25f - 0.5f,
+                              (float)(rand() % 13) * 0.25f - 1.0f));
+    }
+
+    for (const Vec3& p : points)
+    {
+        for (int ignore_vertical = 0; ignore_vertical < 2; ignore_vertical++)
+        {
+            for (unsigned int first = 0; first < soa.size(); first++)
+            {
+                const unsigned int count = std::min(4u, soa.size() - first);
+                unsigned int expected = 0;
+                for (unsigned int i = 0; i < count; i++)
+                {
+                    if (quads[first + i]->pointInside(p, ignore_vertical == 1))
+                        expected |= 1 << i;
+                }
+                assert(soa.pointInside4(p, first, count,
+                                        ignore_vertical == 1) == expected);
+            }
+        }
+    }
+
+    std::vector<int> entries;
+    for (unsigned int i = 0; i < points.size(); i++)
+        entries.push_back((int)(i % (quads.size() + 1)) - 1);
+    std::vector<int> expected = entries;
+    for (unsigned int i = 0; i < points.size(); i++)
+    {
+        if (entries[i] >= 0 && !quads[entries[i]]->pointInside(points[i]))
+            expected[i] = -1;
+    }
+    soa.pointInsideEach(points.data(), entries.data(),
+        (unsigned int)points.size());
+    assert(entries == expected);
+
+    for (Quad* q : quads)
+        delete q;
+}   // unitTesting
@@ -0,0 +1,82 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_QUAD_SOA_HPP
+#define HEADER_QUAD_SOA_HPP
+
+#include "utils/vec3.hpp"
+
+#include <vector>
+
+class Quad;
+
+/** A structure of arrays copy of the data used by Quad::pointInside, so
+ *  that 4 quads (or 4 points) are tested at once with SSE2. The results
+ *  are exactly the same as the ones of Quad::pointInside, the same float
+ *  operations are done. 3d quads use a bounding box test, which is done
+ *  by calling Quad::pointInside.
+ * \ingroup tracks
+ */
+class QuadSoA
+{
+public:
+    enum Field
+    {
+        /** The 4 corners of the quad in the x/z plane. */
+        QS_X0, QS_Z0, QS_X1, QS_Z1, QS_X2, QS_Z2, QS_X3, QS_Z3,
+        /** Difference of the end and start of the lines tested in
+         *  Vec3::sideOfLine2D. */
+        QS_DX01, QS_DZ01, QS_DX12, QS_DZ12, QS_DX23, QS_DZ23,
+        QS_DX30, QS_DZ30, QS_DX02, QS_DZ02,
+        /** Height test. */
+        QS_MIN_H, QS_MAX_H, QS_MIN_TESTING, QS_MAX_TESTING,
+        QS_COUNT,
+        /** Number of floats for each quad in m_packed. */
+        QS_PACKED = (QS_COUNT + 3) / 4 * 4
+    };
+
+private:
+    std::vector<float> m_data[QS_COUNT];
+
+    /** All fields of each quad after each other, so that the data of 4
+     *  quads which are not consecutive can be loaded with a transpose. */
+    std::vector<float> m_packed;
+
+    /** The quad of each entry, used for 3d quads. */
+    std::vector<const Quad*> m_quads;
+
+public:
+    // ------------------------------------------------------------------------
+    void clear();
+    // ------------------------------------------------------------------------
+    void add(const Quad* q);
+    // ------------------------------------------------------------------------
+    unsigned int pointInside4(const Vec3& xyz, unsigned int first,
+                              unsigned int count,
+                              bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    void pointInsideEach(const Vec3* xyz, int* entries,
+                         unsigned int count) const;
+    // ------------------------------------------------------------------------
+    /** Returns the number of quads. */
+    unsigned int size() const          { return (unsigned int)m_quads.size(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // QuadSoA
+
+#endif
@@ -31,8 +31,9 @@
  */
 TerrainInfo::TerrainInfo()
 {
-    m_last_material = NULL;
-    m_material      = NULL;
+    m_last_material      = NULL;
+    m_material           = NULL;
+    m_has_prefetched_ray = false;
 }   // TerrainInfo
 
 //-----------------------------------------------------------------------------
@@ -44,6 +45,7 @@ TerrainInfo::TerrainInfo(const Vec3 &pos)
     // initialise HoT
     m_last_material = NULL;
     m_material = NULL;
+    m_has_prefetched_ray = false;
     update(pos);
 }   // TerrainInfo
 
@@ -77,14 +79,22 @@ void TerrainInfo::update(const btMatrix3x3 &rotation, const Vec3 &from)
     // Save the origin for debug drawing
     m_origin_ray    = from;
 
-    // Compute the 'to' vector by rotating a long 'down' vectory by the
-    // kart rotation, and adding the start point to it.
-    btVector3 to(0, -10000.0f, 0);
-    to = from + rotation*to;
+    btVector3 to = getRayEnd(rotation, from);
 
     const TriangleMesh &tm = Track::getCurrentTrack()->getTriangleMesh();
-    tm.castRay(from, to, &m_hit_point, &m_material, &m_normal,
-               /*interpolate*/true);
+    // Use the ray cast for all karts at once if the kart didn't move since
+    if (m_has_prefetched_ray && m_prefetched_ray.m_from == from &&
+        m_prefetched_ray.m_to == to)
+    {
+        tm.getRayResult(m_prefetched_ray, &m_hit_point, &m_material,
+                        &m_normal, /*interpolate*/true);
+    }
+    else
+    {
+        tm.castRay(from, to, &m_hit_point, &m_material, &m_normal,
+                   /*interpolate*/true);
+    }
+    m_has_prefetched_ray = false;
     // Now also raycast against all track objects (that are driveable). If
     // there should be a closer result (than the one against the main track 
     // mesh), its data will be returned.
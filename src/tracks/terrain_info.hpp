@@ -19,6 +19,7 @@
 #ifndef HEADER_TERRAIN_INFO_HPP
 #define HEADER_TERRAIN_INFO_HPP
 
+#include "physics/triangle_mesh.hpp"
 #include "utils/vec3.hpp"
 
 class btTransform;
@@ -43,6 +44,13 @@ private:
     /** DEBUG only: origin of raycast. */
     Vec3 m_origin_ray;
 
+    /** The result of the next raycast against the main track mesh if it was
+     *  already cast together with the rays of other karts. */
+    TriangleMesh::Ray m_prefetched_ray;
+
+    /** If m_prefetched_ray is set. */
+    bool              m_has_prefetched_ray;
+
 public:
              TerrainInfo();
              TerrainInfo(const Vec3 &pos);
@@ -54,6 +62,24 @@ public:
     virtual void update(const Vec3 &from);
     virtual void update(const Vec3 &from, const Vec3 &towards);
 
+    // ------------------------------------------------------------------------
+    /** Returns the end of the raycast done by update(rotation, from). */
+    static btVector3 getRayEnd(const btMatrix3x3 &rotation, const Vec3 &from)
+    {
+        // Rotate a long 'down' vector by the kart rotation, and add the
+        // start point to it.
+        btVector3 to(0, -10000.0f, 0);
+        return from + rotation*to;
+    }   // getRayEnd
+    // ------------------------------------------------------------------------
+    /** Sets the result of the next raycast against the main track, which is
+     *  only used if update(rotation, from) casts the same ray. */
+    void setPrefetchedRay(const TriangleMesh::Ray &ray)
+    {
+        m_prefetched_ray     = ray;
+        m_has_prefetched_ray = true;
+    }   // setPrefetchedRay
+
     // ------------------------------------------------------------------------
     /** Simple wrapper with no offset. */
     virtual void update(const btMatrix3x3 &rotation)
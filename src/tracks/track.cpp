@@ -62,6 +62,7 @@
 #include "network/network_config.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "network/tick_profiler.hpp"
 #include "physics/physical_object.hpp"
 #include "physics/physics.hpp"
 #include "physics/triangle_mesh.hpp"
@@ -74,6 +75,7 @@
 #include "tracks/drive_graph.hpp"
 #include "tracks/drive_node.hpp"
 #include "tracks/model_definition_loader.hpp"
+#include "tracks/physics_pack.hpp"
 #include "tracks/track_manager.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "utils/constants.hpp"
@@ -103,7 +105,12 @@ bool        Track::m_dont_load_navmesh = false;
 std::atomic<Track*> Track::m_current_track[PT_COUNT];
 
 // ----------------------------------------------------------------------------
-Track::Track(const std::string &filename)
+/** Creates a track and reads its information (but not the model).
+ *  \param filename Name of the track.xml file of the track.
+ *  \param track_xml The already read track.xml file, or NULL if it must be
+ *         read here.
+ */
+Track::Track(const std::string &filename, const XMLNode* track_xml)
 {
 #ifdef DEBUG
     m_magic_number          = 0x17AC3802;
@@ -134,6 +141,7 @@ Track::Track(const std::string &filename)
     m_version               = 0;
     m_track_mesh            = NULL;
     m_gfx_effect_mesh       = NULL;
+    m_physics_pack_loaded   = false;
     m_internal              = false;
     m_enable_auto_rescue    = true;  // Below set to false in arenas
     m_enable_push_back      = true;
@@ -176,7 +184,7 @@ Track::Track(const std::string &filename)
     m_all_nodes.clear();
     m_static_physics_only_nodes.clear();
     m_all_cached_meshes.clear();
-    loadTrackInfo();
+    loadTrackInfo(track_xml);
 }   // Track
 
 //-----------------------------------------------------------------------------
@@ -305,14 +313,9 @@ void Track::cleanup()
 {
     irr_driver->resetSceneComplexity();
     m_physical_object_uid = 0;
-#ifdef USE_RESIZE_CACHE
-    if (!UserConfigParams::m_high_definition_textures)
-    {
-        file_manager->popTextureSearchPath();
-    }
-#endif
-    file_manager->popTextureSearchPath();
-    file_manager->popModelSearchPath();
+    // Multi-lobby servers remove the search paths after loading
+    if (!STKProcess::hasIndependentChildren())
+        popSearchPaths();
 
     Graph::destroy();
     m_item_manager = nullptr;
@@ -428,6 +431,12 @@ void Track::cleanup()
 
     if(m_cache_track)
         material_manager->makeMaterialsPermanent();
+    else if (STKProcess::hasIndependentChildren())
+    {
+        for (Material* m : m_own_materials)
+            delete m;
+        m_own_materials.clear();
+    }
     else
     {
         // remove temporary materials loaded by the material manager
@@ -503,13 +512,33 @@ void Track::cleanup()
 #endif
 
     m_meta_library.clear();
-    Scripting::ScriptEngine::getInstance()->cleanupCache();
+    // Child processes have no scripting engine
+    if (!STKProcess::isChild())
+        Scripting::ScriptEngine::getInstance()->cleanupCache();
 
-    m_current_track[PT_MAIN] = NULL;
+    m_current_track[STKProcess::getType()] = NULL;
 }   // cleanup
 
 //-----------------------------------------------------------------------------
-void Track::loadTrackInfo()
+/** Removes the track directory from the texture and model search path. */
+void Track::popSearchPaths()
+{
+#ifdef USE_RESIZE_CACHE
+    if (!UserConfigParams::m_high_definition_textures)
+    {
+        file_manager->popTextureSearchPath();
+    }
+#endif
+    file_manager->popTextureSearchPath();
+    file_manager->popModelSearchPath();
+}   // popSearchPaths
+
+//-----------------------------------------------------------------------------
+/** Reads the information about the track from its track.xml file.
+ *  \param track_xml The already read track.xml file, or NULL if it must be
+ *         read here.
+ */
+void Track::loadTrackInfo(const XMLNode* track_xml)
 {
     // Default values
     m_use_fog               = false;
@@ -533,11 +562,13 @@ void Track::loadTrackInfo()
     irr_driver->setSSAORadius(1.);
     irr_driver->setSSAOK(1.5);
     irr_driver->setSSAOSigma(1.);
-    XMLNode *root           = file_manager->createXMLTree(m_filename);
+    XMLNode *own_root       = track_xml ? NULL
+                                        : file_manager->createXMLTree(m_filename);
+    const XMLNode *root     = track_xml ? track_xml : own_root;
 
     if(!root || root->getName()!="track")
     {
-        delete root;
+        delete own_root;
         std::ostringstream o;
         o<<"Can't load track '"<<m_filename<<"', no track element.";
         throw std::runtime_error(o.str());
@@ -615,7 +646,7 @@ void Track::loadTrackInfo()
     {
         m_screenshot = m_root+m_screenshot;
     }
-    delete root;
+    delete own_root;
 
     std::string dir = StringUtils::getPath(m_filename);
     std::string easter_name = dir + "/easter_eggs.xml";
@@ -890,6 +921,14 @@ void Track::createPhysicsModel(unsigned int main_track_count)
     if (!UserConfigParams::m_physics_debug)
         m_static_physics_only_nodes.clear();
 
+    // Now the meshes contain all triangles of the main track model, which
+    // is what the physics pack stores
+    if (!m_physics_pack.m_files.empty() && !m_physics_pack_loaded)
+    {
+        PhysicsPack::save(m_physics_pack, *m_track_mesh, *m_gfx_effect_mesh,
+                          m_aabb_min, m_aabb_max);
+    }
+
     for (unsigned int i = 0; i<m_object_physics_only_nodes.size(); i++)
     {
         main_loop->renderGUI(5565, i, m_static_physics_only_nodes.size());
@@ -1205,6 +1244,19 @@ bool Track::loadMainTrack(const XMLNode &root)
     m_track_mesh      = new TriangleMesh(/*can_be_transformed*/false);
     m_gfx_effect_mesh = new TriangleMesh(/*can_be_transformed*/false);
 
+    // A server without graphics only needs the physics of the main track
+    // model, which can be loaded much faster from the physics pack
+    if (!m_physics_pack.m_files.empty() &&
+        PhysicsPack::load(m_physics_pack, m_track_mesh, m_gfx_effect_mesh,
+                          &m_aabb_min, &m_aabb_max))
+    {
+        m_physics_pack_loaded = true;
+        Physics::get()->init(m_aabb_min, m_aabb_max);
+        m_gfx_effect_mesh->createCollisionShape();
+        main_loop->renderGUI(4500);
+        return true;
+    }
+
     const XMLNode *track_node = root.getNode("track");
     std::string model_name;
     track_node->get("model", &model_name);
@@ -1626,7 +1678,8 @@ void Track::update(int ticks)
         m_startup_run = true;
         // After onStart all track objects will be hidden as needed
         // we only copy track objects with physical body which affects network
-        if (LobbyProtocol::getByType<LobbyProtocol>(PT_CHILD))
+        if (!STKProcess::hasIndependentChildren() &&
+            LobbyProtocol::getByType<LobbyProtocol>(PT_CHILD))
         {
             Track* child_track = clone();
             m_current_track[PT_CHILD] = child_track;
@@ -1634,7 +1687,10 @@ void Track::update(int ticks)
     }
     float dt = stk_config->ticks2Time(ticks);
     m_check_manager->update(dt);
-    m_item_manager->update(ticks);
+    {
+        TickProfiler::Scope tick_profiler_scope(TickProfiler::TP_ITEMS);
+        m_item_manager->update(ticks);
+    }
 
     // TODO: enable onUpdate scripts if we ever find a compelling use for them
     //Scripting::ScriptEngine* script_engine = World::getWorld()->getScriptEngine();
@@ -1788,7 +1844,8 @@ static void recursiveUpdatePhysics(std::vector<TrackObject*>& tos)
  */
 void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 {
-    assert(m_current_track[PT_MAIN].load() == NULL);
+    const ProcessType pt = STKProcess::getType();
+    assert(m_current_track[pt].load() == NULL);
 
     // Use m_filename to also get the path, not only the identifier
     STKTexManager::getInstance()
@@ -1847,6 +1904,12 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 #endif
     main_loop->renderGUI(3200);
 
+    // Materials added to the material manager (for example by karts)
+    // since the last track was loaded are kept, only the ones loaded now
+    // are owned by this track
+    if (STKProcess::hasIndependentChildren())
+        material_manager->makeMaterialsPermanent();
+
     // First read the temporary materials.xml file if it exists
     try
     {
@@ -1883,8 +1946,9 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         throw std::runtime_error(msg.str());
     }
 
-    m_current_track[PT_MAIN] = this;
-    m_current_track[PT_CHILD] = NULL;
+    m_current_track[pt] = this;
+    if (pt == PT_MAIN && !STKProcess::hasIndependentChildren())
+        m_current_track[PT_CHILD] = NULL;
 
     // Load the graph only now: this function is called from world, after
     // the race gui was created. The race gui is needed since it stores
@@ -2017,6 +2081,14 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         node->get("xyz", &m_godrays_position);
     }
 
+    m_physics_pack = PhysicsPack::Location();
+    m_physics_pack_loaded = false;
+    if (GUIEngine::isNoGraphics() && NetworkConfig::get()->isNetworking() &&
+        NetworkConfig::get()->isServer() && !UserConfigParams::m_physics_debug)
+    {
+        m_physics_pack = PhysicsPack::getLocation(m_root,
+                                               m_all_modes[mode_id].m_scene);
+    }
     loadMainTrack(*root);
     main_loop->renderGUI(4700);
 
@@ -2250,6 +2322,13 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     main_loop->renderGUI(6100);
 
     STKTexManager::getInstance()->unsetTextureErrorMessage();
+    // Other lobbies of a multi-lobby server may load and unload tracks
+    // during this race, so don't leave anything in the shared managers
+    if (STKProcess::hasIndependentChildren() && !m_cache_track)
+    {
+        popSearchPaths();
+        material_manager->takeTempMaterials(&m_own_materials);
+    }
 #ifndef SERVER_ONLY
     if (CVS->isGLSL())
     {
@@ -2868,10 +2947,12 @@ void Track::copyFromMainProcess()
             m_track_object_manager->insertObject(clone);
     }
 
+    // The triangles and their bvh are not changed anymore, so they are
+    // shared with the main process, only the physical bodies are separate
     m_track_mesh = new TriangleMesh(/*can_be_transformed*/false);
     m_gfx_effect_mesh = new TriangleMesh(/*can_be_transformed*/false);
-    m_track_mesh->copyFrom(*main_track->m_track_mesh);
-    m_gfx_effect_mesh->copyFrom(*main_track->m_gfx_effect_mesh);
+    m_track_mesh->shareFrom(*main_track->m_track_mesh);
+    m_gfx_effect_mesh->shareFrom(*main_track->m_gfx_effect_mesh);
 
     // At the moment we only use network for child track
     auto nim = std::make_shared<NetworkItemManager>();
@@ -2915,7 +2996,18 @@ void Track::initChildTrack()
 //-----------------------------------------------------------------------------
 void Track::cleanChildTrack()
 {
-    assert(STKProcess::getType() == PT_CHILD);
+    assert(STKProcess::isChild());
+    if (STKProcess::hasIndependentChildren())
+    {
+        // The lobby of a multi-lobby server loaded its own copy of the track
+        Track* own_track = m_current_track[STKProcess::getType()];
+        if (own_track)
+        {
+            own_track->cleanup();
+            delete own_track;
+        }
+        return;
+    }
     Track* child_track = m_current_track[PT_CHILD];
     child_track->m_item_manager = nullptr;
     delete child_track->m_check_manager;
@@ -38,6 +38,7 @@ using namespace irr;
 
 #include "LinearMath/btTransform.h"
 
+#include "tracks/physics_pack.hpp"
 #include "utils/aligned_array.hpp"
 #include "utils/log.hpp"
 #include "utils/vec3.hpp"
@@ -48,6 +49,7 @@ class AnimationManager;
 class BezierCurve;
 class CheckManager;
 class ItemManager;
+class Material;
 class ModelDefinitionLoader;
 class MovingTexture;
 class MusicInformation;
@@ -163,6 +165,11 @@ private:
       */
     std::vector<scene::IMesh*>      m_detached_cached_meshes;
 
+    /** Materials of this track which are removed from the material manager
+     *  after loading, so they are not used by tracks loaded by other lobbies
+     *  of a multi-lobby server. */
+    std::vector<Material*>          m_own_materials;
+
     /** A list of all textures loaded by the track, so that they can
      *  be removed from the cache at cleanup time. */
     std::vector<video::ITexture*>   m_all_cached_textures;
@@ -199,6 +206,12 @@ private:
      *  allowing the kart to drive in/partly under water), but the
      *  actual surface position is needed for the water splash effect. */
     TriangleMesh*            m_gfx_effect_mesh;
+    /** Where the physics pack of the loaded scene is stored. Only used on
+     *  servers without graphics, otherwise m_files is empty. */
+    PhysicsPack::Location    m_physics_pack;
+    /** True if the main track model was not loaded, since its triangles
+     *  were loaded from the physics pack. */
+    bool                     m_physics_pack_loaded;
     /** Minimum coordinates of this track. */
     Vec3                     m_aabb_min;
     /** Maximum coordinates of this track. */
@@ -392,7 +405,7 @@ private:
     /** The number of laps that is predefined in a track info dialog. */
     int m_actual_number_of_laps;
 
-    void loadTrackInfo();
+    void loadTrackInfo(const XMLNode* track_xml);
     void loadDriveGraph(unsigned int mode_id, const bool reverse);
     void loadArenaGraph(const XMLNode &node);
     btQuaternion getArenaStartRotation(const Vec3& xyz, float heading);
@@ -404,6 +417,7 @@ private:
     void loadCurves(const XMLNode &node);
     void handleSky(const XMLNode &root, const std::string &filename);
     void freeCachedMeshVertexBuffer();
+    void popSearchPaths();
     void copyFromMainProcess();
 public:
 
@@ -438,7 +452,8 @@ public:
 
     static const float NOHIT;
 
-                       Track             (const std::string &filename);
+                       Track             (const std::string &filename,
+                                          const XMLNode* track_xml=NULL);
                       ~Track             ();
     void               cleanup           ();
     void               removeCachedData  ();
@@ -19,7 +19,6 @@
 #include "tracks/track_manager.hpp"
 
 #include "config/stk_config.hpp"
-#include "graphics/irr_driver.hpp"
 #include "io/file_manager.hpp"
 #include "tracks/track.hpp"
 
@@ -156,43 +155,69 @@ void TrackManager::loadTrackList()
         delete track;
     m_tracks.clear();
 
+    // Collect the track.xml files of all directories that can contain a
+    // track and read them in parallel, the tracks are then created in the
+    // same order as if each file was read when it is needed
+    std::vector<std::set<std::string> > all_subdirs(m_track_search_path.size());
+    std::vector<std::string> config_files;
+    for(unsigned int i=0; i<m_track_search_path.size(); i++)
+    {
+        const std::string &dir = m_track_search_path[i];
+        config_files.push_back(dir+"track.xml");
+        file_manager->listFiles(all_subdirs[i], dir);
+        for(const std::string& subdir : all_subdirs[i])
+        {
+            if(subdir=="." || subdir=="..") continue;
+            config_files.push_back(dir+subdir+"/track.xml");
+        }
+    }   // for i <m_track_search_path.size()
+    std::vector<XMLNode*> all_xmls =
+        file_manager->createXMLTrees(config_files, "track_metadata.dat");
+    std::map<std::string, const XMLNode*> track_xmls;
+    for(unsigned int i=0; i<config_files.size(); i++)
+        track_xmls[config_files[i]] = all_xmls[i];
+
     for(unsigned int i=0; i<m_track_search_path.size(); i++)
     {
         const std::string &dir = m_track_search_path[i];
 
         // First test if the directory itself contains a track:
         // ----------------------------------------------------
-        if(loadTrack(dir)) continue;  // track found, no more tests
+        if(loadTrack(dir, track_xmls[dir+"track.xml"]))
+            continue;  // track found, no more tests
 
         // Then see if a subdir of this dir contains tracks
         // ------------------------------------------------
-        std::set<std::string> dirs;
-        file_manager->listFiles(dirs, dir);
-        for(std::set<std::string>::iterator subdir = dirs.begin();
-            subdir != dirs.end(); subdir++)
+        for(const std::string& subdir : all_subdirs[i])
         {
-            if(*subdir=="." || *subdir=="..") continue;
-            loadTrack(dir+*subdir+"/");
-        }   // for dir in dirs
+            if(subdir=="." || subdir=="..") continue;
+            loadTrack(dir+subdir+"/", track_xmls[dir+subdir+"/track.xml"]);
+        }   // for subdir in all_subdirs[i]
     }   // for i <m_track_search_path.size()
+
+    for(XMLNode* xml : all_xmls)
+        delete xml;
 }  // loadTrackList
 
 // ----------------------------------------------------------------------------
 /** Tries to load a track from a single directory. Returns true if a track was
  *  successfully loaded.
  *  \param dirname Name of the directory to load the track from.
+ *  \param track_xml The already read track.xml file of the directory, or
+ *         NULL if it must be read here (which also handles a missing file).
  */
-bool TrackManager::loadTrack(const std::string& dirname)
+bool TrackManager::loadTrack(const std::string& dirname,
+                             const XMLNode* track_xml)
 {
     std::string config_file = dirname+"track.xml";
-    if(!file_manager->fileExists(config_file))
+    if(!track_xml && !file_manager->fileExists(config_file))
         return false;
 
     Track *track;
 
     try
     {
-        track = new Track(config_file);
+        track = new Track(config_file, track_xml);
     }
     catch (std::exception& e)
     {
@@ -218,11 +243,7 @@ bool TrackManager::loadTrack(const std::string& dirname)
     m_track_avail.push_back(true);
     updateGroups(track);
 
-    // Populate the texture cache with track screenshots
-    // (internal tracks like end cutscene don't have screenshots)
-    if (!track->isInternal())
-        irr_driver->getTexture(track->getScreenshotFile());
-
+    // The screenshot is only loaded when it is displayed the first time
     return true;
 }   // loadTrack
 
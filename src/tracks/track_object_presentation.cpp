@@ -292,7 +292,7 @@ TrackObjectPresentationLibraryNode::TrackObjectPresentationLibraryNode(
 void TrackObjectPresentationLibraryNode::update(float dt)
 {
     // Child process currently has no scripting engine
-    if (STKProcess::getType() == PT_CHILD)
+    if (STKProcess::isChild())
         return;
 
     if (!m_start_executed)
@@ -1144,7 +1144,7 @@ TrackObjectPresentationActionTrigger::TrackObjectPresentationActionTrigger(
 void TrackObjectPresentationActionTrigger::onTriggerItemApproached(int kart_id)
 {
     if (m_reenable_timeout > StkTime::getMonoTimeMs() ||
-        STKProcess::getType() == PT_CHILD)
+        STKProcess::isChild())
     {
         return;
     }
@@ -50,8 +50,12 @@ void TrackSector::reset()
 /** Updates the current graph node index, and the track coordinates for
  *  the specified point.
  *  \param xyz The new coordinates to search the graph node for.
+ *  \param on_current_node True if it is already known that xyz is on the
+ *         current graph node (see Graph::pointInsideQuads), so that it
+ *         doesn't need to be searched.
  */
-void TrackSector::update(const Vec3 &xyz, bool ignore_vertical)
+void TrackSector::update(const Vec3 &xyz, bool ignore_vertical,
+                         bool on_current_node)
 {
     int prev_sector = m_current_graph_node;
     const ArenaGraph* ag = ArenaGraph::get();
@@ -64,8 +68,11 @@ void TrackSector::update(const Vec3 &xyz, bool ignore_vertical)
     }
 
     // Don't only test nodes around if it was not on road
-    Graph::get()->findRoadSector(xyz, &m_current_graph_node,
-        m_on_road ? test_nodes : NULL, ignore_vertical);
+    if (!on_current_node)
+    {
+        Graph::get()->findRoadSector(xyz, &m_current_graph_node,
+            m_on_road ? test_nodes : NULL, ignore_vertical);
+    }
     m_on_road = m_current_graph_node != Graph::UNKNOWN_SECTOR;
 
     // If m_track_sector == UNKNOWN_SECTOR, then the kart is not on top of
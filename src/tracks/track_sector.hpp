@@ -65,7 +65,8 @@ public:
           TrackSector();
     void  reset();
     void  rescue();
-    void  update(const Vec3 &xyz, bool ignore_vertical = false);
+    void  update(const Vec3 &xyz, bool ignore_vertical = false,
+                 bool on_current_node = false);
     float getRelativeDistanceToCenter() const;
     // ------------------------------------------------------------------------
     /** Returns how far the the object is from the start line. */
@@ -19,9 +19,17 @@
 #include "utils/log.hpp"
 #include "utils/string_utils.hpp"
 
+#include <atomic>
+#include <functional>
 #include <stdio.h>
 #include <string>
 #include <sys/stat.h>
+#include <thread>
+#if defined(WIN32)
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
 
 // ----------------------------------------------------------------------------
 #if defined(WIN32)
@@ -166,3 +174,45 @@ int FileUtils::renameU8Path(const std::string& u8_path_old,
     return rename(u8_path_old.c_str(), u8_path_new.c_str());
 #endif
 }   // renameU8Path
+
+// ----------------------------------------------------------------------------
+/** Writes a file under a temporary name first, which replaces the file only
+ *  if writing succeeded, so that no other process (or thread) reads an
+ *  incomplete file. The temporary name contains the process id, so that
+ *  processes sharing a directory (e.g. a client and a server) never write to
+ *  the same temporary file.
+ *  \param u8_path Name of the file.
+ *  \param write Writes the content to the file, returns false if it failed.
+ *  \return True if the file was written.
+ */
+bool FileUtils::writeFileAtomic(const std::string& u8_path,
+                                const std::function<bool(FILE*)>& write)
+{
+    static std::atomic<unsigned int> g_counter(0);
+#if defined(WIN32)
+    const int pid = _getpid();
+#else
+    const int pid = getpid();
+#endif
+    const std::string tmp = u8_path + "." + StringUtils::toString(pid) + "." +
+        StringUtils::toString(
+            std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+        StringUtils::toString(g_counter++) + ".tmp";
+    FILE* fd = fopenU8Path(tmp, "wb");
+    if (!fd)
+        return false;
+    bool ok = write(fd);
+    ok = fclose(fd) == 0 && ok;
+    if (ok && renameU8Path(tmp, u8_path) != 0)
+    {
+        // Windows doesn't replace an existing file
+        remove(getPortableWritingPath(u8_path).c_str());
+        ok = renameU8Path(tmp, u8_path) == 0;
+    }
+    if (!ok)
+    {
+        remove(getPortableWritingPath(tmp).c_str());
+        return false;
+    }
+    return true;
+}   // writeFileAtomic
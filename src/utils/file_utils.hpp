@@ -18,6 +18,9 @@
 #ifndef HEADER_FILE_UTILS_HPP
 #define HEADER_FILE_UTILS_HPP
 
+#include "utils/types.hpp"
+
+#include <functional>
 #include <stdio.h>
 #include <string>
 #include <sys/stat.h>
@@ -39,6 +42,24 @@ namespace FileUtils
     int renameU8Path(const std::string& u8_path_old,
                      const std::string& u8_path_new);
     // ------------------------------------------------------------------------
+    bool writeFileAtomic(const std::string& u8_path,
+                         const std::function<bool(FILE*)>& write);
+    // ------------------------------------------------------------------------
+    /** Initial value of a 64 bit FNV-1a hash (see addToHash). */
+    const uint64_t FNV_HASH_BASIS = 14695981039346656037ULL;
+    // ------------------------------------------------------------------------
+    /** Adds data to a 64 bit FNV-1a hash, which is used to find out if a
+     *  cached file is still valid. */
+    inline void addToHash(uint64_t* hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            *hash ^= bytes[i];
+            *hash *= 1099511628211ULL;
+        }
+    }   // addToHash
+    // ------------------------------------------------------------------------
     /* Return a path which can be opened for writing in all systems, as long as
      * u8_path is unicode encoded. */
     inline std::string getPortableWritingPath(const std::string& u8_path)
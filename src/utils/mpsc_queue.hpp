@@ -0,0 +1,145 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MPSC_QUEUE_HPP
+#define HEADER_MPSC_QUEUE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+/** A bounded lock-free queue which can be filled by many threads and is
+ *  emptied by one thread. Each cell has a sequence number telling if it is
+ *  free or filled for the current round of the ring, so producers only
+ *  synchronise with each other when reserving cells, and never with the
+ *  consumer. A batch of items is reserved in one step, so it is not
+ *  interleaved with items of other threads.
+ */
+template<typename T>
+class MPSCQueue : public NoCopy
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> m_sequence;
+        T m_data;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+
+    /** Number of cells minus 1, the number of cells is a power of 2. */
+    const size_t m_mask;
+
+    /** Keep the positions of producers and the consumer in different cache
+     *  lines. */
+    char m_pad0[64];
+
+    /** Position of the next cell to be reserved by producers. */
+    std::atomic<size_t> m_tail;
+
+    char m_pad1[64];
+
+    /** Position of the next cell to be read, only used by the consumer. */
+    size_t m_head;
+
+    // ------------------------------------------------------------------------
+    static size_t roundUp(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        return size;
+    }   // roundUp
+
+public:
+    /** \param capacity Minimum number of items the queue can hold, rounded
+     *  up to a power of 2. */
+    MPSCQueue(size_t capacity)
+        : m_cells(new Cell[roundUp(capacity)]), m_mask(roundUp(capacity) - 1)
+    {
+        for (size_t i = 0; i <= m_mask; i++)
+            m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_head = 0;
+    }   // MPSCQueue
+    // ------------------------------------------------------------------------
+    /** Adds count items in one go, either all of them or none.
+     *  \return False if the queue has not enough free cells. */
+    bool pushBatch(const T* items, size_t count)
+    {
+        assert(count > 0 && count <= getCapacity());
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            // The consumer frees cells in order, so if the last cell is free
+            // for this round all cells before it are too
+            const size_t last = pos + count - 1;
+            size_t seq = m_cells[last & m_mask].m_sequence
+                .load(std::memory_order_acquire);
+            if (seq == last)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + count,
+                    std::memory_order_relaxed))
+                    break;
+            }
+            else if ((ptrdiff_t)(seq - last) < 0)
+                return false;
+            else
+                pos = m_tail.load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            Cell& cell = m_cells[(pos + i) & m_mask];
+            cell.m_data = items[i];
+            cell.m_sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }   // pushBatch
+    // ------------------------------------------------------------------------
+    /** Adds one item, returns false if the queue is full. */
+    bool push(const T& item)                  { return pushBatch(&item, 1); }
+    // ------------------------------------------------------------------------
+    /** Takes the oldest item, only to be called by the consumer thread.
+     *  \return False if there is no item (or the oldest reserved item is not
+     *  written yet). */
+    bool pop(T* item)
+    {
+        Cell& cell = m_cells[m_head & m_mask];
+        if (cell.m_sequence.load(std::memory_order_acquire) != m_head + 1)
+            return false;
+        *item = std::move(cell.m_data);
+        cell.m_sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        m_head++;
+        return true;
+    }   // pop
+    // ------------------------------------------------------------------------
+    /** Returns true if pop will fail, only to be called by the consumer
+     *  thread. */
+    bool empty() const
+    {
+        return m_cells[m_head & m_mask].m_sequence
+            .load(std::memory_order_seq_cst) != m_head + 1;
+    }   // empty
+    // ------------------------------------------------------------------------
+    size_t getCapacity() const                           { return m_mask + 1; }
+};   // MPSCQueue
+
+#endif
@@ -0,0 +1,103 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SHARED_MUTEX_HPP
+#define HEADER_SHARED_MUTEX_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <condition_variable>
+#include <mutex>
+
+/** A mutex which can be locked by many readers at the same time, or by one
+ *  writer (std::shared_mutex needs C++17). lock() and unlock() are for
+ *  writers, so std::lock_guard can be used for them, while readers use
+ *  SharedLockGuard. Waiting writers are preferred, so a steady stream of
+ *  readers can't block them forever.
+ */
+class SharedMutex : public NoCopy
+{
+private:
+    std::mutex m_mutex;
+
+    std::condition_variable m_cv;
+
+    /** Number of readers holding the lock. */
+    int m_readers;
+
+    /** Number of writers waiting for or holding the lock. */
+    int m_writers;
+
+    /** True while a writer holds the lock. */
+    bool m_writing;
+
+public:
+    // ------------------------------------------------------------------------
+    SharedMutex() : m_readers(0), m_writers(0), m_writing(false) {}
+    // ------------------------------------------------------------------------
+    /** Locks for writing, waits until no reader or writer holds the lock. */
+    void lock()
+    {
+        std::unique_lock<std::mutex> ul(m_mutex);
+        m_writers++;
+        m_cv.wait(ul, [this] { return m_readers == 0 && !m_writing; });
+        m_writing = true;
+    }   // lock
+    // ------------------------------------------------------------------------
+    void unlock()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_writing = false;
+        m_writers--;
+        m_cv.notify_all();
+    }   // unlock
+    // ------------------------------------------------------------------------
+    /** Locks for reading, waits while a writer holds or waits for the lock. */
+    void lockShared()
+    {
+        std::unique_lock<std::mutex> ul(m_mutex);
+        m_cv.wait(ul, [this] { return m_writers == 0; });
+        m_readers++;
+    }   // lockShared
+    // ------------------------------------------------------------------------
+    void unlockShared()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_readers--;
+        if (m_readers == 0)
+            m_cv.notify_all();
+    }   // unlockShared
+};   // SharedMutex
+
+// ============================================================================
+/** Locks a SharedMutex for reading during the lifetime of this object. */
+class SharedLockGuard : public NoCopy
+{
+private:
+    SharedMutex& m_mutex;
+
+public:
+    SharedLockGuard(SharedMutex& mutex) : m_mutex(mutex)
+    {
+        m_mutex.lockShared();
+    }
+    // ------------------------------------------------------------------------
+    ~SharedLockGuard()                            { m_mutex.unlockShared(); }
+};   // SharedLockGuard
+
+#endif
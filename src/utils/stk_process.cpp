@@ -20,4 +20,5 @@
 namespace STKProcess
 {
     thread_local ProcessType g_process_type = PT_MAIN;
+    bool g_independent_children = false;
 } // namespace STKProcess
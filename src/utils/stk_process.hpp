@@ -24,7 +24,8 @@ enum ProcessType : unsigned int
 {
     PT_MAIN = 0, // Main process
     PT_CHILD = 1, // Child process inside main (can be server or ai instance)
-    PT_COUNT = 2
+    // PT_CHILD + n are the extra lobbies of a multi-lobby server
+    PT_COUNT = 32
 };
 
 namespace STKProcess
@@ -32,6 +33,11 @@ namespace STKProcess
     // ========================================================================
     extern thread_local ProcessType g_process_type;
     // ------------------------------------------------------------------------
+    /** True if child processes load and own all their race data, used by
+     *  multi-lobby servers. Otherwise a child gets a copy of the track loaded
+     *  by the main process (server created from the gui). */
+    extern bool g_independent_children;
+    // ------------------------------------------------------------------------
     /** Return which type (main or child) this thread belongs to. */
     inline ProcessType getType()                     { return g_process_type; }
     // ------------------------------------------------------------------------
@@ -40,6 +46,19 @@ namespace STKProcess
     // ------------------------------------------------------------------------
     /** Reset when stk is started (for android mostly). */
     inline void reset()                           { g_process_type = PT_MAIN; }
+    // ------------------------------------------------------------------------
+    /** Returns the process type of the n-th child process. */
+    inline ProcessType getChildType(unsigned n)
+                                     { return (ProcessType)(PT_CHILD + n); }
+    // ------------------------------------------------------------------------
+    /** Return true if this thread belongs to any child process. */
+    inline bool isChild()                  { return g_process_type != PT_MAIN; }
+    // ------------------------------------------------------------------------
+    inline bool hasIndependentChildren()      { return g_independent_children; }
+    // ------------------------------------------------------------------------
+    /** Set before any child process is started. */
+    inline void setIndependentChildren(bool val)
+                                              { g_independent_children = val; }
 } // namespace STKProcess
 
 #endif
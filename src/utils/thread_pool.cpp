@@ -0,0 +1,159 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/thread_pool.hpp"
+
+#include "utils/stk_process.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// ----------------------------------------------------------------------------
+/** Starts the worker threads.
+ *  \param thread_count Number of worker threads, can be 0.
+ *  \param name Name of the threads (shown in debugger), an index is added.
+ */
+ThreadPool::ThreadPool(unsigned thread_count, const std::string& name)
+{
+    m_stop = false;
+    for (unsigned i = 0; i < thread_count; i++)
+    {
+        m_threads.emplace_back([this, i, name]()->void
+            {
+                VS::setThreadName((StringUtils::toString(i) + name).c_str());
+                while (true)
+                {
+                    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+                    m_jobs_cv.wait(ul, [this]
+                        {
+                            return m_stop || !m_jobs.empty();
+                        });
+                    if (m_jobs.empty())
+                        return;
+                    std::function<void()> job = m_jobs.front();
+                    m_jobs.pop_front();
+                    ul.unlock();
+                    job();
+                }
+            });
+    }
+}   // ThreadPool
+
+// ----------------------------------------------------------------------------
+/** Finishes all remaining jobs and joins the worker threads. */
+ThreadPool::~ThreadPool()
+{
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_stop = true;
+    m_jobs_cv.notify_all();
+    ul.unlock();
+    for (std::thread& t : m_threads)
+        t.join();
+}   // ~ThreadPool
+
+// ----------------------------------------------------------------------------
+/** Adds a job which will be run by one of the worker threads, or directly
+ *  if there is no worker thread. */
+void ThreadPool::addJob(std::function<void()> job)
+{
+    if (m_threads.empty())
+    {
+        job();
+        return;
+    }
+    ProcessType pt = STKProcess::getType();
+    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+    m_jobs.push_back([job, pt]()
+        {
+            STKProcess::init(pt);
+            job();
+        });
+    m_jobs_cv.notify_one();
+}   // addJob
+
+// ----------------------------------------------------------------------------
+/** Calls f for each index from 0 to count - 1 using the worker threads and
+ *  the calling thread, and returns when all are finished.
+ */
+void ThreadPool::parallelFor(unsigned count,
+                             const std::function<void(unsigned)>& f)
+{
+    if (m_threads.empty() || count < 2)
+    {
+        for (unsigned i = 0; i < count; i++)
+            f(i);
+        return;
+    }
+
+    struct Progress
+    {
+        std::atomic<unsigned> m_next, m_done;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+    };
+    // Workers starting after all indices are taken only touch the progress
+    // (which they keep alive), never f
+    std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    progress->m_next.store(0);
+    progress->m_done.store(0);
+    const std::function<void(unsigned)>* func = &f;
+    std::function<void()> run = [progress, func, count]()
+    {
+        unsigned finished = 0;
+        while (true)
+        {
+            unsigned i = progress->m_next.fetch_add(1);
+            if (i >= count)
+                break;
+            (*func)(i);
+            finished++;
+        }
+        if (finished > 0 &&
+            progress->m_done.fetch_add(finished) + finished == count)
+        {
+            std::lock_guard<std::mutex> lock(progress->m_mutex);
+            progress->m_cv.notify_all();
+        }
+    };
+
+    const unsigned helpers =
+        std::min((unsigned)m_threads.size(), count - 1);
+    for (unsigned i = 0; i < helpers; i++)
+        addJob(run);
+    run();
+    std::unique_lock<std::mutex> ul(progress->m_mutex);
+    progress->m_cv.wait(ul, [progress, count]
+        {
+            return progress->m_done.load() == count;
+        });
+}   // parallelFor
+
+// ----------------------------------------------------------------------------
+/** Returns the number of worker threads to use so that together with the
+ *  calling thread all cores are used, limited by max_threads.
+ */
+unsigned ThreadPool::getDefaultThreadCount(unsigned max_threads)
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores <= 1)
+        return 0;
+    return std::min(cores - 1, max_threads);
+}   // getDefaultThreadCount
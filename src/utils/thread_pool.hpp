@@ -0,0 +1,67 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2021 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_THREAD_POOL_HPP
+#define HEADER_THREAD_POOL_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A small pool of worker threads. Each job is run with the process type
+ *  (see STKProcess) of the thread adding it, so jobs can use the per process
+ *  singletons and the pool can be shared by the lobbies of a multi-lobby
+ *  server.
+ */
+class ThreadPool : public NoCopy
+{
+private:
+    std::vector<std::thread> m_threads;
+
+    std::list<std::function<void()> > m_jobs;
+
+    std::mutex m_jobs_mutex;
+
+    std::condition_variable m_jobs_cv;
+
+    /** Set when the pool is destroyed, protected by \ref m_jobs_mutex. */
+    bool m_stop;
+
+public:
+    ThreadPool(unsigned thread_count, const std::string& name);
+    // ------------------------------------------------------------------------
+    ~ThreadPool();
+    // ------------------------------------------------------------------------
+    void addJob(std::function<void()> job);
+    // ------------------------------------------------------------------------
+    void parallelFor(unsigned count, const std::function<void(unsigned)>& f);
+    // ------------------------------------------------------------------------
+    /** Returns the number of worker threads, 0 means all jobs are run by the
+     *  calling thread in parallelFor. */
+    unsigned getThreadCount() const       { return (unsigned)m_threads.size(); }
+    // ------------------------------------------------------------------------
+    static unsigned getDefaultThreadCount(unsigned max_threads);
+};   // ThreadPool
+
+#endif